@@ -0,0 +1,44 @@
+#  (The MIT License)
+#
+#  Copyright (c) 2016 Mohammad S. Babaei
+#
+#  Permission is hereby granted, free of charge, to any person obtaining a copy
+#  of this software and associated documentation files (the "Software"), to deal
+#  in the Software without restriction, including without limitation the rights
+#  to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+#  copies of the Software, and to permit persons to whom the Software is
+#  furnished to do so, subject to the following conditions:
+#
+#  The above copyright notice and this permission notice shall be included in
+#  all copies or substantial portions of the Software.
+#
+#  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+#  IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+#  FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+#  AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+#  LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+#  OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+#  THE SOFTWARE.
+
+
+FIND_PATH ( ZSTD_INCLUDE_DIR NAMES zstd.h PATHS /usr/include/ /usr/local/include/ )
+FIND_LIBRARY ( ZSTD_LIBRARY NAMES zstd PATHS /usr/lib /usr/local/lib )
+
+
+IF ( ZSTD_INCLUDE_DIR AND ZSTD_LIBRARY )
+    SET ( ZSTD_FOUND TRUE )
+ENDIF (  )
+
+
+IF ( ZSTD_FOUND )
+    MESSAGE ( STATUS "Found zstd headers in ${ZSTD_INCLUDE_DIR}" )
+    MESSAGE ( STATUS "Found zstd library: ${ZSTD_LIBRARY}" )
+ELSE (  )
+    IF ( ZSTD_FIND_REQUIRED )
+        MESSAGE ( FATAL_ERROR "Could not find zstd" )
+    ELSE (  )
+        MESSAGE ( STATUS "Could not find zstd" )
+    ENDIF (  )
+ENDIF (  )
+
+
@@ -34,22 +34,89 @@
 
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
-#include <iterator>
+#include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
+#include <cerrno>
+#include <cstring>
 #include <fcntl.h>
+#if ! defined ( _WIN32 )
+#include <unistd.h>
+#else
+#include <io.h>
+#endif  // ! defined ( _WIN32 )
 #include <boost/filesystem.hpp>
 #include <boost/format.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/filtering_streambuf.hpp>
 #include <zip.h>
 #include "Archiver.hpp"
-#include "Compression.hpp"
 #include "FileSystem.hpp"
+#include "Stopwatch.hpp"
 #include "System.hpp"
+#include "Trace.hpp"
+
+#define     DEFAULT_UNZIP_BUFFER_SIZE       (256 * 1024)
+#define     UNGZIP_BUFFER_SIZE              (64 * 1024)
 
 using namespace std;
 using namespace boost;
 using namespace CoreLib;
 
+struct Archiver::Impl
+{
+    typedef std::unique_ptr<struct zip, void (*)(struct zip *)> ZipHandle;
+    typedef std::unique_ptr<struct zip_file, int (*)(struct zip_file *)> ZipFileHandle;
+
+    struct Job
+    {
+        zip_uint64_t Index;
+        std::string Name;
+        std::string Path;
+        bool HasSize;
+        zip_uint64_t Size;
+        zip_uint64_t CompressedSize;
+    };
+
+    typedef std::vector<Job> Jobs;
+
+    /// Shared by the extraction threads; the first error stops the others
+    struct Context
+    {
+        const std::string &Archive;
+        const Jobs &Entries;
+        std::size_t BufferSize;
+        ExtractionStats &Stats;
+        std::atomic<std::size_t> Next;
+        std::atomic<bool> Failed;
+        std::mutex ErrorMutex;
+        std::string Error;
+
+        Context(const std::string &archive, const Jobs &entries,
+                std::size_t bufferSize, ExtractionStats &stats);
+    };
+
+    static ZipHandle Open(const std::string &archive, std::string &out_error);
+    static bool IsSafeEntryName(const std::string &name);
+    static bool WriteAll(int fd, const char *data, std::size_t size);
+
+    static void Extract(Context &context, struct zip *za);
+    static bool ExtractEntry(Context &context, struct zip *za, const Job &job,
+                             std::vector<char> &buffer, std::string &out_error);
+    static void Fail(Context &context, const std::string &error);
+};
+
+Archiver::UnZipOptions::UnZipOptions() :
+    Threads(1),
+    BufferSize(DEFAULT_UNZIP_BUFFER_SIZE)
+{
+
+}
+
 bool Archiver::UnGzip(const std::string &archive, const std::string &extractedFile)
 {
     string error;
@@ -59,34 +126,77 @@ bool Archiver::UnGzip(const std::string &archive, const std::string &extractedFi
 bool Archiver::UnGzip(const std::string &archive, const std::string &extractedFile,
                       std::string &out_error)
 {
+    TRACE_SPAN_DETAIL("archive", "Archiver::UnGzip", archive);
+
     out_error.clear();
 
-    ifstream ifs(archive, ios::binary);
+    ifstream ifs(archive, ios::in | ios::binary);
     if (!ifs.is_open()) {
         out_error.assign((format("Archiver::UnGzip: Could not extract '%1%' as %2%!")
                           % archive % extractedFile).str());
         return false;
     }
-    Compression::Buffer compressedContents((std::istreambuf_iterator<char>(ifs)),
-                                                        std::istreambuf_iterator<char>());
-    ifs.close();
 
-    Compression::Buffer uncompressedContents;
-    Compression::Decompress(compressedContents, uncompressedContents,
-                            Compression::Algorithm::Gzip);
+    /// Written next to the target and renamed over it once complete, so
+    /// readers never see a partial file and the rename stays on one device
+    const filesystem::path target(extractedFile);
+    const filesystem::path temp(target.parent_path()
+                                / filesystem::unique_path(target.filename().string()
+                                                          + ".%%%%-%%%%.tmp"));
 
-    ofstream ofs(extractedFile, ios::binary);
-    if (!ofs.is_open()) {
-        out_error.assign((format("Archiver::UnGzip: Could not extract '%1%' as %2%!")
-                          % archive % extractedFile).str());
-        return false;
+    try {
+        iostreams::filtering_istreambuf input;
+        input.push(iostreams::gzip_decompressor(iostreams::zlib::default_window_bits,
+                                                UNGZIP_BUFFER_SIZE));
+        input.push(ifs, UNGZIP_BUFFER_SIZE);
+
+        /// Decompression errors are rethrown instead of ending the stream
+        istream in(&input);
+        in.exceptions(ios::badbit);
+
+        ofstream ofs(temp.string(), ios::out | ios::binary | ios::trunc);
+        if (!ofs.is_open()) {
+            out_error.assign((format("Archiver::UnGzip: Could not extract '%1%' as %2%!")
+                              % archive % extractedFile).str());
+            return false;
+        }
+
+        vector<char> buffer(UNGZIP_BUFFER_SIZE);
+
+        while (in) {
+            in.read(buffer.data(), static_cast<streamsize>(buffer.size()));
+            if (in.gcount() > 0)
+                ofs.write(buffer.data(), in.gcount());
+
+            if (!ofs)
+                break;
+        }
+
+        ofs.close();
+
+        if (ofs.fail()) {
+            out_error.assign((format("Archiver::UnGzip: Could not write '%1%'!")
+                              % temp.string()).str());
+        } else {
+            filesystem::rename(temp, target);
+            return true;
+        }
     }
-    copy(uncompressedContents.begin(), uncompressedContents.end(),
-              ostreambuf_iterator<char>(ofs));
-    ofs.flush();
-    ofs.close();
 
-    return true;
+    catch (const iostreams::gzip_error &ex) {
+        out_error.assign((format("Archiver::UnGzip: Corrupted gzip archive '%1%': %2%!")
+                          % archive % ex.what()).str());
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign((format("Archiver::UnGzip: Could not extract '%1%' as %2%: %3%!")
+                          % archive % extractedFile % ex.what()).str());
+    }
+
+    boost::system::error_code ec;
+    filesystem::remove(temp, ec);
+
+    return false;
 }
 
 bool Archiver::UnZip(const std::string &archive, const std::string &extractionPath)
@@ -98,83 +208,270 @@ bool Archiver::UnZip(const std::string &archive, const std::string &extractionPa
 bool Archiver::UnZip(const std::string &archive, const std::string &extractionPath,
                      std::string &out_error)
 {
-    /// based on https://gist.github.com/mobius/1759816
+    ExtractionStats stats;
+    return UnZip(archive, extractionPath, UnZipOptions(), stats, out_error);
+}
+
+bool Archiver::UnZip(const std::string &archive, const std::string &extractionPath,
+                     const UnZipOptions &options, ExtractionStats &out_stats,
+                     std::string &out_error)
+{
+    TRACE_SPAN_DETAIL("archive", "Archiver::UnZip", archive);
 
     out_error.clear();
+    out_stats.clear();
+
+    Impl::ZipHandle za(Impl::Open(archive, out_error));
+    if (!za)
+        return false;
+
+    /// Directories are created up front, so the threads only ever write files
+    Impl::Jobs jobs;
+    const zip_int64_t count = zip_get_num_entries(za.get(), 0);
+
+    for (zip_int64_t i = 0; i < count; ++i) {
+        struct zip_stat sb;
+        zip_stat_init(&sb);
+
+        if (zip_stat_index(za.get(), static_cast<zip_uint64_t>(i), 0, &sb) != 0
+                || (sb.valid & ZIP_STAT_NAME) == 0) {
+            out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
+                              % archive).str());
+            return false;
+        }
+
+        const std::string name(sb.name);
+
+        if (options.Filter && !options.Filter(name))
+            continue;
+
+        if (!Impl::IsSafeEntryName(name)) {
+            out_error.assign((format("Archiver::UnZip: Refusing to extract `%1%' outside of `%2%'!")
+                              % name % extractionPath).str());
+            return false;
+        }
+
+        const filesystem::path path(filesystem::path(extractionPath) / name);
+        const bool isDirectory = name[name.size() - 1] == '/';
+        const filesystem::path directory(isDirectory ? path : path.parent_path());
+
+        boost::system::error_code ec;
+        filesystem::create_directories(directory, ec);
+        if (ec) {
+            out_error.assign((format("Archiver::UnZip: Could not create directory `%1%': %2%!")
+                              % directory.string() % ec.message()).str());
+            return false;
+        }
+
+        if (isDirectory)
+            continue;
+
+        Impl::Job job;
+        job.Index = static_cast<zip_uint64_t>(i);
+        job.Name = name;
+        job.Path = path.string();
+        job.HasSize = (sb.valid & ZIP_STAT_SIZE) != 0;
+        job.Size = job.HasSize ? sb.size : 0;
+        job.CompressedSize = (sb.valid & ZIP_STAT_COMP_SIZE) != 0 ? sb.comp_size : 0;
+        jobs.push_back(job);
+    }
+
+    out_stats.resize(jobs.size());
+
+    std::size_t threads = options.Threads;
+    if (threads == 0)
+        threads = std::max(std::thread::hardware_concurrency(), 1u);
+    threads = std::max<std::size_t>(std::min(threads, jobs.size()), 1);
+
+    Impl::Context context(archive, jobs, std::max<std::size_t>(options.BufferSize, 1), out_stats);
+
+    /// libzip handles are not thread-safe, so each helper opens its own and
+    /// the calling thread keeps working with the first one
+    std::vector<std::thread> helpers;
+    for (std::size_t t = 1; t < threads; ++t) {
+        helpers.emplace_back([&context]() {
+            std::string error;
+            Impl::ZipHandle handle(Impl::Open(context.Archive, error));
+            if (!handle) {
+                Impl::Fail(context, error);
+                return;
+            }
+            Impl::Extract(context, handle.get());
+        });
+    }
 
-    struct zip *za;
-    char buf[100];
-    int err;
+    Impl::Extract(context, za.get());
 
-    if ((za = zip_open(archive.c_str(), 0, &err)) == NULL) {
+    for (auto &helper : helpers) {
+        helper.join();
+    }
+
+    if (context.Failed.load()) {
+        out_error.assign(context.Error);
+        return false;
+    }
+
+    return true;
+}
+
+Archiver::Impl::Context::Context(const std::string &archive, const Jobs &entries,
+                                 std::size_t bufferSize, ExtractionStats &stats) :
+    Archive(archive),
+    Entries(entries),
+    BufferSize(bufferSize),
+    Stats(stats),
+    Next(0),
+    Failed(false)
+{
+
+}
+
+Archiver::Impl::ZipHandle Archiver::Impl::Open(const std::string &archive, std::string &out_error)
+{
+    int err = 0;
+    struct zip *za = zip_open(archive.c_str(), 0, &err);
+
+    if (za == NULL) {
+        char buf[100];
         zip_error_to_str(buf, sizeof(buf), err, errno);
         out_error.assign((format("Archiver::UnZip: Can't open zip archive `%1%': %2%!")
                           % archive % buf).str());
+    }
+
+    /// Nothing is ever modified, so the handle is discarded, never written back
+    return ZipHandle(za, &zip_discard);
+}
+
+bool Archiver::Impl::IsSafeEntryName(const std::string &name)
+{
+    const filesystem::path path(name);
+
+    if (name.empty() || path.has_root_path())
         return false;
+
+    for (const auto &part : path) {
+        if (part == "..")
+            return false;
+    }
+
+    return true;
+}
+
+bool Archiver::Impl::WriteAll(int fd, const char *data, std::size_t size)
+{
+    while (size > 0) {
+        const auto written = write(fd, data, static_cast<unsigned int>(size));
+
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
     }
 
-    struct zip_file *zf;
-    struct zip_stat sb;
-    zip_int64_t len;
-    int fd;
-    zip_uint64_t sum;
-
-    for (zip_int64_t i = 0; i < zip_get_num_entries(za, 0); ++i) {
-        if (zip_stat_index(za, (zip_uint64_t)i, 0, &sb) == 0) {
-            len = (zip_int64_t)strlen(sb.name);
-            if (sb.name[len - 1] == '/') {
-                FileSystem::CreateDir((filesystem::path(extractionPath)
-                                       / sb.name).string());
-            } else {
-                zf = zip_fopen_index(za, (zip_uint64_t)i, 0);
-                if (!zf) {
-                    out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
-                                      % archive).str());
-                    return false;
-                }
+    return true;
+}
+
+void Archiver::Impl::Extract(Context &context, struct zip *za)
+{
+    std::vector<char> buffer(context.BufferSize);
+
+    while (!context.Failed.load(std::memory_order_relaxed)) {
+        const std::size_t i = context.Next.fetch_add(1);
+        if (i >= context.Entries.size())
+            return;
+
+        std::string error;
+        if (!ExtractEntry(context, za, context.Entries[i], buffer, error)) {
+            Fail(context, error);
+            return;
+        }
+    }
+}
+
+bool Archiver::Impl::ExtractEntry(Context &context, struct zip *za, const Job &job,
+                                  std::vector<char> &buffer, std::string &out_error)
+{
+    TRACE_SPAN_DETAIL("archive", "Archiver::UnZip entry", job.Name);
+
+    Stopwatch<std::chrono::steady_clock> stopwatch;
+
+    ZipFileHandle zf(zip_fopen_index(za, job.Index, 0), &zip_fclose);
+    if (!zf) {
+        out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
+                          % context.Archive).str());
+        return false;
+    }
 
 #if ! defined ( _WIN32 )
-                fd = open((filesystem::path(extractionPath)
-                           / sb.name).string().c_str(),
-                          O_RDWR | O_TRUNC | O_CREAT, 0644);
+    int fd = open(job.Path.c_str(), O_WRONLY | O_TRUNC | O_CREAT, 0644);
 #else
-                fd = open((filesystem::path(extractionPath)
-                           / sb.name).string().c_str(),
-                          O_RDWR | O_TRUNC | O_CREAT | O_BINARY, 0644);
+    int fd = open(job.Path.c_str(), O_WRONLY | O_TRUNC | O_CREAT | O_BINARY, 0644);
 #endif  // ! defined ( _WIN32 )
 
-                if (fd < 0) {
-                    out_error.assign((format("Archiver::UnZip: Cannot open file `%1%' for writing!")
-                                      % sb.name).str());
-                    return false;
-                }
-
-                sum = 0;
-                while (sum != sb.size) {
-                    len = zip_fread(zf, buf, 100);
-                    if (len < 0) {
-                        out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
-                                          % archive).str());
-                        return false;
-                    }
-                    write(fd, buf, (size_t)len);
-                    sum += (zip_uint64_t)len;
-                }
-                close(fd);
-                zip_fclose(zf);
-            }
-        } else {
+    if (fd < 0) {
+        out_error.assign((format("Archiver::UnZip: Cannot open file `%1%' for writing!")
+                          % job.Path).str());
+        return false;
+    }
+
+    zip_uint64_t sum = 0;
+    bool isWritten = true;
+
+    for (;;) {
+        const zip_int64_t len = zip_fread(zf.get(), buffer.data(), buffer.size());
+
+        if (len < 0) {
+            close(fd);
             out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
-                              % archive).str());
+                              % context.Archive).str());
+            return false;
         }
+
+        if (len == 0)
+            break;
+
+        if (!WriteAll(fd, buffer.data(), static_cast<std::size_t>(len))) {
+            isWritten = false;
+            break;
+        }
+
+        sum += static_cast<zip_uint64_t>(len);
     }
 
-    if (zip_close(za) == -1) {
-        out_error.assign((format("Archiver::UnZip: Can't close zip archive `%1%'!")
-                          % archive).str());
+    /// Delayed write errors may only show up on close()
+    if (close(fd) != 0 || !isWritten) {
+        out_error.assign((format("Archiver::UnZip: Could not write `%1%': %2%!")
+                          % job.Path % std::strerror(errno)).str());
         return false;
     }
 
+    if (job.HasSize && sum != job.Size) {
+        out_error.assign((format("Archiver::UnZip: Corrupted zip archive `%1%'!")
+                          % context.Archive).str());
+        return false;
+    }
+
+    /// Each job owns its slot, so no lock is needed
+    EntryStats &stats = context.Stats[static_cast<std::size_t>(&job - context.Entries.data())];
+    stats.Name = job.Name;
+    stats.Bytes = sum;
+    stats.CompressedBytes = job.CompressedSize;
+    stats.Microseconds = stopwatch.Stop();
+
     return true;
 }
 
+void Archiver::Impl::Fail(Context &context, const std::string &error)
+{
+    std::lock_guard<std::mutex> lock(context.ErrorMutex);
+    (void)lock;
+
+    if (!context.Failed.load()) {
+        context.Error = error;
+        context.Failed.store(true);
+    }
+}
@@ -37,7 +37,11 @@
 #define CORELIB_ARCHIVER_HPP
 
 
+#include <functional>
 #include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
 namespace CoreLib {
     class Archiver;
@@ -45,6 +49,35 @@ namespace CoreLib {
 
 class CoreLib::Archiver
 {
+public:
+    /// Receives the entry name as stored in the archive; entries for which
+    /// it returns false are skipped
+    typedef std::function<bool(const std::string &)> EntryFilter;
+
+    /// Zero threads means one per hardware thread; entries are spread over
+    /// the threads, each with its own archive handle and buffer
+    struct UnZipOptions
+    {
+        EntryFilter Filter;
+        std::size_t Threads;
+        std::size_t BufferSize;
+
+        UnZipOptions();
+    };
+
+    struct EntryStats
+    {
+        std::string Name;
+        std::uint_least64_t Bytes;
+        std::uint_least64_t CompressedBytes;
+        double Microseconds;
+    };
+
+    typedef std::vector<EntryStats> ExtractionStats;
+
+private:
+    struct Impl;
+
 public:
     static bool UnGzip(const std::string &archive, const std::string &extractedFile);
     static bool UnGzip(const std::string &archive, const std::string &extractedFile,
@@ -53,6 +86,9 @@ public:
     static bool UnZip(const std::string &archive, const std::string &extractionPath);
     static bool UnZip(const std::string &archive, const std::string &extractionPath,
                       std::string &out_error);
+    static bool UnZip(const std::string &archive, const std::string &extractionPath,
+                      const UnZipOptions &options, ExtractionStats &out_stats,
+                      std::string &out_error);
 };
 
 
@@ -0,0 +1,1051 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A compact, column-oriented file format for tables of text values. Rows
+ * are split into fixed-size row groups and each column of a group is stored
+ * as a separate, optionally compressed block, so readers only load and
+ * decode the columns and row ranges they ask for.
+ *
+ * Layout, all integers little-endian:
+ *   header   "CLA1", version (1 byte), 3 reserved bytes
+ *   blocks   one per column and row group, back to back
+ *   footer   properties, row count, rows per row group, then per column:
+ *            name and, for each row group, encoding, codec, offset, stored
+ *            size, encoded size, CRC-32 of the stored bytes (counts and
+ *            sizes are LEB128 varints)
+ *   trailer  footer size (4 bytes), footer CRC-32 (4 bytes), "CLA1"
+ *
+ * Version 1 files have no rows-per-group field and one block per column.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <cstring>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <zlib.h>
+#include "ColumnArchive.hpp"
+#include "make_unique.hpp"
+#include "Utility.hpp"
+
+#define     COLUMN_ARCHIVE_MAGIC                "CLA1"
+#define     COLUMN_ARCHIVE_MAGIC_SIZE           4
+#define     COLUMN_ARCHIVE_VERSION              2
+#define     COLUMN_ARCHIVE_VERSION_SINGLE_GROUP 1
+#define     COLUMN_ARCHIVE_HEADER_SIZE          8
+#define     COLUMN_ARCHIVE_TRAILER_SIZE         12
+#define     COLUMN_ARCHIVE_CODEC_NONE           0
+
+/// Small enough that a reader streaming a day holds only a slice of it,
+/// large enough for the codecs to find repetition
+#define     DEFAULT_ROW_GROUP_ROWS              1024
+
+/// Digits a decimal may have and still fit a signed 64-bit integer
+#define     DECIMAL_MAX_DIGITS                  18
+
+/// A column is dictionary-encoded when it has at most one distinct value
+/// per this many rows
+#define     DICTIONARY_MIN_REPEAT               2
+
+#define     UNKNOWN_ERROR                       "ColumnArchive: Unknown error!"
+
+using namespace std;
+using namespace CoreLib;
+
+struct ColumnArchive::Impl
+{
+    static void PutVarint(std::string &out_data, std::uint64_t value);
+    static void PutFixed32(std::string &out_data, const std::uint32_t value);
+    static void PutString(std::string &out_data, const std::string &value);
+
+    static std::uint64_t GetVarint(const char *&cursor, const char *end);
+    static std::uint32_t GetFixed32(const char *&cursor, const char *end);
+    static std::string GetString(const char *&cursor, const char *end);
+
+    static std::uint64_t ZigZagEncode(const std::uint64_t value);
+    static std::uint64_t ZigZagDecode(const std::uint64_t value);
+
+    static bool ParseDecimal(const std::string &text, std::int64_t &out_mantissa,
+                             unsigned int &out_scale);
+    static void FormatDecimal(const std::int64_t mantissa, unsigned int scale,
+                              std::string &out_text);
+
+    static Encoding ChooseEncoding(const Column &values, const std::size_t first,
+                                   const std::size_t count, std::vector<std::int64_t> &out_integers,
+                                   unsigned int &out_scale);
+    static void Encode(const Column &values, const std::size_t first, const std::size_t count,
+                       Encoding &out_encoding, std::string &out_block);
+
+    /// Appends the decoded values to out_values
+    static void Decode(const Encoding &encoding, const char *data, const std::size_t size,
+                       const std::size_t rows, Column &out_values);
+
+    static std::uint32_t Checksum(const char *data, const std::size_t size);
+};
+
+struct ColumnArchive::Writer::Impl
+{
+    Options ArchiveOptions;
+    Properties ArchiveProperties;
+    std::vector<std::pair<std::string, Column>> Columns;
+};
+
+struct ColumnArchive::Reader::Impl
+{
+    std::string File;
+    std::ifstream Stream;
+
+    Properties ArchiveProperties;
+    std::size_t Rows;
+    std::size_t RowGroupRows;
+    std::size_t RowGroups;
+    std::vector<ColumnInfo> Columns;
+
+    /// Reused between columns
+    std::string Stored;
+    Compression::Buffer Encoded;
+    std::map<Compression::Algorithm, std::unique_ptr<Compression::Decompressor>> Decompressors;
+
+    Impl();
+
+    std::size_t GetRowGroupSize(const std::size_t group) const;
+
+    void ReadColumn(const std::size_t index, Column &out_values);
+    void ReadBlock(const std::size_t index, const std::size_t group, Column &out_values);
+};
+
+const std::string ColumnArchive::FileExtension(".cla");
+
+ColumnArchive::Options::Options() :
+    Compress(true),
+    CompressionAlgorithm(Compression::IsSupported(Compression::Algorithm::Zstd)
+                         ? Compression::Algorithm::Zstd : Compression::Algorithm::Gzip),
+    CompressionLevel(Compression::DefaultLevel),
+    RowGroupRows(DEFAULT_ROW_GROUP_ROWS)
+{
+
+}
+
+ColumnArchive::Writer::Writer() :
+    m_pimpl(std::make_unique<Writer::Impl>())
+{
+
+}
+
+ColumnArchive::Writer::Writer(const Options &options) :
+    m_pimpl(std::make_unique<Writer::Impl>())
+{
+    m_pimpl->ArchiveOptions = options;
+}
+
+ColumnArchive::Writer::~Writer() = default;
+
+void ColumnArchive::Writer::SetProperty(const std::string &key, const std::string &value)
+{
+    m_pimpl->ArchiveProperties[key] = value;
+}
+
+void ColumnArchive::Writer::AddColumn(const std::string &name, const Column &values)
+{
+    m_pimpl->Columns.emplace_back(name, values);
+}
+
+void ColumnArchive::Writer::AddColumn(const std::string &name, Column &&values)
+{
+    m_pimpl->Columns.emplace_back(name, std::move(values));
+}
+
+bool ColumnArchive::Writer::Save(const std::string &file, std::string &out_error)
+{
+    out_error.clear();
+
+    const boost::filesystem::path target(file);
+    const boost::filesystem::path temp(
+                target.parent_path()
+                / boost::filesystem::unique_path(target.filename().string() + ".%%%%-%%%%.tmp"));
+
+    try {
+        const std::size_t rows = m_pimpl->Columns.empty() ? 0 : m_pimpl->Columns.front().second.size();
+        for (const auto &column : m_pimpl->Columns) {
+            if (column.second.size() != rows) {
+                out_error.assign((boost::format("ColumnArchive: Column '%1%' has %2% values, expected %3%!")
+                                  % column.first % column.second.size() % rows).str());
+                return false;
+            }
+        }
+
+        const Options &options = m_pimpl->ArchiveOptions;
+        if (options.Compress && !Compression::IsSupported(options.CompressionAlgorithm)) {
+            out_error.assign("ColumnArchive: Compression algorithm is not supported by this build!");
+            return false;
+        }
+
+        std::ofstream stream(temp.string(), std::ios_base::out | std::ios_base::binary
+                             | std::ios_base::trunc);
+        if (!stream.is_open()) {
+            out_error.assign((boost::format("ColumnArchive: Could not create '%1%'!")
+                              % temp.string()).str());
+            return false;
+        }
+
+        std::string header(COLUMN_ARCHIVE_MAGIC);
+        header.push_back(static_cast<char>(COLUMN_ARCHIVE_VERSION));
+        header.append(COLUMN_ARCHIVE_HEADER_SIZE - header.size(), '\0');
+        stream.write(header.data(), static_cast<std::streamsize>(header.size()));
+
+        std::unique_ptr<Compression::Compressor> compressor;
+        if (options.Compress) {
+            compressor = std::make_unique<Compression::Compressor>(options.CompressionAlgorithm,
+                                                                   options.CompressionLevel);
+        }
+
+        /// Zero keeps every row in a single group
+        const std::size_t rowGroupRows = options.RowGroupRows > 0
+                ? options.RowGroupRows : std::max<std::size_t>(rows, 1);
+        const std::size_t rowGroups = (rows + rowGroupRows - 1) / rowGroupRows;
+
+        std::vector<ColumnInfo> infos;
+        infos.reserve(m_pimpl->Columns.size());
+
+        std::uint64_t offset = COLUMN_ARCHIVE_HEADER_SIZE;
+        std::string encoded;
+        Compression::Buffer compressed;
+
+        for (const auto &column : m_pimpl->Columns) {
+            ColumnInfo info;
+            info.Name = column.first;
+            info.Blocks.reserve(rowGroups);
+
+            for (std::size_t group = 0; group < rowGroups; ++group) {
+                const std::size_t first = group * rowGroupRows;
+                const std::size_t count = std::min(rowGroupRows, rows - first);
+
+                BlockInfo block;
+                block.IsCompressed = false;
+                block.CompressionAlgorithm = options.CompressionAlgorithm;
+
+                ColumnArchive::Impl::Encode(column.second, first, count, block.BlockEncoding, encoded);
+                block.EncodedSize = encoded.size();
+
+                const char *stored = encoded.data();
+                std::size_t storedSize = encoded.size();
+
+                /// Blocks that do not shrink are kept as they are
+                if (compressor) {
+                    std::string error;
+                    if (!compressor->Compress(encoded.data(), encoded.size(), compressed, error)) {
+                        out_error.assign("ColumnArchive: " + error);
+                        stream.close();
+                        boost::filesystem::remove(temp);
+                        return false;
+                    }
+
+                    if (compressed.size() < encoded.size()) {
+                        block.IsCompressed = true;
+                        stored = compressed.data();
+                        storedSize = compressed.size();
+                    }
+                }
+
+                block.Offset = offset;
+                block.StoredSize = storedSize;
+                block.Checksum = ColumnArchive::Impl::Checksum(stored, storedSize);
+
+                stream.write(stored, static_cast<std::streamsize>(storedSize));
+                offset += storedSize;
+
+                info.Blocks.push_back(block);
+            }
+
+            infos.push_back(std::move(info));
+        }
+
+        std::string footer;
+        ColumnArchive::Impl::PutVarint(footer, m_pimpl->ArchiveProperties.size());
+        for (const auto &property : m_pimpl->ArchiveProperties) {
+            ColumnArchive::Impl::PutString(footer, property.first);
+            ColumnArchive::Impl::PutString(footer, property.second);
+        }
+        ColumnArchive::Impl::PutVarint(footer, rows);
+        ColumnArchive::Impl::PutVarint(footer, rowGroupRows);
+        ColumnArchive::Impl::PutVarint(footer, infos.size());
+        for (const auto &info : infos) {
+            ColumnArchive::Impl::PutString(footer, info.Name);
+            for (const auto &block : info.Blocks) {
+                footer.push_back(static_cast<char>(block.BlockEncoding));
+                footer.push_back(static_cast<char>(
+                                     block.IsCompressed
+                                     ? static_cast<unsigned char>(block.CompressionAlgorithm) + 1
+                                     : COLUMN_ARCHIVE_CODEC_NONE));
+                ColumnArchive::Impl::PutVarint(footer, block.Offset);
+                ColumnArchive::Impl::PutVarint(footer, block.StoredSize);
+                ColumnArchive::Impl::PutVarint(footer, block.EncodedSize);
+                ColumnArchive::Impl::PutFixed32(footer, block.Checksum);
+            }
+        }
+
+        std::string trailer;
+        ColumnArchive::Impl::PutFixed32(trailer, static_cast<std::uint32_t>(footer.size()));
+        ColumnArchive::Impl::PutFixed32(trailer, ColumnArchive::Impl::Checksum(footer.data(),
+                                                                               footer.size()));
+        trailer.append(COLUMN_ARCHIVE_MAGIC);
+
+        stream.write(footer.data(), static_cast<std::streamsize>(footer.size()));
+        stream.write(trailer.data(), static_cast<std::streamsize>(trailer.size()));
+        stream.close();
+
+        if (!stream) {
+            out_error.assign((boost::format("ColumnArchive: Could not write '%1%'!")
+                              % temp.string()).str());
+            boost::filesystem::remove(temp);
+            return false;
+        }
+
+        boost::filesystem::rename(temp, target);
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(temp, ec);
+
+    return false;
+}
+
+ColumnArchive::Reader::Reader() :
+    m_pimpl(std::make_unique<Reader::Impl>())
+{
+
+}
+
+ColumnArchive::Reader::~Reader() = default;
+
+bool ColumnArchive::Reader::Open(const std::string &file, std::string &out_error)
+{
+    out_error.clear();
+
+    m_pimpl->File = file;
+    m_pimpl->ArchiveProperties.clear();
+    m_pimpl->Rows = 0;
+    m_pimpl->RowGroupRows = 0;
+    m_pimpl->RowGroups = 0;
+    m_pimpl->Columns.clear();
+
+    if (m_pimpl->Stream.is_open())
+        m_pimpl->Stream.close();
+    m_pimpl->Stream.clear();
+
+    try {
+        m_pimpl->Stream.open(file, std::ios_base::in | std::ios_base::binary);
+        if (!m_pimpl->Stream.is_open()) {
+            out_error.assign((boost::format("ColumnArchive: Could not open '%1%'!") % file).str());
+            return false;
+        }
+
+        m_pimpl->Stream.exceptions(std::ios_base::badbit | std::ios_base::failbit);
+
+        m_pimpl->Stream.seekg(0, std::ios_base::end);
+        const std::uint64_t fileSize = static_cast<std::uint64_t>(m_pimpl->Stream.tellg());
+        if (fileSize < COLUMN_ARCHIVE_HEADER_SIZE + COLUMN_ARCHIVE_TRAILER_SIZE)
+            throw std::runtime_error("ColumnArchive: File is too small!");
+
+        char header[COLUMN_ARCHIVE_HEADER_SIZE];
+        m_pimpl->Stream.seekg(0, std::ios_base::beg);
+        m_pimpl->Stream.read(header, sizeof(header));
+        if (std::memcmp(header, COLUMN_ARCHIVE_MAGIC, COLUMN_ARCHIVE_MAGIC_SIZE) != 0)
+            throw std::runtime_error("ColumnArchive: Not a column archive!");
+        const unsigned char version = static_cast<unsigned char>(header[COLUMN_ARCHIVE_MAGIC_SIZE]);
+        if (version != COLUMN_ARCHIVE_VERSION && version != COLUMN_ARCHIVE_VERSION_SINGLE_GROUP)
+            throw std::runtime_error("ColumnArchive: Unsupported version!");
+
+        char trailer[COLUMN_ARCHIVE_TRAILER_SIZE];
+        m_pimpl->Stream.seekg(static_cast<std::streamoff>(fileSize - COLUMN_ARCHIVE_TRAILER_SIZE),
+                              std::ios_base::beg);
+        m_pimpl->Stream.read(trailer, sizeof(trailer));
+        if (std::memcmp(trailer + 8, COLUMN_ARCHIVE_MAGIC, COLUMN_ARCHIVE_MAGIC_SIZE) != 0)
+            throw std::runtime_error("ColumnArchive: Truncated archive!");
+
+        const char *cursor = trailer;
+        const std::uint32_t footerSize = ColumnArchive::Impl::GetFixed32(cursor, trailer + 8);
+        const std::uint32_t footerChecksum = ColumnArchive::Impl::GetFixed32(cursor, trailer + 8);
+
+        const std::uint64_t footerOffset = fileSize - COLUMN_ARCHIVE_TRAILER_SIZE - footerSize;
+        if (footerSize > fileSize - COLUMN_ARCHIVE_HEADER_SIZE - COLUMN_ARCHIVE_TRAILER_SIZE)
+            throw std::runtime_error("ColumnArchive: Corrupt footer!");
+
+        std::string footer(footerSize, '\0');
+        m_pimpl->Stream.seekg(static_cast<std::streamoff>(footerOffset), std::ios_base::beg);
+        m_pimpl->Stream.read(&footer[0], static_cast<std::streamsize>(footer.size()));
+        if (ColumnArchive::Impl::Checksum(footer.data(), footer.size()) != footerChecksum)
+            throw std::runtime_error("ColumnArchive: Footer checksum mismatch!");
+
+        cursor = footer.data();
+        const char *end = footer.data() + footer.size();
+
+        const std::uint64_t propertyCount = ColumnArchive::Impl::GetVarint(cursor, end);
+        for (std::uint64_t i = 0; i < propertyCount; ++i) {
+            std::string key(ColumnArchive::Impl::GetString(cursor, end));
+            m_pimpl->ArchiveProperties[key] = ColumnArchive::Impl::GetString(cursor, end);
+        }
+
+        const std::uint64_t rows = ColumnArchive::Impl::GetVarint(cursor, end);
+        std::uint64_t rowGroupRows = rows;
+        std::uint64_t rowGroups = 1;
+
+        if (version != COLUMN_ARCHIVE_VERSION_SINGLE_GROUP) {
+            rowGroupRows = ColumnArchive::Impl::GetVarint(cursor, end);
+            if (rowGroupRows == 0)
+                throw std::runtime_error("ColumnArchive: Corrupt footer!");
+            rowGroups = (rows + rowGroupRows - 1) / rowGroupRows;
+        }
+
+        /// Every block takes several footer bytes
+        if (rowGroups > footer.size())
+            throw std::runtime_error("ColumnArchive: Corrupt footer!");
+
+        m_pimpl->Rows = static_cast<std::size_t>(rows);
+        m_pimpl->RowGroupRows = static_cast<std::size_t>(rowGroupRows);
+        m_pimpl->RowGroups = static_cast<std::size_t>(rowGroups);
+
+        const std::uint64_t columnCount = ColumnArchive::Impl::GetVarint(cursor, end);
+        for (std::uint64_t i = 0; i < columnCount; ++i) {
+            ColumnInfo info;
+            info.Name = ColumnArchive::Impl::GetString(cursor, end);
+            info.Blocks.reserve(m_pimpl->RowGroups);
+
+            for (std::size_t group = 0; group < m_pimpl->RowGroups; ++group) {
+                BlockInfo block;
+
+                if (end - cursor < 2)
+                    throw std::runtime_error("ColumnArchive: Corrupt footer!");
+                const unsigned char encoding = static_cast<unsigned char>(*cursor++);
+                const unsigned char codec = static_cast<unsigned char>(*cursor++);
+                if (encoding > static_cast<unsigned char>(Encoding::Decimal)
+                        || codec > static_cast<unsigned char>(Compression::Algorithm::Lz4) + 1)
+                    throw std::runtime_error("ColumnArchive: Unknown column encoding!");
+
+                block.BlockEncoding = static_cast<Encoding>(encoding);
+                block.IsCompressed = codec != COLUMN_ARCHIVE_CODEC_NONE;
+                block.CompressionAlgorithm = block.IsCompressed
+                        ? static_cast<Compression::Algorithm>(codec - 1)
+                        : Compression::Algorithm::Zlib;
+                block.Offset = ColumnArchive::Impl::GetVarint(cursor, end);
+                block.StoredSize = ColumnArchive::Impl::GetVarint(cursor, end);
+                block.EncodedSize = ColumnArchive::Impl::GetVarint(cursor, end);
+                block.Checksum = ColumnArchive::Impl::GetFixed32(cursor, end);
+
+                if (block.Offset < COLUMN_ARCHIVE_HEADER_SIZE || block.Offset > footerOffset
+                        || block.StoredSize > footerOffset - block.Offset)
+                    throw std::runtime_error("ColumnArchive: Column block out of range!");
+
+                info.Blocks.push_back(block);
+            }
+
+            m_pimpl->Columns.push_back(std::move(info));
+        }
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    m_pimpl->Columns.clear();
+    m_pimpl->Rows = 0;
+    m_pimpl->RowGroupRows = 0;
+    m_pimpl->RowGroups = 0;
+    m_pimpl->Stream.close();
+
+    return false;
+}
+
+const ColumnArchive::Properties &ColumnArchive::Reader::GetProperties() const
+{
+    return m_pimpl->ArchiveProperties;
+}
+
+std::size_t ColumnArchive::Reader::GetRowCount() const
+{
+    return m_pimpl->Rows;
+}
+
+const std::vector<ColumnArchive::ColumnInfo> &ColumnArchive::Reader::GetColumns() const
+{
+    return m_pimpl->Columns;
+}
+
+std::size_t ColumnArchive::Reader::GetRowGroupCount() const
+{
+    return m_pimpl->RowGroups;
+}
+
+std::size_t ColumnArchive::Reader::GetRowGroupRows() const
+{
+    return m_pimpl->RowGroupRows;
+}
+
+bool ColumnArchive::Reader::FindColumn(const std::string &name, std::size_t &out_index) const
+{
+    for (std::size_t i = 0; i < m_pimpl->Columns.size(); ++i) {
+        if (m_pimpl->Columns[i].Name == name) {
+            out_index = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ColumnArchive::Reader::ReadColumn(const std::size_t index, Column &out_values,
+                                       std::string &out_error)
+{
+    out_error.clear();
+
+    try {
+        m_pimpl->ReadColumn(index, out_values);
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    out_values.clear();
+
+    return false;
+}
+
+bool ColumnArchive::Reader::ReadColumns(const std::vector<std::size_t> &indices,
+                                        std::vector<Column> &out_columns,
+                                        std::string &out_error)
+{
+    out_columns.resize(indices.size());
+
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        if (!ReadColumn(indices[i], out_columns[i], out_error)) {
+            out_columns.clear();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ColumnArchive::Reader::ReadAllColumns(std::vector<Column> &out_columns, std::string &out_error)
+{
+    std::vector<std::size_t> indices(m_pimpl->Columns.size());
+    for (std::size_t i = 0; i < indices.size(); ++i) {
+        indices[i] = i;
+    }
+
+    return ReadColumns(indices, out_columns, out_error);
+}
+
+bool ColumnArchive::Reader::ReadRowGroup(const std::size_t group,
+                                         const std::vector<std::size_t> &indices,
+                                         std::vector<Column> &out_columns,
+                                         std::string &out_error)
+{
+    out_error.clear();
+    out_columns.resize(indices.size());
+
+    try {
+        if (group >= m_pimpl->RowGroups)
+            throw std::out_of_range("ColumnArchive: Row group out of range!");
+
+        for (std::size_t i = 0; i < indices.size(); ++i) {
+            out_columns[i].clear();
+            m_pimpl->ReadBlock(indices[i], group, out_columns[i]);
+        }
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    out_columns.clear();
+
+    return false;
+}
+
+ColumnArchive::Reader::Impl::Impl() :
+    Rows(0),
+    RowGroupRows(0),
+    RowGroups(0)
+{
+
+}
+
+std::size_t ColumnArchive::Reader::Impl::GetRowGroupSize(const std::size_t group) const
+{
+    return std::min(RowGroupRows, Rows - group * RowGroupRows);
+}
+
+void ColumnArchive::Reader::Impl::ReadColumn(const std::size_t index, Column &out_values)
+{
+    out_values.clear();
+    out_values.reserve(Rows);
+
+    for (std::size_t group = 0; group < RowGroups; ++group) {
+        ReadBlock(index, group, out_values);
+    }
+}
+
+void ColumnArchive::Reader::Impl::ReadBlock(const std::size_t index, const std::size_t group,
+                                            Column &out_values)
+{
+    if (!Stream.is_open())
+        throw std::runtime_error("ColumnArchive: Archive is not open!");
+
+    if (index >= Columns.size())
+        throw std::out_of_range("ColumnArchive: Column index out of range!");
+
+    const ColumnInfo &info = Columns[index];
+    const BlockInfo &block = info.Blocks[group];
+
+    Stream.clear();
+    Stored.resize(static_cast<std::size_t>(block.StoredSize));
+    Stream.seekg(static_cast<std::streamoff>(block.Offset), std::ios_base::beg);
+    if (!Stored.empty())
+        Stream.read(&Stored[0], static_cast<std::streamsize>(Stored.size()));
+
+    if (ColumnArchive::Impl::Checksum(Stored.data(), Stored.size()) != block.Checksum)
+        throw std::runtime_error((boost::format("ColumnArchive: Checksum mismatch in column '%1%'!")
+                                  % info.Name).str());
+
+    const char *data = Stored.data();
+    std::size_t size = Stored.size();
+
+    if (block.IsCompressed) {
+        auto &decompressor = Decompressors[block.CompressionAlgorithm];
+        if (!decompressor)
+            decompressor = std::make_unique<Compression::Decompressor>(block.CompressionAlgorithm);
+
+        std::string error;
+        if (!decompressor->Decompress(Stored.data(), Stored.size(), Encoded, error))
+            throw std::runtime_error("ColumnArchive: " + error);
+        if (Encoded.size() != block.EncodedSize)
+            throw std::runtime_error((boost::format("ColumnArchive: Size mismatch in column '%1%'!")
+                                      % info.Name).str());
+
+        data = Encoded.data();
+        size = Encoded.size();
+    }
+
+    ColumnArchive::Impl::Decode(block.BlockEncoding, data, size, GetRowGroupSize(group), out_values);
+}
+
+void ColumnArchive::Impl::PutVarint(std::string &out_data, std::uint64_t value)
+{
+    while (value >= 0x80) {
+        out_data.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out_data.push_back(static_cast<char>(value));
+}
+
+void ColumnArchive::Impl::PutFixed32(std::string &out_data, const std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out_data.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+void ColumnArchive::Impl::PutString(std::string &out_data, const std::string &value)
+{
+    PutVarint(out_data, value.size());
+    out_data.append(value);
+}
+
+std::uint64_t ColumnArchive::Impl::GetVarint(const char *&cursor, const char *end)
+{
+    std::uint64_t value = 0;
+
+    for (unsigned int shift = 0; shift < 64; shift += 7) {
+        if (cursor == end)
+            throw std::runtime_error("ColumnArchive: Unexpected end of data!");
+
+        const unsigned char byte = static_cast<unsigned char>(*cursor++);
+        value |= static_cast<std::uint64_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return value;
+    }
+
+    throw std::runtime_error("ColumnArchive: Malformed varint!");
+}
+
+std::uint32_t ColumnArchive::Impl::GetFixed32(const char *&cursor, const char *end)
+{
+    if (end - cursor < 4)
+        throw std::runtime_error("ColumnArchive: Unexpected end of data!");
+
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<std::uint32_t>(static_cast<unsigned char>(*cursor++)) << (8 * i);
+    }
+
+    return value;
+}
+
+std::string ColumnArchive::Impl::GetString(const char *&cursor, const char *end)
+{
+    const std::uint64_t size = GetVarint(cursor, end);
+    if (size > static_cast<std::uint64_t>(end - cursor))
+        throw std::runtime_error("ColumnArchive: Unexpected end of data!");
+
+    std::string value(cursor, static_cast<std::size_t>(size));
+    cursor += size;
+
+    return value;
+}
+
+std::uint64_t ColumnArchive::Impl::ZigZagEncode(const std::uint64_t value)
+{
+    return (value << 1) ^ (0 - (value >> 63));
+}
+
+std::uint64_t ColumnArchive::Impl::ZigZagDecode(const std::uint64_t value)
+{
+    return (value >> 1) ^ (0 - (value & 1));
+}
+
+bool ColumnArchive::Impl::ParseDecimal(const std::string &text, std::int64_t &out_mantissa,
+                                       unsigned int &out_scale)
+{
+    /// Only the form FormatDecimal() gives back: no '+', exponent, leading
+    /// zeros, trailing fractional zeros or negative zero
+    const std::size_t start = text.size() > 0 && text[0] == '-' ? 1 : 0;
+    const std::size_t dot = text.find('.', start);
+    const std::size_t integerEnd = dot == std::string::npos ? text.size() : dot;
+
+    if (integerEnd == start)
+        return false;
+    if (text[start] == '0' && integerEnd - start > 1)
+        return false;
+    if (dot != std::string::npos && (dot + 1 == text.size() || text[text.size() - 1] == '0'))
+        return false;
+
+    std::uint64_t mantissa = 0;
+    unsigned int digits = 0;
+
+    for (std::size_t i = start; i < text.size(); ++i) {
+        if (i == dot)
+            continue;
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+
+        mantissa = mantissa * 10 + static_cast<std::uint64_t>(text[i] - '0');
+        if (mantissa != 0 && ++digits > DECIMAL_MAX_DIGITS)
+            return false;
+    }
+
+    if (start == 1 && mantissa == 0)
+        return false;
+
+    out_scale = dot == std::string::npos ? 0 : static_cast<unsigned int>(text.size() - dot - 1);
+    if (out_scale > DECIMAL_MAX_DIGITS)
+        return false;
+
+    out_mantissa = start == 1 ? -static_cast<std::int64_t>(mantissa) : static_cast<std::int64_t>(mantissa);
+
+    return true;
+}
+
+void ColumnArchive::Impl::FormatDecimal(const std::int64_t mantissa, unsigned int scale,
+                                        std::string &out_text)
+{
+    const unsigned long long magnitude = static_cast<unsigned long long>(mantissa);
+    std::string digits(std::to_string(mantissa < 0 ? 0 - magnitude : magnitude));
+
+    while (scale > 0 && digits.size() > 1 && digits[digits.size() - 1] == '0') {
+        digits.resize(digits.size() - 1);
+        --scale;
+    }
+
+    if (mantissa == 0)
+        scale = 0;
+
+    out_text.clear();
+    if (mantissa < 0)
+        out_text.push_back('-');
+
+    if (scale > 0) {
+        if (digits.size() <= scale)
+            digits.insert(0, scale + 1 - digits.size(), '0');
+        digits.insert(digits.size() - scale, 1, '.');
+    }
+
+    out_text.append(digits);
+}
+
+ColumnArchive::Encoding ColumnArchive::Impl::ChooseEncoding(const Column &values,
+                                                            const std::size_t first,
+                                                            const std::size_t count,
+                                                            std::vector<std::int64_t> &out_integers,
+                                                            unsigned int &out_scale)
+{
+    static const std::int64_t POWERS_OF_TEN[DECIMAL_MAX_DIGITS + 1] = {
+        1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL, 100000000LL,
+        1000000000LL, 10000000000LL, 100000000000LL, 1000000000000LL, 10000000000000LL,
+        100000000000000LL, 1000000000000000LL, 10000000000000000LL, 100000000000000000LL,
+        1000000000000000000LL
+    };
+
+    out_integers.clear();
+    out_scale = 0;
+
+    if (count == 0)
+        return Encoding::Plain;
+
+    const std::size_t last = first + count;
+
+    out_integers.reserve(count);
+
+    std::int64_t integer;
+    for (std::size_t i = first; i < last; ++i) {
+        if (!Utility::ParseCanonicalInteger(values[i], integer)) {
+            out_integers.clear();
+            break;
+        }
+        out_integers.push_back(integer);
+    }
+
+    if (out_integers.size() == count)
+        return Encoding::Delta;
+
+    /// Prices and ratios: scaled to the largest number of fractional digits
+    /// in the block, as long as every value still fits
+    std::vector<unsigned int> scales;
+    scales.reserve(count);
+
+    unsigned int scale;
+    for (std::size_t i = first; i < last; ++i) {
+        if (!ParseDecimal(values[i], integer, scale))
+            break;
+        out_integers.push_back(integer);
+        scales.push_back(scale);
+        out_scale = std::max(out_scale, scale);
+    }
+
+    bool isDecimal = out_integers.size() == count;
+    for (std::size_t i = 0; isDecimal && i < count; ++i) {
+        const std::int64_t limit = std::numeric_limits<std::int64_t>::max()
+                / POWERS_OF_TEN[out_scale - scales[i]];
+        if (out_integers[i] > limit || out_integers[i] < -limit) {
+            isDecimal = false;
+        } else {
+            out_integers[i] *= POWERS_OF_TEN[out_scale - scales[i]];
+        }
+    }
+
+    if (isDecimal)
+        return Encoding::Decimal;
+
+    out_integers.clear();
+    out_scale = 0;
+
+    const std::size_t maxDistinct = count / DICTIONARY_MIN_REPEAT;
+    std::unordered_map<std::string, std::size_t> distinct;
+
+    for (std::size_t i = first; i < last; ++i) {
+        distinct.emplace(values[i], distinct.size());
+        if (distinct.size() > maxDistinct)
+            return Encoding::Plain;
+    }
+
+    return Encoding::Dictionary;
+}
+
+void ColumnArchive::Impl::Encode(const Column &values, const std::size_t first,
+                                 const std::size_t count, Encoding &out_encoding,
+                                 std::string &out_block)
+{
+    out_block.clear();
+
+    const std::size_t last = first + count;
+
+    std::vector<std::int64_t> integers;
+    unsigned int scale;
+    out_encoding = ChooseEncoding(values, first, count, integers, scale);
+
+    switch (out_encoding) {
+    case Encoding::Decimal:
+        PutVarint(out_block, scale);
+        /// Fall through, the scaled values are delta-encoded like integers
+    case Encoding::Delta:
+    {
+        std::uint64_t previous = 0;
+        for (const auto integer : integers) {
+            const std::uint64_t current = static_cast<std::uint64_t>(integer);
+            PutVarint(out_block, ZigZagEncode(current - previous));
+            previous = current;
+        }
+    }
+        break;
+
+    case Encoding::Dictionary:
+    {
+        std::unordered_map<std::string, std::uint64_t> ids;
+        std::vector<const std::string *> entries;
+        std::string indices;
+
+        for (std::size_t i = first; i < last; ++i) {
+            auto result = ids.emplace(values[i], entries.size());
+            if (result.second)
+                entries.push_back(&result.first->first);
+            PutVarint(indices, result.first->second);
+        }
+
+        PutVarint(out_block, entries.size());
+        for (const auto entry : entries) {
+            PutString(out_block, *entry);
+        }
+        out_block.append(indices);
+    }
+        break;
+
+    case Encoding::Plain:
+        for (std::size_t i = first; i < last; ++i) {
+            PutString(out_block, values[i]);
+        }
+        break;
+    }
+}
+
+void ColumnArchive::Impl::Decode(const Encoding &encoding, const char *data, const std::size_t size,
+                                 const std::size_t rows, Column &out_values)
+{
+    out_values.reserve(out_values.size() + rows);
+
+    const char *cursor = data;
+    const char *end = data + size;
+
+    switch (encoding) {
+    case Encoding::Decimal:
+    {
+        const std::uint64_t scale = GetVarint(cursor, end);
+        if (scale > DECIMAL_MAX_DIGITS)
+            throw std::runtime_error("ColumnArchive: Corrupt decimal scale!");
+
+        std::uint64_t current = 0;
+        std::string value;
+        for (std::size_t i = 0; i < rows; ++i) {
+            current += ZigZagDecode(GetVarint(cursor, end));
+            FormatDecimal(static_cast<std::int64_t>(current), static_cast<unsigned int>(scale), value);
+            out_values.push_back(value);
+        }
+    }
+        break;
+
+    case Encoding::Delta:
+    {
+        std::uint64_t current = 0;
+        for (std::size_t i = 0; i < rows; ++i) {
+            current += ZigZagDecode(GetVarint(cursor, end));
+            out_values.push_back(std::to_string(static_cast<long long>(current)));
+        }
+    }
+        break;
+
+    case Encoding::Dictionary:
+    {
+        const std::uint64_t entryCount = GetVarint(cursor, end);
+        if (entryCount > size)
+            throw std::runtime_error("ColumnArchive: Corrupt dictionary!");
+
+        Column entries;
+        entries.reserve(static_cast<std::size_t>(entryCount));
+        for (std::uint64_t i = 0; i < entryCount; ++i) {
+            entries.push_back(GetString(cursor, end));
+        }
+
+        for (std::size_t i = 0; i < rows; ++i) {
+            const std::uint64_t id = GetVarint(cursor, end);
+            if (id >= entries.size())
+                throw std::runtime_error("ColumnArchive: Corrupt dictionary index!");
+            out_values.push_back(entries[static_cast<std::size_t>(id)]);
+        }
+    }
+        break;
+
+    case Encoding::Plain:
+        for (std::size_t i = 0; i < rows; ++i) {
+            out_values.push_back(GetString(cursor, end));
+        }
+        break;
+    }
+
+    if (cursor != end)
+        throw std::runtime_error("ColumnArchive: Trailing data in column block!");
+}
+
+std::uint32_t ColumnArchive::Impl::Checksum(const char *data, const std::size_t size)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    /// crc32() takes a uInt length
+    std::size_t offset = 0;
+    while (offset < size) {
+        const uInt chunk = static_cast<uInt>(std::min<std::size_t>(size - offset, 1u << 30));
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(data + offset), chunk);
+        offset += chunk;
+    }
+
+    return static_cast<std::uint32_t>(crc);
+}
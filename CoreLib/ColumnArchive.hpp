@@ -0,0 +1,171 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A compact, column-oriented file format for tables of text values. Rows
+ * are split into fixed-size row groups and each column of a group is stored
+ * as a separate, optionally compressed block, so readers only load and
+ * decode the columns and row ranges they ask for.
+ */
+
+
+#ifndef CORELIB_COLUMN_ARCHIVE_HPP
+#define CORELIB_COLUMN_ARCHIVE_HPP
+
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "Compression.hpp"
+
+namespace CoreLib {
+    class ColumnArchive;
+}
+
+class CoreLib::ColumnArchive
+{
+public:
+    typedef std::vector<std::string> Column;
+    typedef std::map<std::string, std::string> Properties;
+
+    class Reader;
+    class Writer;
+
+    /// Picked per block by the writer: Delta when every value is a plain
+    /// 64-bit integer, Decimal when every value is a plain decimal number
+    /// that fits a 64-bit integer once scaled, Dictionary when values
+    /// repeat a lot, Plain otherwise
+    enum class Encoding : unsigned char {
+        Plain = 0,
+        Dictionary = 1,
+        Delta = 2,
+        Decimal = 3
+    };
+
+    struct Options
+    {
+        bool Compress;
+        Compression::Algorithm CompressionAlgorithm;
+        int CompressionLevel;
+        std::size_t RowGroupRows;
+
+        Options();
+    };
+
+    struct BlockInfo
+    {
+        ColumnArchive::Encoding BlockEncoding;
+        bool IsCompressed;
+        Compression::Algorithm CompressionAlgorithm;
+        std::uint64_t Offset;
+        std::uint64_t StoredSize;
+        std::uint64_t EncodedSize;
+        std::uint32_t Checksum;
+    };
+
+    struct ColumnInfo
+    {
+        std::string Name;
+
+        /// One per row group
+        std::vector<BlockInfo> Blocks;
+    };
+
+    static const std::string FileExtension;
+
+private:
+    struct Impl;
+};
+
+class CoreLib::ColumnArchive::Writer
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    Writer();
+    explicit Writer(const Options &options);
+    ~Writer();
+
+public:
+    void SetProperty(const std::string &key, const std::string &value);
+
+    /// Every column must have the same number of values
+    void AddColumn(const std::string &name, const Column &values);
+    void AddColumn(const std::string &name, Column &&values);
+
+    /// Writes to a temporary file next to the target and renames it over,
+    /// so readers never see a partial archive
+    bool Save(const std::string &file, std::string &out_error);
+};
+
+/// Open() only reads the footer; column blocks are read and decoded on
+/// demand, either a whole column at a time or one row group at a time.
+/// Not thread-safe.
+class CoreLib::ColumnArchive::Reader
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    Reader();
+    ~Reader();
+
+public:
+    bool Open(const std::string &file, std::string &out_error);
+
+    const Properties &GetProperties() const;
+    std::size_t GetRowCount() const;
+    const std::vector<ColumnInfo> &GetColumns() const;
+
+    /// Every row group but the last holds GetRowGroupRows() rows
+    std::size_t GetRowGroupCount() const;
+    std::size_t GetRowGroupRows() const;
+
+    bool FindColumn(const std::string &name, std::size_t &out_index) const;
+
+    bool ReadColumn(const std::size_t index, Column &out_values, std::string &out_error);
+    bool ReadColumns(const std::vector<std::size_t> &indices, std::vector<Column> &out_columns,
+                     std::string &out_error);
+    bool ReadAllColumns(std::vector<Column> &out_columns, std::string &out_error);
+
+    /// Decodes only the given columns of a single row group
+    bool ReadRowGroup(const std::size_t group, const std::vector<std::size_t> &indices,
+                      std::vector<Column> &out_columns, std::string &out_error);
+};
+
+
+#endif /* CORELIB_COLUMN_ARCHIVE_HPP */
+
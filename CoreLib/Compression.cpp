@@ -29,101 +29,1225 @@
  *
  * @section DESCRIPTION
  *
- * Provides zlib, gzip and bzip2 comprission / decompression algorithms.
+ * Provides zlib, gzip, bzip2, zstd and lz4 comprission / decompression
+ * algorithms.
  */
 
 
+#include <algorithm>
+#include <limits>
+#include <istream>
+#include <ostream>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <boost/iostreams/device/array.hpp>
 #include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/iostreams/filter/bzip2.hpp>
-#include <boost/iostreams/filter/gzip.hpp>
-#include <boost/iostreams/filter/zlib.hpp>
 #include <boost/iostreams/filtering_streambuf.hpp>
+#include <zlib.h>
+#if defined ( HAS_ZSTD )
+#include <zdict.h>
+#include <zstd.h>
+#endif  // defined ( HAS_ZSTD )
+#if defined ( HAS_LZ4 )
+#include <lz4frame.h>
+#endif  // defined ( HAS_LZ4 )
 #include "Compression.hpp"
+#include "Exception.hpp"
 #include "Log.hpp"
+#include "make_unique.hpp"
 
-#define     COMP_ERROR          "Unknow compression error!";
-#define     DECOMP_ERROR        "Unknow decompression error!";
+#define     COMP_ERROR              "Unknow compression error!"
+#define     DECOMP_ERROR            "Unknow decompression error!"
+#define     UNSUPPORTED_ERROR       "Compression algorithm is not supported by this build!"
+
+#define     ZLIB_WINDOW_BITS        15
+#define     ZLIB_GZIP_WINDOW_BITS   (ZLIB_WINDOW_BITS + 16)
+#define     ZLIB_MEMORY_LEVEL       8
+#define     ZLIB_MAX_CHUNK          static_cast<size_t>(UINT_MAX)
+#define     GZIP_TRAILER_SIZE       8
+
+#define     DECOMP_MIN_OUTPUT       (64 * 1024)
+/// Sizes declared by the input are only trusted up to this multiple of it
+#define     DECOMP_MAX_SIZE_RATIO   32
+#define     STREAM_CHUNK_SIZE       (256 * 1024)
 
 using namespace std;
 using namespace boost;
 using namespace CoreLib;
 
+struct Compression::Impl
+{
+    template <typename Container>
+    static char *At(Container &container, const size_t offset);
+
+    template <typename Container>
+    static void Grow(Container &container);
+
+    template <typename Container>
+    static void Reserve(Container &container, const size_t size);
+
+    static size_t SizeHint(const size_t declared, const size_t inputSize);
+};
+
+struct Compression::Compressor::Impl
+{
+    Algorithm CompressionAlgorithm;
+    int Level;
+    const Dictionary *CompressionDictionary;
+
+    bool ZlibInitialized;
+    z_stream ZlibStream;
+
+#if defined ( HAS_ZSTD )
+    std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> ZstdContext;
+#endif  // defined ( HAS_ZSTD )
+
+#if defined ( HAS_LZ4 )
+    std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t (*)(LZ4F_cctx *)> Lz4Context;
+#endif  // defined ( HAS_LZ4 )
+
+    Impl(const Algorithm &algorithm, const int level, const Dictionary *dictionary);
+    ~Impl();
+
+    void Compress(const char *data, size_t size, Buffer &out_compressedBuffer);
+
+    void ZlibCompress(const char *data, size_t size, Buffer &out_compressedBuffer);
+    void Bzip2Compress(const char *data, size_t size, Buffer &out_compressedBuffer);
+    void ZstdCompress(const char *data, size_t size, Buffer &out_compressedBuffer);
+    void Lz4Compress(const char *data, size_t size, Buffer &out_compressedBuffer);
+
+    void Compress(std::istream &input, std::ostream &output);
+
+    void ZlibCompress(std::istream &input, std::ostream &output);
+    void Bzip2Compress(std::istream &input, std::ostream &output);
+    void ZstdCompress(std::istream &input, std::ostream &output);
+    void Lz4Compress(std::istream &input, std::ostream &output);
+
+    void ZlibBegin();
+    static size_t ReadChunk(std::istream &input, Buffer &chunk, bool &out_isLast);
+    static void WriteChunk(std::ostream &output, const char *data, size_t size);
+};
+
+struct Compression::Decompressor::Impl
+{
+    Algorithm CompressionAlgorithm;
+    const Dictionary *CompressionDictionary;
+
+    bool ZlibInitialized;
+    z_stream ZlibStream;
+
+#if defined ( HAS_ZSTD )
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> ZstdContext;
+#endif  // defined ( HAS_ZSTD )
+
+#if defined ( HAS_LZ4 )
+    std::unique_ptr<LZ4F_dctx, LZ4F_errorCode_t (*)(LZ4F_dctx *)> Lz4Context;
+#endif  // defined ( HAS_LZ4 )
+
+    Impl(const Algorithm &algorithm, const Dictionary *dictionary);
+    ~Impl();
+
+    template <typename Container>
+    void Decompress(const char *data, size_t size, Container &out_uncompressed);
+
+    template <typename Container>
+    void ZlibDecompress(const char *data, size_t size, Container &out_uncompressed);
+    template <typename Container>
+    void Bzip2Decompress(const char *data, size_t size, Container &out_uncompressed);
+    template <typename Container>
+    void ZstdDecompress(const char *data, size_t size, Container &out_uncompressed);
+    template <typename Container>
+    void Lz4Decompress(const char *data, size_t size, Container &out_uncompressed);
+};
+
+struct Compression::Dictionary::Impl
+{
+    Buffer Content;
+    int Level;
+    unsigned int Id;
+
+#if defined ( HAS_ZSTD )
+    std::unique_ptr<ZSTD_CDict, size_t (*)(ZSTD_CDict *)> CompressionDictionary;
+    std::unique_ptr<ZSTD_DDict, size_t (*)(ZSTD_DDict *)> DecompressionDictionary;
+
+    Impl() :
+        CompressionDictionary(nullptr, &ZSTD_freeCDict),
+        DecompressionDictionary(nullptr, &ZSTD_freeDDict)
+    {
+
+    }
+#endif  // defined ( HAS_ZSTD )
+};
+
+constexpr int Compression::DefaultLevel;
+
+bool Compression::IsSupported(const Algorithm &algorithm)
+{
+    switch (algorithm) {
+    case Algorithm::Zlib:
+    case Algorithm::Gzip:
+    case Algorithm::Bzip2:
+        return true;
+    case Algorithm::Zstd:
+#if defined ( HAS_ZSTD )
+        return true;
+#else
+        return false;
+#endif  // defined ( HAS_ZSTD )
+    case Algorithm::Lz4:
+#if defined ( HAS_LZ4 )
+        return true;
+#else
+        return false;
+#endif  // defined ( HAS_LZ4 )
+    }
+
+    return false;
+}
+
+std::string Compression::GetFileExtension(const Algorithm &algorithm)
+{
+    switch (algorithm) {
+    case Algorithm::Zlib:
+        return ".z";
+    case Algorithm::Gzip:
+        return ".gz";
+    case Algorithm::Bzip2:
+        return ".bz2";
+    case Algorithm::Zstd:
+        return ".zst";
+    case Algorithm::Lz4:
+        return ".lz4";
+    }
+
+    return "";
+}
+
 void Compression::Compress(const char *data, size_t size,
                            Buffer &out_compressedBuffer,
                            const Algorithm &algorithm)
 {
-    const Compression::Buffer buffer(data, data + size);
-    Compress(buffer, out_compressedBuffer, algorithm);
+    Compress(data, size, out_compressedBuffer, algorithm, DefaultLevel);
 }
 
 void Compression::Compress(const std::string &dataString,
                            Buffer &out_compressedBuffer,
                            const Algorithm &algorithm)
 {
-    const Buffer buffer(dataString.begin(), dataString.end());
-    Compress(buffer, out_compressedBuffer, algorithm);
+    Compress(dataString.data(), dataString.size(), out_compressedBuffer, algorithm, DefaultLevel);
 }
 
 void Compression::Compress(const Buffer &dataBuffer,
                            Buffer &out_compressedBuffer,
                            const Algorithm &algorithm)
 {
-    try {
-        out_compressedBuffer.clear();
-        iostreams::filtering_streambuf<iostreams::output> output;
-
-        switch(algorithm) {
-        case Algorithm::Zlib:
-            output.push(iostreams::zlib_compressor());
-            break;
-        case Algorithm::Gzip:
-            output.push(iostreams::gzip_compressor());
-            break;
-        case Algorithm::Bzip2:
-            output.push(iostreams::bzip2_compressor());
-            break;
-        }
+    Compress(dataBuffer.data(), dataBuffer.size(), out_compressedBuffer, algorithm, DefaultLevel);
+}
 
-        output.push(iostreams::back_inserter(out_compressedBuffer));
-        iostreams::write(output, &dataBuffer[0], (std::streamsize)dataBuffer.size());
-    } catch(...) {
-        LOG_ERROR(COMP_ERROR)
-    }
+void Compression::Compress(const char *data, size_t size,
+                           Buffer &out_compressedBuffer,
+                           const Algorithm &algorithm, const int level)
+{
+    Compressor compressor(algorithm, level);
+    (void)compressor.Compress(data, size, out_compressedBuffer);
+}
+
+void Compression::Compress(const std::string &dataString,
+                           Buffer &out_compressedBuffer,
+                           const Algorithm &algorithm, const int level)
+{
+    Compress(dataString.data(), dataString.size(), out_compressedBuffer, algorithm, level);
+}
+
+void Compression::Compress(const Buffer &dataBuffer,
+                           Buffer &out_compressedBuffer,
+                           const Algorithm &algorithm, const int level)
+{
+    Compress(dataBuffer.data(), dataBuffer.size(), out_compressedBuffer, algorithm, level);
+}
+
+void Compression::Decompress(const char *data, size_t size,
+                             std::string &out_uncompressedString,
+                             const Algorithm &algorithm)
+{
+    Decompressor decompressor(algorithm);
+    (void)decompressor.Decompress(data, size, out_uncompressedString);
+}
+
+void Compression::Decompress(const char *data, size_t size,
+                             Buffer &out_uncompressedBuffer,
+                             const Algorithm &algorithm)
+{
+    Decompressor decompressor(algorithm);
+    (void)decompressor.Decompress(data, size, out_uncompressedBuffer);
 }
 
 void Compression::Decompress(const Buffer &dataBuffer,
                              std::string &out_uncompressedString,
                              const Algorithm &algorithm)
 {
-    Buffer buffer;
-    Decompress(dataBuffer, buffer, algorithm);
-    out_uncompressedString = std::string(buffer.begin(), buffer.end());
+    Decompress(dataBuffer.data(), dataBuffer.size(), out_uncompressedString, algorithm);
 }
 
 void Compression::Decompress(const Buffer &dataBuffer,
                              Buffer &out_uncompressedBuffer,
                              const Algorithm &algorithm)
 {
+    Decompress(dataBuffer.data(), dataBuffer.size(), out_uncompressedBuffer, algorithm);
+}
+
+void Compression::Compress(const char *data, size_t size,
+                           Buffer &out_compressedBuffer,
+                           const Dictionary &dictionary)
+{
+    Compressor compressor(dictionary);
+    (void)compressor.Compress(data, size, out_compressedBuffer);
+}
+
+void Compression::Compress(const Buffer &dataBuffer,
+                           Buffer &out_compressedBuffer,
+                           const Dictionary &dictionary)
+{
+    Compress(dataBuffer.data(), dataBuffer.size(), out_compressedBuffer, dictionary);
+}
+
+void Compression::Decompress(const char *data, size_t size,
+                             std::string &out_uncompressedString,
+                             const Dictionary &dictionary)
+{
+    Decompressor decompressor(dictionary);
+    (void)decompressor.Decompress(data, size, out_uncompressedString);
+}
+
+void Compression::Decompress(const char *data, size_t size,
+                             Buffer &out_uncompressedBuffer,
+                             const Dictionary &dictionary)
+{
+    Decompressor decompressor(dictionary);
+    (void)decompressor.Decompress(data, size, out_uncompressedBuffer);
+}
+
+void Compression::Decompress(const Buffer &dataBuffer,
+                             std::string &out_uncompressedString,
+                             const Dictionary &dictionary)
+{
+    Decompress(dataBuffer.data(), dataBuffer.size(), out_uncompressedString, dictionary);
+}
+
+void Compression::Decompress(const Buffer &dataBuffer,
+                             Buffer &out_uncompressedBuffer,
+                             const Dictionary &dictionary)
+{
+    Decompress(dataBuffer.data(), dataBuffer.size(), out_uncompressedBuffer, dictionary);
+}
+
+Compression::Compressor::Compressor(const Algorithm &algorithm, const int level) :
+    m_pimpl(std::make_unique<Compressor::Impl>(algorithm, level, nullptr))
+{
+
+}
+
+Compression::Compressor::Compressor(const Dictionary &dictionary) :
+    m_pimpl(std::make_unique<Compressor::Impl>(Algorithm::Zstd, dictionary.GetLevel(),
+                                               &dictionary))
+{
+
+}
+
+Compression::Compressor::~Compressor() = default;
+
+const Compression::Algorithm &Compression::Compressor::GetAlgorithm() const
+{
+    return m_pimpl->CompressionAlgorithm;
+}
+
+int Compression::Compressor::GetLevel() const
+{
+    return m_pimpl->Level;
+}
+
+bool Compression::Compressor::Compress(const char *data, size_t size,
+                                       Buffer &out_compressedBuffer)
+{
+    std::string error;
+    if (!Compress(data, size, out_compressedBuffer, error)) {
+        LOG_ERROR(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool Compression::Compressor::Compress(const char *data, size_t size,
+                                       Buffer &out_compressedBuffer,
+                                       std::string &out_error)
+{
+    out_error.clear();
+
     try {
-        out_uncompressedBuffer.clear();
-        iostreams::filtering_streambuf<iostreams::output> output;
-
-        switch(algorithm) {
-        case Algorithm::Zlib:
-            output.push(iostreams::zlib_decompressor());
-            break;
-        case Algorithm::Gzip:
-            output.push(iostreams::gzip_decompressor());
-            break;
-        case Algorithm::Bzip2:
-            output.push(iostreams::bzip2_decompressor());
-            break;
-        }
+        m_pimpl->Compress(data, size, out_compressedBuffer);
+        return true;
+    } catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    } catch(...) {
+        out_error.assign(COMP_ERROR);
+    }
+
+    out_compressedBuffer.clear();
+    return false;
+}
+
+bool Compression::Compressor::Compress(std::istream &input, std::ostream &output)
+{
+    std::string error;
+    if (!Compress(input, output, error)) {
+        LOG_ERROR(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool Compression::Compressor::Compress(std::istream &input, std::ostream &output,
+                                       std::string &out_error)
+{
+    out_error.clear();
+
+    try {
+        m_pimpl->Compress(input, output);
+        return true;
+    } catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    } catch(...) {
+        out_error.assign(COMP_ERROR);
+    }
+
+    return false;
+}
+
+Compression::Decompressor::Decompressor(const Algorithm &algorithm) :
+    m_pimpl(std::make_unique<Decompressor::Impl>(algorithm, nullptr))
+{
+
+}
+
+Compression::Decompressor::Decompressor(const Dictionary &dictionary) :
+    m_pimpl(std::make_unique<Decompressor::Impl>(Algorithm::Zstd, &dictionary))
+{
+
+}
+
+Compression::Decompressor::~Decompressor() = default;
+
+const Compression::Algorithm &Compression::Decompressor::GetAlgorithm() const
+{
+    return m_pimpl->CompressionAlgorithm;
+}
+
+bool Compression::Decompressor::Decompress(const char *data, size_t size,
+                                           Buffer &out_uncompressedBuffer)
+{
+    std::string error;
+    if (!Decompress(data, size, out_uncompressedBuffer, error)) {
+        LOG_ERROR(error);
+        return false;
+    }
+
+    return true;
+}
+
+bool Compression::Decompressor::Decompress(const char *data, size_t size,
+                                           Buffer &out_uncompressedBuffer,
+                                           std::string &out_error)
+{
+    out_error.clear();
+
+    try {
+        m_pimpl->Decompress(data, size, out_uncompressedBuffer);
+        return true;
+    } catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    } catch(...) {
+        out_error.assign(DECOMP_ERROR);
+    }
+
+    out_uncompressedBuffer.clear();
+    return false;
+}
+
+bool Compression::Decompressor::Decompress(const char *data, size_t size,
+                                           std::string &out_uncompressedString)
+{
+    std::string error;
+    if (!Decompress(data, size, out_uncompressedString, error)) {
+        LOG_ERROR(error);
+        return false;
+    }
+
+    return true;
+}
 
-        output.push(iostreams::back_inserter(out_uncompressedBuffer));
-        iostreams::write(output, &dataBuffer[0], (streamsize)dataBuffer.size());
+bool Compression::Decompressor::Decompress(const char *data, size_t size,
+                                           std::string &out_uncompressedString,
+                                           std::string &out_error)
+{
+    out_error.clear();
+
+    try {
+        m_pimpl->Decompress(data, size, out_uncompressedString);
+        return true;
+    } catch (const std::exception &ex) {
+        out_error.assign(ex.what());
     } catch(...) {
-        LOG_ERROR(DECOMP_ERROR)
+        out_error.assign(DECOMP_ERROR);
+    }
+
+    out_uncompressedString.clear();
+    return false;
+}
+
+bool Compression::Dictionary::Train(const std::vector<Buffer> &samples, const std::size_t capacity,
+                                    Buffer &out_dictionary)
+{
+    std::string error;
+    return Train(samples, capacity, out_dictionary, error);
+}
+
+bool Compression::Dictionary::Train(const std::vector<Buffer> &samples, const std::size_t capacity,
+                                    Buffer &out_dictionary, std::string &out_error)
+{
+    out_dictionary.clear();
+    out_error.clear();
+
+#if defined ( HAS_ZSTD )
+    /// The trainer takes the samples back to back plus their sizes
+    Buffer concatenated;
+    std::vector<size_t> sizes;
+    sizes.reserve(samples.size());
+
+    for (const auto &sample : samples) {
+        concatenated.insert(concatenated.end(), sample.begin(), sample.end());
+        sizes.push_back(sample.size());
+    }
+
+    out_dictionary.resize(capacity);
+
+    const size_t result = ZDICT_trainFromBuffer(out_dictionary.data(), out_dictionary.size(),
+                                                concatenated.data(), sizes.data(),
+                                                static_cast<unsigned int>(sizes.size()));
+    if (ZDICT_isError(result)) {
+        out_dictionary.clear();
+        out_error.assign(ZDICT_getErrorName(result));
+        return false;
     }
+
+    out_dictionary.resize(result);
+
+    return true;
+#else
+    (void)samples;
+    (void)capacity;
+    out_error.assign(UNSUPPORTED_ERROR);
+    return false;
+#endif  // defined ( HAS_ZSTD )
 }
 
+Compression::Dictionary::Dictionary(const Buffer &content, const int level) :
+    m_pimpl(std::make_unique<Dictionary::Impl>())
+{
+    m_pimpl->Content = content;
+    m_pimpl->Level = level;
+    m_pimpl->Id = 0;
+
+#if defined ( HAS_ZSTD )
+    if (level == DefaultLevel)
+        m_pimpl->Level = ZSTD_CLEVEL_DEFAULT;
+
+    m_pimpl->CompressionDictionary.reset(ZSTD_createCDict(m_pimpl->Content.data(),
+                                                          m_pimpl->Content.size(),
+                                                          m_pimpl->Level));
+    m_pimpl->DecompressionDictionary.reset(ZSTD_createDDict(m_pimpl->Content.data(),
+                                                            m_pimpl->Content.size()));
+
+    if (!m_pimpl->CompressionDictionary || !m_pimpl->DecompressionDictionary)
+        throw CoreLib::Exception("Compression::Dictionary: Invalid zstd dictionary!");
+
+    m_pimpl->Id = ZSTD_getDictID_fromDict(m_pimpl->Content.data(), m_pimpl->Content.size());
+#else
+    throw CoreLib::Exception(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_ZSTD )
+}
+
+Compression::Dictionary::~Dictionary() = default;
+
+const Compression::Buffer &Compression::Dictionary::GetContent() const
+{
+    return m_pimpl->Content;
+}
+
+unsigned int Compression::Dictionary::GetId() const
+{
+    return m_pimpl->Id;
+}
+
+int Compression::Dictionary::GetLevel() const
+{
+    return m_pimpl->Level;
+}
+
+template <typename Container>
+char *Compression::Impl::At(Container &container, const size_t offset)
+{
+    return &container[0] + offset;
+}
+
+template <typename Container>
+void Compression::Impl::Grow(Container &container)
+{
+    container.resize(std::max<size_t>(container.size() * 2, DECOMP_MIN_OUTPUT));
+}
+
+template <typename Container>
+void Compression::Impl::Reserve(Container &container, const size_t size)
+{
+    /// Whatever the container already holds costs nothing to reuse
+    container.resize(std::max<size_t>(std::max<size_t>(size, container.capacity()), 1));
+}
+
+size_t Compression::Impl::SizeHint(const size_t declared, const size_t inputSize)
+{
+    /// A forged header must not buy a huge allocation; real data that
+    /// expands further is handled by Grow()
+    const size_t limit = inputSize > std::numeric_limits<size_t>::max() / DECOMP_MAX_SIZE_RATIO
+            ? std::numeric_limits<size_t>::max()
+            : std::max<size_t>(inputSize * DECOMP_MAX_SIZE_RATIO, DECOMP_MIN_OUTPUT);
+    return std::min(declared, limit);
+}
+
+Compression::Compressor::Impl::Impl(const Algorithm &algorithm, const int level,
+                                    const Dictionary *dictionary) :
+    CompressionAlgorithm(algorithm),
+    Level(level),
+    CompressionDictionary(dictionary),
+    ZlibInitialized(false)
+#if defined ( HAS_ZSTD )
+    , ZstdContext(nullptr, &ZSTD_freeCCtx)
+#endif  // defined ( HAS_ZSTD )
+#if defined ( HAS_LZ4 )
+    , Lz4Context(nullptr, &LZ4F_freeCompressionContext)
+#endif  // defined ( HAS_LZ4 )
+{
+    std::memset(&ZlibStream, 0, sizeof(ZlibStream));
+}
+
+Compression::Compressor::Impl::~Impl()
+{
+    if (ZlibInitialized)
+        deflateEnd(&ZlibStream);
+}
+
+void Compression::Compressor::Impl::Compress(const char *data, size_t size,
+                                             Buffer &out_compressedBuffer)
+{
+    switch (CompressionAlgorithm) {
+    case Algorithm::Zlib:
+    case Algorithm::Gzip:
+        ZlibCompress(data, size, out_compressedBuffer);
+        break;
+    case Algorithm::Bzip2:
+        Bzip2Compress(data, size, out_compressedBuffer);
+        break;
+    case Algorithm::Zstd:
+        ZstdCompress(data, size, out_compressedBuffer);
+        break;
+    case Algorithm::Lz4:
+        Lz4Compress(data, size, out_compressedBuffer);
+        break;
+    }
+}
+
+void Compression::Compressor::Impl::ZlibCompress(const char *data, size_t size,
+                                                 Buffer &out_compressedBuffer)
+{
+    ZlibBegin();
+
+    out_compressedBuffer.resize(deflateBound(&ZlibStream, static_cast<uLong>(size)));
+
+    size_t consumed = 0;
+    size_t produced = 0;
+    int result = Z_OK;
+
+    /// Inputs and outputs beyond 4 GiB are fed to zlib in uInt slices
+    while (result != Z_STREAM_END) {
+        if (produced == out_compressedBuffer.size())
+            Compression::Impl::Grow(out_compressedBuffer);
+
+        const size_t inputSize = std::min(size - consumed, ZLIB_MAX_CHUNK);
+        const size_t outputSize = std::min(out_compressedBuffer.size() - produced, ZLIB_MAX_CHUNK);
+
+        ZlibStream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data)) + consumed;
+        ZlibStream.avail_in = static_cast<uInt>(inputSize);
+        ZlibStream.next_out = reinterpret_cast<Bytef *>(
+                    Compression::Impl::At(out_compressedBuffer, produced));
+        ZlibStream.avail_out = static_cast<uInt>(outputSize);
+
+        result = deflate(&ZlibStream, consumed + inputSize == size ? Z_FINISH : Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            throw std::runtime_error(ZlibStream.msg != nullptr ? ZlibStream.msg : zError(result));
+
+        consumed += inputSize - ZlibStream.avail_in;
+        produced += outputSize - ZlibStream.avail_out;
+    }
+
+    out_compressedBuffer.resize(produced);
+}
+
+void Compression::Compressor::Impl::Bzip2Compress(const char *data, size_t size,
+                                                  Buffer &out_compressedBuffer)
+{
+    /// libbz2 cannot reset a stream, so there is no state worth keeping
+    out_compressedBuffer.clear();
+
+    iostreams::filtering_streambuf<iostreams::output> output;
+    output.push(iostreams::bzip2_compressor(
+                    Level == DefaultLevel ? iostreams::bzip2::default_block_size : Level));
+    output.push(iostreams::back_inserter(out_compressedBuffer));
+    iostreams::write(output, data, static_cast<std::streamsize>(size));
+}
+
+void Compression::Compressor::Impl::ZstdCompress(const char *data, size_t size,
+                                                 Buffer &out_compressedBuffer)
+{
+#if defined ( HAS_ZSTD )
+    if (!ZstdContext) {
+        ZstdContext.reset(ZSTD_createCCtx());
+        if (!ZstdContext)
+            throw std::bad_alloc();
+    }
+
+    out_compressedBuffer.resize(ZSTD_compressBound(size));
+
+    const size_t result = CompressionDictionary != nullptr
+            ? ZSTD_compress_usingCDict(ZstdContext.get(),
+                                       out_compressedBuffer.data(), out_compressedBuffer.size(),
+                                       data, size,
+                                       CompressionDictionary->m_pimpl->CompressionDictionary.get())
+            : ZSTD_compressCCtx(ZstdContext.get(),
+                                out_compressedBuffer.data(), out_compressedBuffer.size(),
+                                data, size,
+                                Level == DefaultLevel ? ZSTD_CLEVEL_DEFAULT : Level);
+
+    if (ZSTD_isError(result))
+        throw std::runtime_error(ZSTD_getErrorName(result));
+
+    out_compressedBuffer.resize(result);
+#else
+    (void)data;
+    (void)size;
+    (void)out_compressedBuffer;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_ZSTD )
+}
+
+void Compression::Compressor::Impl::Lz4Compress(const char *data, size_t size,
+                                                Buffer &out_compressedBuffer)
+{
+#if defined ( HAS_LZ4 )
+    if (!Lz4Context) {
+        LZ4F_cctx *context = nullptr;
+        const size_t result = LZ4F_createCompressionContext(&context, LZ4F_VERSION);
+        if (LZ4F_isError(result))
+            throw std::runtime_error(LZ4F_getErrorName(result));
+        Lz4Context.reset(context);
+    }
+
+    LZ4F_preferences_t preferences;
+    std::memset(&preferences, 0, sizeof(preferences));
+    preferences.compressionLevel = Level == DefaultLevel ? 0 : Level;
+    preferences.frameInfo.contentSize = size;
+    preferences.autoFlush = 1;
+
+    out_compressedBuffer.resize(LZ4F_HEADER_SIZE_MAX + LZ4F_compressBound(size, &preferences));
+
+    size_t produced = LZ4F_compressBegin(Lz4Context.get(),
+                                         out_compressedBuffer.data(), out_compressedBuffer.size(),
+                                         &preferences);
+    if (LZ4F_isError(produced))
+        throw std::runtime_error(LZ4F_getErrorName(produced));
+
+    size_t result = LZ4F_compressUpdate(Lz4Context.get(),
+                                        out_compressedBuffer.data() + produced,
+                                        out_compressedBuffer.size() - produced,
+                                        data, size, nullptr);
+    if (LZ4F_isError(result))
+        throw std::runtime_error(LZ4F_getErrorName(result));
+    produced += result;
+
+    result = LZ4F_compressEnd(Lz4Context.get(),
+                              out_compressedBuffer.data() + produced,
+                              out_compressedBuffer.size() - produced,
+                              nullptr);
+    if (LZ4F_isError(result))
+        throw std::runtime_error(LZ4F_getErrorName(result));
+    produced += result;
+
+    out_compressedBuffer.resize(produced);
+#else
+    (void)data;
+    (void)size;
+    (void)out_compressedBuffer;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_LZ4 )
+}
+
+void Compression::Compressor::Impl::Compress(std::istream &input, std::ostream &output)
+{
+    switch (CompressionAlgorithm) {
+    case Algorithm::Zlib:
+    case Algorithm::Gzip:
+        ZlibCompress(input, output);
+        break;
+    case Algorithm::Bzip2:
+        Bzip2Compress(input, output);
+        break;
+    case Algorithm::Zstd:
+        ZstdCompress(input, output);
+        break;
+    case Algorithm::Lz4:
+        Lz4Compress(input, output);
+        break;
+    }
+
+    output.flush();
+    if (!output)
+        throw std::runtime_error(COMP_ERROR);
+}
+
+void Compression::Compressor::Impl::ZlibCompress(std::istream &input, std::ostream &output)
+{
+    ZlibBegin();
+
+    Buffer chunk(STREAM_CHUNK_SIZE);
+    Buffer compressed(STREAM_CHUNK_SIZE);
+    bool isLast = false;
+
+    while (!isLast) {
+        const size_t size = ReadChunk(input, chunk, isLast);
+
+        ZlibStream.next_in = reinterpret_cast<Bytef *>(chunk.data());
+        ZlibStream.avail_in = static_cast<uInt>(size);
+
+        /// Until deflate leaves room in the output, it has more to give
+        do {
+            ZlibStream.next_out = reinterpret_cast<Bytef *>(compressed.data());
+            ZlibStream.avail_out = static_cast<uInt>(compressed.size());
+
+            const int result = deflate(&ZlibStream, isLast ? Z_FINISH : Z_NO_FLUSH);
+            if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+                throw std::runtime_error(ZlibStream.msg != nullptr ? ZlibStream.msg : zError(result));
+
+            WriteChunk(output, compressed.data(), compressed.size() - ZlibStream.avail_out);
+        } while (ZlibStream.avail_out == 0);
+    }
+}
+
+void Compression::Compressor::Impl::Bzip2Compress(std::istream &input, std::ostream &output)
+{
+    Buffer chunk(STREAM_CHUNK_SIZE);
+    bool isLast = false;
+
+    iostreams::filtering_streambuf<iostreams::output> compressed;
+    compressed.push(iostreams::bzip2_compressor(
+                        Level == DefaultLevel ? iostreams::bzip2::default_block_size : Level));
+    compressed.push(output);
+
+    while (!isLast) {
+        const size_t size = ReadChunk(input, chunk, isLast);
+        iostreams::write(compressed, chunk.data(), static_cast<std::streamsize>(size));
+    }
+
+    /// Writes out the end of the bzip2 stream
+    compressed.reset();
+}
+
+void Compression::Compressor::Impl::ZstdCompress(std::istream &input, std::ostream &output)
+{
+#if defined ( HAS_ZSTD )
+    if (!ZstdContext) {
+        ZstdContext.reset(ZSTD_createCCtx());
+        if (!ZstdContext)
+            throw std::bad_alloc();
+    }
+
+    ZSTD_CCtx_reset(ZstdContext.get(), ZSTD_reset_session_and_parameters);
+
+    const size_t setup = CompressionDictionary != nullptr
+            ? ZSTD_CCtx_refCDict(ZstdContext.get(),
+                                 CompressionDictionary->m_pimpl->CompressionDictionary.get())
+            : ZSTD_CCtx_setParameter(ZstdContext.get(), ZSTD_c_compressionLevel,
+                                     Level == DefaultLevel ? ZSTD_CLEVEL_DEFAULT : Level);
+    if (ZSTD_isError(setup))
+        throw std::runtime_error(ZSTD_getErrorName(setup));
+
+    Buffer chunk(STREAM_CHUNK_SIZE);
+    Buffer compressed(ZSTD_CStreamOutSize());
+    bool isLast = false;
+
+    while (!isLast) {
+        const size_t size = ReadChunk(input, chunk, isLast);
+
+        ZSTD_inBuffer in = { chunk.data(), size, 0 };
+        bool isDone = false;
+
+        while (!isDone) {
+            ZSTD_outBuffer out = { compressed.data(), compressed.size(), 0 };
+
+            const size_t remaining = ZSTD_compressStream2(ZstdContext.get(), &out, &in,
+                                                          isLast ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(remaining))
+                throw std::runtime_error(ZSTD_getErrorName(remaining));
+
+            WriteChunk(output, compressed.data(), out.pos);
+
+            /// The last chunk is done once the frame epilogue is flushed too
+            isDone = isLast ? remaining == 0 : in.pos == in.size;
+        }
+    }
+#else
+    (void)input;
+    (void)output;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_ZSTD )
+}
+
+void Compression::Compressor::Impl::Lz4Compress(std::istream &input, std::ostream &output)
+{
+#if defined ( HAS_LZ4 )
+    if (!Lz4Context) {
+        LZ4F_cctx *context = nullptr;
+        const size_t result = LZ4F_createCompressionContext(&context, LZ4F_VERSION);
+        if (LZ4F_isError(result))
+            throw std::runtime_error(LZ4F_getErrorName(result));
+        Lz4Context.reset(context);
+    }
+
+    /// The content size is unknown up-front, so the frame header leaves it out
+    LZ4F_preferences_t preferences;
+    std::memset(&preferences, 0, sizeof(preferences));
+    preferences.compressionLevel = Level == DefaultLevel ? 0 : Level;
+
+    Buffer chunk(STREAM_CHUNK_SIZE);
+    Buffer compressed(std::max<size_t>(LZ4F_compressBound(STREAM_CHUNK_SIZE, &preferences),
+                                       LZ4F_HEADER_SIZE_MAX));
+    bool isLast = false;
+
+    size_t result = LZ4F_compressBegin(Lz4Context.get(),
+                                       compressed.data(), compressed.size(),
+                                       &preferences);
+    if (LZ4F_isError(result))
+        throw std::runtime_error(LZ4F_getErrorName(result));
+    WriteChunk(output, compressed.data(), result);
+
+    while (!isLast) {
+        const size_t size = ReadChunk(input, chunk, isLast);
+
+        result = LZ4F_compressUpdate(Lz4Context.get(),
+                                     compressed.data(), compressed.size(),
+                                     chunk.data(), size, nullptr);
+        if (LZ4F_isError(result))
+            throw std::runtime_error(LZ4F_getErrorName(result));
+        WriteChunk(output, compressed.data(), result);
+    }
+
+    result = LZ4F_compressEnd(Lz4Context.get(),
+                              compressed.data(), compressed.size(),
+                              nullptr);
+    if (LZ4F_isError(result))
+        throw std::runtime_error(LZ4F_getErrorName(result));
+    WriteChunk(output, compressed.data(), result);
+#else
+    (void)input;
+    (void)output;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_LZ4 )
+}
+
+void Compression::Compressor::Impl::ZlibBegin()
+{
+    if (!ZlibInitialized) {
+        const int result = deflateInit2(&ZlibStream,
+                                        Level == DefaultLevel ? Z_DEFAULT_COMPRESSION : Level,
+                                        Z_DEFLATED,
+                                        CompressionAlgorithm == Algorithm::Gzip
+                                        ? ZLIB_GZIP_WINDOW_BITS : ZLIB_WINDOW_BITS,
+                                        ZLIB_MEMORY_LEVEL, Z_DEFAULT_STRATEGY);
+        if (result != Z_OK)
+            throw std::runtime_error(ZlibStream.msg != nullptr ? ZlibStream.msg : zError(result));
+        ZlibInitialized = true;
+    } else {
+        deflateReset(&ZlibStream);
+    }
+}
+
+size_t Compression::Compressor::Impl::ReadChunk(std::istream &input, Buffer &chunk, bool &out_isLast)
+{
+    input.read(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+
+    if (input.bad())
+        throw std::runtime_error(COMP_ERROR);
+
+    /// A short read means the end of the input has been reached
+    out_isLast = input.eof();
+
+    return static_cast<size_t>(input.gcount());
+}
+
+void Compression::Compressor::Impl::WriteChunk(std::ostream &output, const char *data, size_t size)
+{
+    if (size == 0)
+        return;
+
+    output.write(data, static_cast<std::streamsize>(size));
+
+    if (!output)
+        throw std::runtime_error(COMP_ERROR);
+}
+
+Compression::Decompressor::Impl::Impl(const Algorithm &algorithm, const Dictionary *dictionary) :
+    CompressionAlgorithm(algorithm),
+    CompressionDictionary(dictionary),
+    ZlibInitialized(false)
+#if defined ( HAS_ZSTD )
+    , ZstdContext(nullptr, &ZSTD_freeDCtx)
+#endif  // defined ( HAS_ZSTD )
+#if defined ( HAS_LZ4 )
+    , Lz4Context(nullptr, &LZ4F_freeDecompressionContext)
+#endif  // defined ( HAS_LZ4 )
+{
+    std::memset(&ZlibStream, 0, sizeof(ZlibStream));
+}
+
+Compression::Decompressor::Impl::~Impl()
+{
+    if (ZlibInitialized)
+        inflateEnd(&ZlibStream);
+}
+
+template <typename Container>
+void Compression::Decompressor::Impl::Decompress(const char *data, size_t size,
+                                                 Container &out_uncompressed)
+{
+    switch (CompressionAlgorithm) {
+    case Algorithm::Zlib:
+    case Algorithm::Gzip:
+        ZlibDecompress(data, size, out_uncompressed);
+        break;
+    case Algorithm::Bzip2:
+        Bzip2Decompress(data, size, out_uncompressed);
+        break;
+    case Algorithm::Zstd:
+        ZstdDecompress(data, size, out_uncompressed);
+        break;
+    case Algorithm::Lz4:
+        Lz4Decompress(data, size, out_uncompressed);
+        break;
+    }
+}
+
+template <typename Container>
+void Compression::Decompressor::Impl::ZlibDecompress(const char *data, size_t size,
+                                                     Container &out_uncompressed)
+{
+    if (!ZlibInitialized) {
+        const int result = inflateInit2(&ZlibStream,
+                                        CompressionAlgorithm == Algorithm::Gzip
+                                        ? ZLIB_GZIP_WINDOW_BITS : ZLIB_WINDOW_BITS);
+        if (result != Z_OK)
+            throw std::runtime_error(ZlibStream.msg != nullptr ? ZlibStream.msg : zError(result));
+        ZlibInitialized = true;
+    } else {
+        inflateReset(&ZlibStream);
+    }
+
+    /// A gzip member ends with the uncompressed size modulo 2^32; it is
+    /// only a hint, since nothing checks it before inflating
+    size_t expected = size * 4;
+    if (CompressionAlgorithm == Algorithm::Gzip && size >= GZIP_TRAILER_SIZE) {
+        const unsigned char *trailer = reinterpret_cast<const unsigned char *>(data) + size - 4;
+        expected = static_cast<size_t>(trailer[0])
+                | static_cast<size_t>(trailer[1]) << 8
+                | static_cast<size_t>(trailer[2]) << 16
+                | static_cast<size_t>(trailer[3]) << 24;
+    }
+    Compression::Impl::Reserve(out_uncompressed, Compression::Impl::SizeHint(expected, size));
+
+    size_t consumed = 0;
+    size_t produced = 0;
+    int result = Z_OK;
+
+    while (result != Z_STREAM_END) {
+        if (produced == out_uncompressed.size())
+            Compression::Impl::Grow(out_uncompressed);
+
+        const size_t inputSize = std::min(size - consumed, ZLIB_MAX_CHUNK);
+        const size_t outputSize = std::min(out_uncompressed.size() - produced, ZLIB_MAX_CHUNK);
+
+        ZlibStream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data)) + consumed;
+        ZlibStream.avail_in = static_cast<uInt>(inputSize);
+        ZlibStream.next_out = reinterpret_cast<Bytef *>(
+                    Compression::Impl::At(out_uncompressed, produced));
+        ZlibStream.avail_out = static_cast<uInt>(outputSize);
+
+        result = inflate(&ZlibStream, Z_NO_FLUSH);
+        if (result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+            throw std::runtime_error(ZlibStream.msg != nullptr ? ZlibStream.msg : zError(result));
+
+        consumed += inputSize - ZlibStream.avail_in;
+        produced += outputSize - ZlibStream.avail_out;
+
+        /// No progress despite room to write means the input ran out
+        if (result == Z_BUF_ERROR && produced < out_uncompressed.size())
+            throw std::runtime_error("Truncated zlib stream!");
+    }
+
+    out_uncompressed.resize(produced);
+}
+
+template <typename Container>
+void Compression::Decompressor::Impl::Bzip2Decompress(const char *data, size_t size,
+                                                      Container &out_uncompressed)
+{
+    out_uncompressed.clear();
+
+    iostreams::filtering_streambuf<iostreams::output> output;
+    output.push(iostreams::bzip2_decompressor());
+    output.push(iostreams::back_inserter(out_uncompressed));
+    iostreams::write(output, data, static_cast<std::streamsize>(size));
+}
+
+template <typename Container>
+void Compression::Decompressor::Impl::ZstdDecompress(const char *data, size_t size,
+                                                     Container &out_uncompressed)
+{
+#if defined ( HAS_ZSTD )
+    if (!ZstdContext) {
+        ZstdContext.reset(ZSTD_createDCtx());
+        if (!ZstdContext)
+            throw std::bad_alloc();
+
+        if (CompressionDictionary != nullptr) {
+            const size_t result = ZSTD_DCtx_refDDict(
+                        ZstdContext.get(),
+                        CompressionDictionary->m_pimpl->DecompressionDictionary.get());
+            if (ZSTD_isError(result))
+                throw std::runtime_error(ZSTD_getErrorName(result));
+        }
+    } else {
+        /// Keeps the referenced dictionary
+        ZSTD_DCtx_reset(ZstdContext.get(), ZSTD_reset_session_only);
+    }
+
+    /// Frames written by Compress() carry their size, which usually allows
+    /// a single allocation; anything else is streamed into a growing buffer
+    const unsigned long long contentSize = ZSTD_getFrameContentSize(data, size);
+    if (contentSize == ZSTD_CONTENTSIZE_ERROR)
+        throw std::runtime_error("Not a zstd frame!");
+
+    if (contentSize != ZSTD_CONTENTSIZE_UNKNOWN)
+        Compression::Impl::Reserve(out_uncompressed,
+                                   Compression::Impl::SizeHint(static_cast<size_t>(contentSize), size));
+    else
+        Compression::Impl::Reserve(out_uncompressed, ZSTD_DStreamOutSize());
+
+    ZSTD_inBuffer input = { data, size, 0 };
+    size_t produced = 0;
+    size_t result = 1;
+
+    while (input.pos < input.size || result != 0) {
+        if (produced == out_uncompressed.size())
+            Compression::Impl::Grow(out_uncompressed);
+
+        ZSTD_outBuffer output = { Compression::Impl::At(out_uncompressed, produced),
+                                  out_uncompressed.size() - produced, 0 };
+        const size_t consumed = input.pos;
+
+        result = ZSTD_decompressStream(ZstdContext.get(), &output, &input);
+        if (ZSTD_isError(result))
+            throw std::runtime_error(ZSTD_getErrorName(result));
+
+        produced += output.pos;
+
+        if (input.pos == input.size && output.pos == 0 && consumed == input.pos && result != 0)
+            throw std::runtime_error("Truncated zstd frame!");
+    }
+
+    out_uncompressed.resize(produced);
+#else
+    (void)data;
+    (void)size;
+    (void)out_uncompressed;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_ZSTD )
+}
+
+template <typename Container>
+void Compression::Decompressor::Impl::Lz4Decompress(const char *data, size_t size,
+                                                    Container &out_uncompressed)
+{
+#if defined ( HAS_LZ4 )
+    if (!Lz4Context) {
+        LZ4F_dctx *context = nullptr;
+        const size_t result = LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
+        if (LZ4F_isError(result))
+            throw std::runtime_error(LZ4F_getErrorName(result));
+        Lz4Context.reset(context);
+    } else {
+        LZ4F_resetDecompressionContext(Lz4Context.get());
+    }
+
+    LZ4F_frameInfo_t frameInfo;
+    size_t consumed = size;
+    size_t result = LZ4F_getFrameInfo(Lz4Context.get(), &frameInfo, data, &consumed);
+    if (LZ4F_isError(result))
+        throw std::runtime_error(LZ4F_getErrorName(result));
+
+    if (frameInfo.contentSize != 0)
+        Compression::Impl::Reserve(out_uncompressed,
+                                   Compression::Impl::SizeHint(static_cast<size_t>(frameInfo.contentSize), size));
+    else
+        Compression::Impl::Reserve(out_uncompressed, size * 2);
+
+    size_t produced = 0;
+
+    while (result != 0) {
+        /// Only grow once the decoder is stuck for room, so a plausible
+        /// content size never costs a second allocation
+        if (produced == out_uncompressed.size())
+            Compression::Impl::Grow(out_uncompressed);
+
+        size_t outputSize = out_uncompressed.size() - produced;
+        size_t inputSize = size - consumed;
+
+        result = LZ4F_decompress(Lz4Context.get(),
+                                 Compression::Impl::At(out_uncompressed, produced), &outputSize,
+                                 data + consumed, &inputSize, nullptr);
+        if (LZ4F_isError(result))
+            throw std::runtime_error(LZ4F_getErrorName(result));
+
+        produced += outputSize;
+        consumed += inputSize;
+
+        if (result != 0 && consumed == size && produced < out_uncompressed.size())
+            throw std::runtime_error("Truncated lz4 frame!");
+    }
+
+    out_uncompressed.resize(produced);
+#else
+    (void)data;
+    (void)size;
+    (void)out_uncompressed;
+    throw std::runtime_error(UNSUPPORTED_ERROR);
+#endif  // defined ( HAS_LZ4 )
+}
@@ -29,7 +29,8 @@
  *
  * @section DESCRIPTION
  *
- * Provides zlib, gzip and bzip2 comprission / decompression algorithms.
+ * Provides zlib, gzip, bzip2, zstd and lz4 comprission / decompression
+ * algorithms.
  */
 
 
@@ -37,8 +38,12 @@
 #define CORELIB_COMPRESSION_HPP
 
 
+#include <iosfwd>
+#include <limits>
+#include <memory>
 #include <string>
 #include <vector>
+#include <cstddef>
 
 namespace CoreLib {
 class Compression;
@@ -49,14 +54,35 @@ class CoreLib::Compression
 public:
     typedef std::vector<char> Buffer;
 
+    class Compressor;
+    class Decompressor;
+    class Dictionary;
+
 public:
+    /// Zstd and Lz4 are only available when CoreLib is built against the
+    /// respective library, see IsSupported()
     enum class Algorithm : unsigned char {
         Zlib,
         Gzip,
-        Bzip2
+        Bzip2,
+        Zstd,
+        Lz4
     };
 
+    /// Keeps the algorithm's own default; otherwise the level is passed
+    /// through: 0-9 for zlib and gzip, 1-9 (block size) for bzip2, 1-22 or
+    /// negative for zstd, and 0-12 for lz4 where 3 and up select LZ4HC
+    static constexpr int DefaultLevel = std::numeric_limits<int>::min();
+
+private:
+    struct Impl;
+
 public:
+    static bool IsSupported(const Algorithm &algorithm);
+    static std::string GetFileExtension(const Algorithm &algorithm);
+
+    /// One-shot helpers; a Compressor / Decompressor kept around avoids
+    /// setting up the algorithm's state on every call
     static void Compress(const char *data, size_t size,
                          Buffer &out_compressedBuffer,
                          const Algorithm &algorithm);
@@ -66,12 +92,130 @@ public:
     static void Compress(const Buffer &dataBuffer,
                          Buffer &out_compressedBuffer,
                          const Algorithm &algorithm);
+    static void Compress(const char *data, size_t size,
+                         Buffer &out_compressedBuffer,
+                         const Algorithm &algorithm, const int level);
+    static void Compress(const std::string &dataString,
+                         Buffer &out_compressedBuffer,
+                         const Algorithm &algorithm, const int level);
+    static void Compress(const Buffer &dataBuffer,
+                         Buffer &out_compressedBuffer,
+                         const Algorithm &algorithm, const int level);
+    static void Decompress(const char *data, size_t size,
+                           std::string &out_uncompressedString,
+                           const Algorithm &algorithm);
+    static void Decompress(const char *data, size_t size,
+                           Buffer &out_uncompressedBuffer,
+                           const Algorithm &algorithm);
     static void Decompress(const Buffer &dataBuffer,
                            std::string &out_uncompressedString,
                            const Algorithm &algorithm);
     static void Decompress(const Buffer &dataBuffer,
                            Buffer &out_uncompressedBuffer,
                            const Algorithm &algorithm);
+
+    /// Zstd with a trained dictionary; the output can only be decompressed
+    /// with the same dictionary
+    static void Compress(const char *data, size_t size,
+                         Buffer &out_compressedBuffer,
+                         const Dictionary &dictionary);
+    static void Compress(const Buffer &dataBuffer,
+                         Buffer &out_compressedBuffer,
+                         const Dictionary &dictionary);
+    static void Decompress(const char *data, size_t size,
+                           std::string &out_uncompressedString,
+                           const Dictionary &dictionary);
+    static void Decompress(const char *data, size_t size,
+                           Buffer &out_uncompressedBuffer,
+                           const Dictionary &dictionary);
+    static void Decompress(const Buffer &dataBuffer,
+                           std::string &out_uncompressedString,
+                           const Dictionary &dictionary);
+    static void Decompress(const Buffer &dataBuffer,
+                           Buffer &out_uncompressedBuffer,
+                           const Dictionary &dictionary);
+};
+
+/// A zstd dictionary, digested once for compression at a fixed level and
+/// for decompression; safe to share between threads
+class CoreLib::Compression::Dictionary
+{
+    friend class Compressor;
+    friend class Decompressor;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    /// Samples should look like the data to be compressed, e.g. earlier
+    /// snapshots; capacity is the maximum dictionary size in bytes
+    static bool Train(const std::vector<Buffer> &samples, const std::size_t capacity,
+                      Buffer &out_dictionary);
+    static bool Train(const std::vector<Buffer> &samples, const std::size_t capacity,
+                      Buffer &out_dictionary, std::string &out_error);
+
+public:
+    explicit Dictionary(const Buffer &content, const int level = DefaultLevel);
+    ~Dictionary();
+
+public:
+    const Buffer &GetContent() const;
+    unsigned int GetId() const;
+    int GetLevel() const;
+};
+
+/// Keeps the algorithm's state (zlib stream, zstd / lz4 context) alive
+/// between calls. The output is overwritten but keeps its capacity, so a
+/// buffer reused across calls stops allocating once it has grown to fit.
+/// Not thread-safe; use one per thread.
+class CoreLib::Compression::Compressor
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    explicit Compressor(const Algorithm &algorithm, const int level = DefaultLevel);
+    /// The dictionary must outlive the compressor
+    explicit Compressor(const Dictionary &dictionary);
+    ~Compressor();
+
+public:
+    const Algorithm &GetAlgorithm() const;
+    int GetLevel() const;
+
+    bool Compress(const char *data, size_t size, Buffer &out_compressedBuffer);
+    bool Compress(const char *data, size_t size, Buffer &out_compressedBuffer,
+                  std::string &out_error);
+    /// Reads the input to its end in fixed-size chunks and writes a single
+    /// compressed stream, so neither side ever has to fit in memory
+    bool Compress(std::istream &input, std::ostream &output);
+    bool Compress(std::istream &input, std::ostream &output, std::string &out_error);
+};
+
+/// The decompressing counterpart of Compressor, with the same rules
+class CoreLib::Compression::Decompressor
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    explicit Decompressor(const Algorithm &algorithm);
+    /// The dictionary must outlive the decompressor
+    explicit Decompressor(const Dictionary &dictionary);
+    ~Decompressor();
+
+public:
+    const Algorithm &GetAlgorithm() const;
+
+    bool Decompress(const char *data, size_t size, Buffer &out_uncompressedBuffer);
+    bool Decompress(const char *data, size_t size, Buffer &out_uncompressedBuffer,
+                    std::string &out_error);
+    bool Decompress(const char *data, size_t size, std::string &out_uncompressedString);
+    bool Decompress(const char *data, size_t size, std::string &out_uncompressedString,
+                    std::string &out_error);
 };
 
 
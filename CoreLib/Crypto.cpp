@@ -48,6 +48,7 @@
 #include <cryptopp/cryptlib.h>
 #include <cryptopp/filters.h>
 #include <cryptopp/hex.h>
+#include <cryptopp/hmac.h>
 #include <cryptopp/sha.h>
 #include <b64/decode.h>
 #include <b64/encode.h>
@@ -69,6 +70,9 @@ public:
     Crypto::Byte *IV;
     std::size_t IVLen;
 
+public:
+    static int HexCharToInt(const char c);
+
 public:
     Impl();
     ~Impl();
@@ -192,6 +196,76 @@ bool Crypto::Hash(const std::string &text, std::string &out_digest,
     return false;
 }
 
+bool Crypto::Hmac(const std::string &text, std::string &out_mac,
+                  const Byte *key, std::size_t keyLen)
+{
+    string err;
+    return Hmac(text, out_mac, err, key, keyLen);
+}
+
+bool Crypto::Hmac(const std::string &text, std::string &out_mac,
+                  std::string &out_error,
+                  const Byte *key, std::size_t keyLen)
+{
+    try {
+        HMAC<SHA256> hmac(key, keyLen);
+
+        string mac;
+        StringSource(text, true,
+                     new HashFilter(hmac, new HexEncoder(new StringSink(mac))));
+        out_mac.assign(std::move(mac));
+
+        return true;
+    }
+
+    catch (const CryptoPP::Exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    return false;
+}
+
+/// Verifies a hex-encoded, possibly truncated, HMAC-SHA256 in constant time.
+/// No filter chains are involved, so this is cheap enough for per-request use.
+bool Crypto::HmacVerify(const std::string &text, const std::string &mac,
+                        const Byte *key, std::size_t keyLen)
+{
+    if (mac.empty() || mac.size() % 2 != 0
+            || mac.size() / 2 > HMAC<SHA256>::DIGESTSIZE) {
+        return false;
+    }
+
+    Byte digest[HMAC<SHA256>::DIGESTSIZE];
+    std::size_t digestLen = mac.size() / 2;
+
+    for (std::size_t i = 0; i < digestLen; ++i) {
+        int hi = Impl::HexCharToInt(mac[i * 2]);
+        int lo = Impl::HexCharToInt(mac[i * 2 + 1]);
+        if (hi < 0 || lo < 0)
+            return false;
+        digest[i] = static_cast<Byte>((hi << 4) | lo);
+    }
+
+    try {
+        HMAC<SHA256> hmac(key, keyLen);
+        hmac.Update(reinterpret_cast<const Byte *>(text.c_str()), text.size());
+        return hmac.TruncatedVerify(digest, digestLen);
+    }
+
+    catch (...) {
+    }
+
+    return false;
+}
+
 int Crypto::Base64Decode(char value)
 {
     base64::decoder decoder;
@@ -324,6 +398,17 @@ std::wstring Crypto::HexStringToWString(const std::wstring &hexString)
     return woss.str();
 }
 
+int Crypto::Impl::HexCharToInt(const char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+    return -1;
+}
+
 Crypto::Impl::Impl()
 {
 
@@ -69,6 +69,13 @@ public:
     static bool Hash(const std::string &text, std::string &out_digest);
     static bool Hash(const std::string &text, std::string &out_digest,
                              std::string &out_error);
+    static bool Hmac(const std::string &text, std::string &out_mac,
+                     const Byte *key, std::size_t keyLen);
+    static bool Hmac(const std::string &text, std::string &out_mac,
+                     std::string &out_error,
+                     const Byte *key, std::size_t keyLen);
+    static bool HmacVerify(const std::string &text, const std::string &mac,
+                           const Byte *key, std::size_t keyLen);
     static int Base64Decode(char value);
     static int Base64Decode(const char *code, const int length, char *out_plainText);
     static void Base64Decode(std::istream &inputStream, std::ostream &outputStream);
@@ -33,11 +33,20 @@
  */
 
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <unordered_map>
 #include <vector>
 #include <cassert>
 #include <cstdarg>
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/format.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/tss.hpp>
 #if defined ( HAS_SQLITE3 )
 #include <sqlite3.h>
 #endif  // defined ( HAS_SQLITE3 )
@@ -45,9 +54,36 @@
 #include <cppdb/driver_manager.h>
 #include "make_unique.hpp"
 #include "Database.hpp"
+#include "Exception.hpp"
 #include "Log.hpp"
+#include "Metrics.hpp"
+#include "Trace.hpp"
 
-#define     UNKNOWN_ERROR       "Unknow database error!"
+#define     UNKNOWN_ERROR                                   "Unknow database error!"
+#define     POOL_EXHAUSTED_ERROR                            "Timed out waiting for a database session!"
+#define     WRITE_QUEUE_STOPPED_ERROR                       "Database write queue is shutting down!"
+
+#define     DEFAULT_POOL_MAX_SIZE                           16
+#define     DEFAULT_POOL_CHECKOUT_TIMEOUT_MILLISECONDS      10000
+#define     DEFAULT_POOL_HEALTH_CHECK_IDLE_SECONDS          60
+
+#define     DEFAULT_WRITE_QUEUE_MAX_SIZE                    4096
+#define     DEFAULT_WRITE_BATCH_MAX_SIZE                    256
+#define     DEFAULT_WRITE_BATCH_DELAY_MILLISECONDS          5
+
+#define     WRITE_SAVEPOINT                                 "write_job"
+
+#define     DEFAULT_SQLITE3_JOURNAL_MODE                    "WAL"
+#define     DEFAULT_SQLITE3_SYNCHRONOUS                     "NORMAL"
+#define     DEFAULT_SQLITE3_CACHE_SIZE_KIB                  16384
+#define     DEFAULT_SQLITE3_MMAP_SIZE_BYTES                 268435456
+#define     DEFAULT_SQLITE3_BUSY_TIMEOUT_MILLISECONDS       5000
+#define     DEFAULT_SQLITE3_INCREMENTAL_VACUUM_PAGES        1024
+#define     DEFAULT_SQLITE3_INCREMENTAL_VACUUM_SECONDS      600
+
+#define     SQLITE3_AUTO_VACUUM_INCREMENTAL                 2
+
+#define     STATEMENT_KEY_SEPARATOR                         '\x1f'
 
 using namespace std;
 using namespace boost;
@@ -56,12 +92,24 @@ using namespace CoreLib;
 
 struct Database::Impl
 {
+    typedef std::chrono::steady_clock Clock;
+
     typedef std::unordered_map<std::string, std::string> EnumNamesHashTable;
     typedef std::unordered_map<std::string, std::vector<std::string>> EnumeratorsHashTable;
 
     typedef std::unordered_map<std::string, std::string> TableNamesHashTable;
     typedef std::unordered_map<std::string, std::string> TableFieldsHashTable;
 
+    typedef std::unordered_map<std::string, cppdb::statement> StatementsHashTable;
+
+    enum class Operation : char {
+        CreateTable = 'C',
+        DropTable = 'D',
+        Insert = 'I',
+        Update = 'U',
+        Delete = 'R'
+    };
+
 #if defined ( CORELIB_STATIC )
 #if defined ( HAS_CPPDB_SQLITE3_DRIVER )
     static bool IsSqlite3DriverLoaded;
@@ -74,13 +122,167 @@ struct Database::Impl
 #endif  // defined ( HAS_CPPDB_MYSQL_DRIVER )
 #endif  // defined ( CORELIB_STATIC )
 
-    cppdb::session Sql;
+#if defined ( HAS_SQLITE3 )
+    static bool Sqlite3Exec(sqlite3 *db, const std::string &query);
+    static int Sqlite3QueryInt(sqlite3 *db, const std::string &query);
+#endif  // defined ( HAS_SQLITE3 )
+
+    /// A connection and the statements prepared on it, which only the
+    /// thread holding the connection ever touches; the two go back to the
+    /// pool, and out to the next thread, together
+    struct PooledSession
+    {
+        cppdb::session Sql;
+        StatementsHashTable Statements;
+        std::uint_least64_t Generation;
+    };
+
+    struct IdleSession
+    {
+        PooledSession Session;
+        Clock::time_point LastUsed;
+    };
+
+    /// Shared with every thread holding a session, so that a session
+    /// returned after the Database is gone never touches freed memory.
+    struct SessionPool
+    {
+        std::string ConnectionString;
+        PoolOptions Options;
+
+        std::mutex Mutex;
+        std::condition_variable Condition;
+        std::vector<IdleSession> IdleSessions;
+        std::size_t OpenSessions;
+        PoolStatistics Statistics;
+
+        SessionPool(const std::string &connectionString, const PoolOptions &options);
+
+        /// Statements prepared on all pooled sessions
+        std::atomic<std::size_t> PreparedStatements;
+
+        PooledSession Checkout();
+        void Return(PooledSession &session);
+        void Close(PooledSession &session);
+        void ClearStatements(PooledSession &session);
+
+        /// Expects Mutex to be held by the caller
+        void RecordCheckout(const Clock::time_point &start, bool waited);
+
+        static bool IsHealthy(cppdb::session &sql);
+    };
+
+    typedef std::shared_ptr<SessionPool> SessionPool_ptr;
+
+    struct OperationMetrics
+    {
+        Metrics::Histogram *Latency;
+        Metrics::Counter *Errors;
+    };
+
+    struct PendingWrite
+    {
+        WriteJob Job;
+        WriteCallback Callback;
+        std::promise<bool> Promise;
+    };
+
+    typedef std::unique_ptr<boost::thread> Thread_ptr;
+
+    struct ThreadState
+    {
+        SessionPool_ptr Pool;
+        std::unique_ptr<PooledSession> Session;
+        std::size_t ScopeDepth;
+
+        explicit ThreadState(const SessionPool_ptr &pool);
+        ~ThreadState();
+
+        void Release();
+    };
+
+    SessionPool_ptr Sessions;
+    boost::thread_specific_ptr<ThreadState> CurrentThread;
+
+    /// 'UPDATE ONLY' / 'DELETE FROM ONLY' skip inheriting tables on
+    /// PostgreSQL, but are a syntax error on SQLite and MySQL, where every
+    /// Update() / Delete() used to fail
+    bool IsPgSql;
+
+    WriteQueueOptions WriteOptions;
+    std::mutex WriteMutex;
+    std::condition_variable WriteAvailable;
+    std::condition_variable WriteDrained;
+    std::deque<PendingWrite> WriteQueue;
+    std::size_t WritesInFlight;
+    bool IsWriterStopping;
+    Thread_ptr WriterThread;
+    WriteQueueStatistics WriteStatistics;
+
+    std::mutex VacuumMutex;
+    std::condition_variable VacuumCondition;
+    bool IsVacuumStopping;
+    Thread_ptr VacuumThread;
+
+    boost::shared_mutex RegistryMutex;
 
     EnumNamesHashTable EnumNames;
     EnumeratorsHashTable Enumerators;
 
     TableNamesHashTable TableNames;
     TableFieldsHashTable TableFields;
+
+    /// Prepared statements are cached on each PooledSession, so a hit
+    /// neither formats SQL nor prepares it, and needs no lock. Changing a
+    /// table's name or fields bumps the generation; a session drops its
+    /// statements the next time it sees a newer one.
+    std::atomic<std::uint_least64_t> StatementsGeneration;
+    std::atomic<std::uint_least64_t> StatementHits;
+    std::atomic<std::uint_least64_t> StatementMisses;
+    std::atomic<std::uint_least64_t> StatementInvalidations;
+
+    Impl();
+
+    ThreadState *GetThreadState();
+    PooledSession &GetSession();
+
+    /// Expects WriteMutex to be held by the caller
+    void StartWriter(Database *database);
+    void StopWriter();
+    void Writer(Database *database);
+    void WriteBatch(Database *database, std::vector<PendingWrite> &batch);
+
+#if defined ( HAS_SQLITE3 )
+    void Sqlite3VacuumWorker(const std::string &databaseFile, const Sqlite3Profile &profile);
+#endif  // defined ( HAS_SQLITE3 )
+    void StopVacuum();
+
+    /// Reset and ready to bind; valid until this thread's next call
+    template <typename Builder_T>
+    cppdb::statement &GetStatement(Operation operation,
+                                   const std::string &id,
+                                   const std::initializer_list<std::string> &parts,
+                                   Builder_T builder);
+    void InvalidateStatements();
+
+    template <typename Args_T>
+    bool Insert(Database *database,
+                const std::string &id,
+                const std::string &fields,
+                const Args_T &args);
+    template <typename Args_T>
+    bool Update(Database *database,
+                const std::string &id,
+                const std::string &where,
+                const std::string &value,
+                const std::string &set,
+                const Args_T &args);
+
+    std::string GetEnumName(const std::string &id);
+    std::vector<std::string> GetEnumerators(const std::string &id);
+
+    /// Meant to be kept in a function-local static, one per call site
+    static OperationMetrics MakeOperationMetrics(const std::string &operation);
 };
 
 #if defined ( CORELIB_STATIC )
@@ -171,71 +373,266 @@ void Database::LoadMySqlDriver()
 #if defined ( HAS_SQLITE3 )
 bool Database::Sqlite3Vacuum(const std::string &databaseFile)
 {
-    sqlite3 *db;
+    sqlite3 *db = nullptr;
 
     int rc = sqlite3_open(databaseFile.c_str(), &db);
-    if (!rc) {
-        sqlite3_exec(db, "VACUUM;", 0, 0, 0);
+    bool isVacuumed = false;
+    if (rc == SQLITE_OK) {
+        isVacuumed = Impl::Sqlite3Exec(db, "VACUUM;");
+    }
+
+    sqlite3_close(db);
+
+    return isVacuumed;
+}
+
+bool Database::Sqlite3EnableIncrementalVacuum(const std::string &databaseFile,
+                                              const Sqlite3Profile &profile)
+{
+    if (profile.IncrementalVacuumPages == 0)
         return true;
+
+    sqlite3 *db = nullptr;
+
+    bool isEnabled = false;
+    if (sqlite3_open(databaseFile.c_str(), &db) == SQLITE_OK) {
+        sqlite3_busy_timeout(db, static_cast<int>(profile.BusyTimeout.count()));
+
+        /// auto_vacuum can only be switched on an existing database by a
+        /// full VACUUM, which rewrites the file under the write lock
+        if (Impl::Sqlite3QueryInt(db, "PRAGMA auto_vacuum;") == SQLITE3_AUTO_VACUUM_INCREMENTAL) {
+            isEnabled = true;
+        } else {
+            LOG_INFO("Converting SQLite3 database to incremental auto-vacuum...", databaseFile);
+            isEnabled = Impl::Sqlite3Exec(db, "PRAGMA auto_vacuum = INCREMENTAL;")
+                    && Impl::Sqlite3Exec(db, "VACUUM;");
+        }
     }
 
-    return false;
+    sqlite3_close(db);
+
+    return isEnabled;
 }
+
 #endif  // defined ( HAS_SQLITE3 )
 
 
-Database::Database(const std::string &connectionString) :
+Database::PoolOptions::PoolOptions() :
+    MaxSize(DEFAULT_POOL_MAX_SIZE),
+    CheckoutTimeout(DEFAULT_POOL_CHECKOUT_TIMEOUT_MILLISECONDS),
+    HealthCheckIdleInterval(DEFAULT_POOL_HEALTH_CHECK_IDLE_SECONDS)
+{
+
+}
+
+Database::WriteQueueOptions::WriteQueueOptions() :
+    MaxSize(DEFAULT_WRITE_QUEUE_MAX_SIZE),
+    MaxBatchSize(DEFAULT_WRITE_BATCH_MAX_SIZE),
+    MaxBatchDelay(DEFAULT_WRITE_BATCH_DELAY_MILLISECONDS)
+{
+
+}
+
+Database::WriteQueueStatistics::WriteQueueStatistics() :
+    Pending(0),
+    Enqueued(0),
+    Succeeded(0),
+    Failed(0),
+    Batches(0),
+    FailedCommits(0)
+{
+
+}
+
+Database::Sqlite3Profile::Sqlite3Profile() :
+    JournalMode(DEFAULT_SQLITE3_JOURNAL_MODE),
+    Synchronous(DEFAULT_SQLITE3_SYNCHRONOUS),
+    CacheSizeKiB(DEFAULT_SQLITE3_CACHE_SIZE_KIB),
+    MmapSizeBytes(DEFAULT_SQLITE3_MMAP_SIZE_BYTES),
+    BusyTimeout(DEFAULT_SQLITE3_BUSY_TIMEOUT_MILLISECONDS),
+    IncrementalVacuumPages(DEFAULT_SQLITE3_INCREMENTAL_VACUUM_PAGES),
+    IncrementalVacuumInterval(DEFAULT_SQLITE3_INCREMENTAL_VACUUM_SECONDS)
+{
+
+}
+
+std::vector<std::string> Database::Sqlite3Profile::GetSessionStatements() const
+{
+    std::vector<std::string> statements;
+
+    /// Busy timeout goes first, so the rest wait on a locked database
+    /// instead of failing
+    if (BusyTimeout.count() > 0)
+        statements.push_back((format("PRAGMA busy_timeout = %1%;") % BusyTimeout.count()).str());
+
+    /// The journal mode is persistent, setting it again is a no-op
+    if (!JournalMode.empty())
+        statements.push_back((format("PRAGMA journal_mode = %1%;") % JournalMode).str());
+
+    if (!Synchronous.empty())
+        statements.push_back((format("PRAGMA synchronous = %1%;") % Synchronous).str());
+
+    /// A negative cache_size is in KiB rather than pages
+    if (CacheSizeKiB > 0)
+        statements.push_back((format("PRAGMA cache_size = -%1%;") % CacheSizeKiB).str());
+
+    if (MmapSizeBytes > 0)
+        statements.push_back((format("PRAGMA mmap_size = %1%;") % MmapSizeBytes).str());
+
+    return statements;
+}
+
+Database::PoolStatistics::PoolStatistics() :
+    MaxSize(0),
+    OpenSessions(0),
+    IdleSessions(0),
+    Checkouts(0),
+    Waits(0),
+    Timeouts(0),
+    FailedHealthChecks(0),
+    TotalWaitMilliseconds(0.0),
+    MaxWaitMilliseconds(0.0)
+{
+
+}
+
+Database::StatementCacheStatistics::StatementCacheStatistics() :
+    Size(0),
+    Hits(0),
+    Misses(0),
+    Invalidations(0)
+{
+
+}
+
+Database::Database(const std::string &connectionString,
+                   const PoolOptions &poolOptions,
+                   const WriteQueueOptions &writeQueueOptions) :
     m_pimpl(make_unique<Database::Impl>())
 {
-    if (!m_pimpl->Sql.is_open()) {
-        bool isDatabaseOpenedSuccessfully = true;
-        try {
-            m_pimpl->Sql.open(connectionString);
-        } catch (const std::exception &ex) {
-            LOG_FATAL("Database connection failed!", ex.what());
-            isDatabaseOpenedSuccessfully = false;
-        } catch (...) {
-            LOG_FATAL("Database connection failed!");
-            isDatabaseOpenedSuccessfully = false;
-        }
-        assert(isDatabaseOpenedSuccessfully);
+    m_pimpl->Sessions = std::make_shared<Impl::SessionPool>(connectionString, poolOptions);
+    m_pimpl->IsPgSql = boost::algorithm::starts_with(connectionString, "postgresql:");
+
+    m_pimpl->WriteOptions = writeQueueOptions;
+    if (m_pimpl->WriteOptions.MaxSize == 0)
+        m_pimpl->WriteOptions.MaxSize = 1;
+    if (m_pimpl->WriteOptions.MaxBatchSize == 0)
+        m_pimpl->WriteOptions.MaxBatchSize = 1;
+
+    /// Open the first session eagerly, so a misconfiguration still fails
+    /// at startup rather than on the first request
+    bool isDatabaseOpenedSuccessfully = true;
+    try {
+        Impl::PooledSession session(m_pimpl->Sessions->Checkout());
+        m_pimpl->Sessions->Return(session);
+    } catch (const std::exception &ex) {
+        LOG_FATAL("Database connection failed!", ex.what());
+        isDatabaseOpenedSuccessfully = false;
+    } catch (...) {
+        LOG_FATAL("Database connection failed!");
+        isDatabaseOpenedSuccessfully = false;
     }
+    assert(isDatabaseOpenedSuccessfully);
+    (void)isDatabaseOpenedSuccessfully;
 }
 
 Database::~Database()
 {
-    if (m_pimpl->Sql.is_open())
-        m_pimpl->Sql.close();
+    m_pimpl->StopWriter();
+    m_pimpl->StopVacuum();
+
+    m_pimpl->CurrentThread.reset();
+
+    std::lock_guard<std::mutex> lock(m_pimpl->Sessions->Mutex);
+    (void)lock;
+
+    /// A session another thread still holds may be in use right now, so it
+    /// is left alone; that thread returns it to the pool, which outlives
+    /// the Database, and the pool closes it once the last holder is gone
+    const std::size_t checkedOut = m_pimpl->Sessions->OpenSessions
+            - m_pimpl->Sessions->IdleSessions.size();
+    if (checkedOut > 0) {
+        LOG_WARNING("Database destroyed while other threads still hold sessions", checkedOut);
+    }
+
+    for (auto &idle : m_pimpl->Sessions->IdleSessions) {
+        m_pimpl->Sessions->Close(idle.Session);
+    }
+    m_pimpl->Sessions->OpenSessions -= m_pimpl->Sessions->IdleSessions.size();
+    m_pimpl->Sessions->IdleSessions.clear();
+}
+
+#if defined ( HAS_SQLITE3 )
+void Database::Sqlite3StartBackgroundVacuum(const std::string &databaseFile,
+                                            const Sqlite3Profile &profile)
+{
+    std::lock_guard<std::mutex> lock(m_pimpl->VacuumMutex);
+    (void)lock;
+
+    if (m_pimpl->VacuumThread == nullptr && !m_pimpl->IsVacuumStopping) {
+        m_pimpl->VacuumThread = make_unique<boost::thread>(&Database::Impl::Sqlite3VacuumWorker,
+                                                           m_pimpl.get(), databaseFile, profile);
+    }
 }
+#endif  // defined ( HAS_SQLITE3 )
 
 cppdb::session &Database::Sql()
 {
-    return m_pimpl->Sql;
+    return m_pimpl->GetSession().Sql;
+}
+
+Database::PoolStatistics Database::GetPoolStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_pimpl->Sessions->Mutex);
+    (void)lock;
+
+    PoolStatistics statistics(m_pimpl->Sessions->Statistics);
+    statistics.MaxSize = m_pimpl->Sessions->Options.MaxSize;
+    statistics.OpenSessions = m_pimpl->Sessions->OpenSessions;
+    statistics.IdleSessions = m_pimpl->Sessions->IdleSessions.size();
+
+    return statistics;
+}
+
+Database::StatementCacheStatistics Database::GetStatementCacheStatistics()
+{
+    StatementCacheStatistics statistics;
+
+    statistics.Size = m_pimpl->Sessions->PreparedStatements.load(std::memory_order_relaxed);
+    statistics.Hits = m_pimpl->StatementHits.load(std::memory_order_relaxed);
+    statistics.Misses = m_pimpl->StatementMisses.load(std::memory_order_relaxed);
+    statistics.Invalidations = m_pimpl->StatementInvalidations.load(std::memory_order_relaxed);
+
+    return statistics;
 }
 
 bool Database::CreateEnum(const std::string &id)
 {
+    TRACE_SPAN_DETAIL("sql", "Database::CreateEnum", id);
+
     try {
-        result r = m_pimpl->Sql << (format("SELECT EXISTS ( SELECT 1 FROM pg_type WHERE typname = '%1%' );")
-                                    % (m_pimpl->EnumNames[id])).str()
-                                << row;
+        std::string enumName(m_pimpl->GetEnumName(id));
+        result r = Sql() << (format("SELECT EXISTS ( SELECT 1 FROM pg_type WHERE typname = '%1%' );")
+                             % enumName).str()
+                         << row;
 
         if (!r.empty()) {
             std::string exists;
             r >> exists;
 
             if (exists == "f") {
+                std::vector<std::string> enumerators(m_pimpl->GetEnumerators(id));
                 std::string ph;
-                for (size_t i = 0; i < m_pimpl->Enumerators[id].size(); ++i) {
+                for (size_t i = 0; i < enumerators.size(); ++i) {
                     if (i != 0)
                         ph += ", ";
-                    ph += (format("'%1%'") % m_pimpl->Enumerators[id][i]).str();
+                    ph += (format("'%1%'") % enumerators[i]).str();
                 }
 
-                m_pimpl->Sql << (format("CREATE TYPE \"%1%\" AS ENUM ( %2% );")
-                                 % m_pimpl->EnumNames[id]
-                                 % ph).str()
-                             << exec;
+                Sql() << (format("CREATE TYPE \"%1%\" AS ENUM ( %2% );")
+                          % enumName
+                          % ph).str()
+                      << exec;
             }
         }
 
@@ -251,16 +648,24 @@ bool Database::CreateEnum(const std::string &id)
 
 bool Database::CreateTable(const std::string &id)
 {
+    static const Impl::OperationMetrics metrics(Impl::MakeOperationMetrics("create_table"));
+    Metrics::Timer timer(metrics.Latency);
+    (void)timer;
+    TRACE_SPAN_DETAIL("sql", "Database::CreateTable", id);
+
     try {
-        m_pimpl->Sql << (format("CREATE TABLE IF NOT EXISTS \"%1%\" ( %2% );")
-                         % m_pimpl->TableNames[id]
-                         % m_pimpl->TableFields[id]).str()
-                     << exec;
+        m_pimpl->GetStatement(Impl::Operation::CreateTable, id, { }, [&]() {
+            return (format("CREATE TABLE IF NOT EXISTS \"%1%\" ( %2% );")
+                    % GetTableName(id)
+                    % GetTableFields(id)).str();
+        }).exec();
 
         return true;
     } catch (const std::exception &ex) {
+        metrics.Errors->Increment();
         LOG_ERROR(ex.what());
     } catch (...) {
+        metrics.Errors->Increment();
         LOG_ERROR(UNKNOWN_ERROR);
     }
 
@@ -269,15 +674,23 @@ bool Database::CreateTable(const std::string &id)
 
 bool Database::DropTable(const std::string &id)
 {
+    static const Impl::OperationMetrics metrics(Impl::MakeOperationMetrics("drop_table"));
+    Metrics::Timer timer(metrics.Latency);
+    (void)timer;
+    TRACE_SPAN_DETAIL("sql", "Database::DropTable", id);
+
     try {
-        m_pimpl->Sql << (format("DROP TABLE IF EXISTS \"%1%\";")
-                         % m_pimpl->TableNames[id]).str()
-                     << exec;
+        m_pimpl->GetStatement(Impl::Operation::DropTable, id, { }, [&]() {
+            return (format("DROP TABLE IF EXISTS \"%1%\";")
+                    % GetTableName(id)).str();
+        }).exec();
 
         return true;
     } catch (const std::exception &ex) {
+        metrics.Errors->Increment();
         LOG_ERROR(ex.what());
     } catch (...) {
+        metrics.Errors->Increment();
         LOG_ERROR(UNKNOWN_ERROR);
     }
 
@@ -286,12 +699,21 @@ bool Database::DropTable(const std::string &id)
 
 bool Database::RenameTable(const std::string &id, const std::string &newName)
 {
+    TRACE_SPAN_DETAIL("sql", "Database::RenameTable", id);
+
     try {
+        boost::upgrade_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+
         auto it = m_pimpl->TableNames.find(id);
         if (it != m_pimpl->TableNames.end()) {
-            m_pimpl->Sql << "ALTER TABLE [" + m_pimpl->TableNames[id] + "] RENAME TO [" +  newName + "];"
-                         << exec;
+            Sql() << "ALTER TABLE [" + it->second + "] RENAME TO [" +  newName + "];"
+                  << exec;
+
+            boost::upgrade_to_unique_lock<boost::shared_mutex> uniqueLock(lock);
+            (void)uniqueLock;
+
             it->second = newName;
+            m_pimpl->InvalidateStatements();
             return true;
         }
     } catch (const std::exception &ex) {
@@ -307,33 +729,7 @@ bool Database::Insert(const std::string &id,
                       const std::string &fields,
                       const std::initializer_list<std::string> &args)
 {
-    try {
-        string ph;
-        for (size_t i = 0; i < args.size(); ++i) {
-            if (i != 0)
-                ph += ", ";
-            ph += "?";
-        }
-
-        statement stat = m_pimpl->Sql << (format("INSERT INTO \"%1%\" ( %2% ) VALUES ( %3% );")
-                                          % m_pimpl->TableNames[id]
-                                          % fields
-                                          % ph).str();
-
-        for(const auto &arg : args) {
-            stat.bind(arg);
-        }
-
-        stat.exec();
-
-        return true;
-    } catch (const std::exception &ex) {
-        LOG_ERROR(ex.what());
-    } catch (...) {
-        LOG_ERROR(UNKNOWN_ERROR);
-    }
-
-    return false;
+    return m_pimpl->Insert(this, id, fields, args);
 }
 
 bool Database::Update(const std::string &id,
@@ -342,55 +738,140 @@ bool Database::Update(const std::string &id,
                       const std::string &set,
                       const std::initializer_list<std::string> &args)
 {
-    try {
-        statement stat = m_pimpl->Sql << (format("UPDATE ONLY \"%1%\" SET %2% WHERE %3%=?;")
-                                          % m_pimpl->TableNames[id]
-                                          % set
-                                          % where).str();
+    return m_pimpl->Update(this, id, where, value, set, args);
+}
 
-        for(const auto &arg : args) {
-            stat.bind(arg);
-        }
+bool Database::Delete(const std::string &id,
+                      const std::string &where,
+                      const std::string &value)
+{
+    static const Impl::OperationMetrics metrics(Impl::MakeOperationMetrics("delete"));
+    Metrics::Timer timer(metrics.Latency);
+    (void)timer;
+    TRACE_SPAN_DETAIL("sql", "Database::Delete", id);
 
-        stat.bind(value);
+    try {
+        cppdb::statement &stat = m_pimpl->GetStatement(Impl::Operation::Delete, id, { where }, [&]() {
+            return (format("DELETE FROM %1%\"%2%\" WHERE %3%=?;")
+                    % (m_pimpl->IsPgSql ? "ONLY " : "")
+                    % GetTableName(id)
+                    % where).str();
+        });
 
+        stat.bind(value);
         stat.exec();
 
         return true;
     } catch (const std::exception &ex) {
+        metrics.Errors->Increment();
         LOG_ERROR(ex.what());
     } catch (...) {
+        metrics.Errors->Increment();
         LOG_ERROR(UNKNOWN_ERROR);
     }
 
     return false;
 }
 
-bool Database::Delete(const std::string &id,
-                      const std::string &where,
-                      const std::string &value)
+std::future<bool> Database::EnqueueWrite(const WriteJob &job,
+                                         const WriteCallback &callback)
 {
-    try {
-        m_pimpl->Sql << (format("DELETE FROM ONLY \"%1%\" WHERE %2%=?;")
-                         % m_pimpl->TableNames[id]
-                         % where).str()
-                     << value
-                     << exec;
+    Impl::PendingWrite write;
+    write.Job = job;
+    write.Callback = callback;
+    std::future<bool> result(write.Promise.get_future());
+
+    std::unique_lock<std::mutex> lock(m_pimpl->WriteMutex);
+
+    if (!m_pimpl->IsWriterStopping) {
+        m_pimpl->StartWriter(this);
+
+        /// Bounded, so a burst pushes back on the callers instead of growing
+        /// without limit; shutting down wakes them up as well
+        m_pimpl->WriteDrained.wait(lock, [this]() {
+            return m_pimpl->WriteQueue.size() < m_pimpl->WriteOptions.MaxSize
+                    || m_pimpl->IsWriterStopping;
+        });
+    }
 
-        return true;
-    } catch (const std::exception &ex) {
-        LOG_ERROR(ex.what());
-    } catch (...) {
-        LOG_ERROR(UNKNOWN_ERROR);
+    /// The writer may already be gone, nothing queued now would ever run
+    if (m_pimpl->IsWriterStopping) {
+        lock.unlock();
+        LOG_ERROR(WRITE_QUEUE_STOPPED_ERROR);
+        write.Promise.set_value(false);
+        if (callback)
+            callback(false);
+        return result;
     }
 
-    return false;
+    m_pimpl->WriteQueue.push_back(std::move(write));
+    ++m_pimpl->WriteStatistics.Enqueued;
+    lock.unlock();
+
+    m_pimpl->WriteAvailable.notify_one();
+
+    return result;
+}
+
+std::future<bool> Database::InsertAsync(const std::string &id,
+                                        const std::string &fields,
+                                        const std::vector<std::string> &args,
+                                        const WriteCallback &callback)
+{
+    return EnqueueWrite([this, id, fields, args](cppdb::session &) {
+        return m_pimpl->Insert(this, id, fields, args);
+    }, callback);
+}
+
+std::future<bool> Database::UpdateAsync(const std::string &id,
+                                        const std::string &where,
+                                        const std::string &value,
+                                        const std::string &set,
+                                        const std::vector<std::string> &args,
+                                        const WriteCallback &callback)
+{
+    return EnqueueWrite([this, id, where, value, set, args](cppdb::session &) {
+        return m_pimpl->Update(this, id, where, value, set, args);
+    }, callback);
+}
+
+std::future<bool> Database::DeleteAsync(const std::string &id,
+                                        const std::string &where,
+                                        const std::string &value,
+                                        const WriteCallback &callback)
+{
+    return EnqueueWrite([this, id, where, value](cppdb::session &) {
+        return Delete(id, where, value);
+    }, callback);
+}
+
+void Database::FlushWrites()
+{
+    std::unique_lock<std::mutex> lock(m_pimpl->WriteMutex);
+
+    m_pimpl->WriteDrained.wait(lock, [this]() {
+        return m_pimpl->WriteQueue.empty() && m_pimpl->WritesInFlight == 0;
+    });
+}
+
+Database::WriteQueueStatistics Database::GetWriteQueueStatistics()
+{
+    std::lock_guard<std::mutex> lock(m_pimpl->WriteMutex);
+    (void)lock;
+
+    WriteQueueStatistics statistics(m_pimpl->WriteStatistics);
+    statistics.Pending = m_pimpl->WriteQueue.size() + m_pimpl->WritesInFlight;
+
+    return statistics;
 }
 
 void Database::RegisterEnum(const std::string &id,
                             const std::string &name,
                             const std::initializer_list<std::string> &enumerators)
 {
+    boost::unique_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
     m_pimpl->EnumNames[id] = name;
     m_pimpl->Enumerators[id] = enumerators;
 }
@@ -399,14 +880,22 @@ void Database::RegisterTable(const std::string &id,
                              const std::string &name,
                              const std::string &fields)
 {
+    boost::unique_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
     m_pimpl->TableNames[id] = name;
     m_pimpl->TableFields[id] = fields;
+    m_pimpl->InvalidateStatements();
 }
 
 std::string Database::GetTableName(const std::string &id)
 {
-    if (m_pimpl->TableNames.find(id) != m_pimpl->TableNames.end()) {
-        return m_pimpl->TableNames[id];
+    boost::shared_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
+    auto it = m_pimpl->TableNames.find(id);
+    if (it != m_pimpl->TableNames.end()) {
+        return it->second;
     }
 
     return "{?}";
@@ -414,8 +903,12 @@ std::string Database::GetTableName(const std::string &id)
 
 std::string Database::GetTableFields(const std::string &id)
 {
-    if (m_pimpl->TableFields.find(id) != m_pimpl->TableFields.end()) {
-        return m_pimpl->TableFields[id];
+    boost::shared_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
+    auto it = m_pimpl->TableFields.find(id);
+    if (it != m_pimpl->TableFields.end()) {
+        return it->second;
     }
 
     return "{?}";
@@ -423,9 +916,13 @@ std::string Database::GetTableFields(const std::string &id)
 
 bool Database::SetTableName(const std::string &id, const std::string &name)
 {
+    boost::unique_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
     auto it = m_pimpl->TableNames.find(id);
     if (it != m_pimpl->TableNames.end()) {
         it->second = name;
+        m_pimpl->InvalidateStatements();
         return true;
     }
 
@@ -434,9 +931,13 @@ bool Database::SetTableName(const std::string &id, const std::string &name)
 
 bool Database::SetTableFields(const std::string &id, const std::string &fields)
 {
+    boost::unique_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+    (void)lock;
+
     auto it = m_pimpl->TableFields.find(id);
     if (it != m_pimpl->TableFields.end()) {
         it->second = fields;
+        m_pimpl->InvalidateStatements();
         return true;
     }
 
@@ -446,14 +947,30 @@ bool Database::SetTableFields(const std::string &id, const std::string &fields)
 bool Database::Initialize()
 {
     try {
-        transaction guard(m_pimpl->Sql);
+        std::vector<std::string> enumIds;
+        std::vector<std::string> tableIds;
 
-        for (const auto &e : m_pimpl->EnumNames) {
-            CreateEnum(e.first);
+        {
+            boost::shared_lock<boost::shared_mutex> lock(m_pimpl->RegistryMutex);
+            (void)lock;
+
+            for (const auto &e : m_pimpl->EnumNames) {
+                enumIds.push_back(e.first);
+            }
+
+            for (const auto &t : m_pimpl->TableNames) {
+                tableIds.push_back(t.first);
+            }
+        }
+
+        transaction guard(Sql());
+
+        for (const auto &id : enumIds) {
+            CreateEnum(id);
         }
 
-        for (const auto &t : m_pimpl->TableNames) {
-            CreateTable(t.first);
+        for (const auto &id : tableIds) {
+            CreateTable(id);
         }
 
         guard.commit();
@@ -468,3 +985,644 @@ bool Database::Initialize()
     return false;
 }
 
+Database::SessionScope::SessionScope(Database *database) :
+    m_database(database)
+{
+    ++m_database->m_pimpl->GetThreadState()->ScopeDepth;
+}
+
+Database::SessionScope::~SessionScope()
+{
+    Impl::ThreadState *state = m_database->m_pimpl->GetThreadState();
+
+    if (--state->ScopeDepth == 0) {
+        state->Release();
+    }
+}
+
+Database::Impl::SessionPool::SessionPool(const std::string &connectionString,
+                                         const PoolOptions &options) :
+    ConnectionString(connectionString),
+    Options(options),
+    OpenSessions(0),
+    PreparedStatements(0)
+{
+    if (Options.MaxSize == 0)
+        Options.MaxSize = 1;
+}
+
+Database::Impl::PooledSession Database::Impl::SessionPool::Checkout()
+{
+    const Clock::time_point start = Clock::now();
+    const Clock::time_point deadline = start + Options.CheckoutTimeout;
+    bool waited = false;
+
+    std::unique_lock<std::mutex> lock(Mutex);
+
+    for (;;) {
+        if (!IdleSessions.empty()) {
+            IdleSession idle(std::move(IdleSessions.back()));
+            IdleSessions.pop_back();
+
+            /// Sessions idle for a while may have been dropped by the server
+            if (Clock::now() - idle.LastUsed >= Options.HealthCheckIdleInterval) {
+                lock.unlock();
+                bool isHealthy = IsHealthy(idle.Session.Sql);
+                lock.lock();
+
+                if (!isHealthy) {
+                    ++Statistics.FailedHealthChecks;
+                    --OpenSessions;
+                    Close(idle.Session);
+                    continue;
+                }
+            }
+
+            RecordCheckout(start, waited);
+            return std::move(idle.Session);
+        }
+
+        if (OpenSessions < Options.MaxSize) {
+            ++OpenSessions;
+            lock.unlock();
+
+            try {
+                PooledSession session { cppdb::session(ConnectionString), StatementsHashTable(), 0 };
+                for (const auto &query : Options.SessionInitStatements) {
+                    session.Sql << query << row;
+                }
+                lock.lock();
+                RecordCheckout(start, waited);
+                return session;
+            } catch (...) {
+                lock.lock();
+                --OpenSessions;
+                Condition.notify_one();
+                throw;
+            }
+        }
+
+        if (!waited) {
+            waited = true;
+            ++Statistics.Waits;
+        }
+
+        if (Condition.wait_until(lock, deadline) == std::cv_status::timeout
+                && IdleSessions.empty() && OpenSessions >= Options.MaxSize) {
+            ++Statistics.Timeouts;
+            LOG_ERROR(POOL_EXHAUSTED_ERROR, ConnectionString.substr(0, ConnectionString.find(':')));
+            throw CoreLib::Exception(POOL_EXHAUSTED_ERROR);
+        }
+    }
+}
+
+void Database::Impl::SessionPool::RecordCheckout(const Clock::time_point &start, bool waited)
+{
+    static Metrics::Histogram *const waitSeconds =
+            Metrics::GetHistogram("corelib_database_pool_wait_seconds",
+                                  "Time spent waiting for a pooled database session while none was idle");
+
+    ++Statistics.Checkouts;
+
+    if (waited) {
+        double waitMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        waitSeconds->Observe(waitMilliseconds / 1000.0);
+        Statistics.TotalWaitMilliseconds += waitMilliseconds;
+        if (waitMilliseconds > Statistics.MaxWaitMilliseconds)
+            Statistics.MaxWaitMilliseconds = waitMilliseconds;
+    }
+}
+
+void Database::Impl::SessionPool::Return(PooledSession &session)
+{
+    {
+        std::lock_guard<std::mutex> lock(Mutex);
+        (void)lock;
+
+        if (session.Sql.is_open()) {
+            IdleSessions.push_back(IdleSession { std::move(session), Clock::now() });
+        } else {
+            ClearStatements(session);
+            --OpenSessions;
+        }
+    }
+
+    Condition.notify_one();
+}
+
+void Database::Impl::SessionPool::Close(PooledSession &session)
+{
+    /// Statements keep their connection alive, so they go first
+    ClearStatements(session);
+
+    try {
+        if (session.Sql.is_open())
+            session.Sql.close();
+    } catch (...) {
+    }
+}
+
+void Database::Impl::SessionPool::ClearStatements(PooledSession &session)
+{
+    PreparedStatements.fetch_sub(session.Statements.size(), std::memory_order_relaxed);
+    session.Statements.clear();
+}
+
+bool Database::Impl::SessionPool::IsHealthy(cppdb::session &sql)
+{
+    try {
+        if (!sql.is_open())
+            return false;
+
+        sql << "SELECT 1;" << row;
+
+        return true;
+    } catch (...) {
+    }
+
+    return false;
+}
+
+Database::Impl::ThreadState::ThreadState(const SessionPool_ptr &pool) :
+    Pool(pool),
+    ScopeDepth(0)
+{
+
+}
+
+Database::Impl::ThreadState::~ThreadState()
+{
+    Release();
+}
+
+void Database::Impl::ThreadState::Release()
+{
+    if (Session != nullptr) {
+        Pool->Return(*Session);
+        Session.reset();
+    }
+}
+
+#if defined ( HAS_SQLITE3 )
+bool Database::Impl::Sqlite3Exec(sqlite3 *db, const std::string &query)
+{
+    char *error = nullptr;
+
+    if (sqlite3_exec(db, query.c_str(), 0, 0, &error) != SQLITE_OK) {
+        LOG_ERROR(query, error != nullptr ? error : UNKNOWN_ERROR);
+        sqlite3_free(error);
+        return false;
+    }
+
+    return true;
+}
+
+int Database::Impl::Sqlite3QueryInt(sqlite3 *db, const std::string &query)
+{
+    sqlite3_stmt *stmt = nullptr;
+    int value = -1;
+
+    if (sqlite3_prepare_v2(db, query.c_str(), -1, &stmt, 0) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            value = sqlite3_column_int(stmt, 0);
+    }
+
+    sqlite3_finalize(stmt);
+
+    return value;
+}
+
+void Database::Impl::Sqlite3VacuumWorker(const std::string &databaseFile,
+                                         const Sqlite3Profile &profile)
+{
+    try {
+        /// Only ever reclaims a few pages at a time; without a prior
+        /// Sqlite3EnableIncrementalVacuum() incremental_vacuum is a no-op
+        if (profile.IncrementalVacuumPages == 0
+                || profile.IncrementalVacuumInterval.count() <= 0) {
+            return;
+        }
+
+        const std::string incrementalVacuum(
+                    (format("PRAGMA incremental_vacuum(%1%);")
+                     % profile.IncrementalVacuumPages).str());
+
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(VacuumMutex);
+
+                if (VacuumCondition.wait_for(lock, profile.IncrementalVacuumInterval, [this]() {
+                    return IsVacuumStopping;
+                })) {
+                    break;
+                }
+            }
+
+            sqlite3 *db = nullptr;
+
+            if (sqlite3_open(databaseFile.c_str(), &db) == SQLITE_OK) {
+                sqlite3_busy_timeout(db, static_cast<int>(profile.BusyTimeout.count()));
+
+                int freePages = Sqlite3QueryInt(db, "PRAGMA freelist_count;");
+                if (freePages > 0) {
+                    Sqlite3Exec(db, incrementalVacuum);
+                }
+            }
+
+            sqlite3_close(db);
+        }
+    } catch (const std::exception &ex) {
+        LOG_ERROR(ex.what());
+    } catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+}
+#endif  // defined ( HAS_SQLITE3 )
+
+Database::Impl::Impl() :
+    IsPgSql(false),
+    WritesInFlight(0),
+    IsWriterStopping(false),
+    IsVacuumStopping(false),
+    StatementsGeneration(0),
+    StatementHits(0),
+    StatementMisses(0),
+    StatementInvalidations(0)
+{
+
+}
+
+void Database::Impl::StartWriter(Database *database)
+{
+    if (WriterThread == nullptr) {
+        WriterThread = make_unique<boost::thread>(&Database::Impl::Writer, this, database);
+    }
+}
+
+void Database::Impl::StopWriter()
+{
+    {
+        std::lock_guard<std::mutex> lock(WriteMutex);
+        (void)lock;
+
+        IsWriterStopping = true;
+    }
+
+    WriteAvailable.notify_all();
+    WriteDrained.notify_all();
+
+    if (WriterThread != nullptr) {
+        WriterThread->join();
+        WriterThread.reset();
+    }
+}
+
+void Database::Impl::StopVacuum()
+{
+    {
+        std::lock_guard<std::mutex> lock(VacuumMutex);
+        (void)lock;
+
+        IsVacuumStopping = true;
+    }
+
+    VacuumCondition.notify_all();
+
+    /// Waits for a pass already running, which only reclaims a few pages
+    if (VacuumThread != nullptr) {
+        VacuumThread->join();
+        VacuumThread.reset();
+    }
+}
+
+void Database::Impl::Writer(Database *database)
+{
+    for (;;) {
+        std::vector<PendingWrite> batch;
+
+        {
+            std::unique_lock<std::mutex> lock(WriteMutex);
+
+            WriteAvailable.wait(lock, [this]() {
+                return !WriteQueue.empty() || IsWriterStopping;
+            });
+
+            if (WriteQueue.empty())
+                break;
+
+            /// Give a burst a moment to arrive, so it lands in one commit
+            if (WriteQueue.size() < WriteOptions.MaxBatchSize
+                    && WriteOptions.MaxBatchDelay.count() > 0 && !IsWriterStopping) {
+                WriteAvailable.wait_for(lock, WriteOptions.MaxBatchDelay, [this]() {
+                    return WriteQueue.size() >= WriteOptions.MaxBatchSize || IsWriterStopping;
+                });
+            }
+
+            while (!WriteQueue.empty() && batch.size() < WriteOptions.MaxBatchSize) {
+                batch.push_back(std::move(WriteQueue.front()));
+                WriteQueue.pop_front();
+            }
+
+            WritesInFlight = batch.size();
+        }
+
+        WriteDrained.notify_all();
+
+        WriteBatch(database, batch);
+
+        {
+            std::lock_guard<std::mutex> lock(WriteMutex);
+            (void)lock;
+
+            WritesInFlight = 0;
+        }
+
+        WriteDrained.notify_all();
+    }
+
+    /// The thread-specific slot dies with Impl, so do not leave it to the
+    /// thread exit cleanup
+    CurrentThread.reset();
+}
+
+void Database::Impl::WriteBatch(Database *database, std::vector<PendingWrite> &batch)
+{
+    TRACE_SPAN("sql", "Database::WriteBatch");
+
+    std::vector<bool> results(batch.size(), false);
+    bool isCommitted = false;
+
+    try {
+        SessionScope scope(database);
+        cppdb::session &sql = database->Sql();
+
+        transaction guard(sql);
+
+        for (std::size_t i = 0; i < batch.size(); ++i) {
+            sql << "SAVEPOINT " WRITE_SAVEPOINT ";" << exec;
+
+            try {
+                results[i] = batch[i].Job(sql);
+            } catch (const std::exception &ex) {
+                LOG_ERROR(ex.what());
+            } catch (...) {
+                LOG_ERROR(UNKNOWN_ERROR);
+            }
+
+            if (!results[i])
+                sql << "ROLLBACK TO SAVEPOINT " WRITE_SAVEPOINT ";" << exec;
+            sql << "RELEASE SAVEPOINT " WRITE_SAVEPOINT ";" << exec;
+        }
+
+        guard.commit();
+        isCommitted = true;
+    } catch (const std::exception &ex) {
+        LOG_ERROR(ex.what());
+    } catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(WriteMutex);
+        (void)lock;
+
+        ++WriteStatistics.Batches;
+        if (!isCommitted)
+            ++WriteStatistics.FailedCommits;
+    }
+
+    std::uint_least64_t succeeded = 0;
+
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        bool isSucceeded = isCommitted && results[i];
+        if (isSucceeded)
+            ++succeeded;
+
+        batch[i].Promise.set_value(isSucceeded);
+
+        if (batch[i].Callback) {
+            try {
+                batch[i].Callback(isSucceeded);
+            } catch (const std::exception &ex) {
+                LOG_ERROR(ex.what());
+            } catch (...) {
+                LOG_ERROR(UNKNOWN_ERROR);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(WriteMutex);
+    (void)lock;
+
+    WriteStatistics.Succeeded += succeeded;
+    WriteStatistics.Failed += batch.size() - succeeded;
+}
+
+Database::Impl::ThreadState *Database::Impl::GetThreadState()
+{
+    ThreadState *state = CurrentThread.get();
+
+    if (state == nullptr) {
+        state = new ThreadState(Sessions);
+        CurrentThread.reset(state);
+    }
+
+    return state;
+}
+
+Database::Impl::PooledSession &Database::Impl::GetSession()
+{
+    ThreadState *state = GetThreadState();
+
+    if (state->Session == nullptr) {
+        if (state->ScopeDepth == 0) {
+            LOG_WARNING("Database session used outside of any SessionScope;"
+                        " it stays checked out until this thread exits");
+        }
+
+        state->Session = make_unique<PooledSession>(state->Pool->Checkout());
+    }
+
+    return *state->Session;
+}
+
+std::string Database::Impl::GetEnumName(const std::string &id)
+{
+    boost::shared_lock<boost::shared_mutex> lock(RegistryMutex);
+    (void)lock;
+
+    auto it = EnumNames.find(id);
+    if (it != EnumNames.end()) {
+        return it->second;
+    }
+
+    return "{?}";
+}
+
+std::vector<std::string> Database::Impl::GetEnumerators(const std::string &id)
+{
+    boost::shared_lock<boost::shared_mutex> lock(RegistryMutex);
+    (void)lock;
+
+    auto it = Enumerators.find(id);
+    if (it != Enumerators.end()) {
+        return it->second;
+    }
+
+    return std::vector<std::string>();
+}
+
+Database::Impl::OperationMetrics Database::Impl::MakeOperationMetrics(const std::string &operation)
+{
+    OperationMetrics metrics;
+    metrics.Latency = Metrics::GetHistogram("corelib_database_query_duration_seconds",
+                                            "Time spent executing a database call",
+                                            { { "operation", operation } });
+    metrics.Errors = Metrics::GetCounter("corelib_database_query_errors_total",
+                                         "Database calls that failed",
+                                         { { "operation", operation } });
+    return metrics;
+}
+
+
+template <typename Builder_T>
+cppdb::statement &Database::Impl::GetStatement(Operation operation,
+                                               const std::string &id,
+                                               const std::initializer_list<std::string> &parts,
+                                               Builder_T builder)
+{
+    PooledSession &session = GetSession();
+
+    const std::uint_least64_t generation = StatementsGeneration.load(std::memory_order_acquire);
+    if (session.Generation != generation) {
+        Sessions->ClearStatements(session);
+        session.Generation = generation;
+    }
+
+    std::string::size_type keySize = 2 + id.size();
+    for (const auto &part : parts) {
+        keySize += 1 + part.size();
+    }
+
+    std::string key;
+    key.reserve(keySize);
+    key += static_cast<char>(operation);
+    key += STATEMENT_KEY_SEPARATOR;
+    key += id;
+    for (const auto &part : parts) {
+        key += STATEMENT_KEY_SEPARATOR;
+        key += part;
+    }
+
+    auto it = session.Statements.find(key);
+    if (it != session.Statements.end()) {
+        StatementHits.fetch_add(1, std::memory_order_relaxed);
+        it->second.reset();
+        return it->second;
+    }
+
+    StatementMisses.fetch_add(1, std::memory_order_relaxed);
+
+    /// Kept here rather than in cppdb's own per-connection cache, which
+    /// would still need the text to look it up
+    cppdb::statement stat(session.Sql.create_prepared_uncached_statement(builder()));
+
+    it = session.Statements.emplace(std::move(key), stat).first;
+    Sessions->PreparedStatements.fetch_add(1, std::memory_order_relaxed);
+
+    return it->second;
+}
+
+void Database::Impl::InvalidateStatements()
+{
+    StatementsGeneration.fetch_add(1, std::memory_order_release);
+    StatementInvalidations.fetch_add(1, std::memory_order_relaxed);
+}
+
+template <typename Args_T>
+bool Database::Impl::Insert(Database *database,
+                            const std::string &id,
+                            const std::string &fields,
+                            const Args_T &args)
+{
+    static const OperationMetrics metrics(MakeOperationMetrics("insert"));
+    Metrics::Timer timer(metrics.Latency);
+    (void)timer;
+    TRACE_SPAN_DETAIL("sql", "Database::Insert", id);
+
+    try {
+        statement &stat = GetStatement(Operation::Insert, id,
+                                       { fields, std::to_string(args.size()) }, [&]() {
+            string ph;
+            for (size_t i = 0; i < args.size(); ++i) {
+                if (i != 0)
+                    ph += ", ";
+                ph += "?";
+            }
+
+            return (format("INSERT INTO \"%1%\" ( %2% ) VALUES ( %3% );")
+                    % database->GetTableName(id)
+                    % fields
+                    % ph).str();
+        });
+
+        for(const auto &arg : args) {
+            stat.bind(arg);
+        }
+
+        stat.exec();
+
+        return true;
+    } catch (const std::exception &ex) {
+        metrics.Errors->Increment();
+        LOG_ERROR(ex.what());
+    } catch (...) {
+        metrics.Errors->Increment();
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+
+    return false;
+}
+
+template <typename Args_T>
+bool Database::Impl::Update(Database *database,
+                            const std::string &id,
+                            const std::string &where,
+                            const std::string &value,
+                            const std::string &set,
+                            const Args_T &args)
+{
+    static const OperationMetrics metrics(MakeOperationMetrics("update"));
+    Metrics::Timer timer(metrics.Latency);
+    (void)timer;
+    TRACE_SPAN_DETAIL("sql", "Database::Update", id);
+
+    try {
+        statement &stat = GetStatement(Operation::Update, id,
+                                       { set, where }, [&]() {
+            return (format("UPDATE %1%\"%2%\" SET %3% WHERE %4%=?;")
+                    % (IsPgSql ? "ONLY " : "")
+                    % database->GetTableName(id)
+                    % set
+                    % where).str();
+        });
+
+        for(const auto &arg : args) {
+            stat.bind(arg);
+        }
+
+        stat.bind(value);
+
+        stat.exec();
+
+        return true;
+    } catch (const std::exception &ex) {
+        metrics.Errors->Increment();
+        LOG_ERROR(ex.what());
+    } catch (...) {
+        metrics.Errors->Increment();
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+
+    return false;
+}
@@ -37,9 +37,15 @@
 #define CORELIB_DATABASE_HPP
 
 
+#include <chrono>
+#include <functional>
+#include <future>
 #include <initializer_list>
 #include <memory>
 #include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 #include <cppdb/frontend.h>
 
 namespace CoreLib {
@@ -48,6 +54,89 @@ class Database;
 
 class CoreLib::Database
 {
+public:
+    struct PoolOptions
+    {
+        std::size_t MaxSize;
+        std::chrono::milliseconds CheckoutTimeout;
+        std::chrono::seconds HealthCheckIdleInterval;
+
+        /// Executed once on every newly opened session, e.g. per-connection
+        /// pragmas
+        std::vector<std::string> SessionInitStatements;
+
+        PoolOptions();
+    };
+
+    struct PoolStatistics
+    {
+        std::size_t MaxSize;
+        std::size_t OpenSessions;
+        std::size_t IdleSessions;
+        std::uint_least64_t Checkouts;
+        std::uint_least64_t Waits;
+        std::uint_least64_t Timeouts;
+        std::uint_least64_t FailedHealthChecks;
+        double TotalWaitMilliseconds;
+        double MaxWaitMilliseconds;
+
+        PoolStatistics();
+    };
+
+    struct StatementCacheStatistics
+    {
+        std::size_t Size;
+        std::uint_least64_t Hits;
+        std::uint_least64_t Misses;
+        std::uint_least64_t Invalidations;
+
+        StatementCacheStatistics();
+    };
+
+    struct WriteQueueOptions
+    {
+        std::size_t MaxSize;
+        std::size_t MaxBatchSize;
+        std::chrono::milliseconds MaxBatchDelay;
+
+        WriteQueueOptions();
+    };
+
+    struct WriteQueueStatistics
+    {
+        std::size_t Pending;
+        std::uint_least64_t Enqueued;
+        std::uint_least64_t Succeeded;
+        std::uint_least64_t Failed;
+        std::uint_least64_t Batches;
+        std::uint_least64_t FailedCommits;
+
+        WriteQueueStatistics();
+    };
+
+    /// Runs on the writer thread inside the batch transaction; returning
+    /// false or throwing rolls back this write only
+    typedef std::function<bool(cppdb::session &)> WriteJob;
+    typedef std::function<void(bool)> WriteCallback;
+
+    /// Zero or an empty string leaves the SQLite default in place
+    struct Sqlite3Profile
+    {
+        std::string JournalMode;
+        std::string Synchronous;
+        std::int_least64_t CacheSizeKiB;
+        std::int_least64_t MmapSizeBytes;
+        std::chrono::milliseconds BusyTimeout;
+        std::size_t IncrementalVacuumPages;
+        std::chrono::seconds IncrementalVacuumInterval;
+
+        Sqlite3Profile();
+
+        std::vector<std::string> GetSessionStatements() const;
+    };
+
+    class SessionScope;
+
 private:
     struct Impl;
     std::unique_ptr<Impl> m_pimpl;
@@ -77,14 +166,30 @@ public:
 
 #if defined ( HAS_SQLITE3 )
     static bool Sqlite3Vacuum(const std::string &databaseFile);
+    /// Rewrites the whole file once, holding the write lock throughout;
+    /// meant to run offline, before any server starts using the database
+    static bool Sqlite3EnableIncrementalVacuum(const std::string &databaseFile,
+                                               const Sqlite3Profile &profile);
 #endif  // defined ( HAS_SQLITE3 )
 
 public:
-    explicit Database(const std::string &connectionString);
+    explicit Database(const std::string &connectionString,
+                      const PoolOptions &poolOptions = PoolOptions(),
+                      const WriteQueueOptions &writeQueueOptions = WriteQueueOptions());
     virtual ~Database();
 
+#if defined ( HAS_SQLITE3 )
+    /// Reclaims free pages every IncrementalVacuumInterval on a thread of
+    /// its own, which the destructor stops and joins
+    void Sqlite3StartBackgroundVacuum(const std::string &databaseFile,
+                                      const Sqlite3Profile &profile);
+#endif  // defined ( HAS_SQLITE3 )
+
     cppdb::session &Sql();
 
+    PoolStatistics GetPoolStatistics();
+    StatementCacheStatistics GetStatementCacheStatistics();
+
     bool CreateEnum(const std::string &id);
 
     bool CreateTable(const std::string &id);
@@ -103,6 +208,25 @@ public:
                 const std::string &where,
                 const std::string &value);
 
+    std::future<bool> EnqueueWrite(const WriteJob &job,
+                                   const WriteCallback &callback = nullptr);
+    std::future<bool> InsertAsync(const std::string &id,
+                                  const std::string &fields,
+                                  const std::vector<std::string> &args,
+                                  const WriteCallback &callback = nullptr);
+    std::future<bool> UpdateAsync(const std::string &id,
+                                  const std::string &where,
+                                  const std::string &value,
+                                  const std::string &set,
+                                  const std::vector<std::string> &args,
+                                  const WriteCallback &callback = nullptr);
+    std::future<bool> DeleteAsync(const std::string &id,
+                                  const std::string &where,
+                                  const std::string &value,
+                                  const WriteCallback &callback = nullptr);
+    void FlushWrites();
+    WriteQueueStatistics GetWriteQueueStatistics();
+
     void RegisterEnum(const std::string &id,
                       const std::string &name,
                       const std::initializer_list<std::string> &enumerators);
@@ -118,6 +242,26 @@ public:
     bool Initialize();
 };
 
+/// Marks a unit of work, e.g. a request or an event handler. The first
+/// Sql() call inside the scope checks a session out of the pool and the
+/// outermost scope returns it. Outside of any scope a session checked out
+/// by Sql() stays bound to the calling thread until that thread exits,
+/// and a warning is logged when that happens. Destroying the Database only
+/// closes idle sessions; one another thread still holds is closed when
+/// that thread returns it or exits.
+class CoreLib::Database::SessionScope
+{
+private:
+    Database *m_database;
+
+public:
+    explicit SessionScope(Database *database);
+    ~SessionScope();
+
+    SessionScope(const SessionScope &) = delete;
+    SessionScope &operator=(const SessionScope &) = delete;
+};
+
 
 #endif /* CORELIB_DATABASE_HPP */
 
@@ -34,12 +34,24 @@
 
 
 #include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <cerrno>
+#include <cstring>
+#if defined ( __unix__ )
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif  // defined ( __unix__ )
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/exception.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
 #include "FileSystem.hpp"
 #include "Log.hpp"
+#include "make_unique.hpp"
 
 #define     UNKNOWN_ERROR       "Unknow filesystem error!"
 
@@ -47,6 +59,26 @@ using namespace std;
 using namespace boost;
 using namespace CoreLib;
 
+struct FileSystem::Impl
+{
+    template <typename _T>
+    static bool Read(const std::string &file, _T &out_data);
+
+#if defined ( __unix__ )
+    static void WriteAll(const int fd, const char *data, std::size_t size);
+    static void SyncDir(const filesystem::path &dir);
+#endif  // defined ( __unix__ )
+};
+
+struct FileSystem::MappedFile::Impl
+{
+    std::string File;
+    boost::iostreams::mapped_file_source Mapping;
+    bool IsOpen;
+
+    Impl();
+};
+
 bool FileSystem::DirExists(const std::string &dir)
 {
     try {
@@ -204,42 +236,278 @@ bool FileSystem::CopyFile(const std::string &from, const std::string &to, bool o
 }
 
 bool FileSystem::Read(const std::string &file, std::string &out_data)
+{
+    return Impl::Read(file, out_data);
+}
+
+bool FileSystem::Read(const std::string &file, std::vector<char> &out_data)
+{
+    return Impl::Read(file, out_data);
+}
+
+bool FileSystem::Write(const std::string &file, const std::string &data)
+{
+    const filesystem::path target(file);
+    const filesystem::path temp(target.parent_path()
+                                / filesystem::unique_path(target.filename().string()
+                                                          + ".%%%%-%%%%.tmp"));
+
+    try {
+#if defined ( __unix__ )
+        int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+        if (fd == -1) {
+            LOG_ERROR(file, temp.string(), std::strerror(errno));
+            return false;
+        }
+
+        try {
+            Impl::WriteAll(fd, data.data(), data.size());
+
+            if (::fsync(fd) != 0)
+                throw std::runtime_error(std::strerror(errno));
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+
+        if (::close(fd) != 0)
+            throw std::runtime_error(std::strerror(errno));
+#else
+        ofstream ofs(temp.string(), ios::out | ios::binary | ios::trunc);
+        if (!ofs.is_open()) {
+            LOG_ERROR(file, temp.string(), "Could not create the file!");
+            return false;
+        }
+
+        ofs.write(data.data(), static_cast<std::streamsize>(data.size()));
+        ofs.close();
+
+        if (!ofs)
+            throw std::runtime_error("Could not write the file!");
+#endif  // defined ( __unix__ )
+
+        filesystem::rename(temp, target);
+
+#if defined ( __unix__ )
+        /// Makes the rename itself durable
+        Impl::SyncDir(target.parent_path());
+#endif  // defined ( __unix__ )
+
+        return true;
+    } catch (const filesystem::filesystem_error &ex) {
+        LOG_ERROR(file, ex.what());
+    } catch (const std::exception &ex) {
+        LOG_ERROR(file, ex.what());
+    } catch (...) {
+        LOG_ERROR(file, UNKNOWN_ERROR);
+    }
+
+    boost::system::error_code ec;
+    filesystem::remove(temp, ec);
+
+    return false;
+}
+
+template <typename _T>
+bool FileSystem::Impl::Read(const std::string &file, _T &out_data)
 {
     try {
+        /// clear() keeps the capacity, so a buffer reused for files of
+        /// similar size is not reallocated
         out_data.clear();
-        ifstream ifs(file);
-        out_data.assign((istreambuf_iterator<char>(ifs)),
-                        istreambuf_iterator<char>());
-        ifs.close();
+
+        ifstream ifs(file, ios::in | ios::binary);
+        if (!ifs.is_open()) {
+            LOG_ERROR(file, "Could not open the file!");
+            return false;
+        }
+
+        ifs.seekg(0, ios::end);
+        const streamoff size = ifs.tellg();
+        ifs.seekg(0, ios::beg);
+
+        if (size > 0) {
+            out_data.resize(static_cast<std::size_t>(size));
+            ifs.read(&out_data[0], static_cast<std::streamsize>(size));
+            out_data.resize(static_cast<std::size_t>(ifs.gcount()));
+        }
+
+        /// Files that report no size, e.g. under /proc, or that grew since
+        if (ifs) {
+            out_data.insert(out_data.end(), istreambuf_iterator<char>(ifs),
+                            istreambuf_iterator<char>());
+        }
+
         return true;
     } catch (const std::ifstream::failure &ex) {
-        LOG_ERROR(ex.what());
+        LOG_ERROR(file, ex.what());
     } catch (const std::exception &ex) {
-        LOG_ERROR(ex.what());
+        LOG_ERROR(file, ex.what());
     } catch (...) {
-        LOG_ERROR(UNKNOWN_ERROR);
+        LOG_ERROR(file, UNKNOWN_ERROR);
     }
 
     return false;
 }
 
-bool FileSystem::Write(const std::string &file, const std::string &data)
+#if defined ( __unix__ )
+void FileSystem::Impl::WriteAll(const int fd, const char *data, std::size_t size)
 {
+    while (size > 0) {
+        const ssize_t written = ::write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            throw std::runtime_error(std::strerror(errno));
+        }
+
+        data += written;
+        size -= static_cast<std::size_t>(written);
+    }
+}
+
+void FileSystem::Impl::SyncDir(const filesystem::path &dir)
+{
+    const int fd = ::open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        return;
+
+    ::fsync(fd);
+    ::close(fd);
+}
+#endif  // defined ( __unix__ )
+
+FileSystem::MappedFile::MappedFile() :
+    m_pimpl(std::make_unique<MappedFile::Impl>())
+{
+
+}
+
+FileSystem::MappedFile::MappedFile(MappedFile &&other) :
+    m_pimpl(std::move(other.m_pimpl))
+{
+    other.m_pimpl = std::make_unique<MappedFile::Impl>();
+}
+
+FileSystem::MappedFile &FileSystem::MappedFile::operator=(MappedFile &&other)
+{
+    if (this != &other) {
+        m_pimpl = std::move(other.m_pimpl);
+        other.m_pimpl = std::make_unique<MappedFile::Impl>();
+    }
+
+    return *this;
+}
+
+FileSystem::MappedFile::~MappedFile() = default;
+
+bool FileSystem::MappedFile::Open(const std::string &file, std::string &out_error,
+                                  const Advice &advice)
+{
+    out_error.clear();
+
+    Close();
+
     try {
-        ofstream ofs(file.c_str(), ios::out | ios::trunc);
-        if (ofs.is_open()) {
-            ofs << data;
-            ofs.close();
+        /// mmap() refuses zero-length mappings
+        if (filesystem::file_size(file) == 0) {
+            m_pimpl->File = file;
+            m_pimpl->IsOpen = true;
             return true;
         }
-    } catch (const std::ifstream::failure &ex) {
-        LOG_ERROR(ex.what());
+
+        m_pimpl->Mapping.open(file);
+        if (!m_pimpl->Mapping.is_open()) {
+            out_error.assign("Could not map '" + file + "'!");
+            return false;
+        }
+
+        m_pimpl->File = file;
+        m_pimpl->IsOpen = true;
+
+        if (advice != Advice::Normal)
+            Advise(advice);
+
+        return true;
+    } catch (const filesystem::filesystem_error &ex) {
+        out_error.assign(ex.what());
     } catch (const std::exception &ex) {
-        LOG_ERROR(ex.what());
+        out_error.assign(ex.what());
     } catch (...) {
-        LOG_ERROR(UNKNOWN_ERROR);
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    Close();
+
+    return false;
+}
+
+void FileSystem::MappedFile::Close()
+{
+    if (m_pimpl->Mapping.is_open())
+        m_pimpl->Mapping.close();
+
+    m_pimpl->File.clear();
+    m_pimpl->IsOpen = false;
+}
+
+bool FileSystem::MappedFile::IsOpen() const
+{
+    return m_pimpl->IsOpen;
+}
+
+bool FileSystem::MappedFile::Advise(const Advice &advice)
+{
+    if (!m_pimpl->Mapping.is_open())
+        return false;
+
+#if defined ( __unix__ )
+    int flag = MADV_NORMAL;
+    switch (advice) {
+    case Advice::Normal:
+        flag = MADV_NORMAL;
+        break;
+    case Advice::Sequential:
+        flag = MADV_SEQUENTIAL;
+        break;
+    case Advice::Random:
+        flag = MADV_RANDOM;
+        break;
+    case Advice::WillNeed:
+        flag = MADV_WILLNEED;
+        break;
     }
 
+    /// The mapping starts at offset 0, so it is page-aligned
+    return ::madvise(const_cast<char *>(m_pimpl->Mapping.data()), m_pimpl->Mapping.size(), flag) == 0;
+#else
+    (void)advice;
     return false;
+#endif  // defined ( __unix__ )
 }
 
+const std::string &FileSystem::MappedFile::GetFile() const
+{
+    return m_pimpl->File;
+}
+
+const char *FileSystem::MappedFile::GetData() const
+{
+    return m_pimpl->Mapping.is_open() ? m_pimpl->Mapping.data() : nullptr;
+}
+
+std::size_t FileSystem::MappedFile::GetSize() const
+{
+    return m_pimpl->Mapping.is_open() ? m_pimpl->Mapping.size() : 0;
+}
+
+boost::string_ref FileSystem::MappedFile::GetView() const
+{
+    return boost::string_ref(GetData(), GetSize());
+}
+
+FileSystem::MappedFile::Impl::Impl() :
+    IsOpen(false)
+{
+
+}
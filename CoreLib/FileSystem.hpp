@@ -37,7 +37,11 @@
 #define CORELIB_FILESYSTEM_HPP
 
 
+#include <memory>
 #include <string>
+#include <vector>
+#include <cstddef>
+#include <boost/utility/string_ref.hpp>
 
 namespace CoreLib {
 class FileSystem;
@@ -45,6 +49,12 @@ class FileSystem;
 
 class CoreLib::FileSystem
 {
+public:
+    class MappedFile;
+
+private:
+    struct Impl;
+
 public:
     static bool DirExists(const std::string &dir);
     static bool FileExists(const std::string &file);
@@ -55,10 +65,57 @@ public:
     static bool Move(const std::string &from, const std::string &to);
     static bool CopyFile(const std::string &from, const std::string &to, bool overwrite = true);
 
+    /// Both reuse the capacity out_data already has
     static bool Read(const std::string &file, std::string &out_data);
+    static bool Read(const std::string &file, std::vector<char> &out_data);
+
+    /// Writes to a temporary file next to the target, flushes it to disk
+    /// and renames it over the target, so a crash leaves either the old or
+    /// the new content, never a mix of both
     static bool Write(const std::string &file, const std::string &data);
 };
 
+/// A read-only memory mapping of a whole file; pages are shared with the
+/// page cache and every other process mapping the same file
+class CoreLib::FileSystem::MappedFile
+{
+public:
+    /// Access pattern hints, passed to madvise() where it exists
+    enum class Advice : unsigned char {
+        Normal,
+        Sequential,
+        Random,
+        WillNeed
+    };
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    MappedFile();
+    MappedFile(MappedFile &&other);
+    MappedFile &operator=(MappedFile &&other);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+public:
+    /// Empty files open fine but have no data
+    bool Open(const std::string &file, std::string &out_error,
+              const Advice &advice = Advice::Normal);
+    void Close();
+    bool IsOpen() const;
+
+    bool Advise(const Advice &advice);
+
+    const std::string &GetFile() const;
+    const char *GetData() const;
+    std::size_t GetSize() const;
+    boost::string_ref GetView() const;
+};
+
 
 #endif /* CORELIB_FILESYSTEM_HPP */
 
@@ -40,6 +40,7 @@
 #include <curlpp/Exception.hpp>
 #include <curlpp/Options.hpp>
 #include "Http.hpp"
+#include "Trace.hpp"
 
 #define     UNKNOWN_ERROR           "Unknown error!"
 #define     OPEN_FILE_ERROR         "Could not open file!"
@@ -57,6 +58,8 @@ bool Http::Download(const std::string &remoteAddr, const std::string &localPath)
 bool Http::Download(const std::string &remoteAddr, const std::string &localPath,
                         std::string &out_error)
 {
+    TRACE_SPAN_DETAIL("http", "Http::Download", remoteAddr);
+
     try {
         out_error.clear();
 
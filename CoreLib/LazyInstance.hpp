@@ -0,0 +1,94 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ *
+ * @section DESCRIPTION
+ *
+ * Thread-safe, initialize-once holder for process wide instances.
+ */
+
+
+#ifndef CORELIB_LAZY_INSTANCE_HPP
+#define CORELIB_LAZY_INSTANCE_HPP
+
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+namespace CoreLib {
+template<typename Instance_T>
+class LazyInstance;
+}
+
+/// Once constructed, Get() costs a single acquire load; std::call_once
+/// only serializes the callers racing on the very first construction.
+/// A throwing factory leaves the instance unset so a later call may retry.
+template<typename Instance_T>
+class CoreLib::LazyInstance
+{
+private:
+    std::once_flag m_onceFlag;
+    std::unique_ptr<Instance_T> m_instance;
+    std::atomic<Instance_T *> m_pointer;
+
+public:
+    LazyInstance() :
+        m_pointer(nullptr)
+    {
+
+    }
+
+    LazyInstance(const LazyInstance &) = delete;
+    LazyInstance &operator=(const LazyInstance &) = delete;
+
+    virtual ~LazyInstance() = default;
+
+public:
+    template<typename Factory_T>
+    Instance_T *Get(Factory_T factory)
+    {
+        Instance_T *instance = m_pointer.load(std::memory_order_acquire);
+
+        if (instance == nullptr) {
+            std::call_once(m_onceFlag, [this, &factory]() {
+                m_instance = factory();
+                m_pointer.store(m_instance.get(), std::memory_order_release);
+            });
+
+            instance = m_pointer.load(std::memory_order_acquire);
+        }
+
+        return instance;
+    }
+};
+
+
+#endif /* CORELIB_LAZY_INSTANCE_HPP */
+
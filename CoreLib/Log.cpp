@@ -29,22 +29,43 @@
  *
  * @section DESCRIPTION
  *
- * A thread-safe log class with support for log files and standard output that
- * provides different log levels.
+ * A thread-safe asynchronous log class with support for log files and standard
+ * output that provides different log levels.
  */
 
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include <cassert>
+#include <csignal>
+#include <cstdint>
 #include <boost/algorithm/string.hpp>
+#include <boost/date_time/gregorian/gregorian.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/filesystem/exception.hpp>
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/format.hpp>
-#include <boost/thread/lock_guard.hpp>
-#include <boost/thread/mutex.hpp>
 #include "make_unique.hpp"
+#include "LazyInstance.hpp"
 #include "Log.hpp"
+#include "Utility.hpp"
+
+#define     DEFAULT_BUFFER_CAPACITY             8192
+#define     FLUSH_INTERVAL_MILLISECONDS         100
+#define     MAX_RECORDS_PER_WRITE               1024
+
+#define     DEFAULT_ROTATION_MAX_FILE_SIZE      67108864
+#define     DEFAULT_ROTATION_RETENTION_COUNT    30
+
+#define     LOG_FILE_EXTENSION                  ".txt"
 
 using namespace std;
 using namespace boost;
@@ -53,44 +74,134 @@ using namespace CoreLib;
 struct Log::Impl
 {
 public:
-    struct ETypeHasher
-    {
-        std::size_t operator()(const EType &t) const
-        {
-            return std::hash<unsigned char>()(static_cast<unsigned char>(t));
-        }
-    };
-
     struct StorageStruct
     {
         bool MultiStream;
         bool Initialized;
 
-        std::unordered_map<Log::EType, std::string, ETypeHasher> LogTypeHash;
-
         std::ostream *LogOutputStream;
 
         std::ofstream LogOutputFileStream;
         std::string LogOutputDirectoryPath;
         std::string LogOutputFilePrefix;
         std::string LogOutputFilePath;
+
+        std::uintmax_t LogOutputFileSize;
+        boost::gregorian::date LogOutputFileDate;
     };
 
     typedef std::unique_ptr<StorageStruct> Storage_ptr;
 
-    boost::mutex StorageMutex;
-    Storage_ptr StorageInstance;
+    struct BackendStruct;
+
+    /// Declared before the backend, so the flusher thread is joined while
+    /// the streams it writes to are still alive
+    LazyInstance<StorageStruct> StorageInstance;
+    LazyInstance<BackendStruct> BackendInstance;
+
+    /// Bounded multi-producer ring buffer with per-slot sequence numbers;
+    /// producers never take a lock and the flusher thread is its only
+    /// consumer.
+    struct Slot
+    {
+        std::atomic<std::size_t> Sequence;
+        std::string Record;
+    };
+
+    struct BackendStruct
+    {
+        StorageStruct *Storage;
+
+        std::unique_ptr<Slot[]> Slots;
+        std::size_t Mask;
+        EOverflowPolicy OverflowPolicy;
+
+        std::atomic<std::size_t> EnqueuePosition;
+        std::size_t DequeuePosition;
+
+        std::atomic<std::uint_least64_t> Enqueued;
+        std::atomic<std::uint_least64_t> Dropped;
+        std::uint_least64_t Written;
+
+        std::mutex WakeUpMutex;
+        std::condition_variable WakeUp;
+        std::condition_variable Flushed;
+        std::atomic<bool> IsIdle;
+        bool IsStopping;
+
+        RotationOptions Rotation;
+        std::thread Archiver;
+
+        /// Segments this process has closed, oldest first. Only these are
+        /// ever pruned: other processes may log to the same directory with
+        /// the same prefix, and their active files must never be touched.
+        /// Only the archiver thread touches it, one at a time.
+        std::deque<std::string> ClosedSegments;
+
+        std::thread Flusher;
+
+        BackendStruct(StorageStruct *storage,
+                      std::size_t capacity, EOverflowPolicy overflowPolicy,
+                      const RotationOptions &rotation);
+        ~BackendStruct();
+
+        void Push(std::string &record);
+        bool TryPush(std::string &record);
+        bool TryPop(std::string &out_record);
 
-    boost::mutex LogMutex;
+        void Run();
+        void Write(const std::string &batch);
+        void Flush();
+
+        bool IsRotationDue(std::size_t incomingSize);
+        void Rotate();
+        void Archive(const std::string &segmentPath);
+    };
+
+    typedef std::unique_ptr<BackendStruct> Backend_ptr;
+
+    std::atomic<std::size_t> BufferCapacity;
+    std::atomic<EOverflowPolicy> OverflowPolicy;
+
+    std::mutex RotationMutex;
+    RotationOptions Rotation;
 
 public:
     Impl();
-    ~Impl();
 
 public:
     StorageStruct *Storage();
+    BackendStruct *Backend();
+
+    /// Indexed by EType
+    static const char *const TypeNames[];
+
+    /// Both only ever touched through lock-free atomics, so the signal
+    /// handler may flip them at any point
+    static std::atomic<unsigned char> QuietLevel;
+    static std::atomic<unsigned char> VerboseLevel;
+
+    static Storage_ptr CreateStorage();
+    static void OnLevelSignal(int signal);
+    static std::string MakeLogFilePath(const std::string &directoryPath,
+                                       const std::string &filePrefix);
+};
+
+const char *const Log::Impl::TypeNames[] = {
+    "TRACE",
+    "DEBUG",
+    "INFO",
+    "WARNING",
+    "ERROR",
+    "FATAL"
 };
 
+std::atomic<unsigned char> Log::s_level(static_cast<unsigned char>(Log::EType::Trace));
+std::atomic<unsigned char> Log::s_format(static_cast<unsigned char>(Log::EFormat::Text));
+
+std::atomic<unsigned char> Log::Impl::QuietLevel(static_cast<unsigned char>(Log::EType::Trace));
+std::atomic<unsigned char> Log::Impl::VerboseLevel(static_cast<unsigned char>(Log::EType::Trace));
+
 std::unique_ptr<Log::Impl> Log::s_pimpl = make_unique<Log::Impl>();
 
 void Log::Initialize(std::ostream &out_outputStream)
@@ -100,8 +211,10 @@ void Log::Initialize(std::ostream &out_outputStream)
 
     s_pimpl->Storage()->LogOutputStream = &out_outputStream;
 
-    if (!s_pimpl->Storage()->MultiStream)
+    if (!s_pimpl->Storage()->MultiStream) {
+        s_pimpl->Backend();
         s_pimpl->Storage()->Initialized = true;
+    }
 }
 
 void Log::Initialize(const std::string &outputDirectoryPath,
@@ -124,18 +237,13 @@ void Log::Initialize(const std::string &outputDirectoryPath,
     }
 
     s_pimpl->Storage()->LogOutputFilePath =
-            (filesystem::path(s_pimpl->Storage()->LogOutputDirectoryPath)
-             / filesystem::path((format("%1%_%2%.txt")
-                                 % s_pimpl->Storage()->LogOutputFilePrefix
-                                 % algorithm::replace_all_copy(
-                                     algorithm::replace_all_copy(
-                                         posix_time::to_simple_string(
-                                             posix_time::second_clock::local_time()),
-                                         ":", "-"),
-                                     " ", "_")).str())).string();
-
-    if (!s_pimpl->Storage()->MultiStream)
+            Impl::MakeLogFilePath(s_pimpl->Storage()->LogOutputDirectoryPath,
+                                  s_pimpl->Storage()->LogOutputFilePrefix);
+
+    if (!s_pimpl->Storage()->MultiStream) {
+        s_pimpl->Backend();
         s_pimpl->Storage()->Initialized = true;
+    }
 }
 
 void Log::Initialize(std::ostream &out_outputStream,
@@ -150,92 +258,559 @@ void Log::Initialize(std::ostream &out_outputStream,
     Initialize(out_outputStream);
     Initialize(outputDirectoryPath, outputFilePrefix);
 
+    s_pimpl->Backend();
     s_pimpl->Storage()->Initialized = true;
 }
 
+void Log::InitializeFromDefinitions(std::ostream &out_outputStream,
+                                    const std::string &outputDirectoryPath,
+                                    const std::string &outputFilePrefix)
+{
+#if defined ( CORELIB_LOG_FORMAT_JSON_LINES )
+    SetFormat(EFormat::JsonLines);
+#endif  // defined ( CORELIB_LOG_FORMAT_JSON_LINES )
+
+#if defined ( CORELIB_LOG_BUFFER_CAPACITY )
+#if defined ( CORELIB_LOG_OVERFLOW_POLICY_DROP )
+    Configure(CORELIB_LOG_BUFFER_CAPACITY, EOverflowPolicy::Drop);
+#else
+    Configure(CORELIB_LOG_BUFFER_CAPACITY, EOverflowPolicy::Block);
+#endif  // defined ( CORELIB_LOG_OVERFLOW_POLICY_DROP )
+#endif  // defined ( CORELIB_LOG_BUFFER_CAPACITY )
+
+    RotationOptions rotation;
+#if defined ( CORELIB_LOG_ROTATION_MAX_FILE_SIZE_BYTES )
+    rotation.MaxFileSize = CORELIB_LOG_ROTATION_MAX_FILE_SIZE_BYTES;
+#endif  // defined ( CORELIB_LOG_ROTATION_MAX_FILE_SIZE_BYTES )
+#if defined ( CORELIB_LOG_ROTATION_NOT_DAILY )
+    rotation.Daily = false;
+#endif  // defined ( CORELIB_LOG_ROTATION_NOT_DAILY )
+#if defined ( CORELIB_LOG_ROTATION_COMPRESSION_NONE )
+    rotation.Compress = false;
+#elif defined ( CORELIB_LOG_ROTATION_COMPRESSION_BZIP2 )
+    rotation.CompressionAlgorithm = Compression::Algorithm::Bzip2;
+#elif defined ( CORELIB_LOG_ROTATION_COMPRESSION_ZSTD )
+    rotation.CompressionAlgorithm = Compression::Algorithm::Zstd;
+#elif defined ( CORELIB_LOG_ROTATION_COMPRESSION_LZ4 )
+    rotation.CompressionAlgorithm = Compression::Algorithm::Lz4;
+#endif  // defined ( CORELIB_LOG_ROTATION_COMPRESSION_NONE )
+#if defined ( CORELIB_LOG_ROTATION_RETENTION_COUNT )
+    rotation.RetentionCount = CORELIB_LOG_ROTATION_RETENTION_COUNT;
+#endif  // defined ( CORELIB_LOG_ROTATION_RETENTION_COUNT )
+    ConfigureRotation(rotation);
+
+    Initialize(out_outputStream, outputDirectoryPath, outputFilePrefix);
+
+#if defined ( CORELIB_LOG_LEVEL )
+    SetLevel(static_cast<EType>(CORELIB_LOG_LEVEL));
+#endif  // defined ( CORELIB_LOG_LEVEL )
+
+#if defined ( __unix__ )
+    ToggleLevelOnSignal(SIGUSR1);
+#endif  // defined ( __unix__ )
+}
+
+void Log::Configure(std::size_t bufferCapacity, EOverflowPolicy overflowPolicy)
+{
+    s_pimpl->BufferCapacity.store(bufferCapacity);
+    s_pimpl->OverflowPolicy.store(overflowPolicy);
+}
+
+void Log::ConfigureRotation(const RotationOptions &options)
+{
+    std::lock_guard<std::mutex> lock(s_pimpl->RotationMutex);
+    (void)lock;
+
+    s_pimpl->Rotation = options;
+}
+
+void Log::SetLevel(EType level)
+{
+    s_level.store(static_cast<unsigned char>(level), std::memory_order_relaxed);
+}
+
+Log::EType Log::GetLevel()
+{
+    return static_cast<EType>(s_level.load(std::memory_order_relaxed));
+}
+
+bool Log::ToggleLevelOnSignal(const int signal, const EType verboseLevel)
+{
+    Impl::VerboseLevel.store(static_cast<unsigned char>(verboseLevel), std::memory_order_relaxed);
+
+    if (std::signal(signal, &Impl::OnLevelSignal) == SIG_ERR) {
+        LOG_ERROR("Failed to install the log level signal handler!", signal);
+        return false;
+    }
+
+    return true;
+}
+
+void Log::SetFormat(EFormat format)
+{
+    s_format.store(static_cast<unsigned char>(format), std::memory_order_relaxed);
+}
+
+Log::EFormat Log::GetFormat()
+{
+    return static_cast<EFormat>(s_format.load(std::memory_order_relaxed));
+}
+
+void Log::Flush()
+{
+    if (!s_pimpl->Storage()->Initialized)
+        return;
+
+    s_pimpl->Backend()->Flush();
+}
+
+Log::RotationOptions::RotationOptions() :
+    MaxFileSize(DEFAULT_ROTATION_MAX_FILE_SIZE),
+    Daily(true),
+    Compress(true),
+    CompressionAlgorithm(Compression::Algorithm::Gzip),
+    RetentionCount(DEFAULT_ROTATION_RETENTION_COUNT)
+{
+
+}
+
 Log::Log(EType type, const std::string &file, const std::string &func, int line, ...)
-    : m_hasEntries(false)
+    : m_hasEntries(false),
+      m_type(type),
+      m_isJson(GetFormat() == EFormat::JsonLines)
 {
     assert(s_pimpl->Storage()->Initialized);
 
+    if (m_isJson) {
+        std::string header("{\"time\":\"");
+        header += posix_time::to_iso_extended_string(posix_time::microsec_clock::local_time());
+        header += "\",\"level\":\"";
+        header += Impl::TypeNames[static_cast<unsigned char>(type)];
+        header += "\",\"file\":";
+        Utility::AppendJsonString(header, file);
+        header += ",\"function\":";
+        Utility::AppendJsonString(header, func);
+        header += ",\"line\":";
+        header += std::to_string(line);
+        m_buffer << header;
+        return;
+    }
+
     m_buffer << "[ " << posix_time::second_clock::local_time()
-             << " " << s_pimpl->Storage()->LogTypeHash[type]
+             << " " << Impl::TypeNames[static_cast<unsigned char>(type)]
                 << " " << line << " " << func << " " << file << " ]"
                 << "\n";
 }
 
 Log::~Log()
 {
-    m_buffer << "\n\n";
-    m_buffer.flush();
+    if (m_isJson) {
+        if (!m_jsonArguments.empty())
+            m_buffer << ",\"args\":[" << m_jsonArguments << "]";
+        if (!m_jsonFields.empty())
+            m_buffer << ",\"fields\":{" << m_jsonFields << "}";
+        m_buffer << "}\n";
+    } else {
+        m_buffer << "\n\n";
+    }
 
-    boost::lock_guard<boost::mutex> lock(s_pimpl->LogMutex);
-    (void)lock;
+    std::string record(m_buffer.str());
+    s_pimpl->Backend()->Push(record);
+
+    /// The process is likely about to go down, make sure this one lands
+    if (m_type == EType::Fatal)
+        s_pimpl->Backend()->Flush();
+}
 
-    if (s_pimpl->Storage()->LogOutputStream) {
-        (*s_pimpl->Storage()->LogOutputStream) << m_buffer.str();
-        s_pimpl->Storage()->LogOutputStream->flush();
+void Log::AppendJsonArgument(const std::string &value)
+{
+    /// The first plain argument is the message, by convention
+    if (!m_hasEntries) {
+        std::string message(",\"message\":");
+        Utility::AppendJsonString(message, value);
+        m_buffer << message;
+        m_hasEntries = true;
+        return;
     }
 
-    if (s_pimpl->Storage()->LogOutputFilePath != "") {
-        if(!s_pimpl->Storage()->LogOutputFileStream.is_open()) {
-            s_pimpl->Storage()->LogOutputFileStream.open(
-                        s_pimpl->Storage()->LogOutputFilePath,
-                        std::ios_base::out | std::ios_base::app);
-            s_pimpl->Storage()->LogOutputFileStream.imbue(
-                        std::locale(
-                            s_pimpl->Storage()->LogOutputFileStream.getloc(),
-                            new posix_time::time_facet()));
-        }
+    if (!m_jsonArguments.empty())
+        m_jsonArguments += ",";
+    Utility::AppendJsonString(m_jsonArguments, value);
+}
+
+void Log::AppendJsonField(const char *key, const std::string &value)
+{
+    if (!m_jsonFields.empty())
+        m_jsonFields += ",";
+    Utility::AppendJsonString(m_jsonFields, key);
+    m_jsonFields += ":";
+    Utility::AppendJsonString(m_jsonFields, value);
+}
+
+Log::Impl::Impl() :
+    BufferCapacity(DEFAULT_BUFFER_CAPACITY),
+    OverflowPolicy(EOverflowPolicy::Block)
+{
+
+}
 
-        s_pimpl->Storage()->LogOutputFileStream << m_buffer.str();
-        s_pimpl->Storage()->LogOutputFileStream.flush();
-        s_pimpl->Storage()->LogOutputFileStream.close();
+Log::Impl::StorageStruct *Log::Impl::Storage()
+{
+    return StorageInstance.Get(&Impl::CreateStorage);
+}
+
+Log::Impl::BackendStruct *Log::Impl::Backend()
+{
+    return BackendInstance.Get([this]() {
+        std::lock_guard<std::mutex> lock(RotationMutex);
+        (void)lock;
+
+        return make_unique<BackendStruct>(Storage(), BufferCapacity.load(), OverflowPolicy.load(),
+                                          Rotation);
+    });
+}
+
+Log::Impl::Storage_ptr Log::Impl::CreateStorage()
+{
+    Storage_ptr storage = make_unique<StorageStruct>();
+
+    storage->MultiStream = false;
+    storage->Initialized = false;
+
+    storage->LogOutputStream = NULL;
+
+    storage->LogOutputFileSize = 0;
+
+    return storage;
+}
+
+void Log::Impl::OnLevelSignal(int signal)
+{
+    (void)signal;
+
+    const unsigned char verbose = VerboseLevel.load(std::memory_order_relaxed);
+    const unsigned char current = s_level.load(std::memory_order_relaxed);
+
+    if (current == verbose) {
+        s_level.store(QuietLevel.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    } else {
+        QuietLevel.store(current, std::memory_order_relaxed);
+        s_level.store(verbose, std::memory_order_relaxed);
     }
 }
 
-Log::Impl::Impl()
+std::string Log::Impl::MakeLogFilePath(const std::string &directoryPath,
+                                       const std::string &filePrefix)
 {
+    /// Sortable down to the microsecond, so file names alone give the
+    /// order of segments for retention
+    const std::string timestamp(posix_time::to_iso_string(
+                                    posix_time::microsec_clock::local_time()));
+
+    std::string path((filesystem::path(directoryPath)
+                      / filesystem::path((format("%1%_%2%" LOG_FILE_EXTENSION)
+                                          % filePrefix
+                                          % timestamp).str())).string());
+
+    /// Size based rotation may happen more than once a second, and an
+    /// archived segment must never be overwritten by a later one
+    const auto isTaken = [](const std::string &p) {
+        return filesystem::exists(p) || filesystem::exists(p + ".gz")
+                || filesystem::exists(p + ".bz2") || filesystem::exists(p + ".z")
+                || filesystem::exists(p + ".zst") || filesystem::exists(p + ".lz4");
+    };
+
+    for (std::size_t i = 1; isTaken(path); ++i) {
+        path = (filesystem::path(directoryPath)
+                / filesystem::path((format("%1%_%2%_%3%" LOG_FILE_EXTENSION)
+                                    % filePrefix
+                                    % timestamp
+                                    % i).str())).string();
+    }
 
+    return path;
 }
 
-Log::Impl::~Impl()
+Log::Impl::BackendStruct::BackendStruct(StorageStruct *storage,
+                                        std::size_t capacity, EOverflowPolicy overflowPolicy,
+                                        const RotationOptions &rotation) :
+    Storage(storage),
+    OverflowPolicy(overflowPolicy),
+    EnqueuePosition(0),
+    DequeuePosition(0),
+    Enqueued(0),
+    Dropped(0),
+    Written(0),
+    IsIdle(false),
+    IsStopping(false),
+    Rotation(rotation)
 {
-    boost::lock_guard<boost::mutex> lock(StorageMutex);
-    (void)lock;
+    /// Round up to a power of two so a slot is picked with a mask
+    std::size_t size = 2;
+    while (size < capacity)
+        size <<= 1;
+
+    Slots.reset(new Slot[size]);
+    Mask = size - 1;
 
-    StorageInstance.reset();
+    for (std::size_t i = 0; i < size; ++i) {
+        Slots[i].Sequence.store(i, std::memory_order_relaxed);
+    }
+
+    Flusher = std::thread(&BackendStruct::Run, this);
 }
 
-Log::Impl::StorageStruct *Log::Impl::Storage()
+Log::Impl::BackendStruct::~BackendStruct()
 {
-    boost::lock_guard<boost::mutex> lock(StorageMutex);
-    (void)lock;
+    {
+        std::lock_guard<std::mutex> lock(WakeUpMutex);
+        (void)lock;
+
+        IsStopping = true;
+    }
+
+    WakeUp.notify_one();
+
+    if (Flusher.joinable())
+        Flusher.join();
+
+    if (Archiver.joinable())
+        Archiver.join();
+}
+
+void Log::Impl::BackendStruct::Push(std::string &record)
+{
+    while (!TryPush(record)) {
+        if (OverflowPolicy == EOverflowPolicy::Drop) {
+            Dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+
+        WakeUp.notify_one();
+        std::this_thread::yield();
+    }
+
+    Enqueued.fetch_add(1, std::memory_order_release);
+
+    if (IsIdle.load(std::memory_order_relaxed))
+        WakeUp.notify_one();
+}
+
+bool Log::Impl::BackendStruct::TryPush(std::string &record)
+{
+    std::size_t position = EnqueuePosition.load(std::memory_order_relaxed);
+
+    for (;;) {
+        Slot &slot = Slots[position & Mask];
+        std::size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+        std::intptr_t difference = static_cast<std::intptr_t>(sequence)
+                - static_cast<std::intptr_t>(position);
+
+        if (difference == 0) {
+            if (EnqueuePosition.compare_exchange_weak(position, position + 1,
+                                                      std::memory_order_relaxed)) {
+                slot.Record.swap(record);
+                slot.Sequence.store(position + 1, std::memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = EnqueuePosition.load(std::memory_order_relaxed);
+        }
+    }
+}
 
-    if (StorageInstance == nullptr) {
-        StorageInstance = make_unique<StorageStruct>();
+bool Log::Impl::BackendStruct::TryPop(std::string &out_record)
+{
+    Slot &slot = Slots[DequeuePosition & Mask];
+    std::size_t sequence = slot.Sequence.load(std::memory_order_acquire);
+
+    if (sequence != DequeuePosition + 1)
+        return false;
+
+    out_record.swap(slot.Record);
+    slot.Record.clear();
+    slot.Sequence.store(DequeuePosition + Mask + 1, std::memory_order_release);
+    ++DequeuePosition;
+
+    return true;
+}
+
+void Log::Impl::BackendStruct::Run()
+{
+    std::string record;
+    std::string batch;
+
+    for (;;) {
+        std::size_t count = 0;
+
+        batch.clear();
+        while (count < MAX_RECORDS_PER_WRITE && TryPop(record)) {
+            batch += record;
+            ++count;
+        }
+
+        std::uint_least64_t dropped = Dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped > 0) {
+            if (GetFormat() == EFormat::JsonLines) {
+                batch += (format("{\"time\":\"%1%\",\"level\":\"WARNING\",\"message\":\"Log buffer was full\","
+                                 "\"fields\":{\"dropped\":\"%2%\"}}\n")
+                          % posix_time::to_iso_extended_string(posix_time::microsec_clock::local_time())
+                          % dropped).str();
+            } else {
+                batch += (format("[ %1% DROPPED %2% log records, buffer was full ]\n\n")
+                          % posix_time::second_clock::local_time()
+                          % dropped).str();
+            }
+        }
 
-        StorageInstance->MultiStream = false;
-        StorageInstance->Initialized = false;
+        if (!batch.empty()) {
+            Write(batch);
 
-        StorageInstance->LogTypeHash.clear();
-        StorageInstance->LogTypeHash[Log::EType::Trace] = "TRACE";
-        StorageInstance->LogTypeHash[Log::EType::Debug] = "DEBUG";
-        StorageInstance->LogTypeHash[Log::EType::Info] = "INFO";
-        StorageInstance->LogTypeHash[Log::EType::Warning] = "WARNING";
-        StorageInstance->LogTypeHash[Log::EType::Error] = "ERROR";
-        StorageInstance->LogTypeHash[Log::EType::Fatal] = "FATAL";
+            std::lock_guard<std::mutex> lock(WakeUpMutex);
+            (void)lock;
 
-        StorageInstance->LogOutputStream = NULL;
+            Written += count;
+            Flushed.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(WakeUpMutex);
+
+        if (IsStopping)
+            break;
 
-        if (StorageInstance->LogOutputFileStream.is_open())
-            StorageInstance->LogOutputFileStream.close();
+        IsIdle.store(true, std::memory_order_relaxed);
+        WakeUp.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL_MILLISECONDS));
+        IsIdle.store(false, std::memory_order_relaxed);
+    }
+
+    if (Storage->LogOutputFileStream.is_open())
+        Storage->LogOutputFileStream.close();
+}
 
-        StorageInstance->LogOutputDirectoryPath.clear();;
-        StorageInstance->LogOutputFilePrefix.clear();;
-        StorageInstance->LogOutputFilePath.clear();;
+void Log::Impl::BackendStruct::Write(const std::string &batch)
+{
+    if (Storage->LogOutputStream) {
+        (*Storage->LogOutputStream) << batch;
+        Storage->LogOutputStream->flush();
     }
 
-    return StorageInstance.get();
+    if (Storage->LogOutputFilePath != "") {
+        if (IsRotationDue(batch.size()))
+            Rotate();
+
+        if (!Storage->LogOutputFileStream.is_open()) {
+            Storage->LogOutputFileStream.open(Storage->LogOutputFilePath,
+                                              std::ios_base::out | std::ios_base::app);
+            boost::system::error_code ec;
+            std::uintmax_t size = filesystem::file_size(Storage->LogOutputFilePath, ec);
+            Storage->LogOutputFileSize = ec ? 0 : size;
+            Storage->LogOutputFileDate = gregorian::day_clock::local_day();
+        }
+
+        Storage->LogOutputFileStream << batch;
+        Storage->LogOutputFileStream.flush();
+        Storage->LogOutputFileSize += batch.size();
+    }
 }
 
+bool Log::Impl::BackendStruct::IsRotationDue(std::size_t incomingSize)
+{
+    if (!Storage->LogOutputFileStream.is_open() || Storage->LogOutputFileSize == 0)
+        return false;
+
+    if (Rotation.MaxFileSize > 0
+            && Storage->LogOutputFileSize + incomingSize > Rotation.MaxFileSize)
+        return true;
+
+    if (Rotation.Daily
+            && gregorian::day_clock::local_day() != Storage->LogOutputFileDate)
+        return true;
+
+    return false;
+}
+
+void Log::Impl::BackendStruct::Rotate()
+{
+    Storage->LogOutputFileStream.close();
+
+    const std::string segmentPath(Storage->LogOutputFilePath);
+    Storage->LogOutputFilePath = MakeLogFilePath(Storage->LogOutputDirectoryPath,
+                                                 Storage->LogOutputFilePrefix);
+
+    /// At most one archiver at a time; a rotation every few seconds means
+    /// the size limit is far too small anyway
+    if (Archiver.joinable())
+        Archiver.join();
+
+    Archiver = std::thread(&BackendStruct::Archive, this, segmentPath);
+}
+
+void Log::Impl::BackendStruct::Archive(const std::string &segmentPath)
+{
+    /// Never log from here: the flusher may be waiting for this thread
+    /// while the buffer is full
+    try {
+        std::string closedPath(segmentPath);
+
+        if (Rotation.Compress) {
+            std::ifstream segment(segmentPath, std::ios_base::in | std::ios_base::binary);
+            if (segment.is_open()) {
+                const std::string archivePath(
+                            segmentPath
+                            + Compression::GetFileExtension(Rotation.CompressionAlgorithm));
+                std::ofstream archive(archivePath, std::ios_base::out | std::ios_base::binary
+                                      | std::ios_base::trunc);
+
+                /// Streamed through in chunks, a segment may be as large as
+                /// MaxFileSize. A failure leaves the segment uncompressed
+                /// rather than reporting through the logger.
+                Compression::Compressor compressor(Rotation.CompressionAlgorithm);
+                std::string error;
+                bool isCompressed = archive.is_open()
+                        && compressor.Compress(segment, archive, error);
+
+                segment.close();
+                archive.close();
+                isCompressed = isCompressed && archive;
+
+                boost::system::error_code ec;
+                if (isCompressed) {
+                    filesystem::remove(segmentPath, ec);
+                    closedPath = archivePath;
+                } else {
+                    filesystem::remove(archivePath, ec);
+                }
+            }
+        }
+
+        ClosedSegments.push_back(closedPath);
+
+        if (Rotation.RetentionCount == 0)
+            return;
+
+        boost::system::error_code ec;
+        while (ClosedSegments.size() > Rotation.RetentionCount) {
+            filesystem::remove(ClosedSegments.front(), ec);
+            ClosedSegments.pop_front();
+        }
+    } catch (const std::exception &ex) {
+        std::cerr << "Log rotation failed: " << ex.what() << std::endl;
+    } catch (...) {
+        std::cerr << "Log rotation failed!" << std::endl;
+    }
+}
+
+void Log::Impl::BackendStruct::Flush()
+{
+    std::uint_least64_t target = Enqueued.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock(WakeUpMutex);
+
+    WakeUp.notify_one();
+    Flushed.wait(lock, [this, target]() {
+        return Written >= target || IsStopping;
+    });
+}
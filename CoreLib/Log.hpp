@@ -29,8 +29,8 @@
  *
  * @section DESCRIPTION
  *
- * A thread-safe log class with support for log files and standard output that
- * provides different log levels.
+ * A thread-safe asynchronous log class with support for log files and standard
+ * output that provides different log levels.
  */
 
 
@@ -38,11 +38,27 @@
 #define CORELIB_LOG_HPP
 
 
+#include <atomic>
+#include <cstddef>
 #include <fstream>
 #include <memory>
 #include <sstream>
 #include <string>
 #include <unordered_map>
+#include "Compression.hpp"
+
+/// Numeric values of Log::EType, for use in preprocessor conditions
+#define CORELIB_LOG_LEVEL_TRACE     0
+#define CORELIB_LOG_LEVEL_DEBUG     1
+#define CORELIB_LOG_LEVEL_INFO      2
+#define CORELIB_LOG_LEVEL_WARNING   3
+#define CORELIB_LOG_LEVEL_ERROR     4
+#define CORELIB_LOG_LEVEL_FATAL     5
+
+/// Calls below this level are compiled out, arguments included
+#if !defined ( CORELIB_LOG_MIN_LEVEL )
+#define CORELIB_LOG_MIN_LEVEL       CORELIB_LOG_LEVEL_TRACE
+#endif  // !defined ( CORELIB_LOG_MIN_LEVEL )
 
 namespace CoreLib {
 class Log;
@@ -52,21 +68,62 @@ class CoreLib::Log
 {
 public:
     enum class EType : unsigned char {
-        Trace,
-        Debug,
-        Info,
-        Warning,
-        Error,
-        Fatal
+        Trace = CORELIB_LOG_LEVEL_TRACE,
+        Debug = CORELIB_LOG_LEVEL_DEBUG,
+        Info = CORELIB_LOG_LEVEL_INFO,
+        Warning = CORELIB_LOG_LEVEL_WARNING,
+        Error = CORELIB_LOG_LEVEL_ERROR,
+        Fatal = CORELIB_LOG_LEVEL_FATAL
+    };
+
+    /// What a logging thread does when the buffer is full
+    enum class EOverflowPolicy : unsigned char {
+        Block,
+        Drop
+    };
+
+    enum class EFormat : unsigned char {
+        /// Bracketed header followed by one line per argument
+        Text,
+        /// One JSON object per line
+        JsonLines
+    };
+
+    /// A named value; see LOG_FIELD
+    template<typename T>
+    struct Field
+    {
+        const char *Key;
+        const T &Value;
+    };
+
+    /// Zero disables the size limit or the retention limit respectively.
+    /// Retention only counts segments closed by the running process, so
+    /// files left behind by other processes or earlier runs are kept.
+    struct RotationOptions
+    {
+        std::size_t MaxFileSize;
+        bool Daily;
+        bool Compress;
+        Compression::Algorithm CompressionAlgorithm;
+        std::size_t RetentionCount;
+
+        RotationOptions();
     };
 
 private:
     struct Impl;
     static std::unique_ptr<Impl> s_pimpl;
+    static std::atomic<unsigned char> s_level;
+    static std::atomic<unsigned char> s_format;
 
 private:
     std::ostringstream m_buffer;
     bool m_hasEntries;
+    EType m_type;
+    bool m_isJson;
+    std::string m_jsonArguments;
+    std::string m_jsonFields;
 
 public:
     static void Initialize(std::ostream &out_outputStream);
@@ -76,40 +133,149 @@ public:
                            const std::string &outputDirectoryPath,
                            const std::string &outputFilePrefix);
 
+    /// Applies the LOG_* options from definitions.cmake and initializes
+    /// both outputs; on UNIX, SIGUSR1 then toggles the level
+    static void InitializeFromDefinitions(std::ostream &out_outputStream,
+                                          const std::string &outputDirectoryPath,
+                                          const std::string &outputFilePrefix);
+
+    /// Takes effect only before the first Initialize() call
+    static void Configure(std::size_t bufferCapacity, EOverflowPolicy overflowPolicy);
+    static void ConfigureRotation(const RotationOptions &options);
+    static void Flush();
+
+    /// Runtime threshold on top of CORELIB_LOG_MIN_LEVEL; checked before
+    /// anything gets formatted
+    static void SetLevel(EType level);
+    static EType GetLevel();
+
+    /// Each delivery of the signal switches between the level in effect and
+    /// verboseLevel, so a running server can be turned up and back down
+    static bool ToggleLevelOnSignal(const int signal, const EType verboseLevel = EType::Trace);
+
+    static void SetFormat(EFormat format);
+    static EFormat GetFormat();
+
+    static bool IsEnabled(EType type)
+    {
+        return static_cast<unsigned char>(type) >= s_level.load(std::memory_order_relaxed);
+    }
+
 public:
     Log(EType type, const std::string &file, const std::string &func, int line, ...);
     virtual ~Log();
 
+public:
+    template<typename T>
+    static Field<T> MakeField(const char *key, const T &value)
+    {
+        return Field<T> { key, value };
+    }
+
 public:
     template<typename T>
     Log &operator,(const T &arg)
     {
+        if (m_isJson) {
+            std::ostringstream value;
+            value << arg;
+            AppendJsonArgument(value.str());
+            return *this;
+        }
+
         if (m_hasEntries)
             m_buffer << "\n";
         m_buffer << "  - " << arg;
         m_hasEntries = true;
         return *this;
     }
+
+    template<typename T>
+    Log &operator,(const Field<T> &field)
+    {
+        if (m_isJson) {
+            std::ostringstream value;
+            value << field.Value;
+            AppendJsonField(field.Key, value.str());
+            return *this;
+        }
+
+        if (m_hasEntries)
+            m_buffer << "\n";
+        m_buffer << "  - " << field.Key << ": " << field.Value;
+        m_hasEntries = true;
+        return *this;
+    }
+
+private:
+    void AppendJsonArgument(const std::string &value);
+    void AppendJsonField(const char *key, const std::string &value);
 };
 
 
+/// The level is checked before the Log object, and any formatting, exists;
+/// a single-pass for rather than an if, so an enclosing if / else is left
+/// alone
+#define CORELIB_LOG(TYPE, ...)  \
+    for (bool corelibLogEnabled = CoreLib::Log::IsEnabled(CoreLib::Log::EType::TYPE); \
+         corelibLogEnabled; corelibLogEnabled = false) \
+        (CoreLib::Log(CoreLib::Log::EType::TYPE, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+
+/// e.g. LOG_INFO("Stock data updated", LOG_FIELD("rows", count));
+/// becomes "fields":{"rows":"42"} in JsonLines mode
+#define LOG_FIELD(KEY, VALUE)  \
+    CoreLib::Log::MakeField(KEY, VALUE)
+
+#define CORELIB_LOG_DISABLED(...)  \
+    do { } while (false);
+
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_TRACE
 #define LOG_TRACE(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Trace, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG(Trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...)  \
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_TRACE
 
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...)  \
+    CORELIB_LOG(Debug, __VA_ARGS__)
+#else
 #define LOG_DEBUG(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Debug, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_DEBUG
 
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_INFO
+#define LOG_INFO(...)  \
+    CORELIB_LOG(Info, __VA_ARGS__)
+#else
 #define LOG_INFO(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Info, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_INFO
 
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_WARNING
 #define LOG_WARNING(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Warning, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG(Warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...)  \
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_WARNING
 
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_ERROR
+#define LOG_ERROR(...)  \
+    CORELIB_LOG(Error, __VA_ARGS__)
+#else
 #define LOG_ERROR(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Error, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_ERROR
 
+#if CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_FATAL
+#define LOG_FATAL(...)  \
+    CORELIB_LOG(Fatal, __VA_ARGS__)
+#else
 #define LOG_FATAL(...)  \
-    (CoreLib::Log(CoreLib::Log::EType::Fatal, __FILE__, __FUNCTION__, __LINE__)), __VA_ARGS__;
+    CORELIB_LOG_DISABLED(__VA_ARGS__)
+#endif  // CORELIB_LOG_MIN_LEVEL <= CORELIB_LOG_LEVEL_FATAL
 
 
 #endif /* CORELIB_LOG_HPP */
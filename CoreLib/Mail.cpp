@@ -33,13 +33,12 @@
  */
 
 
-#include <chrono>
 #include <queue>
-#include <cmath>
-#include <boost/bind.hpp>
+#include <cstdlib>
 #include <boost/chrono/chrono.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/lock_guard.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
@@ -49,11 +48,25 @@
 #include <vmime/platforms/posix/posixHandler.hpp>
 #include <vmime/vmime.hpp>
 #endif  // defined (_WIN32 )
-#include "make_unique.hpp"
 #include "Log.hpp"
 #include "Mail.hpp"
 
-#define     WORKER_THREAD_STOP_IDLE_MILLISECONDS        10000.0
+#if defined ( CORELIB_MAIL_SENDER_THREADS )
+#define     SENDER_THREADS                              CORELIB_MAIL_SENDER_THREADS
+#else
+#define     SENDER_THREADS                              2
+#endif  // defined ( CORELIB_MAIL_SENDER_THREADS )
+
+#if defined ( CORELIB_MAIL_SMTP_URL )
+#define     SMTP_URL                                    CORELIB_MAIL_SMTP_URL
+#else
+#define     SMTP_URL                                    "smtp://localhost"
+#endif  // defined ( CORELIB_MAIL_SMTP_URL )
+
+#define     SMTP_PASSWORD_ENVIRONMENT_VARIABLE          "MAIL_SMTP_PASSWORD"
+#define     SMTP_NOOP_AFTER_IDLE_MILLISECONDS           5000
+
+#define     WORKER_THREAD_STOP_IDLE_MILLISECONDS        10000
 #define     UNKNOWN_ERROR                               "Unknown error!"
 
 using namespace std;
@@ -63,15 +76,46 @@ using namespace CoreLib;
 struct Mail::Impl
 {
 public:
-    static std::queue<Mail *> MailQueue;
-    static std::queue<Mail::SendCallback> MailCallbackQueue;
-    static bool WorkerThreadIsRunning;
-    static boost::mutex MailMutex;
-    static boost::mutex WorkerMutex;
-    static std::unique_ptr<boost::thread> WorkerThread;
+    struct Job
+    {
+        Mail *Message;
+        Mail::SendCallback Callback;
+    };
+
+    /// An SMTP transport that connects (and authenticates) on first use and
+    /// then stays connected, so a sender thread delivers its mails
+    /// back-to-back over a single session
+    struct Connection
+    {
+        vmime::shared_ptr<vmime::net::session> Session;
+        vmime::shared_ptr<vmime::net::transport> Transport;
+        boost::chrono::steady_clock::time_point LastUsed;
+
+        ~Connection();
+
+        void Connect();
+        void Disconnect();
+        void Send(const vmime::shared_ptr<vmime::message> &message);
+    };
+
+public:
+    /// Sender threads are started on demand, up to SENDER_THREADS, and
+    /// leave after WORKER_THREAD_STOP_IDLE_MILLISECONDS without a job
+    struct Queue
+    {
+        std::queue<Job> Jobs;
+        std::size_t RunningWorkers;
+        std::size_t IdleWorkers;
+        boost::mutex Mutex;
+        boost::condition_variable Condition;
+
+        Queue();
+    };
 
 public:
+    static Queue &GetQueue();
     static void DoWork();
+    static void Process(const Job &job, Connection &connection);
 
 public:
     std::string From;
@@ -85,92 +129,68 @@ public:
 public:
     Impl();
     ~Impl();
-};
 
-std::queue<Mail *> Mail::Impl::MailQueue;
-std::queue<Mail::SendCallback> Mail::Impl::MailCallbackQueue;
-bool Mail::Impl::WorkerThreadIsRunning = false;
-boost::mutex Mail::Impl::MailMutex;
-boost::mutex Mail::Impl::WorkerMutex;
-std::unique_ptr<boost::thread> Mail::Impl::WorkerThread;
+    bool Send(Connection &connection, std::string &out_error);
+};
 
-void Mail::Impl::DoWork()
+Mail::Impl::Queue::Queue() :
+    RunningWorkers(0),
+    IdleWorkers(0)
 {
-    LOG_INFO("Mail worker thread started");
-
-    try {
-        auto lastJobTime = std::chrono::high_resolution_clock::now();
-
-        bool isMailQueueEmpty = false;
-        Mail *mail = nullptr;
-        Mail::SendCallback callback = nullptr;
 
-        for (;;) {
-            boost::this_thread::interruption_point();
-
-            {
-                boost::lock_guard<boost::mutex> lock(WorkerMutex);
-                (void)lock;
-
-                if (!WorkerThreadIsRunning)
-                    break;
-            }
-
-            boost::this_thread::disable_interruption di;
+}
 
-            {
-                boost::lock_guard<boost::mutex> lock(MailMutex);
-                (void)lock;
+Mail::Impl::Queue &Mail::Impl::GetQueue()
+{
+    /// Never destroyed: detached sender threads may still be waiting on it
+    /// while the process exits
+    static Queue *queue = new Queue();
+    return *queue;
+}
 
-                isMailQueueEmpty = !(MailQueue.size() > 0);
+void Mail::Impl::DoWork()
+{
+    LOG_INFO("Mail worker thread started");
 
-                if (!isMailQueueEmpty) {
-                    mail = MailQueue.front();
-                    callback = MailCallbackQueue.front();
-                }
-            }
+    /// Outlives the lock below, so the SMTP session is closed after this
+    /// thread stops taking jobs
+    Connection connection;
 
-            if (!isMailQueueEmpty) {
-                string error;
-                bool rc = mail->Send(error);
-                if (callback != nullptr) {
-                    callback(rc, error);
-                }
+    Queue &queue = GetQueue();
+    boost::unique_lock<boost::mutex> lock(queue.Mutex);
 
-                {
-                    boost::lock_guard<boost::mutex> lock(MailMutex);
-                    (void)lock;
+    for (;;) {
+        ++queue.IdleWorkers;
+        const bool hasJob = queue.Condition.wait_for(
+                    lock, boost::chrono::milliseconds(WORKER_THREAD_STOP_IDLE_MILLISECONDS),
+                    [&queue] { return !queue.Jobs.empty(); });
+        --queue.IdleWorkers;
 
-                    MailQueue.pop();
-                    MailCallbackQueue.pop();
-                }
+        if (!hasJob)
+            break;
 
-                if (mail->GetDeleteLater()) {
-                    delete mail;
-                }
+        Job job(queue.Jobs.front());
+        queue.Jobs.pop();
 
-                lastJobTime = std::chrono::high_resolution_clock::now();
-            }
+        lock.unlock();
+        Process(job, connection);
+        lock.lock();
+    }
 
-            boost::this_thread::restore_interruption ri(di);
-            (void)ri;
-            boost::this_thread::interruption_point();
+    --queue.RunningWorkers;
 
-            boost::this_thread::sleep_for(boost::chrono::nanoseconds(1));
+    lock.unlock();
 
-            if (isMailQueueEmpty) {
-                if ((std::chrono::duration<double, std::milli>(
-                         std::chrono::high_resolution_clock::now() - lastJobTime)).count() // elapsed in milliseconds
-                        > WORKER_THREAD_STOP_IDLE_MILLISECONDS) {
-                    {
-                        boost::lock_guard<boost::mutex> lock(WorkerMutex);
-                        (void)lock;
+    LOG_INFO("Mail worker thread stopped");
+}
 
-                        WorkerThreadIsRunning = false;
-                        break;
-                    }
-                }
-            }
+void Mail::Impl::Process(const Job &job, Connection &connection)
+{
+    try {
+        string error;
+        bool rc = job.Message->m_pimpl->Send(connection, error);
+        if (job.Callback != nullptr) {
+            job.Callback(rc, error);
         }
     }
 
@@ -186,7 +206,9 @@ void Mail::Impl::DoWork()
         LOG_ERROR(UNKNOWN_ERROR);
     }
 
-    LOG_INFO("Mail worker thread stopped");
+    if (job.Message->GetDeleteLater()) {
+        delete job.Message;
+    }
 }
 
 Mail::Mail()
@@ -279,27 +301,68 @@ bool Mail::Send() const
 }
 
 bool Mail::Send(std::string &out_error) const
+{
+    Impl::Connection connection;
+    return m_pimpl->Send(connection, out_error);
+}
+
+void Mail::SendAsync(SendCallback callback)
 {
     try {
-#if defined (_WIN32)
-        vmime::platform::setHandler<vmime::platforms::windows::windowsHandler>();
-#else
-        vmime::platform::setHandler<vmime::platforms::posix::posixHandler>();
-#endif /* defined (_WIN32) */
+        Impl::Queue &queue = Impl::GetQueue();
+
+        boost::lock_guard<boost::mutex> lock(queue.Mutex);
+        (void)lock;
+
+        queue.Jobs.push(Impl::Job { this, callback });
+
+        /// Only when every idle sender already has a job waiting for it
+        if (queue.Jobs.size() > queue.IdleWorkers && queue.RunningWorkers < SENDER_THREADS) {
+            boost::thread worker(&Mail::Impl::DoWork);
+            worker.detach();
+            ++queue.RunningWorkers;
+        }
+
+        queue.Condition.notify_one();
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+}
+
+Mail::Impl::Impl()
+    : DeleteLater(false)
+{
+
+}
+
+Mail::Impl::~Impl() = default;
 
+bool Mail::Impl::Send(Connection &connection, std::string &out_error)
+{
+    try {
         vmime::messageBuilder mb;
 
-        mb.setExpeditor(vmime::mailbox(m_pimpl->From));
-        mb.getRecipients().appendAddress(vmime::make_shared<vmime::mailbox>(m_pimpl->To));
+        mb.setExpeditor(vmime::mailbox(From));
+        mb.getRecipients().appendAddress(vmime::make_shared<vmime::mailbox>(To));
 
-        mb.setSubject(*vmime::text::newFromString(m_pimpl->Subject, vmime::charsets::UTF_8));
+        mb.setSubject(*vmime::text::newFromString(Subject, vmime::charsets::UTF_8));
 
         mb.constructTextPart(vmime::mediaType(vmime::mediaTypes::TEXT, vmime::mediaTypes::TEXT_HTML));
         mb.getTextPart()->setCharset(vmime::charsets::UTF_8);
-        mb.getTextPart()->setText(vmime::make_shared<vmime::stringContentHandler>(m_pimpl->Body));
+        mb.getTextPart()->setText(vmime::make_shared<vmime::stringContentHandler>(Body));
 
-        if (m_pimpl->Attachments.size() > 0) {
-            for (auto a : m_pimpl->Attachments) {
+        if (Attachments.size() > 0) {
+            for (auto a : Attachments) {
                 vmime::shared_ptr <vmime::attachment> att = vmime::make_shared <vmime::fileAttachment>
                         (a, vmime::mediaType("application/octet-stream"),
                          vmime::text(filesystem::path(a).stem().string()));
@@ -309,13 +372,7 @@ bool Mail::Send(std::string &out_error) const
 
         vmime::shared_ptr<vmime::message> msg = mb.construct();
 
-        vmime::utility::url url("smtp://localhost");
-        vmime::shared_ptr<vmime::net::session> sess = vmime::make_shared<vmime::net::session>();
-        vmime::shared_ptr<vmime::net::transport> tr = sess->getTransport(url);
-
-        tr->connect();
-        tr->send(msg);
-        tr->disconnect();
+        connection.Send(msg);
 
         return true;
     }
@@ -335,48 +392,84 @@ bool Mail::Send(std::string &out_error) const
     return false;
 }
 
-void Mail::SendAsync(SendCallback callback)
+Mail::Impl::Connection::~Connection()
 {
-    try {
-        {
-            boost::lock_guard<boost::mutex> lock(Impl::MailMutex);
-            (void)lock;
+    Disconnect();
+}
 
-            Impl::MailQueue.push(this);
-            Impl::MailCallbackQueue.push(callback);
-        }
+void Mail::Impl::Connection::Connect()
+{
+    if (!Session) {
+#if defined (_WIN32)
+        vmime::platform::setHandler<vmime::platforms::windows::windowsHandler>();
+#else
+        vmime::platform::setHandler<vmime::platforms::posix::posixHandler>();
+#endif /* defined (_WIN32) */
+
+        Session = vmime::make_shared<vmime::net::session>();
+    }
 
-        {
-            boost::lock_guard<boost::mutex> lock(Impl::WorkerMutex);
-            (void)lock;
+    Transport = Session->getTransport(vmime::utility::url(SMTP_URL));
 
-            if (!Impl::WorkerThreadIsRunning) {
-                Impl::WorkerThreadIsRunning = true;
+#if defined ( CORELIB_MAIL_SMTP_USERNAME )
+    Transport->setProperty("options.need-authentication", true);
+    Transport->setProperty("auth.username", std::string(CORELIB_MAIL_SMTP_USERNAME));
+    const char *password = std::getenv(SMTP_PASSWORD_ENVIRONMENT_VARIABLE);
+    if (password != nullptr)
+        Transport->setProperty("auth.password", std::string(password));
+#endif  // defined ( CORELIB_MAIL_SMTP_USERNAME )
 
-                Impl::WorkerThread = make_unique<boost::thread>(Mail::Impl::DoWork);
-                Impl::WorkerThread->detach();
-            }
-        }
-    }
+    Transport->connect();
+    LastUsed = boost::chrono::steady_clock::now();
+}
 
-    catch (boost::exception &ex) {
-        LOG_ERROR(boost::diagnostic_information(ex));
-    }
+void Mail::Impl::Connection::Disconnect()
+{
+    if (!Transport)
+        return;
 
-    catch (std::exception &ex) {
-        LOG_ERROR(ex.what());
+    try {
+        if (Transport->isConnected())
+            Transport->disconnect();
+    } catch (...) {
+        /// The server may already be gone; the transport is dropped anyway
     }
 
-    catch (...) {
-        LOG_ERROR(UNKNOWN_ERROR);
-    }
+    Transport.reset();
 }
 
-Mail::Impl::Impl()
-    : DeleteLater(false)
+void Mail::Impl::Connection::Send(const vmime::shared_ptr<vmime::message> &message)
 {
+    /// Servers close sessions that sit idle for too long. A NOOP finds that
+    /// out before any part of the message is handed over, so reconnecting
+    /// can never deliver it twice; back-to-back mails skip the round trip.
+    if (Transport && Transport->isConnected()
+            && boost::chrono::steady_clock::now() - LastUsed
+            > boost::chrono::milliseconds(SMTP_NOOP_AFTER_IDLE_MILLISECONDS)) {
+        try {
+            Transport->noop();
+        }
 
-}
+        catch (vmime::exception &) {
+            Disconnect();
+        }
+    }
 
-Mail::Impl::~Impl() = default;
+    if (!Transport || !Transport->isConnected()) {
+        Disconnect();
+        Connect();
+    }
 
+    /// Once MAIL FROM is out, a failure may still mean the server accepted
+    /// the message, and a rejection will not change on retry; either way
+    /// the error goes to the caller and the session is not trusted again
+    try {
+        Transport->send(message);
+        LastUsed = boost::chrono::steady_clock::now();
+    }
+
+    catch (vmime::exception &) {
+        Disconnect();
+        throw;
+    }
+}
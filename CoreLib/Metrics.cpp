@@ -0,0 +1,316 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A process-wide registry of counters, gauges and fixed-bucket histograms,
+ * exposed in the Prometheus text format.
+ */
+
+
+#include <algorithm>
+#include <functional>
+#include <locale>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <boost/format.hpp>
+#include "make_unique.hpp"
+#include "Exception.hpp"
+#include "Metrics.hpp"
+
+#define     TYPE_MISMATCH_ERROR             "Metric '%1%' is already registered with another type!"
+#define     INVALID_BUCKETS_ERROR           "Histogram '%1%' needs strictly increasing bucket bounds!"
+
+using namespace std;
+using namespace boost;
+using namespace CoreLib;
+
+struct Metrics::Impl
+{
+    enum class Type : unsigned char {
+        Counter,
+        Gauge,
+        Histogram
+    };
+
+    /// Series are keyed by their rendered label set, e.g. 'method="GET"',
+    /// which is exactly what goes between the braces on exposition.
+    struct Family
+    {
+        Type MetricType;
+        std::string Help;
+        std::map<std::string, std::unique_ptr<Counter>> Counters;
+        std::map<std::string, std::unique_ptr<Gauge>> Gauges;
+        std::map<std::string, std::unique_ptr<Histogram>> Histograms;
+    };
+
+    std::mutex Mutex;
+    std::map<std::string, Family> Families;
+
+    Family &GetFamily(const std::string &name, const std::string &help, const Type type);
+
+    static std::string RenderLabels(const Labels &labels);
+    static std::string EscapeLabelValue(const std::string &value);
+    static std::string EscapeHelp(const std::string &help);
+    static std::string FormatValue(const double value);
+    static const char *TypeName(const Type type);
+};
+
+std::unique_ptr<Metrics::Impl> Metrics::s_pimpl = std::make_unique<Metrics::Impl>();
+
+Metrics::Histogram::Histogram(const Buckets &bounds) :
+    m_bounds(bounds),
+    m_counts(new std::atomic<std::uint_least64_t>[bounds.size() + 1]),
+    m_count(0),
+    m_sum(0.0)
+{
+    for (std::size_t i = 0; i <= m_bounds.size(); ++i) {
+        m_counts[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+std::vector<std::uint_least64_t> Metrics::Histogram::BucketCounts() const
+{
+    std::vector<std::uint_least64_t> counts;
+    counts.reserve(m_bounds.size() + 1);
+
+    for (std::size_t i = 0; i <= m_bounds.size(); ++i) {
+        counts.push_back(m_counts[i].load(std::memory_order_relaxed));
+    }
+
+    return counts;
+}
+
+Metrics::Buckets Metrics::DefaultLatencyBuckets()
+{
+    return { 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0 };
+}
+
+Metrics::Counter *Metrics::GetCounter(const std::string &name, const std::string &help,
+                                      const Labels &labels)
+{
+    std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+    (void)lock;
+
+    Impl::Family &family = s_pimpl->GetFamily(name, help, Impl::Type::Counter);
+    std::unique_ptr<Counter> &counter = family.Counters[Impl::RenderLabels(labels)];
+    if (!counter)
+        counter = std::make_unique<Counter>();
+
+    return counter.get();
+}
+
+Metrics::Gauge *Metrics::GetGauge(const std::string &name, const std::string &help,
+                                  const Labels &labels)
+{
+    std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+    (void)lock;
+
+    Impl::Family &family = s_pimpl->GetFamily(name, help, Impl::Type::Gauge);
+    std::unique_ptr<Gauge> &gauge = family.Gauges[Impl::RenderLabels(labels)];
+    if (!gauge)
+        gauge = std::make_unique<Gauge>();
+
+    return gauge.get();
+}
+
+Metrics::Histogram *Metrics::GetHistogram(const std::string &name, const std::string &help,
+                                          const Labels &labels, const Buckets &buckets)
+{
+    if (buckets.empty()
+            || std::adjacent_find(buckets.begin(), buckets.end(),
+                                  std::greater_equal<double>()) != buckets.end()) {
+        throw CoreLib::Exception((format(INVALID_BUCKETS_ERROR) % name).str());
+    }
+
+    std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+    (void)lock;
+
+    Impl::Family &family = s_pimpl->GetFamily(name, help, Impl::Type::Histogram);
+    std::unique_ptr<Histogram> &histogram = family.Histograms[Impl::RenderLabels(labels)];
+    if (!histogram)
+        histogram = std::make_unique<Histogram>(buckets);
+
+    return histogram.get();
+}
+
+std::string Metrics::Expose()
+{
+    std::ostringstream out;
+
+    std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+    (void)lock;
+
+    for (const auto &entry : s_pimpl->Families) {
+        const std::string &name = entry.first;
+        const Impl::Family &family = entry.second;
+
+        out << "# HELP " << name << " " << Impl::EscapeHelp(family.Help) << "\n";
+        out << "# TYPE " << name << " " << Impl::TypeName(family.MetricType) << "\n";
+
+        for (const auto &series : family.Counters) {
+            out << name << (series.first.empty() ? "" : "{" + series.first + "}")
+                << " " << series.second->Value() << "\n";
+        }
+
+        for (const auto &series : family.Gauges) {
+            out << name << (series.first.empty() ? "" : "{" + series.first + "}")
+                << " " << series.second->Value() << "\n";
+        }
+
+        for (const auto &series : family.Histograms) {
+            const Histogram &histogram = *series.second;
+            const std::string prefix(series.first.empty() ? "" : series.first + ",");
+            const std::string labels(series.first.empty() ? "" : "{" + series.first + "}");
+
+            /// Buckets are read one by one while writers keep going, so
+            /// the total is taken from them to stay consistent with +Inf
+            std::vector<std::uint_least64_t> counts(histogram.BucketCounts());
+            std::uint_least64_t cumulative = 0;
+
+            for (std::size_t i = 0; i < histogram.Bounds().size(); ++i) {
+                cumulative += counts[i];
+                out << name << "_bucket{" << prefix << "le=\""
+                    << Impl::FormatValue(histogram.Bounds()[i]) << "\"} "
+                    << cumulative << "\n";
+            }
+            cumulative += counts.back();
+
+            out << name << "_bucket{" << prefix << "le=\"+Inf\"} " << cumulative << "\n";
+            out << name << "_sum" << labels << " " << Impl::FormatValue(histogram.Sum()) << "\n";
+            out << name << "_count" << labels << " " << cumulative << "\n";
+        }
+    }
+
+    return out.str();
+}
+
+Metrics::Impl::Family &Metrics::Impl::GetFamily(const std::string &name,
+                                                const std::string &help,
+                                                const Type type)
+{
+    auto it = Families.find(name);
+
+    if (it == Families.end()) {
+        Family &family = Families[name];
+        family.MetricType = type;
+        family.Help = help;
+        return family;
+    }
+
+    if (it->second.MetricType != type)
+        throw CoreLib::Exception((format(TYPE_MISMATCH_ERROR) % name).str());
+
+    return it->second;
+}
+
+std::string Metrics::Impl::RenderLabels(const Labels &labels)
+{
+    std::string rendered;
+
+    for (const auto &label : labels) {
+        if (!rendered.empty())
+            rendered += ",";
+        rendered += label.first + "=\"" + EscapeLabelValue(label.second) + "\"";
+    }
+
+    return rendered;
+}
+
+std::string Metrics::Impl::EscapeLabelValue(const std::string &value)
+{
+    std::string escaped;
+    escaped.reserve(value.size());
+
+    for (const char c : value) {
+        switch (c) {
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '"':
+            escaped += "\\\"";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        default:
+            escaped += c;
+            break;
+        }
+    }
+
+    return escaped;
+}
+
+std::string Metrics::Impl::EscapeHelp(const std::string &help)
+{
+    std::string escaped;
+    escaped.reserve(help.size());
+
+    for (const char c : help) {
+        switch (c) {
+        case '\\':
+            escaped += "\\\\";
+            break;
+        case '\n':
+            escaped += "\\n";
+            break;
+        default:
+            escaped += c;
+            break;
+        }
+    }
+
+    return escaped;
+}
+
+std::string Metrics::Impl::FormatValue(const double value)
+{
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    out.precision(15);
+    out << value;
+    return out.str();
+}
+
+const char *Metrics::Impl::TypeName(const Type type)
+{
+    switch (type) {
+    case Type::Counter:
+        return "counter";
+    case Type::Gauge:
+        return "gauge";
+    case Type::Histogram:
+        return "histogram";
+    }
+
+    return "untyped";
+}
+
@@ -0,0 +1,245 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A process-wide registry of counters, gauges and fixed-bucket histograms,
+ * exposed in the Prometheus text format.
+ */
+
+
+#ifndef CORELIB_METRICS_HPP
+#define CORELIB_METRICS_HPP
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include "Stopwatch.hpp"
+
+namespace CoreLib {
+class Metrics;
+}
+
+class CoreLib::Metrics
+{
+public:
+    typedef std::vector<std::pair<std::string, std::string>> Labels;
+    typedef std::vector<double> Buckets;
+
+    /// Monotonically increasing; only ever touched through relaxed atomics
+    class Counter
+    {
+    private:
+        std::atomic<std::uint_least64_t> m_value;
+
+    public:
+        Counter() :
+            m_value(0)
+        {
+
+        }
+
+        Counter(const Counter &) = delete;
+        Counter &operator=(const Counter &) = delete;
+
+    public:
+        void Increment(const std::uint_least64_t delta = 1)
+        {
+            m_value.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        /// For totals kept elsewhere and copied in before each scrape; never
+        /// moves the counter backwards, even with concurrent scrapes
+        void Advance(const std::uint_least64_t total)
+        {
+            std::uint_least64_t current = m_value.load(std::memory_order_relaxed);
+            while (current < total
+                   && !m_value.compare_exchange_weak(current, total, std::memory_order_relaxed)) {
+            }
+        }
+
+        std::uint_least64_t Value() const
+        {
+            return m_value.load(std::memory_order_relaxed);
+        }
+    };
+
+    class Gauge
+    {
+    private:
+        std::atomic<std::int_least64_t> m_value;
+
+    public:
+        Gauge() :
+            m_value(0)
+        {
+
+        }
+
+        Gauge(const Gauge &) = delete;
+        Gauge &operator=(const Gauge &) = delete;
+
+    public:
+        void Set(const std::int_least64_t value)
+        {
+            m_value.store(value, std::memory_order_relaxed);
+        }
+
+        void Add(const std::int_least64_t delta)
+        {
+            m_value.fetch_add(delta, std::memory_order_relaxed);
+        }
+
+        std::int_least64_t Value() const
+        {
+            return m_value.load(std::memory_order_relaxed);
+        }
+    };
+
+    /// Bucket bounds are fixed at registration, so Observe() is a short
+    /// linear scan plus two relaxed increments and a CAS on the sum.
+    /// Counts are kept per bucket and only made cumulative on exposition.
+    class Histogram
+    {
+    private:
+        const Buckets m_bounds;
+        std::unique_ptr<std::atomic<std::uint_least64_t>[]> m_counts;
+        std::atomic<std::uint_least64_t> m_count;
+        std::atomic<double> m_sum;
+
+    public:
+        explicit Histogram(const Buckets &bounds);
+
+        Histogram(const Histogram &) = delete;
+        Histogram &operator=(const Histogram &) = delete;
+
+    public:
+        void Observe(const double value)
+        {
+            std::size_t i = 0;
+            while (i < m_bounds.size() && value > m_bounds[i])
+                ++i;
+
+            m_counts[i].fetch_add(1, std::memory_order_relaxed);
+            m_count.fetch_add(1, std::memory_order_relaxed);
+
+            double sum = m_sum.load(std::memory_order_relaxed);
+            while (!m_sum.compare_exchange_weak(sum, sum + value, std::memory_order_relaxed)) {
+            }
+        }
+
+        const Buckets &Bounds() const
+        {
+            return m_bounds;
+        }
+
+        /// One entry per bound plus the trailing +Inf bucket, not cumulative
+        std::vector<std::uint_least64_t> BucketCounts() const;
+
+        std::uint_least64_t Count() const
+        {
+            return m_count.load(std::memory_order_relaxed);
+        }
+
+        double Sum() const
+        {
+            return m_sum.load(std::memory_order_relaxed);
+        }
+    };
+
+    /// Observes the seconds elapsed between construction and destruction;
+    /// the target may be swapped while timing, e.g. once a route is known.
+    class Timer
+    {
+    private:
+        Histogram *m_histogram;
+        Stopwatch<std::chrono::steady_clock> m_stopwatch;
+
+    public:
+        explicit Timer(Histogram *histogram) :
+            m_histogram(histogram)
+        {
+
+        }
+
+        Timer(const Timer &) = delete;
+        Timer &operator=(const Timer &) = delete;
+
+        ~Timer()
+        {
+            Stop();
+        }
+
+    public:
+        void Rebind(Histogram *histogram)
+        {
+            m_histogram = histogram;
+        }
+
+        /// Observes now rather than on destruction; later calls are no-ops
+        void Stop()
+        {
+            if (m_histogram != nullptr) {
+                m_histogram->Observe(m_stopwatch.Stop() / 1000000.0);
+                m_histogram = nullptr;
+            }
+        }
+    };
+
+private:
+    struct Impl;
+    static std::unique_ptr<Impl> s_pimpl;
+
+public:
+    /// 1ms up to 10s; suits request, query and stage latencies in seconds
+    static Buckets DefaultLatencyBuckets();
+
+    /// Registration takes a lock and is meant to happen once per series;
+    /// keep the returned pointer, it stays valid for the process lifetime.
+    /// Asking for an existing name with another type throws CoreLib::Exception.
+    static Counter *GetCounter(const std::string &name, const std::string &help,
+                               const Labels &labels = Labels());
+    static Gauge *GetGauge(const std::string &name, const std::string &help,
+                           const Labels &labels = Labels());
+    static Histogram *GetHistogram(const std::string &name, const std::string &help,
+                                   const Labels &labels = Labels(),
+                                   const Buckets &buckets = DefaultLatencyBuckets());
+
+    /// Text exposition format, version 0.0.4
+    static std::string Expose();
+};
+
+
+#endif /* CORELIB_METRICS_HPP */
+
@@ -33,12 +33,11 @@
  */
 
 
-#include <unordered_map>
 #include <boost/random/random_device.hpp>
+#include <boost/thread/tss.hpp>
 #include <boost/uuid/random_generator.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
-#include <CoreLib/make_unique.hpp>
 #include "Random.hpp"
 #include "Utility.hpp"
 
@@ -49,22 +48,66 @@ using namespace CoreLib;
 struct Random::Impl
 {
 public:
-    typedef std::unordered_map<const CoreLib::Random::Character, const std::string,
-        CoreLib::Utility::Hasher<const CoreLib::Random::Character>> CharactersHashTable;
+    struct CharacterSet
+    {
+        const char *Characters;
+        size_t Size;
+    };
+
+    struct ThreadState
+    {
+        random::mt19937 Engine;
+        uuids::basic_random_generator<random::mt19937> UuidGenerator;
+
+        ThreadState();
+    };
 
 public:
-    static CharactersHashTable &GetLookupTable();
+    /// Indexed by Character, in declaration order
+    static const CharacterSet LookupTable[];
+
+    static ThreadState &GetThreadState();
 };
 
+#define     CHARACTER_SET(CHARS)        { CHARS, sizeof(CHARS) - 1 }
+
+const Random::Impl::CharacterSet Random::Impl::LookupTable[] = {
+    /* Alphabetic */    CHARACTER_SET("ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"),
+    /* Alphanumeric */  CHARACTER_SET("0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"),
+    /* Blank */         CHARACTER_SET("\t "),
+    /* Control */       CHARACTER_SET("0123456789"),
+    /* Digits */        CHARACTER_SET("0123456789"),
+    /* Graphical */     CHARACTER_SET("!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"),
+    /* Hexadecimal */   CHARACTER_SET("0123456789ABCDEFabcdef"),
+    /* Lower */         CHARACTER_SET("abcdefghijklmnopqrstuvwxyz"),
+    /* Punctuation */   CHARACTER_SET("!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"),
+    /* Printable */     CHARACTER_SET(" !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"),
+    /* Space */         CHARACTER_SET("\t\n\v\f\r "),
+    /* Upper */         CHARACTER_SET("ABCDEFGHIJKLMNOPQRSTUVWXYZ")
+};
+
+#undef      CHARACTER_SET
+
 void Random::Characters(const Character &type, const size_t length, std::string &out_chars)
 {
-    boost::lock_guard<boost::mutex> guard(GetLock());
+    out_chars.resize(length);
+    if (length > 0)
+        Characters(type, &out_chars[0], length);
+}
+
+void Random::Characters(const Character &type, char *out_chars, const size_t length)
+{
+    static_assert(sizeof(Impl::LookupTable) / sizeof(Impl::LookupTable[0])
+                  == static_cast<size_t>(Character::Upper) + 1,
+                  "Random::Impl::LookupTable must have one entry per Random::Character");
+
+    const Impl::CharacterSet &set = Impl::LookupTable[Utility::ToUnderlyingType(type)];
 
-    random::uniform_int_distribution<> index_dist(0, (int)Impl::GetLookupTable()[type].size() - 1);
+    random::uniform_int_distribution<size_t> index_dist(0, set.Size - 1);
+    random::mt19937 &engine = GetEngine();
 
-    out_chars.clear();
     for (size_t i = 0; i < length; ++i) {
-        out_chars += Impl::GetLookupTable()[type][(size_t)index_dist(GetEngine())];
+        out_chars[i] = set.Characters[index_dist(engine)];
     }
 }
 
@@ -77,8 +120,7 @@ std::string Random::Characters(const Character &type, const size_t length)
 
 void Random::Uuid(std::string &out_uuid)
 {
-    static uuids::basic_random_generator<random::mt19937> rng(&GetEngine());
-    uuids::uuid u = rng();
+    uuids::uuid u = Impl::GetThreadState().UuidGenerator();
     out_uuid.assign(std::move(uuids::to_string(u)));
 }
 
@@ -91,33 +133,22 @@ std::string Random::Uuid()
 
 boost::random::mt19937 &Random::GetEngine()
 {
-    static random::random_device rd;
-    static random::mt19937 rng(rd);
-    return rng;
+    return Impl::GetThreadState().Engine;
 }
 
-boost::mutex &Random::GetLock()
+Random::Impl::ThreadState::ThreadState() :
+    UuidGenerator(&Engine)
 {
-    static boost::mutex lock;
-    return lock;
+    random::random_device rd;
+    Engine.seed(rd);
 }
 
-Random::Impl::CharactersHashTable &Random::Impl::GetLookupTable()
+Random::Impl::ThreadState &Random::Impl::GetThreadState()
 {
-    static CharactersHashTable lookupTable {
-        {Character::Alphabetic, "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"},
-        {Character::Alphanumeric, "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz"},
-        {Character::Blank, "\t "},
-        {Character::Control, "0123456789"},
-        {Character::Digits, "0123456789"},
-        {Character::Graphical, "!\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"},
-        {Character::Hexadecimal, "0123456789ABCDEFabcdef"},
-        {Character::Lower, "abcdefghijklmnopqrstuvwxyz"},
-        {Character::Printable, " !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~"},
-        {Character::Punctuation, "!\"#$%&'()*+,-./:;<=>?@[\\]^_`{|}~"},
-        {Character::Space, "\t\n\v\f\r "},
-        {Character::Upper, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"}
-    };
-    return lookupTable;
-}
+    static boost::thread_specific_ptr<ThreadState> state;
 
+    if (state.get() == nullptr)
+        state.reset(new ThreadState());
+
+    return *state;
+}
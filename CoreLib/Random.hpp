@@ -38,10 +38,10 @@
 
 
 #include <string>
+#include <vector>
+#include <cstddef>
 #include <boost/random/mersenne_twister.hpp>
 #include <boost/random/uniform_int_distribution.hpp>
-#include <boost/thread/mutex.hpp>
-#include <boost/thread/lock_guard.hpp>
 #include "System.hpp"
 
 namespace CoreLib {
@@ -70,23 +70,42 @@ private:
     struct Impl;
 
 public:
+    /// Every thread draws from its own engine, seeded from random_device
+    /// on first use, so none of these take a lock
     static void Characters(const Character &type, const size_t length, std::string &out_chars);
+    static void Characters(const Character &type, char *out_chars, const size_t length);
     static std::string Characters(const Character &type, const size_t length);
 
     template <typename _T>
     static _T Number(_T lowerBound, _T upperBound)
     {
-        boost::lock_guard<boost::mutex> guard(GetLock());
-        boost::random::uniform_int_distribution<> dist(lowerBound, upperBound);
+        boost::random::uniform_int_distribution<_T> dist(lowerBound, upperBound);
         return dist(GetEngine());
     }
 
+    template <typename _T>
+    static void Numbers(_T lowerBound, _T upperBound, _T *out_numbers, const size_t count)
+    {
+        boost::random::uniform_int_distribution<_T> dist(lowerBound, upperBound);
+        boost::random::mt19937 &engine = GetEngine();
+        for (size_t i = 0; i < count; ++i) {
+            out_numbers[i] = dist(engine);
+        }
+    }
+
+    template <typename _T>
+    static void Numbers(_T lowerBound, _T upperBound, const size_t count, std::vector<_T> &out_numbers)
+    {
+        out_numbers.resize(count);
+        if (count > 0)
+            Numbers(lowerBound, upperBound, &out_numbers[0], count);
+    }
+
     static void Uuid(std::string &out_uuid);
     static std::string Uuid();
 
 private:
     static boost::random::mt19937 &GetEngine();
-    static boost::mutex &GetLock();
 };
 
 
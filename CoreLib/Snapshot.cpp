@@ -0,0 +1,762 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Immutable, versioned table snapshots meant to be memory-mapped. Values are
+ * read straight from the mapping, so opening one costs a checksum pass and
+ * every process that maps the same file shares a single page-cache copy.
+ *
+ * Layout, all integers little-endian, every section 8-byte aligned:
+ *   header      "SNP1", format version (1 byte), 3 reserved bytes,
+ *               snapshot version (8), row count (8), column count (4),
+ *               property count (4), string count (4), CRC-32 of
+ *               everything after the header (4), directory offset (8),
+ *               string offsets offset (8), string data offset (8)
+ *   directory   per column: name string id (4), type (1), 3 reserved
+ *               bytes, data offset (8); then per property: key and value
+ *               string ids (4 + 4)
+ *   columns     Int64: one 8-byte value per row; String: one 4-byte
+ *               string id per row
+ *   strings     string count + 1 offsets (8 each) into the string data,
+ *               then the string data itself; every distinct string once
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <cstring>
+#include <boost/algorithm/string/trim.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <zlib.h>
+#include "FileSystem.hpp"
+#include "Snapshot.hpp"
+#include "make_unique.hpp"
+#include "Utility.hpp"
+
+#define     SNAPSHOT_MAGIC                      "SNP1"
+#define     SNAPSHOT_MAGIC_SIZE                 4
+#define     SNAPSHOT_FORMAT_VERSION             1
+#define     SNAPSHOT_HEADER_SIZE                64
+#define     SNAPSHOT_COLUMN_ENTRY_SIZE          16
+#define     SNAPSHOT_PROPERTY_ENTRY_SIZE        8
+#define     SNAPSHOT_ALIGNMENT                  8
+#define     SNAPSHOT_FILE_PREFIX                "snapshot-"
+
+#define     UNKNOWN_ERROR                       "Snapshot: Unknown error!"
+
+using namespace std;
+using namespace CoreLib;
+
+struct Snapshot::Impl
+{
+    static void PutFixed32(std::string &out_data, const std::uint32_t value);
+    static void PutFixed64(std::string &out_data, const std::uint64_t value);
+    static void SetFixed32(std::string &out_data, const std::size_t offset, const std::uint32_t value);
+    static void SetFixed64(std::string &out_data, const std::size_t offset, const std::uint64_t value);
+    static void Align(std::string &out_data);
+
+    static std::uint32_t LoadFixed32(const char *data);
+    static std::uint64_t LoadFixed64(const char *data);
+
+    static bool ParseFileName(const std::string &fileName, std::uint64_t &out_version);
+    static std::string GetFileName(const std::uint64_t version);
+
+    static std::uint32_t Checksum(const char *data, const std::size_t size);
+};
+
+struct Snapshot::Writer::Impl
+{
+    Properties SnapshotProperties;
+    std::vector<std::pair<std::string, Column>> Columns;
+
+    /// Every distinct string in insertion order, looked up by Intern()
+    std::vector<const std::string *> Strings;
+    std::unordered_map<std::string, std::uint32_t> StringIds;
+
+    std::uint32_t Intern(const std::string &value);
+    void Serialize(const std::uint64_t version, std::string &out_data);
+};
+
+struct Snapshot::Reader::Impl
+{
+    struct ColumnEntry
+    {
+        std::uint32_t NameId;
+        ColumnType Type;
+        const char *Data;
+    };
+
+    std::string File;
+    FileSystem::MappedFile Mapping;
+
+    std::uint64_t Version;
+    Properties SnapshotProperties;
+    std::size_t Rows;
+    std::vector<ColumnEntry> Columns;
+
+    std::uint32_t StringCount;
+    const char *StringOffsets;
+    const char *StringData;
+
+    Impl();
+
+    void Reset();
+    void GetString(const std::uint32_t id, std::string &out_value) const;
+};
+
+const std::string Snapshot::FileExtension(".snap");
+const std::string Snapshot::LatestFileName("LATEST");
+
+bool Snapshot::GetLatest(const std::string &directory, std::string &out_file,
+                         std::string &out_error)
+{
+    out_file.clear();
+    out_error.clear();
+
+    try {
+        const boost::filesystem::path pointer(boost::filesystem::path(directory) / LatestFileName);
+
+        std::ifstream stream(pointer.string(), std::ios_base::in | std::ios_base::binary);
+        if (!stream.is_open()) {
+            out_error.assign((boost::format("Snapshot: Nothing published to '%1%' yet!")
+                              % directory).str());
+            return false;
+        }
+
+        std::string fileName((std::istreambuf_iterator<char>(stream)),
+                             std::istreambuf_iterator<char>());
+        boost::algorithm::trim(fileName);
+
+        std::uint64_t version;
+        if (!Impl::ParseFileName(fileName, version)) {
+            out_error.assign((boost::format("Snapshot: Invalid pointer in '%1%'!")
+                              % pointer.string()).str());
+            return false;
+        }
+
+        out_file.assign((boost::filesystem::path(directory) / fileName).string());
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    return false;
+}
+
+Snapshot::Writer::Writer() :
+    m_pimpl(std::make_unique<Writer::Impl>())
+{
+
+}
+
+Snapshot::Writer::~Writer() = default;
+
+void Snapshot::Writer::SetProperty(const std::string &key, const std::string &value)
+{
+    m_pimpl->SnapshotProperties[key] = value;
+}
+
+void Snapshot::Writer::AddColumn(const std::string &name, const Column &values)
+{
+    m_pimpl->Columns.emplace_back(name, values);
+}
+
+void Snapshot::Writer::AddColumn(const std::string &name, Column &&values)
+{
+    m_pimpl->Columns.emplace_back(name, std::move(values));
+}
+
+bool Snapshot::Writer::Save(const std::string &file, const std::uint64_t version,
+                            std::string &out_error)
+{
+    out_error.clear();
+
+    const boost::filesystem::path target(file);
+    const boost::filesystem::path temp(
+                target.parent_path()
+                / boost::filesystem::unique_path(target.filename().string() + ".%%%%-%%%%.tmp"));
+
+    try {
+        const std::size_t rows = m_pimpl->Columns.empty() ? 0 : m_pimpl->Columns.front().second.size();
+        for (const auto &column : m_pimpl->Columns) {
+            if (column.second.size() != rows) {
+                out_error.assign((boost::format("Snapshot: Column '%1%' has %2% values, expected %3%!")
+                                  % column.first % column.second.size() % rows).str());
+                return false;
+            }
+        }
+
+        std::string data;
+        m_pimpl->Serialize(version, data);
+
+        std::ofstream stream(temp.string(), std::ios_base::out | std::ios_base::binary
+                             | std::ios_base::trunc);
+        if (!stream.is_open()) {
+            out_error.assign((boost::format("Snapshot: Could not create '%1%'!")
+                              % temp.string()).str());
+            return false;
+        }
+
+        stream.write(data.data(), static_cast<std::streamsize>(data.size()));
+        stream.close();
+
+        if (!stream) {
+            out_error.assign((boost::format("Snapshot: Could not write '%1%'!")
+                              % temp.string()).str());
+            boost::filesystem::remove(temp);
+            return false;
+        }
+
+        boost::filesystem::rename(temp, target);
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    boost::system::error_code ec;
+    boost::filesystem::remove(temp, ec);
+
+    return false;
+}
+
+bool Snapshot::Writer::Publish(const std::string &directory, const std::size_t keep,
+                               std::uint64_t &out_version, std::string &out_error)
+{
+    out_error.clear();
+
+    try {
+        const boost::filesystem::path dir(directory);
+        if (!boost::filesystem::exists(dir))
+            boost::filesystem::create_directories(dir);
+
+        std::vector<std::uint64_t> versions;
+        for (boost::filesystem::directory_iterator it(dir), end; it != end; ++it) {
+            std::uint64_t version;
+            if (Snapshot::Impl::ParseFileName(it->path().filename().string(), version))
+                versions.push_back(version);
+        }
+        std::sort(versions.begin(), versions.end());
+
+        const std::uint64_t version = versions.empty() ? 1 : versions.back() + 1;
+        const std::string fileName(Snapshot::Impl::GetFileName(version));
+
+        if (!Save((dir / fileName).string(), version, out_error))
+            return false;
+
+        versions.push_back(version);
+
+        const boost::filesystem::path pointer(dir / LatestFileName);
+        const boost::filesystem::path temp(
+                    dir / boost::filesystem::unique_path(LatestFileName + ".%%%%-%%%%.tmp"));
+        {
+            std::ofstream stream(temp.string(), std::ios_base::out | std::ios_base::binary
+                                 | std::ios_base::trunc);
+            stream << fileName << '\n';
+            stream.close();
+
+            if (!stream) {
+                out_error.assign((boost::format("Snapshot: Could not write '%1%'!")
+                                  % temp.string()).str());
+                boost::system::error_code ec;
+                boost::filesystem::remove(temp, ec);
+                return false;
+            }
+        }
+        boost::filesystem::rename(temp, pointer);
+
+        out_version = version;
+
+        /// Best effort; a reader that still maps an old file keeps it
+        /// alive until it lets go of it
+        const std::size_t retained = std::max<std::size_t>(keep, 1);
+        for (std::size_t i = 0; i + retained < versions.size(); ++i) {
+            boost::system::error_code ec;
+            boost::filesystem::remove(dir / Snapshot::Impl::GetFileName(versions[i]), ec);
+        }
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    return false;
+}
+
+Snapshot::Reader::Reader() :
+    m_pimpl(std::make_unique<Reader::Impl>())
+{
+
+}
+
+Snapshot::Reader::~Reader() = default;
+
+bool Snapshot::Reader::Open(const std::string &file, std::string &out_error)
+{
+    out_error.clear();
+
+    m_pimpl->Reset();
+    m_pimpl->File = file;
+
+    try {
+        /// Every page is read by the checksum below anyway
+        std::string err;
+        if (!m_pimpl->Mapping.Open(file, err, FileSystem::MappedFile::Advice::WillNeed)) {
+            out_error.assign("Snapshot: " + err);
+            return false;
+        }
+
+        const char *data = m_pimpl->Mapping.GetData();
+        const std::uint64_t fileSize = m_pimpl->Mapping.GetSize();
+
+        if (fileSize < SNAPSHOT_HEADER_SIZE)
+            throw std::runtime_error("Snapshot: File is too small!");
+        if (std::memcmp(data, SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE) != 0)
+            throw std::runtime_error("Snapshot: Not a snapshot!");
+        if (static_cast<unsigned char>(data[SNAPSHOT_MAGIC_SIZE]) != SNAPSHOT_FORMAT_VERSION)
+            throw std::runtime_error("Snapshot: Unsupported version!");
+
+        if (Snapshot::Impl::Checksum(data + SNAPSHOT_HEADER_SIZE,
+                                     static_cast<std::size_t>(fileSize - SNAPSHOT_HEADER_SIZE))
+                != Snapshot::Impl::LoadFixed32(data + 36))
+            throw std::runtime_error("Snapshot: Checksum mismatch!");
+
+        const std::uint64_t version = Snapshot::Impl::LoadFixed64(data + 8);
+        const std::uint64_t rows = Snapshot::Impl::LoadFixed64(data + 16);
+        const std::uint32_t columnCount = Snapshot::Impl::LoadFixed32(data + 24);
+        const std::uint32_t propertyCount = Snapshot::Impl::LoadFixed32(data + 28);
+        const std::uint32_t stringCount = Snapshot::Impl::LoadFixed32(data + 32);
+        const std::uint64_t directoryOffset = Snapshot::Impl::LoadFixed64(data + 40);
+        const std::uint64_t stringOffsetsOffset = Snapshot::Impl::LoadFixed64(data + 48);
+        const std::uint64_t stringDataOffset = Snapshot::Impl::LoadFixed64(data + 56);
+
+        /// Keeps the size arithmetic below from overflowing
+        if (rows > fileSize || columnCount > fileSize || propertyCount > fileSize
+                || stringCount > fileSize)
+            throw std::runtime_error("Snapshot: Corrupt header!");
+
+        const auto checkRange = [fileSize](const std::uint64_t offset, const std::uint64_t size) {
+            if (offset < SNAPSHOT_HEADER_SIZE || offset > fileSize || size > fileSize - offset)
+                throw std::runtime_error("Snapshot: Section out of range!");
+        };
+
+        checkRange(directoryOffset, static_cast<std::uint64_t>(columnCount) * SNAPSHOT_COLUMN_ENTRY_SIZE
+                   + static_cast<std::uint64_t>(propertyCount) * SNAPSHOT_PROPERTY_ENTRY_SIZE);
+        checkRange(stringOffsetsOffset, (static_cast<std::uint64_t>(stringCount) + 1) * 8);
+
+        m_pimpl->StringCount = stringCount;
+        m_pimpl->StringOffsets = data + stringOffsetsOffset;
+        m_pimpl->StringData = data + stringDataOffset;
+
+        std::uint64_t previous = 0;
+        for (std::uint32_t i = 0; i <= stringCount; ++i) {
+            const std::uint64_t offset = Snapshot::Impl::LoadFixed64(m_pimpl->StringOffsets + i * 8);
+            if (offset < previous)
+                throw std::runtime_error("Snapshot: Corrupt string table!");
+            previous = offset;
+        }
+        checkRange(stringDataOffset, previous);
+
+        const char *entry = data + directoryOffset;
+        for (std::uint32_t i = 0; i < columnCount; ++i, entry += SNAPSHOT_COLUMN_ENTRY_SIZE) {
+            Reader::Impl::ColumnEntry column;
+            column.NameId = Snapshot::Impl::LoadFixed32(entry);
+
+            const unsigned char type = static_cast<unsigned char>(entry[4]);
+            if (type > static_cast<unsigned char>(ColumnType::Int64))
+                throw std::runtime_error("Snapshot: Unknown column type!");
+            column.Type = static_cast<ColumnType>(type);
+
+            const std::uint64_t offset = Snapshot::Impl::LoadFixed64(entry + 8);
+            checkRange(offset, rows * (column.Type == ColumnType::Int64 ? 8 : 4));
+            column.Data = data + offset;
+
+            if (column.NameId >= stringCount)
+                throw std::runtime_error("Snapshot: String id out of range!");
+
+            /// Checked once here so GetValue() can trust every id
+            if (column.Type == ColumnType::String) {
+                for (std::uint64_t row = 0; row < rows; ++row) {
+                    if (Snapshot::Impl::LoadFixed32(column.Data + row * 4) >= stringCount)
+                        throw std::runtime_error("Snapshot: String id out of range!");
+                }
+            }
+
+            m_pimpl->Columns.push_back(column);
+        }
+
+        for (std::uint32_t i = 0; i < propertyCount; ++i, entry += SNAPSHOT_PROPERTY_ENTRY_SIZE) {
+            const std::uint32_t keyId = Snapshot::Impl::LoadFixed32(entry);
+            const std::uint32_t valueId = Snapshot::Impl::LoadFixed32(entry + 4);
+            if (keyId >= stringCount || valueId >= stringCount)
+                throw std::runtime_error("Snapshot: String id out of range!");
+
+            std::string key;
+            m_pimpl->GetString(keyId, key);
+            m_pimpl->GetString(valueId, m_pimpl->SnapshotProperties[key]);
+        }
+
+        m_pimpl->Version = version;
+        m_pimpl->Rows = static_cast<std::size_t>(rows);
+
+        return true;
+    }
+
+    catch (const std::exception &ex) {
+        out_error.assign(ex.what());
+    }
+
+    catch (...) {
+        out_error.assign(UNKNOWN_ERROR);
+    }
+
+    m_pimpl->Reset();
+
+    return false;
+}
+
+const std::string &Snapshot::Reader::GetFile() const
+{
+    return m_pimpl->File;
+}
+
+std::uint64_t Snapshot::Reader::GetVersion() const
+{
+    return m_pimpl->Version;
+}
+
+const Snapshot::Properties &Snapshot::Reader::GetProperties() const
+{
+    return m_pimpl->SnapshotProperties;
+}
+
+std::size_t Snapshot::Reader::GetRowCount() const
+{
+    return m_pimpl->Rows;
+}
+
+std::size_t Snapshot::Reader::GetColumnCount() const
+{
+    return m_pimpl->Columns.size();
+}
+
+std::string Snapshot::Reader::GetColumnName(const std::size_t column) const
+{
+    std::string name;
+    m_pimpl->GetString(m_pimpl->Columns[column].NameId, name);
+    return name;
+}
+
+Snapshot::ColumnType Snapshot::Reader::GetColumnType(const std::size_t column) const
+{
+    return m_pimpl->Columns[column].Type;
+}
+
+void Snapshot::Reader::GetValue(const std::size_t row, const std::size_t column,
+                                std::string &out_value) const
+{
+    const Reader::Impl::ColumnEntry &entry = m_pimpl->Columns[column];
+
+    if (entry.Type == ColumnType::Int64) {
+        out_value.assign(std::to_string(
+                             static_cast<long long>(Snapshot::Impl::LoadFixed64(entry.Data + row * 8))));
+    } else {
+        m_pimpl->GetString(Snapshot::Impl::LoadFixed32(entry.Data + row * 4), out_value);
+    }
+}
+
+std::int64_t Snapshot::Reader::GetInteger(const std::size_t row, const std::size_t column) const
+{
+    return static_cast<std::int64_t>(
+                Snapshot::Impl::LoadFixed64(m_pimpl->Columns[column].Data + row * 8));
+}
+
+std::uint32_t Snapshot::Writer::Impl::Intern(const std::string &value)
+{
+    const auto it = StringIds.find(value);
+    if (it != StringIds.end())
+        return it->second;
+
+    const std::uint32_t id = static_cast<std::uint32_t>(Strings.size());
+    const auto inserted = StringIds.emplace(value, id);
+    Strings.push_back(&inserted.first->first);
+
+    return id;
+}
+
+void Snapshot::Writer::Impl::Serialize(const std::uint64_t version, std::string &out_data)
+{
+    Strings.clear();
+    StringIds.clear();
+
+    const std::size_t rows = Columns.empty() ? 0 : Columns.front().second.size();
+
+    std::vector<std::pair<ColumnType, std::string>> blocks;
+    blocks.reserve(Columns.size());
+
+    std::vector<std::uint32_t> nameIds;
+    nameIds.reserve(Columns.size());
+
+    for (const auto &column : Columns) {
+        nameIds.push_back(Intern(column.first));
+
+        std::string block;
+        ColumnType type = rows > 0 ? ColumnType::Int64 : ColumnType::String;
+
+        std::int64_t integer;
+        for (const auto &value : column.second) {
+            if (!Utility::ParseCanonicalInteger(value, integer)) {
+                type = ColumnType::String;
+                break;
+            }
+            Snapshot::Impl::PutFixed64(block, static_cast<std::uint64_t>(integer));
+        }
+
+        if (type == ColumnType::String) {
+            block.clear();
+            for (const auto &value : column.second) {
+                Snapshot::Impl::PutFixed32(block, Intern(value));
+            }
+        }
+
+        blocks.emplace_back(type, std::move(block));
+    }
+
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> properties;
+    for (const auto &property : SnapshotProperties) {
+        const std::uint32_t keyId = Intern(property.first);
+        properties.emplace_back(keyId, Intern(property.second));
+    }
+
+    out_data.assign(SNAPSHOT_HEADER_SIZE, '\0');
+    std::memcpy(&out_data[0], SNAPSHOT_MAGIC, SNAPSHOT_MAGIC_SIZE);
+    out_data[SNAPSHOT_MAGIC_SIZE] = static_cast<char>(SNAPSHOT_FORMAT_VERSION);
+    Snapshot::Impl::SetFixed64(out_data, 8, version);
+    Snapshot::Impl::SetFixed64(out_data, 16, rows);
+    Snapshot::Impl::SetFixed32(out_data, 24, static_cast<std::uint32_t>(Columns.size()));
+    Snapshot::Impl::SetFixed32(out_data, 28, static_cast<std::uint32_t>(properties.size()));
+    Snapshot::Impl::SetFixed32(out_data, 32, static_cast<std::uint32_t>(Strings.size()));
+
+    /// The directory is written with placeholder offsets and patched once
+    /// the column blocks are laid out
+    const std::size_t directoryOffset = out_data.size();
+    Snapshot::Impl::SetFixed64(out_data, 40, directoryOffset);
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+        Snapshot::Impl::PutFixed32(out_data, nameIds[i]);
+        out_data.push_back(static_cast<char>(blocks[i].first));
+        out_data.append(3, '\0');
+        Snapshot::Impl::PutFixed64(out_data, 0);
+    }
+    for (const auto &property : properties) {
+        Snapshot::Impl::PutFixed32(out_data, property.first);
+        Snapshot::Impl::PutFixed32(out_data, property.second);
+    }
+
+    for (std::size_t i = 0; i < blocks.size(); ++i) {
+        Snapshot::Impl::Align(out_data);
+        Snapshot::Impl::SetFixed64(out_data, directoryOffset + i * SNAPSHOT_COLUMN_ENTRY_SIZE + 8,
+                                   out_data.size());
+        out_data.append(blocks[i].second);
+    }
+
+    Snapshot::Impl::Align(out_data);
+    Snapshot::Impl::SetFixed64(out_data, 48, out_data.size());
+    std::uint64_t offset = 0;
+    Snapshot::Impl::PutFixed64(out_data, offset);
+    for (const auto string : Strings) {
+        offset += string->size();
+        Snapshot::Impl::PutFixed64(out_data, offset);
+    }
+
+    Snapshot::Impl::SetFixed64(out_data, 56, out_data.size());
+    out_data.reserve(out_data.size() + static_cast<std::size_t>(offset));
+    for (const auto string : Strings) {
+        out_data.append(*string);
+    }
+
+    Snapshot::Impl::SetFixed32(out_data, 36, Snapshot::Impl::Checksum(
+                                   out_data.data() + SNAPSHOT_HEADER_SIZE,
+                                   out_data.size() - SNAPSHOT_HEADER_SIZE));
+}
+
+Snapshot::Reader::Impl::Impl() :
+    Version(0),
+    Rows(0),
+    StringCount(0),
+    StringOffsets(nullptr),
+    StringData(nullptr)
+{
+
+}
+
+void Snapshot::Reader::Impl::Reset()
+{
+    Mapping.Close();
+
+    File.clear();
+    Version = 0;
+    SnapshotProperties.clear();
+    Rows = 0;
+    Columns.clear();
+    StringCount = 0;
+    StringOffsets = nullptr;
+    StringData = nullptr;
+}
+
+void Snapshot::Reader::Impl::GetString(const std::uint32_t id, std::string &out_value) const
+{
+    const std::uint64_t begin = Snapshot::Impl::LoadFixed64(StringOffsets + id * 8);
+    const std::uint64_t end = Snapshot::Impl::LoadFixed64(StringOffsets + (id + 1) * 8);
+
+    out_value.assign(StringData + begin, static_cast<std::size_t>(end - begin));
+}
+
+void Snapshot::Impl::PutFixed32(std::string &out_data, const std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out_data.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void Snapshot::Impl::PutFixed64(std::string &out_data, const std::uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        out_data.push_back(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+void Snapshot::Impl::SetFixed32(std::string &out_data, const std::size_t offset, const std::uint32_t value)
+{
+    for (int i = 0; i < 4; ++i) {
+        out_data[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+void Snapshot::Impl::SetFixed64(std::string &out_data, const std::size_t offset, const std::uint64_t value)
+{
+    for (int i = 0; i < 8; ++i) {
+        out_data[offset + i] = static_cast<char>((value >> (8 * i)) & 0xff);
+    }
+}
+
+void Snapshot::Impl::Align(std::string &out_data)
+{
+    out_data.append((SNAPSHOT_ALIGNMENT - out_data.size() % SNAPSHOT_ALIGNMENT) % SNAPSHOT_ALIGNMENT, '\0');
+}
+
+std::uint32_t Snapshot::Impl::LoadFixed32(const char *data)
+{
+    /// Compilers turn this into a single load on little-endian hosts
+    std::uint32_t value = 0;
+    for (int i = 0; i < 4; ++i) {
+        value |= static_cast<std::uint32_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+
+    return value;
+}
+
+std::uint64_t Snapshot::Impl::LoadFixed64(const char *data)
+{
+    std::uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+        value |= static_cast<std::uint64_t>(static_cast<unsigned char>(data[i])) << (8 * i);
+    }
+
+    return value;
+}
+
+bool Snapshot::Impl::ParseFileName(const std::string &fileName, std::uint64_t &out_version)
+{
+    static const std::string prefix(SNAPSHOT_FILE_PREFIX);
+
+    if (fileName.size() <= prefix.size() + FileExtension.size()
+            || fileName.compare(0, prefix.size(), prefix) != 0
+            || fileName.compare(fileName.size() - FileExtension.size(), FileExtension.size(),
+                                FileExtension) != 0)
+        return false;
+
+    const std::string digits(fileName.substr(prefix.size(),
+                                             fileName.size() - prefix.size() - FileExtension.size()));
+    if (digits.size() > 20 || digits.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+
+    try {
+        out_version = std::stoull(digits);
+    } catch (const std::out_of_range &) {
+        return false;
+    }
+
+    return true;
+}
+
+std::string Snapshot::Impl::GetFileName(const std::uint64_t version)
+{
+    /// Zero-padded so a plain directory listing sorts by version
+    return (boost::format("%1%%2$020u%3%") % SNAPSHOT_FILE_PREFIX % version % FileExtension).str();
+}
+
+std::uint32_t Snapshot::Impl::Checksum(const char *data, const std::size_t size)
+{
+    uLong crc = crc32(0L, Z_NULL, 0);
+
+    /// crc32() takes a uInt length
+    std::size_t offset = 0;
+    while (offset < size) {
+        const uInt chunk = static_cast<uInt>(std::min<std::size_t>(size - offset, 1u << 30));
+        crc = crc32(crc, reinterpret_cast<const Bytef *>(data + offset), chunk);
+        offset += chunk;
+    }
+
+    return static_cast<std::uint32_t>(crc);
+}
+
@@ -0,0 +1,140 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Immutable, versioned table snapshots meant to be memory-mapped. Values are
+ * read straight from the mapping, so opening one costs a checksum pass and
+ * every process that maps the same file shares a single page-cache copy.
+ */
+
+
+#ifndef CORELIB_SNAPSHOT_HPP
+#define CORELIB_SNAPSHOT_HPP
+
+
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+namespace CoreLib {
+    class Snapshot;
+}
+
+class CoreLib::Snapshot
+{
+public:
+    typedef std::vector<std::string> Column;
+    typedef std::map<std::string, std::string> Properties;
+
+    class Reader;
+    class Writer;
+
+    /// Int64 when every value of a column is a plain 64-bit integer
+    enum class ColumnType : unsigned char {
+        String = 0,
+        Int64 = 1
+    };
+
+    static const std::string FileExtension;
+
+    /// Holds the file name of the newest snapshot published to a directory
+    static const std::string LatestFileName;
+
+public:
+    /// Reads the LATEST pointer of a snapshot directory
+    static bool GetLatest(const std::string &directory, std::string &out_file,
+                          std::string &out_error);
+
+private:
+    struct Impl;
+};
+
+class CoreLib::Snapshot::Writer
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    Writer();
+    ~Writer();
+
+public:
+    void SetProperty(const std::string &key, const std::string &value);
+
+    /// Every column must have the same number of values
+    void AddColumn(const std::string &name, const Column &values);
+    void AddColumn(const std::string &name, Column &&values);
+
+    /// Writes to a temporary file next to the target and renames it over,
+    /// so readers never see a partial snapshot
+    bool Save(const std::string &file, const std::uint64_t version, std::string &out_error);
+
+    /// Saves the next version into directory, atomically points LATEST at
+    /// it, then removes all but the newest keep snapshots. Files that are
+    /// still mapped by a reader stay readable until they are unmapped.
+    bool Publish(const std::string &directory, const std::size_t keep,
+                 std::uint64_t &out_version, std::string &out_error);
+};
+
+/// Once open, a reader never changes, so it can be shared between threads;
+/// values are only valid for as long as the reader lives.
+class CoreLib::Snapshot::Reader
+{
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    Reader();
+    ~Reader();
+
+public:
+    bool Open(const std::string &file, std::string &out_error);
+
+    const std::string &GetFile() const;
+    std::uint64_t GetVersion() const;
+    const Properties &GetProperties() const;
+    std::size_t GetRowCount() const;
+    std::size_t GetColumnCount() const;
+
+    /// Callers keep row and column within GetRowCount() / GetColumnCount()
+    std::string GetColumnName(const std::size_t column) const;
+    ColumnType GetColumnType(const std::size_t column) const;
+    void GetValue(const std::size_t row, const std::size_t column, std::string &out_value) const;
+    std::int64_t GetInteger(const std::size_t row, const std::size_t column) const;
+};
+
+
+#endif /* CORELIB_SNAPSHOT_HPP */
+
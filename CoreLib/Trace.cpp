@@ -0,0 +1,453 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Scoped tracing spans, dumped as Chrome trace_event JSON.
+ */
+
+
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/filesystem/operations.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/format.hpp>
+#include <boost/thread/tss.hpp>
+#include "make_unique.hpp"
+#include "Log.hpp"
+#include "Trace.hpp"
+#include "Utility.hpp"
+
+#define     TRACE_FILE_EXTENSION                ".json"
+#define     SIGNAL_POLL_INTERVAL_MILLISECONDS   250
+#define     PROCESS_ID                          1
+
+using namespace std;
+using namespace boost;
+using namespace CoreLib;
+
+struct Trace::Impl
+{
+    typedef std::chrono::steady_clock Clock;
+
+    struct Event
+    {
+        const char *Category;
+        const char *Name;
+        std::string Detail;
+        double Start;
+        double Duration;
+    };
+
+    /// Owned jointly by its thread and the registry, so events recorded
+    /// by a thread that has already exited still make it into the dump
+    struct ThreadBuffer
+    {
+        std::mutex Mutex;
+        std::vector<Event> Events;
+        std::uint_least64_t Dropped;
+        std::uint_least32_t ThreadId;
+        std::atomic<bool> IsRetired;
+
+        explicit ThreadBuffer(const std::uint_least32_t threadId);
+    };
+
+    typedef std::shared_ptr<ThreadBuffer> ThreadBuffer_ptr;
+
+    struct ThreadHandle
+    {
+        ThreadBuffer_ptr Buffer;
+
+        explicit ThreadHandle(const ThreadBuffer_ptr &buffer);
+        ~ThreadHandle();
+    };
+
+    static volatile std::sig_atomic_t IsDumpRequested;
+
+    const Clock::time_point Epoch;
+    std::atomic<std::size_t> Capacity;
+
+    std::mutex Mutex;
+    std::vector<ThreadBuffer_ptr> Buffers;
+    std::uint_least32_t NextThreadId;
+    boost::thread_specific_ptr<ThreadHandle> CurrentThread;
+
+    std::string SignalOutputDirectoryPath;
+    std::string SignalOutputFilePrefix;
+
+    /// A single watcher for the life of the process, stopped and joined
+    /// when the tracer is torn down at exit
+    std::mutex SignalWatcherMutex;
+    std::condition_variable SignalWatcherCondition;
+    bool IsSignalWatcherStopping;
+    std::thread SignalWatcherThread;
+
+    Impl();
+    ~Impl();
+
+    ThreadBuffer *GetThreadBuffer();
+    void Record(const char *category, const char *name, std::string &detail,
+                const double start, const double duration);
+
+    void SignalWatcher();
+
+    static void OnSignal(int signal);
+    static std::string FormatMicroseconds(const double microseconds);
+};
+
+volatile std::sig_atomic_t Trace::Impl::IsDumpRequested = 0;
+
+std::unique_ptr<Trace::Impl> Trace::s_pimpl = std::make_unique<Trace::Impl>();
+std::atomic<bool> Trace::s_isEnabled(false);
+
+Trace::Span::Span(const char *category, const char *name) :
+    m_isRecording(false),
+    m_category(category),
+    m_name(name),
+    m_start(0.0)
+{
+    Begin();
+}
+
+Trace::Span::Span(const char *category, const char *name, const std::string &detail) :
+    m_isRecording(false),
+    m_category(category),
+    m_name(name),
+    m_start(0.0)
+{
+    Begin();
+
+    if (m_isRecording)
+        m_detail = detail;
+}
+
+Trace::Span::~Span()
+{
+    if (!m_isRecording)
+        return;
+
+    const double duration = m_stopwatch.Stop() / 1000.0;
+    s_pimpl->Record(m_category, m_name, m_detail, m_start, duration);
+}
+
+void Trace::Span::Begin()
+{
+    if (!IsEnabled())
+        return;
+
+    m_isRecording = true;
+    m_start = std::chrono::duration<double, std::micro>(
+                Impl::Clock::now() - s_pimpl->Epoch).count();
+    m_stopwatch.Start();
+}
+
+void Trace::Enable(const std::size_t perThreadCapacity)
+{
+    s_pimpl->Capacity.store(perThreadCapacity, std::memory_order_relaxed);
+    s_isEnabled.store(true, std::memory_order_relaxed);
+}
+
+void Trace::Disable()
+{
+    s_isEnabled.store(false, std::memory_order_relaxed);
+}
+
+bool Trace::EnableFromDefinitions(const std::string &outputDirectoryPath,
+                                  const std::string &outputFilePrefix)
+{
+#if defined ( CORELIB_TRACE_SPANS_ENABLED )
+#if defined ( CORELIB_TRACE_BUFFER_CAPACITY )
+    Enable(CORELIB_TRACE_BUFFER_CAPACITY);
+#else
+    Enable();
+#endif  // defined ( CORELIB_TRACE_BUFFER_CAPACITY )
+
+#if defined ( __unix__ )
+    return DumpOnSignal(SIGUSR2, outputDirectoryPath, outputFilePrefix);
+#endif  // defined ( __unix__ )
+#endif  // defined ( CORELIB_TRACE_SPANS_ENABLED )
+
+    (void)outputDirectoryPath;
+    (void)outputFilePrefix;
+    return true;
+}
+
+bool Trace::Dump(const std::string &filePath)
+{
+    std::vector<Impl::ThreadBuffer_ptr> buffers;
+
+    {
+        std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+        (void)lock;
+
+        buffers = s_pimpl->Buffers;
+
+        /// Retired buffers are drained below for the last time
+        std::vector<Impl::ThreadBuffer_ptr> live;
+        for (const auto &buffer : s_pimpl->Buffers) {
+            if (!buffer->IsRetired.load(std::memory_order_acquire))
+                live.push_back(buffer);
+        }
+        s_pimpl->Buffers.swap(live);
+    }
+
+    std::string json("{\"traceEvents\":[");
+    std::uint_least64_t dropped = 0;
+    bool isFirst = true;
+
+    for (const auto &buffer : buffers) {
+        std::vector<Impl::Event> events;
+
+        {
+            std::lock_guard<std::mutex> lock(buffer->Mutex);
+            (void)lock;
+
+            events.swap(buffer->Events);
+            dropped += buffer->Dropped;
+            buffer->Dropped = 0;
+        }
+
+        const std::string threadId(std::to_string(buffer->ThreadId));
+
+        for (const auto &event : events) {
+            if (!isFirst)
+                json += ",\n";
+            isFirst = false;
+
+            json += "{\"name\":";
+            Utility::AppendJsonString(json, event.Name);
+            json += ",\"cat\":";
+            Utility::AppendJsonString(json, event.Category);
+            json += ",\"ph\":\"X\",\"ts\":";
+            json += Impl::FormatMicroseconds(event.Start);
+            json += ",\"dur\":";
+            json += Impl::FormatMicroseconds(event.Duration);
+            json += ",\"pid\":" + std::to_string(PROCESS_ID);
+            json += ",\"tid\":" + threadId;
+            if (!event.Detail.empty()) {
+                json += ",\"args\":{\"detail\":";
+                Utility::AppendJsonString(json, event.Detail);
+                json += "}";
+            }
+            json += "}";
+        }
+    }
+
+    json += "],\"displayTimeUnit\":\"ms\",\"otherData\":{\"droppedEvents\":";
+    json += std::to_string(dropped);
+    json += "}}\n";
+
+    try {
+        std::ofstream file(filePath, std::ios::out | std::ios::trunc | std::ios::binary);
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        file.write(json.data(), static_cast<std::streamsize>(json.size()));
+        file.close();
+
+        return true;
+    } catch (const std::exception &ex) {
+        LOG_ERROR(ex.what(), filePath);
+    } catch (...) {
+        LOG_ERROR("Unknown error!", filePath);
+    }
+
+    return false;
+}
+
+bool Trace::DumpOnSignal(const int signal,
+                         const std::string &outputDirectoryPath,
+                         const std::string &outputFilePrefix)
+{
+    try {
+        if (!filesystem::exists(outputDirectoryPath))
+            filesystem::create_directories(outputDirectoryPath);
+    } catch (const std::exception &ex) {
+        LOG_ERROR(ex.what(), outputDirectoryPath);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(s_pimpl->Mutex);
+    (void)lock;
+
+    s_pimpl->SignalOutputDirectoryPath = outputDirectoryPath;
+    s_pimpl->SignalOutputFilePrefix = outputFilePrefix;
+
+    if (std::signal(signal, &Impl::OnSignal) == SIG_ERR) {
+        LOG_ERROR("Failed to install the trace dump signal handler!", signal);
+        return false;
+    }
+
+    if (!s_pimpl->SignalWatcherThread.joinable()) {
+        s_pimpl->SignalWatcherThread = std::thread(&Impl::SignalWatcher, s_pimpl.get());
+    }
+
+    return true;
+}
+
+Trace::Impl::ThreadBuffer::ThreadBuffer(const std::uint_least32_t threadId) :
+    Dropped(0),
+    ThreadId(threadId),
+    IsRetired(false)
+{
+
+}
+
+Trace::Impl::ThreadHandle::ThreadHandle(const ThreadBuffer_ptr &buffer) :
+    Buffer(buffer)
+{
+
+}
+
+Trace::Impl::ThreadHandle::~ThreadHandle()
+{
+    Buffer->IsRetired.store(true, std::memory_order_release);
+}
+
+Trace::Impl::Impl() :
+    Epoch(Clock::now()),
+    Capacity(65536),
+    NextThreadId(1),
+    IsSignalWatcherStopping(false)
+{
+
+}
+
+Trace::Impl::~Impl()
+{
+    {
+        std::lock_guard<std::mutex> lock(SignalWatcherMutex);
+        (void)lock;
+
+        IsSignalWatcherStopping = true;
+    }
+
+    SignalWatcherCondition.notify_all();
+
+    if (SignalWatcherThread.joinable())
+        SignalWatcherThread.join();
+}
+
+Trace::Impl::ThreadBuffer *Trace::Impl::GetThreadBuffer()
+{
+    ThreadHandle *handle = CurrentThread.get();
+
+    if (handle == nullptr) {
+        std::lock_guard<std::mutex> lock(Mutex);
+        (void)lock;
+
+        ThreadBuffer_ptr buffer(std::make_shared<ThreadBuffer>(NextThreadId++));
+        Buffers.push_back(buffer);
+
+        handle = new ThreadHandle(buffer);
+        CurrentThread.reset(handle);
+    }
+
+    return handle->Buffer.get();
+}
+
+void Trace::Impl::Record(const char *category, const char *name, std::string &detail,
+                         const double start, const double duration)
+{
+    ThreadBuffer *buffer = GetThreadBuffer();
+
+    /// Only contended while a dump swaps the events out
+    std::lock_guard<std::mutex> lock(buffer->Mutex);
+    (void)lock;
+
+    if (buffer->Events.size() >= Capacity.load(std::memory_order_relaxed)) {
+        ++buffer->Dropped;
+        return;
+    }
+
+    Event event;
+    event.Category = category;
+    event.Name = name;
+    event.Detail.swap(detail);
+    event.Start = start;
+    event.Duration = duration;
+
+    buffer->Events.push_back(std::move(event));
+}
+
+void Trace::Impl::SignalWatcher()
+{
+    for (;;) {
+        {
+            /// The handler cannot notify, so the flag is still polled; a
+            /// stop request cuts the wait short
+            std::unique_lock<std::mutex> lock(SignalWatcherMutex);
+            if (SignalWatcherCondition.wait_for(lock,
+                                                std::chrono::milliseconds(SIGNAL_POLL_INTERVAL_MILLISECONDS),
+                                                [this] { return IsSignalWatcherStopping; }))
+                return;
+        }
+
+        if (IsDumpRequested == 0)
+            continue;
+
+        IsDumpRequested = 0;
+
+        std::string path;
+
+        {
+            std::lock_guard<std::mutex> lock(Mutex);
+            (void)lock;
+
+            path = (filesystem::path(SignalOutputDirectoryPath)
+                    / filesystem::path((format("%1%_%2%" TRACE_FILE_EXTENSION)
+                                        % SignalOutputFilePrefix
+                                        % posix_time::to_iso_string(
+                                            posix_time::microsec_clock::local_time())).str())).string();
+        }
+
+        if (Trace::Dump(path)) {
+            LOG_INFO("Trace dumped!", path);
+        }
+    }
+}
+
+void Trace::Impl::OnSignal(int signal)
+{
+    (void)signal;
+    IsDumpRequested = 1;
+}
+
+std::string Trace::Impl::FormatMicroseconds(const double microseconds)
+{
+    char formatted[32];
+    std::snprintf(formatted, sizeof(formatted), "%.3f", microseconds);
+    return formatted;
+}
+
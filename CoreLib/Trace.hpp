@@ -0,0 +1,121 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Scoped tracing spans, dumped as Chrome trace_event JSON.
+ */
+
+
+#ifndef CORELIB_TRACE_HPP
+#define CORELIB_TRACE_HPP
+
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <cstddef>
+#include "Stopwatch.hpp"
+
+#define CORELIB_TRACE_CONCAT_IMPL(A, B)     A##B
+#define CORELIB_TRACE_CONCAT(A, B)          CORELIB_TRACE_CONCAT_IMPL(A, B)
+
+/// CATEGORY and NAME must be string literals; DETAIL is copied, and only
+/// while tracing is enabled, but the expression itself is always evaluated
+#define TRACE_SPAN(CATEGORY, NAME)  \
+    CoreLib::Trace::Span CORELIB_TRACE_CONCAT(corelibTraceSpan, __LINE__)(CATEGORY, NAME)
+#define TRACE_SPAN_DETAIL(CATEGORY, NAME, DETAIL)  \
+    CoreLib::Trace::Span CORELIB_TRACE_CONCAT(corelibTraceSpan, __LINE__)(CATEGORY, NAME, DETAIL)
+
+namespace CoreLib {
+class Trace;
+}
+
+class CoreLib::Trace
+{
+public:
+    /// Recorded as a single complete event on destruction; nesting follows
+    /// from the timestamps, as spans on one thread are strictly scoped.
+    class Span
+    {
+    private:
+        bool m_isRecording;
+        const char *m_category;
+        const char *m_name;
+        std::string m_detail;
+        double m_start;
+        Stopwatch<std::chrono::steady_clock, std::chrono::nanoseconds> m_stopwatch;
+
+    public:
+        Span(const char *category, const char *name);
+        Span(const char *category, const char *name, const std::string &detail);
+        ~Span();
+
+        Span(const Span &) = delete;
+        Span &operator=(const Span &) = delete;
+
+    private:
+        void Begin();
+    };
+
+private:
+    struct Impl;
+    static std::unique_ptr<Impl> s_pimpl;
+    static std::atomic<bool> s_isEnabled;
+
+public:
+    /// Each thread keeps at most perThreadCapacity events between dumps;
+    /// anything beyond that is counted and dropped
+    static void Enable(const std::size_t perThreadCapacity = 65536);
+    static void Disable();
+
+    /// Does nothing unless built with TRACE_SPANS (see definitions.cmake);
+    /// otherwise enables tracing and, on UNIX, dumps on SIGUSR2
+    static bool EnableFromDefinitions(const std::string &outputDirectoryPath,
+                                      const std::string &outputFilePrefix);
+
+    static bool IsEnabled()
+    {
+        return s_isEnabled.load(std::memory_order_relaxed);
+    }
+
+    /// Writes every buffered event to filePath and empties the buffers
+    static bool Dump(const std::string &filePath);
+
+    /// The handler only raises a flag; a watcher thread then dumps into
+    /// outputDirectoryPath as '<prefix>_<timestamp>.json'
+    static bool DumpOnSignal(const int signal,
+                             const std::string &outputDirectoryPath,
+                             const std::string &outputFilePrefix);
+};
+
+
+#endif /* CORELIB_TRACE_HPP */
+
@@ -34,6 +34,8 @@
 
 
 #include <vector>
+#include <cerrno>
+#include <cstdlib>
 #include <boost/format.hpp>
 #include "Utility.hpp"
 
@@ -68,3 +70,67 @@ std::string Utility::CalculateSize(const std::size_t size)
     return result;
 }
 
+
+bool Utility::ParseCanonicalInteger(const std::string &text, std::int64_t &out_value)
+{
+    /// No sign, spaces or leading zeros other than a single '-'
+    std::size_t start = text.size() > 0 && text[0] == '-' ? 1 : 0;
+    if (text.size() == start || text.size() - start > 19)
+        return false;
+
+    if (text[start] == '0' && (text.size() - start > 1 || start == 1))
+        return false;
+
+    for (std::size_t i = start; i < text.size(); ++i) {
+        if (text[i] < '0' || text[i] > '9')
+            return false;
+    }
+
+    errno = 0;
+    const long long value = std::strtoll(text.c_str(), nullptr, 10);
+    if (errno == ERANGE)
+        return false;
+
+    out_value = static_cast<std::int64_t>(value);
+
+    return true;
+}
+
+void Utility::AppendJsonString(std::string &out, const std::string &value)
+{
+    static const char HEX[] = "0123456789abcdef";
+
+    out.reserve(out.size() + value.size() + 2);
+    out += '"';
+
+    for (const char c : value) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                out += "\\u00";
+                out += HEX[(c >> 4) & 0x0F];
+                out += HEX[c & 0x0F];
+            } else {
+                out += c;
+            }
+            break;
+        }
+    }
+
+    out += '"';
+}
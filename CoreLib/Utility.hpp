@@ -39,6 +39,7 @@
 
 #include <string>
 #include <unordered_map>
+#include <cstdint>
 
 namespace CoreLib {
 class Utility;
@@ -69,6 +70,14 @@ public:
     }
 
     static std::string CalculateSize(const std::size_t size);
+
+    /// Only accepts the exact form the value prints back as, so storing the
+    /// integer instead of the text loses nothing
+    static bool ParseCanonicalInteger(const std::string &text, std::int64_t &out_value);
+
+    /// Appends value as a quoted JSON string, escaping quotes, backslashes
+    /// and control characters
+    static void AppendJsonString(std::string &out, const std::string &value);
 };
 
 
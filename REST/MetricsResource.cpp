@@ -0,0 +1,194 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2015 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Serves the process metrics in the Prometheus text exposition format.
+ */
+
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <Wt/Http/Request>
+#include <Wt/Http/Response>
+#include <CoreLib/Database.hpp>
+#include <CoreLib/Metrics.hpp>
+#include <CoreLib/make_unique.hpp>
+#include "MetricsResource.hpp"
+#include "Pool.hpp"
+
+#define     EXPOSITION_CONTENT_TYPE             "text/plain; version=0.0.4; charset=utf-8"
+#define     AUTHORIZATION_BEARER_PREFIX         "Bearer "
+
+using namespace std;
+using namespace Wt;
+using namespace CoreLib;
+using namespace Rest;
+
+struct MetricsResource::Impl
+{
+    /// Database statistics are only kept as snapshots, so they are
+    /// copied in right before each scrape; running totals go to counters
+    Metrics::Gauge *PoolMaxSessions;
+    Metrics::Gauge *PoolOpenSessions;
+    Metrics::Gauge *PoolIdleSessions;
+    Metrics::Counter *PoolTimeouts;
+    Metrics::Gauge *StatementCacheSize;
+    Metrics::Counter *StatementCacheHits;
+    Metrics::Counter *StatementCacheMisses;
+    Metrics::Gauge *WriteQueuePending;
+    Metrics::Counter *WriteQueueFailed;
+
+    Impl();
+    ~Impl();
+
+    void Refresh();
+
+    /// Internal pool and queue state is nobody else's business: loopback
+    /// clients only, unless a METRICS_TOKEN bearer token is configured
+    static bool IsAuthorized(const Wt::Http::Request &request);
+    static bool IsEqual(const std::string &a, const std::string &b);
+};
+
+MetricsResource::MetricsResource(WObject *parent) :
+    ApiResource(parent),
+    m_pimpl(std::make_unique<MetricsResource::Impl>())
+{
+
+}
+
+MetricsResource::~MetricsResource()
+{
+    beingDeleted();
+}
+
+void MetricsResource::handleRequest(const Wt::Http::Request &request, Wt::Http::Response &response)
+{
+    try {
+        if (!Impl::IsAuthorized(request)) {
+            response.setStatus(403);
+            Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_403));
+            return;
+        }
+
+        m_pimpl->Refresh();
+
+        response.addHeader("Content-type", EXPOSITION_CONTENT_TYPE);
+        response.out() << Metrics::Expose();
+    }
+
+    catch (...) {
+        Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_500));
+    }
+}
+
+MetricsResource::Impl::Impl() :
+    PoolMaxSessions(Metrics::GetGauge("corelib_database_pool_sessions",
+                                      "Database sessions by state",
+                                      { { "state", "max" } })),
+    PoolOpenSessions(Metrics::GetGauge("corelib_database_pool_sessions",
+                                       "Database sessions by state",
+                                       { { "state", "open" } })),
+    PoolIdleSessions(Metrics::GetGauge("corelib_database_pool_sessions",
+                                       "Database sessions by state",
+                                       { { "state", "idle" } })),
+    PoolTimeouts(Metrics::GetCounter("corelib_database_pool_timeouts_total",
+                                     "Session checkouts that timed out")),
+    StatementCacheSize(Metrics::GetGauge("corelib_database_statement_cache_size",
+                                         "Prepared statements cached across pooled database sessions")),
+    StatementCacheHits(Metrics::GetCounter("corelib_database_statement_cache_lookups_total",
+                                           "Statement cache lookups",
+                                           { { "result", "hit" } })),
+    StatementCacheMisses(Metrics::GetCounter("corelib_database_statement_cache_lookups_total",
+                                             "Statement cache lookups",
+                                             { { "result", "miss" } })),
+    WriteQueuePending(Metrics::GetGauge("corelib_database_write_queue_pending",
+                                        "Asynchronous writes waiting for the writer thread")),
+    WriteQueueFailed(Metrics::GetCounter("corelib_database_write_queue_failed_total",
+                                         "Asynchronous writes that failed"))
+{
+
+}
+
+MetricsResource::Impl::~Impl()
+{
+
+}
+
+void MetricsResource::Impl::Refresh()
+{
+    Database::PoolStatistics pool(Pool::Database()->GetPoolStatistics());
+    PoolMaxSessions->Set(static_cast<std::int_least64_t>(pool.MaxSize));
+    PoolOpenSessions->Set(static_cast<std::int_least64_t>(pool.OpenSessions));
+    PoolIdleSessions->Set(static_cast<std::int_least64_t>(pool.IdleSessions));
+    PoolTimeouts->Advance(pool.Timeouts);
+
+    Database::StatementCacheStatistics statements(Pool::Database()->GetStatementCacheStatistics());
+    StatementCacheSize->Set(static_cast<std::int_least64_t>(statements.Size));
+    StatementCacheHits->Advance(statements.Hits);
+    StatementCacheMisses->Advance(statements.Misses);
+
+    Database::WriteQueueStatistics writes(Pool::Database()->GetWriteQueueStatistics());
+    WriteQueuePending->Set(static_cast<std::int_least64_t>(writes.Pending));
+    WriteQueueFailed->Advance(writes.Failed);
+}
+
+bool MetricsResource::Impl::IsAuthorized(const Wt::Http::Request &request)
+{
+    const std::string address(request.clientAddress());
+    if (boost::algorithm::starts_with(address, "127.")
+            || address == "::1"
+            || boost::algorithm::starts_with(address, "::ffff:127.")) {
+        return true;
+    }
+
+    static const std::string TOKEN(METRICS_TOKEN);
+    if (TOKEN.empty())
+        return false;
+
+    const std::string authorization(request.headerValue("Authorization"));
+    if (!boost::algorithm::starts_with(authorization, AUTHORIZATION_BEARER_PREFIX))
+        return false;
+
+    return IsEqual(authorization.substr(sizeof(AUTHORIZATION_BEARER_PREFIX) - 1), TOKEN);
+}
+
+bool MetricsResource::Impl::IsEqual(const std::string &a, const std::string &b)
+{
+    /// Constant time, so the token cannot be guessed byte by byte
+    if (a.size() != b.size())
+        return false;
+
+    unsigned char difference = 0;
+    for (std::string::size_type i = 0; i < a.size(); ++i) {
+        difference |= static_cast<unsigned char>(a[i] ^ b[i]);
+    }
+
+    return difference == 0;
+}
+
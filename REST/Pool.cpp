@@ -38,6 +38,7 @@
 #include <boost/format.hpp>
 #include <CoreLib/Crypto.hpp>
 #include <CoreLib/Database.hpp>
+#include <CoreLib/LazyInstance.hpp>
 #include <CoreLib/make_unique.hpp>
 #include <CoreLib/Log.hpp>
 #include "Pool.hpp"
@@ -51,196 +52,277 @@ struct Pool::Impl
     typedef std::unique_ptr<CoreLib::Crypto> Crypto_ptr;
     typedef std::unique_ptr<CoreLib::Database> Database_ptr;
     typedef std::unique_ptr<Rest::StockUpdateWorker> StockUpdateWorker_ptr;
-
-    std::mutex StorageMutex;
-    Storage_ptr StorageInstance;
-
-    std::mutex DatabaseMutex;
-    Database_ptr DatabaseInstance;
-
-    std::mutex StockUpdateWorkerMutex;
-    StockUpdateWorker_ptr StockUpdateWorkerInstance;
-
-    std::mutex ClientTokenMutex;
-    Crypto_ptr ClientTokenInstance;
-
-    std::mutex ServerTokenMutex;
-    Crypto_ptr ServerTokenInstance;
+    typedef std::unique_ptr<Rest::TokenVerifier> TokenVerifier_ptr;
+
+    CoreLib::LazyInstance<StorageStruct> StorageInstance;
+    CoreLib::LazyInstance<CoreLib::Database> DatabaseInstance;
+    CoreLib::LazyInstance<Rest::StockUpdateWorker> StockUpdateWorkerInstance;
+    CoreLib::LazyInstance<CoreLib::Crypto> ClientTokenInstance;
+    CoreLib::LazyInstance<CoreLib::Crypto> ServerTokenInstance;
+    CoreLib::LazyInstance<Rest::TokenVerifier> ClientTokenVerifierInstance;
+
+    static Storage_ptr CreateStorage();
+    static Database_ptr CreateDatabase();
+    static StockUpdateWorker_ptr CreateStockUpdateWorker();
+    static Crypto_ptr CreateClientToken();
+    static Crypto_ptr CreateServerToken();
+    static TokenVerifier_ptr CreateClientTokenVerifier();
+
+#if DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL
+    static const std::string &GetSqlite3DatabaseFile();
+    static CoreLib::Database::Sqlite3Profile GetSqlite3Profile();
+#endif  // DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL
 };
 
 std::unique_ptr<Pool::Impl> Pool::s_pimpl = std::make_unique<Pool::Impl>();
 
 Pool::StorageStruct *Pool::Storage()
 {
-    lock_guard<mutex> lock(s_pimpl->StorageMutex);
-    (void)lock;
+    return s_pimpl->StorageInstance.Get(&Impl::CreateStorage);
+}
+
+CoreLib::Database *Pool::Database()
+{
+    return s_pimpl->DatabaseInstance.Get(&Impl::CreateDatabase);
+}
 
-    if (s_pimpl->StorageInstance == nullptr) {
-        s_pimpl->StorageInstance = std::make_unique<Pool::StorageStruct>();
+void Pool::PrepareDatabase()
+{
+#if DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+    if (!CoreLib::Database::Sqlite3EnableIncrementalVacuum(Impl::GetSqlite3DatabaseFile(),
+                                                           Impl::GetSqlite3Profile())) {
+        LOG_WARNING("Failed to enable SQLite3 incremental auto-vacuum; will retry on the next start!");
     }
+#endif  // DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+}
 
-    return s_pimpl->StorageInstance.get();
+Rest::StockUpdateWorker *Pool::StockUpdateWorker()
+{
+    return s_pimpl->StockUpdateWorkerInstance.Get(&Impl::CreateStockUpdateWorker);
 }
 
-CoreLib::Database *Pool::Database()
+CoreLib::Crypto *Pool::ClientToken()
+{
+    return s_pimpl->ClientTokenInstance.Get(&Impl::CreateClientToken);
+}
+
+CoreLib::Crypto *Pool::ServerToken()
 {
-    lock_guard<mutex> lock(s_pimpl->DatabaseMutex);
-    (void)lock;
+    return s_pimpl->ServerTokenInstance.Get(&Impl::CreateServerToken);
+}
 
-    if (s_pimpl->DatabaseInstance == nullptr) {
+Rest::TokenVerifier *Pool::ClientTokenVerifier()
+{
+    return s_pimpl->ClientTokenVerifierInstance.Get(&Impl::CreateClientTokenVerifier);
+}
+
+Pool::Impl::Storage_ptr Pool::Impl::CreateStorage()
+{
+    return std::make_unique<Pool::StorageStruct>();
+}
+
+Pool::Impl::Database_ptr Pool::Impl::CreateDatabase()
+{
+    CoreLib::Database::PoolOptions poolOptions;
 
 #if DATABASE_BACKEND == PGSQL
 
 #ifdef CORELIB_STATIC
 #if defined ( HAS_CPPDB_PGSQL_DRIVER )
-        if (!Database::IsPgSqlDriverLoaded()) {
-            Database::LoadPgSqlDriver();
-        }
+    if (!Database::IsPgSqlDriverLoaded()) {
+        Database::LoadPgSqlDriver();
+    }
 #endif  // defined ( HAS_CPPDB_PGSQL_DRIVER )
 #endif  // CORELIB_STATIC
 
-        std::string parameters;
-        std::string pgSqlHost(PGSQL_HOST);
-        std::string pgSqlPort(PGSQL_PORT);
-        std::string pgSqlDatabase(PGSQL_DATABASE);
-        std::string pgSqlUser(PGSQL_USER);
-        std::string pgSqlPassword(PGSQL_PASSWORD);
+    std::string parameters;
+    std::string pgSqlHost(PGSQL_HOST);
+    std::string pgSqlPort(PGSQL_PORT);
+    std::string pgSqlDatabase(PGSQL_DATABASE);
+    std::string pgSqlUser(PGSQL_USER);
+    std::string pgSqlPassword(PGSQL_PASSWORD);
 
-        if (boost::trim_copy(pgSqlHost) != "")
-            parameters += (boost::format("host=%1%;") % pgSqlHost).str();
+    if (boost::trim_copy(pgSqlHost) != "")
+        parameters += (boost::format("host=%1%;") % pgSqlHost).str();
 
-        if (boost::trim_copy(pgSqlPort) != "")
-            parameters += (boost::format("port=%1%;") % pgSqlPort).str();
+    if (boost::trim_copy(pgSqlPort) != "")
+        parameters += (boost::format("port=%1%;") % pgSqlPort).str();
 
-        if (boost::trim_copy(pgSqlDatabase) != "")
-            parameters += (boost::format("dbname=%1%;") % pgSqlDatabase).str();
+    if (boost::trim_copy(pgSqlDatabase) != "")
+        parameters += (boost::format("dbname=%1%;") % pgSqlDatabase).str();
 
-        if (boost::trim_copy(pgSqlUser) != "")
-            parameters += (boost::format("user=%1%;") % pgSqlUser).str();
+    if (boost::trim_copy(pgSqlUser) != "")
+        parameters += (boost::format("user=%1%;") % pgSqlUser).str();
 
-        if (boost::trim_copy(pgSqlPassword) != "")
-            parameters += (boost::format("password=%1%;") % pgSqlPassword).str();
+    if (boost::trim_copy(pgSqlPassword) != "")
+        parameters += (boost::format("password=%1%;") % pgSqlPassword).str();
 
-        static const std::string CONNECTION_STRING(
-                    (boost::format("postgresql:%1%")
-                     % parameters).str());
+    static const std::string CONNECTION_STRING(
+                (boost::format("postgresql:%1%")
+                 % parameters).str());
 
 #elif DATABASE_BACKEND == MYSQL
 
 #ifdef CORELIB_STATIC
 #if defined ( HAS_CPPDB_MYSQL_DRIVER )
-        if (!Database::IsMySqlDriverLoaded()) {
-            Database::LoadMySqlDriver();
-        }
+    if (!Database::IsMySqlDriverLoaded()) {
+        Database::LoadMySqlDriver();
+    }
 #endif  // defined ( HAS_CPPDB_MYSQL_DRIVER )
 #endif  // CORELIB_STATIC
 
-        std::string parameters;
-        std::string mySqlHost(MYSQL_HOST);
-        std::string mySqlPort(MYSQL_PORT);
-        std::string mySqlUnixSocket(MYSQL_UNIX_SOCKET);
-        std::string mySqlDatabase(MYSQL_DATABASE);
-        std::string mySqlUser(MYSQL_USER);
-        std::string mySqlPassword(MYSQL_PASSWORD);
+    std::string parameters;
+    std::string mySqlHost(MYSQL_HOST);
+    std::string mySqlPort(MYSQL_PORT);
+    std::string mySqlUnixSocket(MYSQL_UNIX_SOCKET);
+    std::string mySqlDatabase(MYSQL_DATABASE);
+    std::string mySqlUser(MYSQL_USER);
+    std::string mySqlPassword(MYSQL_PASSWORD);
 
-        if (boost::trim_copy(mySqlHost) != "")
-            parameters += (boost::format("host=%1%;") % mySqlHost).str();
+    if (boost::trim_copy(mySqlHost) != "")
+        parameters += (boost::format("host=%1%;") % mySqlHost).str();
 
-        if (boost::trim_copy(mySqlPort) != "")
-            parameters += (boost::format("port=%1%;") % mySqlPort).str();
+    if (boost::trim_copy(mySqlPort) != "")
+        parameters += (boost::format("port=%1%;") % mySqlPort).str();
 
-        if (boost::trim_copy(mySqlUnixSocket) != "")
-            parameters += (boost::format("unix_socket=%1%;") % mySqlUnixSocket).str();
+    if (boost::trim_copy(mySqlUnixSocket) != "")
+        parameters += (boost::format("unix_socket=%1%;") % mySqlUnixSocket).str();
 
-        if (boost::trim_copy(mySqlDatabase) != "")
-            parameters += (boost::format("database=%1%;") % mySqlDatabase).str();
+    if (boost::trim_copy(mySqlDatabase) != "")
+        parameters += (boost::format("database=%1%;") % mySqlDatabase).str();
 
-        if (boost::trim_copy(mySqlUser) != "")
-            parameters += (boost::format("user=%1%;") % mySqlUser).str();
+    if (boost::trim_copy(mySqlUser) != "")
+        parameters += (boost::format("user=%1%;") % mySqlUser).str();
 
-        if (boost::trim_copy(mySqlPassword) != "")
-            parameters += (boost::format("password=%1%;") % mySqlPassword).str();
+    if (boost::trim_copy(mySqlPassword) != "")
+        parameters += (boost::format("password=%1%;") % mySqlPassword).str();
 
-        static const std::string CONNECTION_STRING(
-                    (boost::format("mysql:%1%")
-                     % parameters).str());
+    static const std::string CONNECTION_STRING(
+                (boost::format("mysql:%1%")
+                 % parameters).str());
 
 #else   // SQLITE3
 
 #if defined ( CORELIB_STATIC )
 #if defined ( HAS_CPPDB_SQLITE3_DRIVER )
-        if (!Database::IsSqlite3DriverLoaded()) {
-            Database::LoadSQLite3Driver();
-        }
+    if (!Database::IsSqlite3DriverLoaded()) {
+        Database::LoadSQLite3Driver();
+    }
 #endif  // defined ( HAS_CPPDB_SQLITE3_DRIVER )
 #endif  // defined ( CORELIB_STATIC )
 
-        static const std::string DB_FILE((boost::filesystem::path(Storage()->AppPath)
-                                          / boost::filesystem::path(SQLITE3_DATABASE_FILE_PATH)
-                                          / boost::filesystem::path(SQLITE3_DATABASE_FILE_NAME)).string());
-        static const std::string CONNECTION_STRING(
-                    (boost::format("sqlite3:db=%1%")
-                     % DB_FILE).str());
+    static const std::string CONNECTION_STRING(
+                (boost::format("sqlite3:db=%1%")
+                 % GetSqlite3DatabaseFile()).str());
 
-#if defined ( HAS_SQLITE3 )
-        CoreLib::Database::Sqlite3Vacuum(DB_FILE);
-#endif  // defined ( HAS_SQLITE3 )
+    const CoreLib::Database::Sqlite3Profile sqlite3Profile(GetSqlite3Profile());
 
-#endif // DATABASE_BACKEND == PGSQL
+    poolOptions.SessionInitStatements = sqlite3Profile.GetSessionStatements();
 
-        s_pimpl->DatabaseInstance = std::make_unique<CoreLib::Database>(CONNECTION_STRING);
-    }
+#endif // DATABASE_BACKEND == PGSQL
 
-    return s_pimpl->DatabaseInstance.get();
+#if defined ( DATABASE_POOL_MAX_SIZE )
+    poolOptions.MaxSize = DATABASE_POOL_MAX_SIZE;
+#endif  // defined ( DATABASE_POOL_MAX_SIZE )
+#if defined ( DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS )
+    poolOptions.CheckoutTimeout = std::chrono::milliseconds(DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS);
+#endif  // defined ( DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS )
+#if defined ( DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS )
+    poolOptions.HealthCheckIdleInterval = std::chrono::seconds(DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS);
+#endif  // defined ( DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS )
+
+    CoreLib::Database::WriteQueueOptions writeQueueOptions;
+#if defined ( DATABASE_WRITE_QUEUE_MAX_SIZE )
+    writeQueueOptions.MaxSize = DATABASE_WRITE_QUEUE_MAX_SIZE;
+#endif  // defined ( DATABASE_WRITE_QUEUE_MAX_SIZE )
+#if defined ( DATABASE_WRITE_BATCH_MAX_SIZE )
+    writeQueueOptions.MaxBatchSize = DATABASE_WRITE_BATCH_MAX_SIZE;
+#endif  // defined ( DATABASE_WRITE_BATCH_MAX_SIZE )
+#if defined ( DATABASE_WRITE_BATCH_DELAY_MILLISECONDS )
+    writeQueueOptions.MaxBatchDelay = std::chrono::milliseconds(DATABASE_WRITE_BATCH_DELAY_MILLISECONDS);
+#endif  // defined ( DATABASE_WRITE_BATCH_DELAY_MILLISECONDS )
+
+    Database_ptr database(std::make_unique<CoreLib::Database>(CONNECTION_STRING, poolOptions,
+                                                              writeQueueOptions));
+
+#if DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+    database->Sqlite3StartBackgroundVacuum(GetSqlite3DatabaseFile(), sqlite3Profile);
+#endif  // DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+
+    return database;
 }
 
-Rest::StockUpdateWorker *Pool::StockUpdateWorker()
+#if DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL
+const std::string &Pool::Impl::GetSqlite3DatabaseFile()
 {
-    lock_guard<mutex> lock(s_pimpl->StockUpdateWorkerMutex);
-    (void)lock;
+    static const std::string DB_FILE((boost::filesystem::path(Storage()->AppPath)
+                                      / boost::filesystem::path(SQLITE3_DATABASE_FILE_PATH)
+                                      / boost::filesystem::path(SQLITE3_DATABASE_FILE_NAME)).string());
 
-    if (s_pimpl->StockUpdateWorkerInstance == nullptr) {
-        s_pimpl->StockUpdateWorkerInstance = std::make_unique<Rest::StockUpdateWorker>(
-                    STOCK_DATA_SOURCE_URL,
-                    STOCK_DATA_UPDATE_INTERVAL_SECONDS,
-                    true
-                    );
-    }
-
-    return s_pimpl->StockUpdateWorkerInstance.get();
+    return DB_FILE;
 }
 
-CoreLib::Crypto *Pool::ClientToken()
+CoreLib::Database::Sqlite3Profile Pool::Impl::GetSqlite3Profile()
 {
-    lock_guard<mutex> lock(s_pimpl->ClientTokenMutex);
-    (void)lock;
+    CoreLib::Database::Sqlite3Profile sqlite3Profile;
+#if defined ( SQLITE3_JOURNAL_MODE )
+    sqlite3Profile.JournalMode = SQLITE3_JOURNAL_MODE;
+#endif  // defined ( SQLITE3_JOURNAL_MODE )
+#if defined ( SQLITE3_SYNCHRONOUS )
+    sqlite3Profile.Synchronous = SQLITE3_SYNCHRONOUS;
+#endif  // defined ( SQLITE3_SYNCHRONOUS )
+#if defined ( SQLITE3_CACHE_SIZE_KIB )
+    sqlite3Profile.CacheSizeKiB = SQLITE3_CACHE_SIZE_KIB;
+#endif  // defined ( SQLITE3_CACHE_SIZE_KIB )
+#if defined ( SQLITE3_MMAP_SIZE_BYTES )
+    sqlite3Profile.MmapSizeBytes = SQLITE3_MMAP_SIZE_BYTES;
+#endif  // defined ( SQLITE3_MMAP_SIZE_BYTES )
+#if defined ( SQLITE3_BUSY_TIMEOUT_MILLISECONDS )
+    sqlite3Profile.BusyTimeout = std::chrono::milliseconds(SQLITE3_BUSY_TIMEOUT_MILLISECONDS);
+#endif  // defined ( SQLITE3_BUSY_TIMEOUT_MILLISECONDS )
+#if defined ( SQLITE3_INCREMENTAL_VACUUM_PAGES )
+    sqlite3Profile.IncrementalVacuumPages = SQLITE3_INCREMENTAL_VACUUM_PAGES;
+#endif  // defined ( SQLITE3_INCREMENTAL_VACUUM_PAGES )
+#if defined ( SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS )
+    sqlite3Profile.IncrementalVacuumInterval = std::chrono::seconds(SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS);
+#endif  // defined ( SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS )
+
+    return sqlite3Profile;
+}
+#endif  // DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL
 
-    if (s_pimpl->ClientTokenInstance == nullptr) {
-        static const string KEY = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_KEY);
-        static const string IV = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_IV);
+Pool::Impl::StockUpdateWorker_ptr Pool::Impl::CreateStockUpdateWorker()
+{
+    return std::make_unique<Rest::StockUpdateWorker>(
+                STOCK_DATA_SOURCE_URL,
+                STOCK_DATA_UPDATE_INTERVAL_SECONDS,
+                true
+                );
+}
 
-        s_pimpl->ClientTokenInstance =
-                std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
-                                                  reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
-    }
+Pool::Impl::Crypto_ptr Pool::Impl::CreateClientToken()
+{
+    static const string KEY = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_KEY);
+    static const string IV = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_IV);
 
-    return s_pimpl->ClientTokenInstance.get();
+    return std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
+                                             reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
 }
 
-CoreLib::Crypto *Pool::ServerToken()
+Pool::Impl::Crypto_ptr Pool::Impl::CreateServerToken()
 {
-    lock_guard<mutex> lock(s_pimpl->ServerTokenMutex);
-    (void)lock;
+    static const string KEY = CoreLib::Crypto::HexStringToString(SERVER_TOKEN_CRYPTO_KEY);
+    static const string IV = CoreLib::Crypto::HexStringToString(SERVER_TOKEN_CRYPTO_IV);
 
-    if (s_pimpl->ServerTokenInstance == nullptr) {
-        static const string KEY = CoreLib::Crypto::HexStringToString(SERVER_TOKEN_CRYPTO_KEY);
-        static const string IV = CoreLib::Crypto::HexStringToString(SERVER_TOKEN_CRYPTO_IV);
+    return std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
+                                             reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
+}
 
-        s_pimpl->ServerTokenInstance =
-                std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
-                                                  reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
-    }
+Pool::Impl::TokenVerifier_ptr Pool::Impl::CreateClientTokenVerifier()
+{
+    static const string KEY = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_HMAC_KEY);
 
-    return s_pimpl->ServerTokenInstance.get();
+    return std::make_unique<Rest::TokenVerifier>(reinterpret_cast<const Rest::TokenVerifier::Byte *>(KEY.c_str()), KEY.size(),
+                                                 MAX_TOKEN_MILLISECONDS_DIFFERENCE);
 }
 
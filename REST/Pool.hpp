@@ -39,6 +39,7 @@
 
 #include <memory>
 #include "StockUpdateWorker.hpp"
+#include "TokenVerifier.hpp"
 
 namespace CoreLib {
     class Crypto;
@@ -55,6 +56,8 @@ public:
     struct StorageStruct
     {
         std::string AppPath;
+        std::string ArchivePath;
+        std::string SnapshotPath;
     };
 
 private:
@@ -64,11 +67,16 @@ private:
 public:
     static StorageStruct *Storage();
     static CoreLib::Database *Database();
+    /// One-time, offline maintenance that may hold the database's write
+    /// lock for a long time; run it from a single process before serving
+    static void PrepareDatabase();
 
     static Rest::StockUpdateWorker *StockUpdateWorker();
 
     static CoreLib::Crypto *ClientToken();
     static CoreLib::Crypto *ServerToken();
+
+    static Rest::TokenVerifier *ClientTokenVerifier();
 };
 
 
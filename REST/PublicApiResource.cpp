@@ -33,9 +33,13 @@
  */
 
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
+#include <mutex>
+#include <unordered_map>
 #include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
 #include <boost/format.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/property_tree/json_parser.hpp>
@@ -43,11 +47,18 @@
 #include <boost/property_tree/xml_parser.hpp>
 #include <Wt/Http/Request>
 #include <Wt/Http/Response>
+#include <Wt/Http/ResponseContinuation>
 #include <Wt/Utils>
 #include <Wt/WString>
+#include <CoreLib/ColumnArchive.hpp>
 #include <CoreLib/Crypto.hpp>
 #include <CoreLib/Database.hpp>
+#include <CoreLib/Exception.hpp>
 #include <CoreLib/Log.hpp>
+#include <CoreLib/Metrics.hpp>
+#include <CoreLib/Snapshot.hpp>
+#include <CoreLib/Trace.hpp>
+#include <CoreLib/Utility.hpp>
 #include <CoreLib/make_unique.hpp>
 #include "JsonException.hpp"
 #include "Pool.hpp"
@@ -55,14 +66,30 @@
 #include "ServiceContract.hpp"
 #include "XmlException.hpp"
 
-#define     MAX_TOKEN_MILLISECONDS_DIFFERENCE        240000
+#define     STREAM_CHUNK_ROWS                        256
+
+/// Written as the last line of a CSV or NDJSON export that could not be
+/// completed, since the status line has already gone out by then
+#define     STREAM_ERROR_CSV_MARKER                  "#ERROR"
+#define     STREAM_DATA_UPDATED_ERROR                "DATA_UPDATED"
+#define     STREAM_INTERNAL_ERROR                    "INTERNAL_ERROR"
+
+/// How often the LATEST pointer of the snapshot directory is looked at
+#define     SNAPSHOT_CHECK_INTERVAL_MILLISECONDS     1000
+
+#define     UNMATCHED_ROUTE_LABEL                    "unmatched"
+#define     STREAM_ROUTE_LABEL                       "stream-continuation"
 
 #define     INVALID_TOKEN_ERROR                      L"INVALID_TOKEN"
 
 #define     DataByDateJSON_URI_TEMPLATE              L"StockMarket/DataByDate/JSON/{DATE}/{TOKEN}"
 #define     DataByDateXML_URI_TEMPLATE               L"StockMarket/DataByDate/XML/{DATE}/{TOKEN}"
+#define     DataByDateCSV_URI_TEMPLATE               L"StockMarket/DataByDate/CSV/{DATE}/{TOKEN}"
+#define     DataByDateNDJSON_URI_TEMPLATE            L"StockMarket/DataByDate/NDJSON/{DATE}/{TOKEN}"
 #define     LatestDataJSON_URI_TEMPLATE              L"StockMarket/LatestData/JSON/{TOKEN}"
 #define     LatestDataXML_URI_TEMPLATE               L"StockMarket/LatestData/XML/{TOKEN}"
+#define     LatestDataCSV_URI_TEMPLATE               L"StockMarket/LatestData/CSV/{TOKEN}"
+#define     LatestDataNDJSON_URI_TEMPLATE            L"StockMarket/LatestData/NDJSON/{TOKEN}"
 #define     TokenJSON_URI_TEMPLATE                   L"StockMarket/Token/JSON"
 #define     TokenXML_URI_TEMPLATE                    L"StockMarket/Token/XML"
 
@@ -75,15 +102,93 @@ struct PublicApiResource::Impl
 {
     typedef vector<vector<std::string>> Table;
     typedef vector<std::string> Row;
+    typedef std::shared_ptr<const CoreLib::Snapshot::Reader> Snapshot_ptr;
 
     enum class OutputType : unsigned char {
         JSON,
-        XML
+        XML,
+        CSV,
+        NDJSON
+    };
+
+    /// Keeps track of a line-oriented export between Wt continuations.
+    /// Every export reads from the source it resolved at the start: rows
+    /// are fetched in keyset-paginated chunks from a day's table, so
+    /// neither the whole response nor a database transaction outlives a
+    /// single chunk; a column archive stays open and is decoded one row
+    /// group at a time; the latest data is read from the snapshot mapping
+    /// the export started with. LastRowId then counts the rows already
+    /// written. Only the live table, used when no snapshot is published,
+    /// is replaced under an export; IsLatest has every chunk re-check
+    /// LAST_UPDATE and the export ends with an error marker if it moved.
+    /// Columns holds the source columns picked by the 'columns' parameter,
+    /// Titles their names; an archive only decodes those.
+    struct StreamState
+    {
+        OutputType Type;
+        std::string Date;
+        std::string Time;
+        std::string StockDataTable;
+        Row Titles;
+        std::vector<std::size_t> Columns;
+        long LastRowId;
+        bool IsHeaderWritten;
+        bool IsLatest;
+        std::unique_ptr<CoreLib::ColumnArchive::Reader> Archive;
+        std::vector<CoreLib::ColumnArchive::Column> RowGroup;
+        Snapshot_ptr Snapshot;
+
+        StreamState();
+    };
+
+    typedef std::shared_ptr<StreamState> StreamState_ptr;
+
+    struct RouteMetrics
+    {
+        CoreLib::Metrics::Counter *Requests;
+        CoreLib::Metrics::Counter *Errors;
+        CoreLib::Metrics::Histogram *Duration;
+
+        explicit RouteMetrics(const std::string &route);
+    };
+
+    typedef std::unordered_map<std::wstring, std::unique_ptr<RouteMetrics>> RouteMetricsHashTable;
+
+    /// Counts and times one request against the route it resolves to,
+    /// whichever way handleRequest() is left
+    struct RequestScope
+    {
+        Impl *Owner;
+        RouteMetrics *Route;
+        bool IsFailed;
+        CoreLib::Metrics::Timer Timer;
+
+        explicit RequestScope(Impl *owner);
+        ~RequestScope();
+
+        void SetRoute(RouteMetrics *route);
     };
 
     std::unique_ptr<Rest::ServiceContract> ServiceContractPtr;
 
-    bool IsValidToken(const std::wstring &encryptedToken);
+    /// Only filled in by the constructor, so lookups need no lock
+    RouteMetricsHashTable Routes;
+    RouteMetrics UnmatchedRoute;
+    RouteMetrics StreamRoute;
+    CoreLib::Metrics::Gauge *InFlightRequests;
+
+    /// Replaced, never modified, so a request or stream keeps the mapping
+    /// it started with alive after a newer one is published
+    std::mutex SnapshotMutex;
+    Snapshot_ptr LatestSnapshot;
+    std::string FailedSnapshotFile;
+    bool IsSnapshotChecked;
+    std::chrono::steady_clock::time_point SnapshotCheckedAt;
+
+    void RegisterRoute(const std::wstring &uriTemplate);
+
+    bool IsValidToken(const std::wstring &token);
+    bool IsValidLegacyToken(const std::string &encryptedToken);
 
     void GetDataTree(const OutputType &outputType,
                      const std::string &dateId, const std::string &time,
@@ -94,6 +199,29 @@ struct PublicApiResource::Impl
     void GetLatestData(const OutputType &outputType, boost::property_tree::wptree &out_tree);
     void GetToken(boost::property_tree::wptree &out_tree);
 
+    Snapshot_ptr GetLatestSnapshot();
+    void GetSnapshotHeader(const Snapshot_ptr &snapshot, std::string &out_date,
+                           std::string &out_time, Row &out_titles);
+
+    bool CreateDataByDateStream(const OutputType &outputType, const std::string &dateId,
+                                StreamState_ptr &out_state);
+    bool CreateLatestDataStream(const OutputType &outputType, StreamState_ptr &out_state);
+    void GetStreamTitles(const std::string &dataTitlesTable, Row &out_titles);
+    bool SelectStreamColumns(const StreamState_ptr &state, const std::string *columns);
+    void OpenArchive(const std::string &archiveFile, CoreLib::ColumnArchive::Reader &reader,
+                     Row &out_titles);
+    void ReadArchive(const std::string &archiveFile, Row &out_titles,
+                     std::vector<CoreLib::ColumnArchive::Column> &out_columns);
+    bool WriteStream(const StreamState_ptr &state, Wt::Http::Response &response);
+    bool WriteStreamChunk(const StreamState_ptr &state, std::ostream &out);
+    void WriteStreamError(const StreamState_ptr &state, const std::string &error, std::ostream &out);
+    bool IsLatestUpdate(const std::string &date, const std::string &time);
+    void WriteRow(const StreamState_ptr &state, const Row &row, std::ostream &out);
+    void WriteCsvRow(const StreamState_ptr &state, const Row &row, std::ostream &out);
+    void WriteNdjsonRow(const StreamState_ptr &state, const Row &row, std::ostream &out);
+
+    static std::string EscapeCsv(const std::string &field);
+
     void DataByDateJson(const std::wstring &date, std::wstring &out_response);
     void DataByDateXml(const std::wstring &date, std::wstring &out_response);
     void LatestDataJson(std::wstring &out_response);
@@ -110,12 +238,19 @@ PublicApiResource::PublicApiResource(WObject *parent) :
     m_pimpl(std::make_unique<PublicApiResource::Impl>())
 {
     m_pimpl->ServiceContractPtr = std::make_unique<Rest::ServiceContract>();
-    m_pimpl->ServiceContractPtr->Register(DataByDateJSON_URI_TEMPLATE);
-    m_pimpl->ServiceContractPtr->Register(DataByDateXML_URI_TEMPLATE);
-    m_pimpl->ServiceContractPtr->Register(LatestDataJSON_URI_TEMPLATE);
-    m_pimpl->ServiceContractPtr->Register(LatestDataXML_URI_TEMPLATE);
-    m_pimpl->ServiceContractPtr->Register(TokenJSON_URI_TEMPLATE);
-    m_pimpl->ServiceContractPtr->Register(TokenXML_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(DataByDateJSON_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(DataByDateXML_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(DataByDateCSV_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(DataByDateNDJSON_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(LatestDataJSON_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(LatestDataXML_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(LatestDataCSV_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(LatestDataNDJSON_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(TokenJSON_URI_TEMPLATE);
+    m_pimpl->RegisterRoute(TokenXML_URI_TEMPLATE);
+
+    /// Mapped before the server starts, so the first request finds it ready
+    m_pimpl->GetLatestSnapshot();
 }
 
 PublicApiResource::~PublicApiResource()
@@ -125,7 +260,25 @@ PublicApiResource::~PublicApiResource()
 
 void PublicApiResource::handleRequest(const Wt::Http::Request &request, Wt::Http::Response &response)
 {
+    TRACE_SPAN("rest", "PublicApiResource::handleRequest");
+    Impl::RequestScope requestScope(m_pimpl.get());
+
     try {
+        /// Borrow a pooled session only if this request actually hits the database
+        CoreLib::Database::SessionScope sessionScope(Pool::Database());
+        (void)sessionScope;
+
+        /// Resuming a chunked export; the token has already been validated
+        /// on the initial request, so it must not expire mid-stream
+        if (request.continuation()) {
+            requestScope.SetRoute(&m_pimpl->StreamRoute);
+            if (!m_pimpl->WriteStream(boost::any_cast<Impl::StreamState_ptr>(request.continuation()->data()),
+                                      response)) {
+                requestScope.IsFailed = true;
+            }
+            return;
+        }
+
         WString uri((boost::format("%1%%2%")
                      % request.path().substr(request.path().find_last_of("/") + 1)
                      % request.pathInfo()
@@ -134,6 +287,8 @@ void PublicApiResource::handleRequest(const Wt::Http::Request &request, Wt::Http
         vector<wstring> args;
 
         if (m_pimpl->ServiceContractPtr->Resolve(uri.value(), uriTemplate, args)) {
+            requestScope.SetRoute(m_pimpl->Routes.at(uriTemplate).get());
+
             wstring outResponse;
 
             /// Validating the token
@@ -159,6 +314,34 @@ void PublicApiResource::handleRequest(const Wt::Http::Request &request, Wt::Http
                 m_pimpl->DataByDateXml(args[0], outResponse);
                 PrintXml(response, outResponse);
 
+            } else if (uriTemplate == DataByDateCSV_URI_TEMPLATE) {
+
+                Impl::StreamState_ptr state;
+                if (m_pimpl->CreateDataByDateStream(Impl::OutputType::CSV, WString(args[0]).toUTF8(), state)) {
+                    if (!m_pimpl->SelectStreamColumns(state, request.getParameter("columns"))) {
+                        requestScope.IsFailed = true;
+                        Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_400));
+                    } else if (!m_pimpl->WriteStream(state, response)) {
+                        requestScope.IsFailed = true;
+                    }
+                } else {
+                    Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_404));
+                }
+
+            } else if (uriTemplate == DataByDateNDJSON_URI_TEMPLATE) {
+
+                Impl::StreamState_ptr state;
+                if (m_pimpl->CreateDataByDateStream(Impl::OutputType::NDJSON, WString(args[0]).toUTF8(), state)) {
+                    if (!m_pimpl->SelectStreamColumns(state, request.getParameter("columns"))) {
+                        requestScope.IsFailed = true;
+                        Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_400));
+                    } else if (!m_pimpl->WriteStream(state, response)) {
+                        requestScope.IsFailed = true;
+                    }
+                } else {
+                    Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_404));
+                }
+
             } else if (uriTemplate == LatestDataJSON_URI_TEMPLATE) {
 
                 m_pimpl->LatestDataJson(outResponse);
@@ -169,6 +352,34 @@ void PublicApiResource::handleRequest(const Wt::Http::Request &request, Wt::Http
                 m_pimpl->LatestDataXml(outResponse);
                 PrintXml(response, outResponse);
 
+            } else if (uriTemplate == LatestDataCSV_URI_TEMPLATE) {
+
+                Impl::StreamState_ptr state;
+                if (m_pimpl->CreateLatestDataStream(Impl::OutputType::CSV, state)) {
+                    if (!m_pimpl->SelectStreamColumns(state, request.getParameter("columns"))) {
+                        requestScope.IsFailed = true;
+                        Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_400));
+                    } else if (!m_pimpl->WriteStream(state, response)) {
+                        requestScope.IsFailed = true;
+                    }
+                } else {
+                    Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_404));
+                }
+
+            } else if (uriTemplate == LatestDataNDJSON_URI_TEMPLATE) {
+
+                Impl::StreamState_ptr state;
+                if (m_pimpl->CreateLatestDataStream(Impl::OutputType::NDJSON, state)) {
+                    if (!m_pimpl->SelectStreamColumns(state, request.getParameter("columns"))) {
+                        requestScope.IsFailed = true;
+                        Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_400));
+                    } else if (!m_pimpl->WriteStream(state, response)) {
+                        requestScope.IsFailed = true;
+                    }
+                } else {
+                    Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_404));
+                }
+
             } else if (uriTemplate == TokenJSON_URI_TEMPLATE) {
 
                 m_pimpl->TokenJson(outResponse);
@@ -192,23 +403,80 @@ void PublicApiResource::handleRequest(const Wt::Http::Request &request, Wt::Http
     }
 
     catch (const Rest::JsonException &ex) {
+        requestScope.IsFailed = true;
         PrintJson(response, ex.What());
     }
 
     catch (const Rest::XmlException &ex) {
+        requestScope.IsFailed = true;
         PrintXml(response, ex.What());
     }
 
     catch (const Rest::Exception &ex) {
+        requestScope.IsFailed = true;
         Print(response, ex.What());
     }
 
     catch (...) {
+        requestScope.IsFailed = true;
         Print(response, GetHttpStatus(CoreLib::HttpStatus::HttpStatusCode::HTTP_500));
     }
 }
 
-PublicApiResource::Impl::Impl()
+PublicApiResource::Impl::StreamState::StreamState() :
+    Type(OutputType::CSV),
+    LastRowId(0),
+    IsHeaderWritten(false),
+    IsLatest(false)
+{
+
+}
+
+PublicApiResource::Impl::RouteMetrics::RouteMetrics(const std::string &route) :
+    Requests(CoreLib::Metrics::GetCounter("rest_requests_total",
+                                          "Requests handled, by route template",
+                                          { { "route", route } })),
+    Errors(CoreLib::Metrics::GetCounter("rest_request_errors_total",
+                                        "Requests answered with an error response, by route template",
+                                        { { "route", route } })),
+    Duration(CoreLib::Metrics::GetHistogram("rest_request_duration_seconds",
+                                            "Time spent handling a request, by route template",
+                                            { { "route", route } }))
+{
+
+}
+
+PublicApiResource::Impl::RequestScope::RequestScope(Impl *owner) :
+    Owner(owner),
+    Route(&owner->UnmatchedRoute),
+    IsFailed(false),
+    Timer(owner->UnmatchedRoute.Duration)
+{
+    Owner->InFlightRequests->Add(1);
+}
+
+PublicApiResource::Impl::RequestScope::~RequestScope()
+{
+    Route->Requests->Increment();
+    if (IsFailed)
+        Route->Errors->Increment();
+    Timer.Stop();
+
+    Owner->InFlightRequests->Add(-1);
+}
+
+void PublicApiResource::Impl::RequestScope::SetRoute(RouteMetrics *route)
+{
+    Route = route;
+    Timer.Rebind(route->Duration);
+}
+
+PublicApiResource::Impl::Impl() :
+    UnmatchedRoute(UNMATCHED_ROUTE_LABEL),
+    StreamRoute(STREAM_ROUTE_LABEL),
+    InFlightRequests(CoreLib::Metrics::GetGauge("rest_requests_in_flight",
+                                                "Requests currently being handled")),
+    IsSnapshotChecked(false)
 {
 
 }
@@ -218,14 +486,33 @@ PublicApiResource::Impl::~Impl()
 
 }
 
-bool PublicApiResource::Impl::IsValidToken(const std::wstring &encryptedToken)
+void PublicApiResource::Impl::RegisterRoute(const std::wstring &uriTemplate)
+{
+    ServiceContractPtr->Register(uriTemplate);
+    Routes[uriTemplate] = std::make_unique<RouteMetrics>(WString(uriTemplate).toUTF8());
+}
+
+bool PublicApiResource::Impl::IsValidToken(const std::wstring &token)
+{
+    std::string utf8Token(WString(token).toUTF8());
+
+    /// HMAC tokens, i.e. '<timestamp>.<client-id>.<mac>', are verified
+    /// without any global lock or cipher setup
+    if (utf8Token.find('.') != std::string::npos)
+        return Pool::ClientTokenVerifier()->Verify(utf8Token);
+
+    /// Hex-encoded AES-CBC timestamps, kept for existing clients
+    return IsValidLegacyToken(utf8Token);
+}
+
+bool PublicApiResource::Impl::IsValidLegacyToken(const std::string &encryptedToken)
 {
     std::chrono::system_clock::time_point now = std::chrono::system_clock::now();
     double token;
 
     try {
         std::string decryptedToken;
-        Pool::ClientToken()->Decrypt(WString(encryptedToken).toUTF8(), decryptedToken);
+        Pool::ClientToken()->Decrypt(encryptedToken, decryptedToken);
         token = boost::lexical_cast<double>(decryptedToken);
     } catch (...) {
         return false;
@@ -244,6 +531,8 @@ void PublicApiResource::Impl::GetDataTree(const OutputType &outputType,
                                           const Row &titles, const Table &data,
                                           boost::property_tree::wptree &out_tree)
 {
+    TRACE_SPAN("rest", "PublicApiResource::GetDataTree");
+
     out_tree.clear();
 
     out_tree.put(L"StockMarket.version.major", "1");
@@ -302,6 +591,8 @@ void PublicApiResource::Impl::GetDataTree(const OutputType &outputType,
 void PublicApiResource::Impl::GetDataByDate(const OutputType &outputType, const std::string &dateId,
                                             boost::property_tree::wptree &out_tree)
 {
+    TRACE_SPAN("sql", "PublicApiResource::GetDataByDate");
+
     out_tree.clear();
 
     std::string date;
@@ -331,6 +622,27 @@ void PublicApiResource::Impl::GetDataByDate(const OutputType &outputType, const
 
     r >> date >> time >> dataTitlesTable >> stockDataTable;
 
+    /// StockUpdateWorker leaves datatitlestbl empty for days it moved into
+    /// a column archive; stockdatatbl then holds the archive's file name
+    if (dataTitlesTable.empty()) {
+        guard.rollback();
+
+        std::vector<CoreLib::ColumnArchive::Column> columns;
+        ReadArchive(stockDataTable, titles, columns);
+
+        const std::size_t rows = columns.empty() ? 0 : columns.front().size();
+        data.resize(rows);
+        for (std::size_t i = 0; i < rows; ++i) {
+            data[i].reserve(columns.size());
+            for (const auto &column : columns) {
+                data[i].push_back(column[i]);
+            }
+        }
+
+        GetDataTree(outputType, date, time, titles, data, out_tree);
+        return;
+    }
+
     r = Pool::Database()->Sql()
             << (boost::format("SELECT title"
                               " FROM %1%"
@@ -373,6 +685,8 @@ void PublicApiResource::Impl::GetDataByDate(const OutputType &outputType, const
 void PublicApiResource::Impl::GetLatestData(const OutputType &outputType,
                                             boost::property_tree::wptree &out_tree)
 {
+    TRACE_SPAN("sql", "PublicApiResource::GetLatestData");
+
     out_tree.clear();
 
     std::string date;
@@ -380,6 +694,22 @@ void PublicApiResource::Impl::GetLatestData(const OutputType &outputType,
     Row titles;
     Table data;
 
+    Snapshot_ptr snapshot(GetLatestSnapshot());
+    if (snapshot) {
+        GetSnapshotHeader(snapshot, date, time, titles);
+
+        data.resize(snapshot->GetRowCount());
+        for (std::size_t i = 0; i < data.size(); ++i) {
+            data[i].resize(snapshot->GetColumnCount());
+            for (std::size_t j = 0; j < data[i].size(); ++j) {
+                snapshot->GetValue(i, j, data[i][j]);
+            }
+        }
+
+        GetDataTree(outputType, date, time, titles, data, out_tree);
+        return;
+    }
+
     cppdb::transaction guard(Pool::Database()->Sql());
 
     cppdb::result r = Pool::Database()->Sql()
@@ -449,6 +779,502 @@ void PublicApiResource::Impl::GetToken(boost::property_tree::wptree &out_tree)
     out_tree.put(L"token", WString(token).value());
 }
 
+PublicApiResource::Impl::Snapshot_ptr PublicApiResource::Impl::GetLatestSnapshot()
+{
+    std::lock_guard<std::mutex> lock(SnapshotMutex);
+    (void)lock;
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    if (IsSnapshotChecked
+            && now - SnapshotCheckedAt < std::chrono::milliseconds(SNAPSHOT_CHECK_INTERVAL_MILLISECONDS))
+        return LatestSnapshot;
+
+    IsSnapshotChecked = true;
+    SnapshotCheckedAt = now;
+
+    /// Until something is published, the database answers
+    std::string file;
+    std::string err;
+    if (!CoreLib::Snapshot::GetLatest(Pool::Storage()->SnapshotPath, file, err))
+        return LatestSnapshot;
+
+    if ((LatestSnapshot && LatestSnapshot->GetFile() == file) || file == FailedSnapshotFile)
+        return LatestSnapshot;
+
+    TRACE_SPAN_DETAIL("rest", "PublicApiResource::GetLatestSnapshot", file);
+
+    std::shared_ptr<CoreLib::Snapshot::Reader> snapshot = std::make_shared<CoreLib::Snapshot::Reader>();
+    if (!snapshot->Open(file, err)) {
+        LOG_ERROR(err, file);
+        FailedSnapshotFile = file;
+        return LatestSnapshot;
+    }
+
+    LOG_INFO("Mapped stock data snapshot", snapshot->GetVersion(), file);
+
+    LatestSnapshot = snapshot;
+
+    return LatestSnapshot;
+}
+
+void PublicApiResource::Impl::GetSnapshotHeader(const Snapshot_ptr &snapshot, std::string &out_date,
+                                                std::string &out_time, Row &out_titles)
+{
+    const CoreLib::Snapshot::Properties &properties = snapshot->GetProperties();
+
+    CoreLib::Snapshot::Properties::const_iterator it = properties.find("date");
+    out_date = it != properties.end() ? it->second : "";
+    it = properties.find("time");
+    out_time = it != properties.end() ? it->second : "";
+
+    out_titles.clear();
+    for (std::size_t i = 0; i < snapshot->GetColumnCount(); ++i) {
+        out_titles.push_back(snapshot->GetColumnName(i));
+    }
+}
+
+bool PublicApiResource::Impl::CreateDataByDateStream(const OutputType &outputType,
+                                                     const std::string &dateId,
+                                                     StreamState_ptr &out_state)
+{
+    StreamState_ptr state = std::make_shared<StreamState>();
+    state->Type = outputType;
+
+    std::string dataTitlesTable;
+
+    cppdb::transaction guard(Pool::Database()->Sql());
+
+    cppdb::result r = Pool::Database()->Sql()
+            << (boost::format("SELECT date, time, datatitlestbl, stockdatatbl"
+                              " FROM %1%"
+                              " WHERE date=? "
+                              " ORDER BY ROWID ASC"
+                              " LIMIT 1;")
+                % Pool::Database()->GetTableName("ARCHIVE")).str()
+            << boost::replace_all_copy(dateId, "-", "/")
+            << cppdb::row;
+
+    if (r.empty()) {
+        guard.rollback();
+        return false;
+    }
+
+    r >> state->Date >> state->Time >> dataTitlesTable >> state->StockDataTable;
+
+    if (dataTitlesTable.empty()) {
+        guard.rollback();
+
+        state->Archive = std::make_unique<CoreLib::ColumnArchive::Reader>();
+        OpenArchive(state->StockDataTable, *state->Archive, state->Titles);
+
+        out_state = state;
+        return true;
+    }
+
+    GetStreamTitles(dataTitlesTable, state->Titles);
+
+    guard.rollback();
+
+    out_state = state;
+
+    return true;
+}
+
+bool PublicApiResource::Impl::CreateLatestDataStream(const OutputType &outputType,
+                                                     StreamState_ptr &out_state)
+{
+    StreamState_ptr state = std::make_shared<StreamState>();
+    state->Type = outputType;
+
+    state->Snapshot = GetLatestSnapshot();
+    if (state->Snapshot) {
+        GetSnapshotHeader(state->Snapshot, state->Date, state->Time, state->Titles);
+
+        out_state = state;
+        return true;
+    }
+
+    state->StockDataTable = Pool::Database()->GetTableName("STOCK_DATA");
+    state->IsLatest = true;
+
+    cppdb::transaction guard(Pool::Database()->Sql());
+
+    cppdb::result r = Pool::Database()->Sql()
+            << (boost::format("SELECT date, time"
+                              " FROM %1%"
+                              " ORDER BY ROWID ASC"
+                              " LIMIT 1;")
+                % Pool::Database()->GetTableName("LAST_UPDATE")).str()
+            << cppdb::row;
+
+    if (r.empty()) {
+        guard.rollback();
+        return false;
+    }
+
+    r >> state->Date >> state->Time;
+
+    GetStreamTitles(Pool::Database()->GetTableName("DATA_TITLES"), state->Titles);
+
+    guard.rollback();
+
+    out_state = state;
+
+    return true;
+}
+
+void PublicApiResource::Impl::GetStreamTitles(const std::string &dataTitlesTable, Row &out_titles)
+{
+    out_titles.clear();
+
+    cppdb::result r = Pool::Database()->Sql()
+            << (boost::format("SELECT title"
+                              " FROM %1%"
+                              " ORDER BY ROWID ASC;")
+                % dataTitlesTable).str();
+
+    std::string value;
+    while(r.next()) {
+        r >> value;
+        out_titles.push_back(value);
+    }
+}
+
+bool PublicApiResource::Impl::SelectStreamColumns(const StreamState_ptr &state,
+                                                  const std::string *columns)
+{
+    state->Columns.clear();
+
+    if (columns == nullptr || columns->empty()) {
+        for (std::size_t i = 0; i < state->Titles.size(); ++i) {
+            state->Columns.push_back(i);
+        }
+        return true;
+    }
+
+    Row names;
+    boost::algorithm::split(names, *columns, boost::is_any_of(","));
+
+    for (const auto &name : names) {
+        Row::const_iterator it = std::find(state->Titles.begin(), state->Titles.end(), name);
+        if (it == state->Titles.end())
+            return false;
+        state->Columns.push_back(static_cast<std::size_t>(it - state->Titles.begin()));
+    }
+
+    state->Titles.swap(names);
+
+    return true;
+}
+
+void PublicApiResource::Impl::OpenArchive(const std::string &archiveFile,
+                                          CoreLib::ColumnArchive::Reader &reader,
+                                          Row &out_titles)
+{
+    out_titles.clear();
+
+    const std::string path((boost::filesystem::path(Pool::Storage()->ArchivePath)
+                            / boost::filesystem::path(archiveFile)).string());
+
+    std::string err;
+    if (!reader.Open(path, err)) {
+        LOG_ERROR(err, path);
+        throw CoreLib::Exception(err);
+    }
+
+    for (const auto &column : reader.GetColumns()) {
+        out_titles.push_back(column.Name);
+    }
+}
+
+void PublicApiResource::Impl::ReadArchive(const std::string &archiveFile, Row &out_titles,
+                                          std::vector<CoreLib::ColumnArchive::Column> &out_columns)
+{
+    TRACE_SPAN_DETAIL("rest", "PublicApiResource::ReadArchive", archiveFile);
+
+    out_columns.clear();
+
+    CoreLib::ColumnArchive::Reader reader;
+    OpenArchive(archiveFile, reader, out_titles);
+
+    std::string err;
+    if (!reader.ReadAllColumns(out_columns, err)) {
+        LOG_ERROR(err, archiveFile);
+        throw CoreLib::Exception(err);
+    }
+}
+
+bool PublicApiResource::Impl::WriteStream(const StreamState_ptr &state, Wt::Http::Response &response)
+{
+    if (!state->IsHeaderWritten) {
+        switch (state->Type) {
+        case OutputType::CSV:
+        {
+            response.addHeader("Content-type", "text/csv; charset=utf-8");
+
+            Row header { "date", "time" };
+            header.insert(header.end(), state->Titles.begin(), state->Titles.end());
+
+            for (Row::const_iterator it = header.begin(); it != header.end(); ++it) {
+                if (it != header.begin())
+                    response.out() << ',';
+                response.out() << EscapeCsv(*it);
+            }
+            response.out() << "\r\n";
+        }
+            break;
+        case OutputType::NDJSON:
+            response.addHeader("Content-type", "application/x-ndjson; charset=utf-8");
+            break;
+        default:
+            break;
+        }
+
+        state->IsHeaderWritten = true;
+    }
+
+    /// Once the body has started, an error status can no longer be sent;
+    /// an error marker ends the data instead, so a cut-short export never
+    /// looks complete
+    bool isMore;
+    bool isSucceeded = true;
+
+    try {
+        isMore = WriteStreamChunk(state, response.out());
+    }
+
+    catch (const std::exception &ex) {
+        LOG_ERROR(ex.what(), state->StockDataTable, state->LastRowId);
+        isMore = false;
+        isSucceeded = false;
+    }
+
+    catch (...) {
+        LOG_ERROR("Unknown error!", state->StockDataTable, state->LastRowId);
+        isMore = false;
+        isSucceeded = false;
+    }
+
+    if (!isSucceeded)
+        WriteStreamError(state, STREAM_INTERNAL_ERROR, response.out());
+
+    /// No Content-Length is known up-front, so each continuation
+    /// goes out as a separate chunk
+    if (isMore) {
+        Wt::Http::ResponseContinuation *continuation = response.createContinuation();
+        continuation->setData(state);
+    }
+
+    return isSucceeded;
+}
+
+bool PublicApiResource::Impl::WriteStreamChunk(const StreamState_ptr &state, std::ostream &out)
+{
+    TRACE_SPAN("rest", "PublicApiResource::WriteStreamChunk");
+
+    std::size_t rowsCount = 0;
+
+    if (state->Archive) {
+        const std::size_t rows = state->Archive->GetRowCount();
+        const std::size_t rowGroupRows = state->Archive->GetRowGroupRows();
+        Row row;
+
+        while (rowsCount < STREAM_CHUNK_ROWS
+               && static_cast<std::size_t>(state->LastRowId) < rows) {
+            const std::size_t rowId = static_cast<std::size_t>(state->LastRowId);
+
+            /// Only the row group being written is held decoded
+            if (rowId % rowGroupRows == 0) {
+                std::string err;
+                if (!state->Archive->ReadRowGroup(rowId / rowGroupRows, state->Columns,
+                                                  state->RowGroup, err))
+                    throw CoreLib::Exception(err);
+            }
+
+            row.clear();
+            for (const auto &column : state->RowGroup) {
+                row.push_back(column[rowId % rowGroupRows]);
+            }
+
+            WriteRow(state, row, out);
+
+            ++state->LastRowId;
+            ++rowsCount;
+        }
+
+        return static_cast<std::size_t>(state->LastRowId) < rows;
+    }
+
+    if (state->Snapshot) {
+        const std::size_t rows = state->Snapshot->GetRowCount();
+        Row row(state->Columns.size());
+
+        while (rowsCount < STREAM_CHUNK_ROWS
+               && static_cast<std::size_t>(state->LastRowId) < rows) {
+            for (std::size_t i = 0; i < row.size(); ++i) {
+                state->Snapshot->GetValue(static_cast<std::size_t>(state->LastRowId),
+                                          state->Columns[i], row[i]);
+            }
+
+            WriteRow(state, row, out);
+
+            ++state->LastRowId;
+            ++rowsCount;
+        }
+
+        return static_cast<std::size_t>(state->LastRowId) < rows;
+    }
+
+    cppdb::transaction guard(Pool::Database()->Sql());
+
+    cppdb::result r = Pool::Database()->Sql()
+            << (boost::format("SELECT *"
+                              " FROM %1%"
+                              " WHERE r > ?"
+                              " ORDER BY r ASC"
+                              " LIMIT %2%;")
+                % state->StockDataTable
+                % STREAM_CHUNK_ROWS).str()
+            << state->LastRowId;
+
+    Table data;
+    long lastRowId = state->LastRowId;
+    Row fields;
+    std::string value;
+    while(r.next()) {
+        Row row;
+
+        fields.clear();
+        r >> lastRowId;
+        for (int i = 1; i < r.cols(); ++i) {
+            value.clear();
+            r >> value;
+            fields.push_back(value);
+        }
+
+        for (const std::size_t column : state->Columns) {
+            row.push_back(column < fields.size() ? fields[column] : std::string());
+        }
+
+        data.push_back(row);
+    }
+
+    /// The live table is replaced wholesale on every update. Checked after
+    /// the rows are read, so rows from a newer update never go out under
+    /// the date and time of the one this export started with.
+    if (state->IsLatest && !IsLatestUpdate(state->Date, state->Time)) {
+        guard.rollback();
+        LOG_WARNING("Stock data was updated mid-export; ending the stream with an error",
+                    state->Date, state->Time, state->LastRowId);
+        WriteStreamError(state, STREAM_DATA_UPDATED_ERROR, out);
+        return false;
+    }
+
+    guard.rollback();
+
+    for (const Row &row : data) {
+        WriteRow(state, row, out);
+        ++rowsCount;
+    }
+
+    state->LastRowId = lastRowId;
+
+    return rowsCount == STREAM_CHUNK_ROWS;
+}
+
+void PublicApiResource::Impl::WriteStreamError(const StreamState_ptr &state, const std::string &error,
+                                               std::ostream &out)
+{
+    switch (state->Type) {
+    case OutputType::CSV:
+        out << STREAM_ERROR_CSV_MARKER << ',' << EscapeCsv(error) << "\r\n";
+        break;
+    case OutputType::NDJSON:
+    {
+        std::string line("{\"error\":");
+        CoreLib::Utility::AppendJsonString(line, error);
+        line += "}\n";
+        out << line;
+    }
+        break;
+    default:
+        break;
+    }
+}
+
+bool PublicApiResource::Impl::IsLatestUpdate(const std::string &date, const std::string &time)
+{
+    cppdb::result r = Pool::Database()->Sql()
+            << (boost::format("SELECT date, time"
+                              " FROM %1%"
+                              " ORDER BY ROWID ASC"
+                              " LIMIT 1;")
+                % Pool::Database()->GetTableName("LAST_UPDATE")).str()
+            << cppdb::row;
+
+    if (r.empty())
+        return false;
+
+    std::string latestDate;
+    std::string latestTime;
+    r >> latestDate >> latestTime;
+
+    return latestDate == date && latestTime == time;
+}
+
+void PublicApiResource::Impl::WriteRow(const StreamState_ptr &state, const Row &row, std::ostream &out)
+{
+    switch (state->Type) {
+    case OutputType::CSV:
+        WriteCsvRow(state, row, out);
+        break;
+    case OutputType::NDJSON:
+        WriteNdjsonRow(state, row, out);
+        break;
+    default:
+        break;
+    }
+}
+
+void PublicApiResource::Impl::WriteCsvRow(const StreamState_ptr &state, const Row &row, std::ostream &out)
+{
+    out << EscapeCsv(state->Date) << ',' << EscapeCsv(state->Time);
+
+    for (Row::const_iterator it = row.begin(); it != row.end(); ++it) {
+        out << ',' << EscapeCsv(*it);
+    }
+
+    out << "\r\n";
+}
+
+void PublicApiResource::Impl::WriteNdjsonRow(const StreamState_ptr &state, const Row &row, std::ostream &out)
+{
+    std::string line("{\"date\":");
+    CoreLib::Utility::AppendJsonString(line, state->Date);
+    line += ",\"time\":";
+    CoreLib::Utility::AppendJsonString(line, state->Time);
+    line += ",\"data\":{";
+
+    for (std::size_t i = 0; i < row.size(); ++i) {
+        if (i != 0)
+            line += ',';
+        CoreLib::Utility::AppendJsonString(line, i < state->Titles.size() ? state->Titles[i] : lexical_cast<std::string>(i));
+        line += ':';
+        CoreLib::Utility::AppendJsonString(line, row[i]);
+    }
+
+    line += "}}\n";
+    out << line;
+}
+
+std::string PublicApiResource::Impl::EscapeCsv(const std::string &field)
+{
+    if (field.find_first_of(",\"\r\n") == std::string::npos)
+        return field;
+
+    return (boost::format("\"%1%\"") % boost::replace_all_copy(field, "\"", "\"\"")).str();
+}
+
 void PublicApiResource::Impl::DataByDateJson(const std::wstring &date, std::wstring &out_response)
 {
     out_response.clear();
@@ -458,7 +1284,10 @@ void PublicApiResource::Impl::DataByDateJson(const std::wstring &date, std::wstr
 
     GetDataByDate(OutputType::JSON, WString(date).toUTF8(), tree);
 
-    boost::property_tree::write_json(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_json");
+        boost::property_tree::write_json(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
@@ -472,7 +1301,10 @@ void PublicApiResource::Impl::DataByDateXml(const std::wstring &date, std::wstri
 
     GetDataByDate(OutputType::XML, WString(date).toUTF8(), tree);
 
-    boost::property_tree::write_xml(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_xml");
+        boost::property_tree::write_xml(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
@@ -486,7 +1318,10 @@ void PublicApiResource::Impl::LatestDataJson(std::wstring &out_response)
 
     GetLatestData(OutputType::JSON, tree);
 
-    boost::property_tree::write_json(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_json");
+        boost::property_tree::write_json(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
@@ -500,7 +1335,10 @@ void PublicApiResource::Impl::LatestDataXml(std::wstring &out_response)
 
     GetLatestData(OutputType::XML, tree);
 
-    boost::property_tree::write_xml(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_xml");
+        boost::property_tree::write_xml(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
@@ -514,7 +1352,10 @@ void PublicApiResource::Impl::TokenJson(std::wstring &out_response)
 
     GetToken(tree);
 
-    boost::property_tree::write_json(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_json");
+        boost::property_tree::write_json(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
@@ -528,7 +1369,10 @@ void PublicApiResource::Impl::TokenXml(std::wstring &out_response)
 
     GetToken(tree);
 
-    boost::property_tree::write_xml(stream, tree);
+    {
+        TRACE_SPAN("rest", "write_xml");
+        boost::property_tree::write_xml(stream, tree);
+    }
 
     out_response.assign(stream.str());
 }
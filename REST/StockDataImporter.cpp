@@ -0,0 +1,574 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Imports an extracted MarketWatchPlus workbook into the database, archives
+ * the previous trading day and publishes the result as a snapshot. Shared by
+ * the stock update worker and the ingest benchmark.
+ */
+
+
+#include <vector>
+#include <cassert>
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/foreach.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/xml_parser.hpp>
+#include <boost/regex.hpp>
+#include <cppdb/frontend.h>
+#include <CoreLib/Database.hpp>
+#include <CoreLib/FileSystem.hpp>
+#include <CoreLib/Log.hpp>
+#include <CoreLib/make_unique.hpp>
+#include <CoreLib/Snapshot.hpp>
+#include <CoreLib/Trace.hpp>
+#include "StockDataImporter.hpp"
+
+#define         DEFAULT_SNAPSHOTS_TO_KEEP                   3
+
+using namespace std;
+using namespace boost;
+using namespace CoreLib;
+using namespace Rest;
+
+struct StockDataImporter::Impl
+{
+    CoreLib::Database &Database;
+    StockDataImporter::Options Options;
+
+    vector<std::string> SharedStrings;
+    property_tree::ptree Sheet;
+
+    std::string Date;
+    std::string Time;
+
+    std::unique_ptr<cppdb::transaction> Guard;
+    std::size_t FailedStatements;
+
+    Impl(CoreLib::Database &database, const StockDataImporter::Options &options);
+
+    bool ReadStockData(const std::string &date, std::vector<std::string> &out_titles,
+                       std::vector<std::vector<std::string>> &out_columns);
+    bool ArchiveToFile(const std::string &date, const std::string &time,
+                       std::string &out_fileName);
+    void Archive(const std::string &date, const std::string &time);
+
+    std::string GetTableNameFromDate(const std::string &id, const std::string &date);
+
+    static void ParseTitle(const std::string &title, std::string &out_date, std::string &out_time);
+};
+
+void StockDataImporter::RegisterTables(CoreLib::Database &database, const std::string &namePrefix)
+{
+    database.RegisterTable("LAST_UPDATE", namePrefix + "lastupdate",
+                           " date TEXT NOT NULL, "
+                           " time TEXT NOT NULL ");
+    database.RegisterTable("DATA_TITLES", namePrefix + "datatitles",
+                           " id TEXT NOT NULL, "
+                           " title TEXT NOT NULL, "
+                           " PRIMARY KEY ( id ) ");
+    database.RegisterTable("STOCK_DATA", namePrefix + "stockdata",
+                           " ");
+    /// An empty datatitlestbl means stockdatatbl names a column archive
+    /// file under the archive path instead of a table
+    database.RegisterTable("ARCHIVE", namePrefix + "archive",
+                           " date TEXT NOT NULL, "
+                           " time TEXT NOT NULL, "
+                           " datatitlestbl TEXT NOT NULL, "
+                           " stockdatatbl TEXT NOT NULL, "
+                           " PRIMARY KEY ( date ) ");
+}
+
+StockDataImporter::Options::Options() :
+    SnapshotsToKeep(DEFAULT_SNAPSHOTS_TO_KEEP)
+{
+
+}
+
+StockDataImporter::StockDataImporter(CoreLib::Database &database, const Options &options) :
+    m_pimpl(std::make_unique<StockDataImporter::Impl>(database, options))
+{
+
+}
+
+StockDataImporter::~StockDataImporter()
+{
+
+}
+
+void StockDataImporter::ReadSharedStrings(const std::string &file)
+{
+    property_tree::ptree sharedStringsTree;
+    {
+        TRACE_SPAN_DETAIL("ingest", "read_xml", file);
+        property_tree::read_xml(file, sharedStringsTree);
+    }
+
+    m_pimpl->SharedStrings.clear();
+
+    BOOST_FOREACH(property_tree::ptree::value_type &siNode,
+                  sharedStringsTree.get_child("sst")) {
+        auto t = siNode.second.get_child_optional("t");
+        if (t) {
+            m_pimpl->SharedStrings.push_back(siNode.second.get<std::string>("t"));
+        }
+    }
+}
+
+void StockDataImporter::ReadSheet(const std::string &file)
+{
+    TRACE_SPAN_DETAIL("ingest", "read_xml", file);
+
+    m_pimpl->Sheet.clear();
+    property_tree::read_xml(file, m_pimpl->Sheet);
+}
+
+bool StockDataImporter::Begin()
+{
+    m_pimpl->Date.clear();
+    m_pimpl->Time.clear();
+    m_pimpl->FailedStatements = 0;
+
+    bool hasTitle = false;
+
+    BOOST_FOREACH(property_tree::ptree::value_type &rowNode,
+                  m_pimpl->Sheet.get_child("worksheet.sheetData")) {
+        if (rowNode.second.get<long>("<xmlattr>.r", -1) != 1)
+            continue;
+
+        BOOST_FOREACH(property_tree::ptree::value_type &cNode,
+                      rowNode.second) {
+            if (cNode.first == "c"
+                    && cNode.second.get<std::string>("<xmlattr>.r", "") == "A1"
+                    && cNode.second.get<std::string>("<xmlattr>.t", "") == "s") {
+                Impl::ParseTitle(m_pimpl->SharedStrings[cNode.second.get<size_t>("v")],
+                                 m_pimpl->Date, m_pimpl->Time);
+                hasTitle = true;
+                break;
+            }
+        }
+
+        break;
+    }
+
+    m_pimpl->Guard = std::make_unique<cppdb::transaction>(m_pimpl->Database.Sql());
+
+    if (!hasTitle)
+        return true;
+
+    try {
+        cppdb::result r = m_pimpl->Database.Sql()
+                << (boost::format("SELECT date, time"
+                                  " FROM %1%"
+                                  " ORDER BY ROWID ASC"
+                                  " LIMIT 1;")
+                    % m_pimpl->Database.GetTableName("LAST_UPDATE")).str()
+                << cppdb::row;
+
+        if (!r.empty()) {
+            string lastUpdateDate;
+            string lastUpdateTime;
+            r >> lastUpdateDate >> lastUpdateTime;
+
+            if (lastUpdateDate == m_pimpl->Date && lastUpdateTime == m_pimpl->Time) {
+                m_pimpl->Guard->rollback();
+                m_pimpl->Guard.reset();
+                return false;
+            }
+
+            if (lastUpdateDate != m_pimpl->Date) {
+                m_pimpl->Archive(lastUpdateDate, lastUpdateTime);
+            }
+        }
+    } catch (...) {
+    }
+
+    return true;
+}
+
+void StockDataImporter::Import()
+{
+    assert(m_pimpl->Guard);
+
+    CoreLib::Database &database = m_pimpl->Database;
+    const vector<std::string> &sharedStrings = m_pimpl->SharedStrings;
+
+    string createTableFields = " r INTEGER NOT NULL, ";
+    vector<string> tableFieldsId;
+
+    BOOST_FOREACH(property_tree::ptree::value_type &rowNode,
+                  m_pimpl->Sheet.get_child("worksheet.sheetData")) {
+
+        long rRow(rowNode.second.get<long>("<xmlattr>.r", -1));
+
+        /// The title row was read by Begin()
+        if (rRow == 1)
+            continue;
+
+        if (rRow == 2) {
+            database.DropTable("DATA_TITLES");
+            database.CreateTable("DATA_TITLES");
+        } else if (rRow == 3) {
+            createTableFields += " PRIMARY KEY ( r ) ";
+
+            /// We should set this each and every time
+            /// due to any possible changes in original
+            /// .xlsx file
+            database.SetTableFields("STOCK_DATA", createTableFields);
+
+            database.DropTable("STOCK_DATA");
+            database.CreateTable("STOCK_DATA");
+        }
+
+        if (rRow > 2) {
+            if (!database.Insert("STOCK_DATA",
+                                 "r",
+                                 { boost::lexical_cast<string>(rRow) }))
+                ++m_pimpl->FailedStatements;
+        }
+
+        size_t col = 0;
+
+        BOOST_FOREACH(property_tree::ptree::value_type &cNode,
+                      rowNode.second) {
+            if (cNode.first == "c") {
+                if (rRow == 2) {
+                    string tC(cNode.second.get<std::string>("<xmlattr>.t", ""));
+                    if (tC == "s") {
+                        string rC(cNode.second.get<std::string>("<xmlattr>.r", ""));
+                        string v(sharedStrings[cNode.second.get<size_t>("v")]);
+
+                        if (!database.Insert("DATA_TITLES",
+                                             "id, title",
+                                             { rC, v }))
+                            ++m_pimpl->FailedStatements;
+
+                        tableFieldsId.push_back(rC);
+                        /// Cell references are plain identifiers; SQLite's
+                        /// [A2] quoting is rejected by PostgreSQL
+                        createTableFields += (boost::format(" %1% TEXT, ") % rC).str();
+                    }
+                } else {
+                    string tC(cNode.second.get<std::string>("<xmlattr>.t", ""));
+                    string v(tC == "s"
+                             ? sharedStrings[cNode.second.get<size_t>("v")]
+                             : boost::lexical_cast<string>(cNode.second.get<double>("v")));
+                    if (!database.Update("STOCK_DATA",
+                                         "r",
+                                         boost::lexical_cast<string>(rRow),
+                                         (boost::format("%1%=?") % tableFieldsId[col]).str(),
+                                         { v }))
+                        ++m_pimpl->FailedStatements;
+                }
+                ++col;
+            }
+        }
+    }
+}
+
+void StockDataImporter::Commit()
+{
+    assert(m_pimpl->Guard);
+
+    m_pimpl->Database.DropTable("LAST_UPDATE");
+    m_pimpl->Database.CreateTable("LAST_UPDATE");
+    m_pimpl->Database.Insert("LAST_UPDATE",
+                             "date, time",
+                             { m_pimpl->Date, m_pimpl->Time });
+
+    {
+        TRACE_SPAN("sql", "commit");
+        m_pimpl->Guard->commit();
+    }
+
+    m_pimpl->Guard.reset();
+}
+
+bool StockDataImporter::PublishSnapshot()
+{
+    const std::string &date = m_pimpl->Date;
+    const std::string &time = m_pimpl->Time;
+
+    TRACE_SPAN_DETAIL("ingest", "StockDataImporter::PublishSnapshot", date);
+
+    try {
+        vector<std::string> titles;
+        vector<Snapshot::Column> columns;
+        if (!m_pimpl->ReadStockData(date, titles, columns))
+            return false;
+
+        Snapshot::Writer writer;
+        writer.SetProperty("date", date);
+        writer.SetProperty("time", time);
+        for (size_t i = 0; i < titles.size(); ++i) {
+            writer.AddColumn(titles[i], std::move(columns[i]));
+        }
+
+        std::uint64_t version;
+        std::string err;
+        if (!writer.Publish(m_pimpl->Options.SnapshotPath, m_pimpl->Options.SnapshotsToKeep,
+                            version, err)) {
+            LOG_ERROR(err, date, time);
+            return false;
+        }
+
+        LOG_INFO("Published stock data snapshot", version, date, time);
+
+        return true;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what(), date);
+    }
+
+    catch (...) {
+        LOG_ERROR("StockDataImporter::PublishSnapshot(): Unknown error!", date);
+    }
+
+    return false;
+}
+
+bool StockDataImporter::IsSnapshotCurrent()
+{
+    std::string file;
+    std::string err;
+    if (!Snapshot::GetLatest(m_pimpl->Options.SnapshotPath, file, err))
+        return false;
+
+    Snapshot::Reader snapshot;
+    if (!snapshot.Open(file, err)) {
+        LOG_WARNING(err, file);
+        return false;
+    }
+
+    const Snapshot::Properties &properties = snapshot.GetProperties();
+    Snapshot::Properties::const_iterator date = properties.find("date");
+    Snapshot::Properties::const_iterator time = properties.find("time");
+
+    return date != properties.end() && date->second == m_pimpl->Date
+            && time != properties.end() && time->second == m_pimpl->Time;
+}
+
+const std::string &StockDataImporter::GetDate() const
+{
+    return m_pimpl->Date;
+}
+
+const std::string &StockDataImporter::GetTime() const
+{
+    return m_pimpl->Time;
+}
+
+std::size_t StockDataImporter::GetFailedStatements() const
+{
+    return m_pimpl->FailedStatements;
+}
+
+StockDataImporter::Impl::Impl(CoreLib::Database &database, const StockDataImporter::Options &options) :
+    Database(database),
+    Options(options),
+    FailedStatements(0)
+{
+
+}
+
+bool StockDataImporter::Impl::ReadStockData(const std::string &date, std::vector<std::string> &out_titles,
+                                            std::vector<std::vector<std::string>> &out_columns)
+{
+    out_titles.clear();
+    out_columns.clear();
+
+    std::string value;
+
+    cppdb::result r = Database.Sql()
+            << (boost::format("SELECT title"
+                              " FROM %1%"
+                              " ORDER BY ROWID ASC;")
+                % Database.GetTableName("DATA_TITLES")).str();
+
+    while (r.next()) {
+        r >> value;
+        out_titles.push_back(value);
+    }
+
+    out_columns.resize(out_titles.size());
+
+    r = Database.Sql()
+            << (boost::format("SELECT *"
+                              " FROM %1%"
+                              " ORDER BY r ASC;")
+                % Database.GetTableName("STOCK_DATA")).str();
+
+    while (r.next()) {
+        /// Column 0 is 'r'
+        if (static_cast<size_t>(r.cols()) != out_titles.size() + 1) {
+            LOG_ERROR("Stock data does not match its titles", date);
+            return false;
+        }
+
+        for (int i = 1; i < r.cols(); ++i) {
+            value.clear();
+            r >> value;
+            out_columns[i - 1].push_back(value);
+        }
+    }
+
+    return true;
+}
+
+bool StockDataImporter::Impl::ArchiveToFile(const std::string &date, const std::string &time,
+                                            std::string &out_fileName)
+{
+    TRACE_SPAN_DETAIL("ingest", "StockDataImporter::ArchiveToFile", date);
+
+    try {
+        vector<std::string> titles;
+        vector<ColumnArchive::Column> columns;
+        if (!ReadStockData(date, titles, columns))
+            return false;
+
+        ColumnArchive::Writer writer(Options.Archive);
+        writer.SetProperty("date", date);
+        writer.SetProperty("time", time);
+        for (size_t i = 0; i < titles.size(); ++i) {
+            writer.AddColumn(titles[i], std::move(columns[i]));
+        }
+
+        if (!FileSystem::DirExists(Options.ArchivePath))
+            FileSystem::CreateDir(Options.ArchivePath, true);
+
+        const std::string fileName(boost::replace_all_copy(date, "/", "_")
+                                   + ColumnArchive::FileExtension);
+
+        std::string err;
+        if (!writer.Save((boost::filesystem::path(Options.ArchivePath)
+                          / boost::filesystem::path(fileName)).string(), err)) {
+            LOG_ERROR(err, date);
+            return false;
+        }
+
+        out_fileName = fileName;
+
+        return true;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what(), date);
+    }
+
+    catch (...) {
+        LOG_ERROR("StockDataImporter::Impl::ArchiveToFile(): Unknown error!", date);
+    }
+
+    return false;
+}
+
+void StockDataImporter::Impl::Archive(const std::string &date, const std::string &time)
+{
+    /// The column archive is far smaller than a pair of renamed tables; the
+    /// tables are only kept when it cannot be written
+    std::string archiveFile;
+    if (ArchiveToFile(date, time, archiveFile)) {
+        Database.Insert("ARCHIVE",
+                        "date, time, datatitlestbl, stockdatatbl ",
+                        {
+                            date,
+                            time,
+                            "",
+                            archiveFile
+                        });
+    } else {
+        std::string archiveDataTitlesTableName(
+                    GetTableNameFromDate("DATA_TITLES", date));
+        std::string archiveStockDataTableName(
+                    GetTableNameFromDate("STOCK_DATA", date));
+
+        Database.RenameTable("STOCK_DATA", archiveStockDataTableName);
+        Database.RenameTable("DATA_TITLES", archiveDataTitlesTableName);
+
+        Database.Insert("ARCHIVE",
+                        "date, time, datatitlestbl, stockdatatbl ",
+                        {
+                            date,
+                            time,
+                            archiveDataTitlesTableName,
+                            archiveStockDataTableName
+                        });
+    }
+}
+
+std::string StockDataImporter::Impl::GetTableNameFromDate(const std::string &id, const std::string &date)
+{
+    return  (boost::format("archive__%1%__%2%")
+             % Database.GetTableName(id)
+             % boost::replace_all_copy(date, "/", "_")).str();
+}
+
+void StockDataImporter::Impl::ParseTitle(const std::string &title, std::string &out_date, std::string &out_time)
+{
+    static const regex eDate("(13)[1-9][1-9][\\/]((0[1-9]|1[012])|([1-9]))[\\/]((0[1-9]|[12][0-9]|3[01])|([1-9]))");
+    static const regex eTime("[0-2][1-9][\\:](([0-9][0-9])|([0-9]))[\\:](([0-9][0-9])|([0-9]))");
+
+    string &date = out_date;
+    string &time = out_time;
+
+    boost::smatch result;
+    if (boost::regex_search(title, result, eDate)) {
+        date.assign(result[0].first, result[0].second);
+        if (date.size() != 10 || date.size() != 0) {
+            std::vector<std::string> vec;
+            boost::split(vec, date, boost::is_any_of(L"/"));
+            if (vec.size() == 3) {
+                date = (boost::format("%1%/%2%/%3%")
+                        % vec[0]
+                        % (vec[1].size() == 2 ? vec[1] : (boost::format("0%1%") % vec[1]).str())
+                        % (vec[2].size() == 2 ? vec[2] : (boost::format("0%1%") % vec[2]).str())
+                  ).str();
+            }
+        }
+    }
+    if (boost::regex_search(title, result, eTime)) {
+        time.assign(result[0].first, result[0].second);
+        if (time.size() != 10 || time.size() != 0) {
+            std::vector<std::string> vec;
+            boost::split(vec, time, boost::is_any_of(L":"));
+            if (vec.size() == 3) {
+                time = (boost::format("%1%:%2%:%3%")
+                        % vec[0]
+                        % (vec[1].size() == 2 ? vec[1] : (boost::format("0%1%") % vec[1]).str())
+                        % (vec[2].size() == 2 ? vec[2] : (boost::format("0%1%") % vec[2]).str())
+                  ).str();
+            }
+        }
+    }
+}
@@ -0,0 +1,110 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Imports an extracted MarketWatchPlus workbook into the database, archives
+ * the previous trading day and publishes the result as a snapshot. Shared by
+ * the stock update worker and the ingest benchmark.
+ */
+
+
+#ifndef REST_STOCK_DATA_IMPORTER_HPP
+#define REST_STOCK_DATA_IMPORTER_HPP
+
+
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <CoreLib/ColumnArchive.hpp>
+
+namespace CoreLib {
+    class Database;
+}
+
+namespace Rest {
+    class StockDataImporter;
+}
+
+class Rest::StockDataImporter
+{
+public:
+    struct Options
+    {
+        std::string ArchivePath;
+        CoreLib::ColumnArchive::Options Archive;
+        std::string SnapshotPath;
+        std::size_t SnapshotsToKeep;
+
+        Options();
+    };
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    /// Registers LAST_UPDATE, DATA_TITLES, STOCK_DATA and ARCHIVE; table
+    /// names get namePrefix, so a benchmark can keep its own copies
+    static void RegisterTables(CoreLib::Database &database, const std::string &namePrefix = "");
+
+public:
+    StockDataImporter(CoreLib::Database &database, const Options &options);
+    ~StockDataImporter();
+
+public:
+    /// The steps below run in this order and throw on malformed input or
+    /// database errors, leaving the transaction rolled back
+    void ReadSharedStrings(const std::string &file);
+    void ReadSheet(const std::string &file);
+
+    /// Opens the import transaction and archives the previous trading day
+    /// when the date changes. Returns false, with nothing left open, when
+    /// the workbook is the one already imported.
+    bool Begin();
+    void Import();
+    void Commit();
+
+    /// Publishes what the database holds for GetDate() / GetTime(); REST
+    /// servers fall back to the previous snapshot, or the database, if this
+    /// fails
+    bool PublishSnapshot();
+
+    /// Whether the latest published snapshot holds GetDate() / GetTime()
+    bool IsSnapshotCurrent();
+
+    const std::string &GetDate() const;
+    const std::string &GetTime() const;
+
+    /// Inserts and updates that did not go through
+    std::size_t GetFailedStatements() const;
+};
+
+
+#endif /* REST_STOCK_DATA_IMPORTER_HPP */
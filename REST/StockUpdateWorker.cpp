@@ -39,23 +39,30 @@
 #include <boost/chrono/chrono.hpp>
 #include <boost/exception/diagnostic_information.hpp>
 #include <boost/filesystem/path.hpp>
-#include <boost/foreach.hpp>
 #include <boost/format.hpp>
-#include <boost/lexical_cast.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
-#include <boost/regex.hpp>
 #include <CoreLib/Archiver.hpp>
+#include <CoreLib/Compression.hpp>
 #include <CoreLib/Database.hpp>
 #include <CoreLib/FileSystem.hpp>
 #include <CoreLib/Http.hpp>
 #include <CoreLib/Log.hpp>
 #include <CoreLib/make_unique.hpp>
+#include <CoreLib/Metrics.hpp>
+#include <CoreLib/Trace.hpp>
 #include "Pool.hpp"
+#include "StockDataImporter.hpp"
 #include "StockUpdateWorker.hpp"
 
 #define         STOCK_DATA_LOCAL_TEMP_FILE_NAME             "stock-quotes-latest.xlsx"
 #define         STOCK_DATA_TEMP_WORK_DIR_NAME               "stock-quotes-excel-temp"
+#define         STOCK_DATA_SHARED_STRINGS_ENTRY             "xl/sharedStrings.xml"
+#define         STOCK_DATA_SHEET1_ENTRY                     "xl/worksheets/sheet1.xml"
+
+#if defined ( STOCK_DATA_SNAPSHOT_KEEP )
+#define         SNAPSHOTS_TO_KEEP                           STOCK_DATA_SNAPSHOT_KEEP
+#else
+#define         SNAPSHOTS_TO_KEEP                           3
+#endif  // defined ( STOCK_DATA_SNAPSHOT_KEEP )
 
 using namespace std;
 using namespace boost;
@@ -66,6 +73,14 @@ struct StockUpdateWorker::Impl
 {
     typedef std::unique_ptr<boost::thread> thread_ptr;
 
+    struct Stage
+    {
+        Metrics::Histogram *Duration;
+        Metrics::Counter *Failures;
+
+        explicit Stage(const std::string &name);
+    };
+
     bool Running;
     bool StartImmediately;
 
@@ -75,13 +90,19 @@ struct StockUpdateWorker::Impl
     thread_ptr WorkerThread;
     std::mutex WorkerMutex;
 
+    Stage Download;
+    Stage Unzip;
+    Stage Parse;
+    Stage Import;
+    Stage Commit;
+
     Impl();
     ~Impl();
 
     void Cron();
     void Update();
 
-    std::string GetTableNameFromDate(const std::string &id, const std::string &date);
+    static StockDataImporter::Options GetImporterOptions();
 };
 
 StockUpdateWorker::StockUpdateWorker() :
@@ -167,7 +188,7 @@ void StockUpdateWorker::Start()
 
     m_pimpl->Running = true;
 
-    m_pimpl->WorkerThread = std::make_unique<thread>(&StockUpdateWorker::Impl::Cron, m_pimpl.get());
+    m_pimpl->WorkerThread = std::make_unique<boost::thread>(&StockUpdateWorker::Impl::Cron, m_pimpl.get());
     m_pimpl->WorkerThread->detach();
 }
 
@@ -190,7 +211,12 @@ void StockUpdateWorker::Stop()
 
 StockUpdateWorker::Impl::Impl() :
     Running(false),
-    StartImmediately(false)
+    StartImmediately(false),
+    Download("download"),
+    Unzip("unzip"),
+    Parse("parse"),
+    Import("import"),
+    Commit("commit")
 {
 
 }
@@ -246,6 +272,11 @@ void StockUpdateWorker::Impl::Update()
                  / STOCK_DATA_TEMP_WORK_DIR_NAME).string()
                 );
 
+    TRACE_SPAN("ingest", "StockUpdateWorker::Update");
+
+    CoreLib::Database::SessionScope sessionScope(Pool::Database());
+    (void)sessionScope;
+
     string err;
 
     if (FileSystem::DirExists(WORK_DIR))
@@ -254,10 +285,35 @@ void StockUpdateWorker::Impl::Update()
     if (FileSystem::FileExists(TEMP_FILE))
         FileSystem::Erase(TEMP_FILE);
 
-    if (Http::Download(SourceURL, TEMP_FILE, err)) {
-        if (Archiver::UnZip(TEMP_FILE, WORK_DIR, err)) {
+    Metrics::Timer downloadTimer(Download.Duration);
+    bool isDownloaded = Http::Download(SourceURL, TEMP_FILE, err);
+    downloadTimer.Stop();
+
+    if (isDownloaded) {
+        /// Only the two parts that get parsed are extracted, in parallel
+        /// when there are spare cores
+        Archiver::UnZipOptions unzipOptions;
+        unzipOptions.Threads = 0;
+        unzipOptions.Filter = [](const std::string &entry) {
+            return entry == STOCK_DATA_SHARED_STRINGS_ENTRY || entry == STOCK_DATA_SHEET1_ENTRY;
+        };
+        Archiver::ExtractionStats unzipStats;
+
+        Metrics::Timer unzipTimer(Unzip.Duration);
+        bool isUnzipped = Archiver::UnZip(TEMP_FILE, WORK_DIR, unzipOptions, unzipStats, err);
+        unzipTimer.Stop();
+
+        for (const auto &entry : unzipStats) {
+            LOG_DEBUG("Extracted", entry.Name, entry.Bytes, entry.Microseconds);
+        }
+
+        if (isUnzipped) {
+            /// Whichever stage throws is the one that gets the failure
+            Stage *stage = &Parse;
 
             try {
+                Metrics::Timer parseTimer(Parse.Duration);
+
                 static const std::string SHARED_STRINGS_FILE(
                             (boost::filesystem::path(WORK_DIR)
                              / boost::filesystem::path("xl")
@@ -270,198 +326,63 @@ void StockUpdateWorker::Impl::Update()
                              / boost::filesystem::path("sheet1.xml")).string()
                             );
 
-                property_tree::ptree sharedStringsTree;
-                property_tree::read_xml(SHARED_STRINGS_FILE, sharedStringsTree);
+                StockDataImporter importer(*Pool::Database(), GetImporterOptions());
 
-                vector<std::string> sharedStrings;
+                importer.ReadSharedStrings(SHARED_STRINGS_FILE);
+                importer.ReadSheet(SHEET1_FILE);
 
-                BOOST_FOREACH(property_tree::ptree::value_type &siNode,
-                              sharedStringsTree.get_child("sst")) {
-                    auto t = siNode.second.get_child_optional("t");
-                    if (t) {
-                        sharedStrings.push_back(siNode.second.get<std::string>("t"));
-                    }
-                }
+                parseTimer.Stop();
 
-                property_tree::ptree sheet1Tree;
-                property_tree::read_xml(SHEET1_FILE, sheet1Tree);
-
-                string date;
-                string time;
-                string createTableFields = " r INTEGER NOT NULL, ";
-                vector<string> tableFieldsId;
-
-                cppdb::transaction guard(Pool::Database()->Sql());
-
-                BOOST_FOREACH(property_tree::ptree::value_type &rowNode,
-                              sheet1Tree.get_child("worksheet.sheetData")) {
-
-                    long rRow(rowNode.second.get<long>("<xmlattr>.r", -1));
-
-                    if (rRow == 2) {
-                        Pool::Database()->DropTable("DATA_TITLES");
-                        Pool::Database()->CreateTable("DATA_TITLES");
-                    } else if (rRow == 3) {
-                        createTableFields += " PRIMARY KEY ( r ) ";
-
-                        /// We should set this each and every time
-                        /// due to any possible changes in original
-                        /// .xlsx file
-                        Pool::Database()->SetTableFields("STOCK_DATA",
-                                                         createTableFields);
-
-                        Pool::Database()->DropTable("STOCK_DATA");
-                        Pool::Database()->CreateTable("STOCK_DATA");
-                    }
-
-                    if (rRow > 2) {
-                        Pool::Database()->Insert("STOCK_DATA",
-                                                 "r",
-                                                 { boost::lexical_cast<string>(rRow) });
-                    }
-
-                    size_t col = 0;
-
-                    BOOST_FOREACH(property_tree::ptree::value_type &cNode,
-                                  rowNode.second) {
-                        if (cNode.first == "c") {
-                            if (rRow == 1) {
-                                string rC(cNode.second.get<std::string>("<xmlattr>.r", ""));
-                                string tC(cNode.second.get<std::string>("<xmlattr>.t", ""));
-
-                                if (rC == "A1" && tC == "s") {
-                                    std::string v(sharedStrings[cNode.second.get<size_t>("v")]);
-
-                                    static const regex eDate("(13)[1-9][1-9][\\/]((0[1-9]|1[012])|([1-9]))[\\/]((0[1-9]|[12][0-9]|3[01])|([1-9]))");
-                                    static const regex eTime("[0-2][1-9][\\:](([0-9][0-9])|([0-9]))[\\:](([0-9][0-9])|([0-9]))");
-
-                                    boost::smatch result;
-                                    if (boost::regex_search(v, result, eDate)) {
-                                        date.assign(result[0].first, result[0].second);
-                                        if (date.size() != 10 || date.size() != 0) {
-                                            std::vector<std::string> vec;
-                                            boost::split(vec, date, boost::is_any_of(L"/"));
-                                            if (vec.size() == 3) {
-                                                date = (boost::format("%1%/%2%/%3%")
-                                                        % vec[0]
-                                                        % (vec[1].size() == 2 ? vec[1] : (boost::format("0%1%") % vec[1]).str())
-                                                        % (vec[2].size() == 2 ? vec[2] : (boost::format("0%1%") % vec[2]).str())
-                                                  ).str();
-                                            }
-                                        }
-                                    }
-                                    if (boost::regex_search(v, result, eTime)) {
-                                        time.assign(result[0].first, result[0].second);
-                                        if (time.size() != 10 || time.size() != 0) {
-                                            std::vector<std::string> vec;
-                                            boost::split(vec, time, boost::is_any_of(L":"));
-                                            if (vec.size() == 3) {
-                                                time = (boost::format("%1%:%2%:%3%")
-                                                        % vec[0]
-                                                        % (vec[1].size() == 2 ? vec[1] : (boost::format("0%1%") % vec[1]).str())
-                                                        % (vec[2].size() == 2 ? vec[2] : (boost::format("0%1%") % vec[2]).str())
-                                                  ).str();
-                                            }
-                                        }
-                                    }
-
-                                    try {
-                                        cppdb::result r = Pool::Database()->Sql()
-                                                << (boost::format("SELECT date, time"
-                                                                  " FROM %1%"
-                                                                  " ORDER BY ROWID ASC"
-                                                                  " LIMIT 1;")
-                                                    % Pool::Database()->GetTableName("LAST_UPDATE")).str()
-                                                << cppdb::row;
-
-                                        if (!r.empty()) {
-                                            string lastUpdateDate;
-                                            string lastUpdateTime;
-                                            r >> lastUpdateDate >> lastUpdateTime;
-
-                                            if (lastUpdateDate == date && lastUpdateTime == time) {
-                                                guard.rollback();
-                                                return;
-                                            } else {
-                                                if (lastUpdateDate != date) {
-                                                    std::string archiveDataTitlesTableName(
-                                                                GetTableNameFromDate("DATA_TITLES", lastUpdateDate));
-                                                    std::string archiveStockDataTableName(
-                                                                GetTableNameFromDate("STOCK_DATA", lastUpdateDate));
-
-                                                    Pool::Database()->RenameTable("STOCK_DATA", archiveStockDataTableName);
-                                                    Pool::Database()->RenameTable("DATA_TITLES", archiveDataTitlesTableName);
-
-                                                    Pool::Database()->Insert("ARCHIVE",
-                                                                             "date, time, datatitlestbl, stockdatatbl ",
-                                                                             {
-                                                                                 lastUpdateDate,
-                                                                                 lastUpdateTime,
-                                                                                 archiveDataTitlesTableName,
-                                                                                 archiveStockDataTableName
-                                                                             });
-                                                }
-                                            }
-                                        }
-                                    } catch (...) {
-                                    }
-
-                                    break;
-                                }
-                            } else if (rRow == 2) {
-                                string tC(cNode.second.get<std::string>("<xmlattr>.t", ""));
-                                if (tC == "s") {
-                                    string rC(cNode.second.get<std::string>("<xmlattr>.r", ""));
-                                    string v(sharedStrings[cNode.second.get<size_t>("v")]);
-
-                                    Pool::Database()->Insert("DATA_TITLES",
-                                                             "id, title",
-                                                             { rC, v });
-
-                                    tableFieldsId.push_back(rC);
-                                    createTableFields += (boost::format(" [%1%] TEXT, ") % rC).str();
-                                }
-                            } else {
-                                string tC(cNode.second.get<std::string>("<xmlattr>.t", ""));
-                                string v(tC == "s"
-                                         ? sharedStrings[cNode.second.get<size_t>("v")]
-                                         : boost::lexical_cast<string>(cNode.second.get<double>("v")));
-                                Pool::Database()->Update("STOCK_DATA",
-                                                         "r",
-                                                         boost::lexical_cast<string>(rRow),
-                                                         (boost::format("%1%=?") % tableFieldsId[col]).str(),
-                                                         { v });
-                            }
-                            ++col;
-                        }
-                    }
-                }
+                /// Archiving the previous day and the inserts / updates
+                stage = &Import;
+                Metrics::Timer importTimer(Import.Duration);
+
+                if (importer.Begin()) {
+                    importer.Import();
+
+                    importTimer.Stop();
+
+                    stage = &Commit;
+                    Metrics::Timer commitTimer(Commit.Duration);
+                    (void)commitTimer;
+
+                    importer.Commit();
 
-                Pool::Database()->DropTable("LAST_UPDATE");
-                Pool::Database()->CreateTable("LAST_UPDATE");
-                Pool::Database()->Insert("LAST_UPDATE",
-                                         "date, time",
-                                         { date, time });
+                    /// REST servers keep answering from the previous snapshot,
+                    /// or the database, if this fails
+                    importer.PublishSnapshot();
+                } else {
+                    /// Nothing was imported
+                    importTimer.Rebind(nullptr);
 
-                guard.commit();
+                    /// e.g. the first run after an upgrade, or after a
+                    /// publish that failed once the data was committed
+                    if (!importer.IsSnapshotCurrent())
+                        importer.PublishSnapshot();
+                }
             }
 
             catch (boost::exception &ex) {
+                stage->Failures->Increment();
                 LOG_ERROR(boost::diagnostic_information(ex));
             }
 
             catch (std::exception &ex) {
+                stage->Failures->Increment();
                 LOG_ERROR(ex.what());
             }
 
             catch (...) {
+                stage->Failures->Increment();
                 LOG_ERROR("StockUpdateWorker::Impl::Update(): Unknown error!");
             }
 
         } else {
+            Unzip.Failures->Increment();
             LOG_ERROR(err);
         }
     } else {
+        Download.Failures->Increment();
         LOG_ERROR(err);
     }
 
@@ -472,10 +393,36 @@ void StockUpdateWorker::Impl::Update()
         FileSystem::Erase(TEMP_FILE);
 }
 
-std::string StockUpdateWorker::Impl::GetTableNameFromDate(const std::string &id, const std::string &date)
+StockUpdateWorker::Impl::Stage::Stage(const std::string &name) :
+    Duration(Metrics::GetHistogram("stock_update_stage_duration_seconds",
+                                   "Time spent in each stage of a stock data update",
+                                   { { "stage", name } },
+                                   { 0.01, 0.05, 0.1, 0.25, 0.5, 1.0, 2.5, 5.0, 10.0, 30.0, 60.0, 120.0 })),
+    Failures(Metrics::GetCounter("stock_update_stage_failures_total",
+                                 "Stock data updates that failed in a given stage",
+                                 { { "stage", name } }))
 {
-    return  (boost::format("archive__%1%__%2%")
-             % Pool::Database()->GetTableName(id)
-             % boost::replace_all_copy(date, "/", "_")).str();
+
 }
 
+StockDataImporter::Options StockUpdateWorker::Impl::GetImporterOptions()
+{
+    StockDataImporter::Options options;
+
+    options.ArchivePath = Pool::Storage()->ArchivePath;
+#if defined ( STOCK_DATA_ARCHIVE_COMPRESSION_NONE )
+    options.Archive.Compress = false;
+#elif defined ( STOCK_DATA_ARCHIVE_COMPRESSION_BZIP2 )
+    options.Archive.CompressionAlgorithm = Compression::Algorithm::Bzip2;
+#elif defined ( STOCK_DATA_ARCHIVE_COMPRESSION_ZSTD )
+    options.Archive.CompressionAlgorithm = Compression::Algorithm::Zstd;
+#elif defined ( STOCK_DATA_ARCHIVE_COMPRESSION_LZ4 )
+    options.Archive.CompressionAlgorithm = Compression::Algorithm::Lz4;
+#else
+    options.Archive.CompressionAlgorithm = Compression::Algorithm::Gzip;
+#endif  // defined ( STOCK_DATA_ARCHIVE_COMPRESSION_NONE )
+    options.SnapshotPath = Pool::Storage()->SnapshotPath;
+    options.SnapshotsToKeep = SNAPSHOTS_TO_KEEP;
+
+    return options;
+}
@@ -0,0 +1,185 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Stateless HMAC client tokens.
+ */
+
+
+#include <chrono>
+#include <limits>
+#include <cerrno>
+#include <cstdlib>
+#include <CoreLib/Crypto.hpp>
+#include <CoreLib/make_unique.hpp>
+#include "TokenVerifier.hpp"
+
+#define     TRUNCATED_MAC_HEX_LENGTH        32
+#define     CLIENT_ID_MAX_LENGTH            64
+#define     TIMESTAMP_MAX_DIGITS            15
+
+using namespace std;
+using namespace Rest;
+
+/// Verification is lock-free: an HMAC over a token this short costs about as
+/// much as a locked cache lookup would, so nothing is remembered between calls.
+struct TokenVerifier::Impl
+{
+    std::string Key;
+    Timestamp MaxAge;
+
+    bool IsFresh(const Timestamp timestamp, const Timestamp now) const;
+    static bool ParseTimestamp(const std::string &text, Timestamp &out_timestamp);
+    static bool IsValidClientId(const std::string &clientId);
+};
+
+TokenVerifier::TokenVerifier(const Byte *key, std::size_t keyLen,
+                             const Timestamp maxAgeMilliseconds) :
+    m_pimpl(std::make_unique<TokenVerifier::Impl>())
+{
+    m_pimpl->Key.assign(reinterpret_cast<const char *>(key), keyLen);
+    m_pimpl->MaxAge = maxAgeMilliseconds;
+}
+
+TokenVerifier::~TokenVerifier()
+{
+
+}
+
+bool TokenVerifier::Sign(const std::string &clientId, const Timestamp timestamp,
+                         std::string &out_token) const
+{
+    if (!Impl::IsValidClientId(clientId))
+        return false;
+
+    std::string payload(std::to_string(timestamp) + "." + clientId);
+    std::string mac;
+
+    if (!CoreLib::Crypto::Hmac(payload, mac,
+                               reinterpret_cast<const CoreLib::Crypto::Byte *>(m_pimpl->Key.c_str()),
+                               m_pimpl->Key.size())) {
+        return false;
+    }
+
+    out_token.assign(payload + "." + mac.substr(0, TRUNCATED_MAC_HEX_LENGTH));
+
+    return true;
+}
+
+bool TokenVerifier::Verify(const std::string &token) const
+{
+    std::string::size_type timestampEnd = token.find('.');
+    if (timestampEnd == std::string::npos || timestampEnd == 0)
+        return false;
+
+    std::string::size_type clientIdEnd = token.find('.', timestampEnd + 1);
+    if (clientIdEnd == std::string::npos)
+        return false;
+
+    Timestamp timestamp;
+    if (!Impl::ParseTimestamp(token.substr(0, timestampEnd), timestamp))
+        return false;
+
+    /// Cheap rejections first, before spending any cycles on the MAC
+    if (!m_pimpl->IsFresh(timestamp, Now()))
+        return false;
+
+    if (!Impl::IsValidClientId(token.substr(timestampEnd + 1, clientIdEnd - timestampEnd - 1)))
+        return false;
+
+    std::string mac(token.substr(clientIdEnd + 1));
+    if (mac.size() != TRUNCATED_MAC_HEX_LENGTH)
+        return false;
+
+    if (!CoreLib::Crypto::HmacVerify(token.substr(0, clientIdEnd), mac,
+                                     reinterpret_cast<const CoreLib::Crypto::Byte *>(m_pimpl->Key.c_str()),
+                                     m_pimpl->Key.size())) {
+        return false;
+    }
+
+    return true;
+}
+
+TokenVerifier::Timestamp TokenVerifier::Now()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+bool TokenVerifier::Impl::IsFresh(const Timestamp timestamp, const Timestamp now) const
+{
+    /// Written without subtracting the two so that no timestamp, however far
+    /// off, can overflow
+    const Timestamp lowest = now >= std::numeric_limits<Timestamp>::min() + MaxAge
+            ? now - MaxAge : std::numeric_limits<Timestamp>::min();
+    const Timestamp highest = now <= std::numeric_limits<Timestamp>::max() - MaxAge
+            ? now + MaxAge : std::numeric_limits<Timestamp>::max();
+
+    return timestamp >= lowest && timestamp <= highest;
+}
+
+bool TokenVerifier::Impl::ParseTimestamp(const std::string &text, Timestamp &out_timestamp)
+{
+    /// Digits only: no sign, no whitespace and never more than a millisecond
+    /// timestamp needs, which keeps strtoll far away from its limits
+    if (text.empty() || text.size() > TIMESTAMP_MAX_DIGITS)
+        return false;
+
+    for (const char c : text) {
+        if (c < '0' || c > '9')
+            return false;
+    }
+
+    char *end = nullptr;
+    errno = 0;
+    const long long timestamp = std::strtoll(text.c_str(), &end, 10);
+    if (errno == ERANGE || end == nullptr || *end != '\0')
+        return false;
+
+    out_timestamp = static_cast<Timestamp>(timestamp);
+
+    return true;
+}
+
+bool TokenVerifier::Impl::IsValidClientId(const std::string &clientId)
+{
+    if (clientId.empty() || clientId.size() > CLIENT_ID_MAX_LENGTH)
+        return false;
+
+    for (const char c : clientId) {
+        if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+              || (c >= '0' && c <= '9') || c == '-' || c == '_')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
@@ -0,0 +1,79 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Stateless HMAC client tokens.
+ */
+
+
+#ifndef REST_TOKEN_VERIFIER_HPP
+#define REST_TOKEN_VERIFIER_HPP
+
+
+#include <memory>
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+#define     MAX_TOKEN_MILLISECONDS_DIFFERENCE        240000
+
+namespace Rest {
+class TokenVerifier;
+}
+
+/// A client token looks like '<milliseconds-since-epoch>.<client-id>.<mac>'
+/// where mac is the hex-encoded, truncated HMAC-SHA256 of the first two
+/// parts. Verification needs no shared state and takes no locks.
+class Rest::TokenVerifier
+{
+public:
+    typedef std::int_least64_t Timestamp;
+    typedef unsigned char Byte;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> m_pimpl;
+
+public:
+    TokenVerifier(const Byte *key, std::size_t keyLen,
+                  const Timestamp maxAgeMilliseconds);
+    ~TokenVerifier();
+
+public:
+    bool Sign(const std::string &clientId, const Timestamp timestamp,
+              std::string &out_token) const;
+    bool Verify(const std::string &token) const;
+
+    static Timestamp Now();
+};
+
+
+#endif /* REST_TOKEN_VERIFIER_HPP */
+
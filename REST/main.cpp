@@ -53,9 +53,12 @@
 #include <CoreLib/Log.hpp>
 #include <CoreLib/make_unique.hpp>
 #include <CoreLib/System.hpp>
+#include <CoreLib/Trace.hpp>
 #include "Exception.hpp"
+#include "MetricsResource.hpp"
 #include "Pool.hpp"
 #include "PublicApiResource.hpp"
+#include "StockDataImporter.hpp"
 #include "VersionInfo.hpp"
 
 void Terminate [[noreturn]] (int signo);
@@ -82,6 +85,10 @@ int main(int argc, char **argv)
         std::string appId(path.filename().string());
         std::string appPath(boost::algorithm::replace_last_copy(path.string(), appId, ""));
         Rest::Pool::Storage()->AppPath = appPath;
+        Rest::Pool::Storage()->ArchivePath = (boost::filesystem::path(appPath)
+                                              / boost::filesystem::path(STOCK_DATA_ARCHIVE_PATH)).string();
+        Rest::Pool::Storage()->SnapshotPath = (boost::filesystem::path(appPath)
+                                               / boost::filesystem::path(STOCK_DATA_SNAPSHOT_PATH)).string();
 
 
         /// Force changing the current path to executable path
@@ -93,11 +100,11 @@ int main(int argc, char **argv)
 
 
         /// Initializing log system
-        CoreLib::Log::Initialize(std::cout,
-                                 (boost::filesystem::path(appPath)
-                                  / boost::filesystem::path("..")
-                                  / boost::filesystem::path("log")).string(),
-                                 "JobApplicationSystemServer");
+        const std::string logPath((boost::filesystem::path(appPath)
+                                   / boost::filesystem::path("..")
+                                   / boost::filesystem::path("log")).string());
+        CoreLib::Log::InitializeFromDefinitions(std::cout, logPath, "JobApplicationSystemServer");
+        CoreLib::Trace::EnableFromDefinitions(logPath, "JobApplicationSystemServer-trace");
 
 
         /// Acquiring process lock
@@ -118,13 +125,20 @@ int main(int argc, char **argv)
         LOG_INFO("Version Information", "", "BUILD_COMPILER             " VERSION_INFO_BUILD_COMPILER, "BUILD_DATE                 " VERSION_INFO_BUILD_DATE, "BUILD_HOST                 " VERSION_INFO_BUILD_HOST, "BUILD_PROCESSOR            " VERSION_INFO_BUILD_PROCESSOR, "BUILD_SYSTEM               " VERSION_INFO_BUILD_SYSTEM, "PRODUCT_COMPANY_NAME       " VERSION_INFO_PRODUCT_COMPANY_NAME, "PRODUCT_COPYRIGHT          " VERSION_INFO_PRODUCT_COPYRIGHT, "PRODUCT_INTERNAL_NAME      " VERSION_INFO_PRODUCT_INTERNAL_NAME, "PRODUCT_NAME               " VERSION_INFO_PRODUCT_NAME, "PRODUCT_VERSION            " VERSION_INFO_PRODUCT_VERSION, "PRODUCT_DESCRIPTION        " VERSION_INFO_PRODUCT_DESCRIPTION);
 
 
-        if(!CoreLib::System::GetLock(lockId, lock)) {
+        bool isLocked = CoreLib::System::GetLock(lockId, lock);
+        if(!isLocked) {
             LOG_WARNING("Process is already running!");
         } else {
             LOG_INFO("Got the process lock!");
         }
 
 
+        /// One-time database maintenance, only by the process holding the lock
+        if (isLocked) {
+            Rest::Pool::PrepareDatabase();
+        }
+
+
         /// Initialize the database structure
         InitializeDatabase();
 
@@ -134,6 +148,8 @@ int main(int argc, char **argv)
         server.setServerConfiguration(argc, argv, WTHTTP_CONFIGURATION);
         Rest::PublicApiResource publicApiResource;
         server.addResource(&publicApiResource, "/StockMarket");
+        Rest::MetricsResource metricsResource;
+        server.addResource(&metricsResource, "/metrics");
         if (server.start()) {
             int sig = Wt::WServer::waitForShutdown();
             server.stop();
@@ -182,21 +198,10 @@ void Terminate(int signo)
 void InitializeDatabase()
 {
     try {
-        Rest::Pool::Database()->RegisterTable("LAST_UPDATE", "lastupdate",
-                                              " date TEXT NOT NULL, "
-                                              " time TEXT NOT NULL ");
-        Rest::Pool::Database()->RegisterTable("DATA_TITLES", "datatitles",
-                                              " id TEXT NOT NULL, "
-                                              " title TEXT NOT NULL, "
-                                              " PRIMARY KEY ( id ) ");
-        Rest::Pool::Database()->RegisterTable("STOCK_DATA", "stockdata",
-                                              " ");
-        Rest::Pool::Database()->RegisterTable("ARCHIVE", "archive",
-                                              " date TEXT NOT NULL, "
-                                              " time TEXT NOT NULL, "
-                                              " datatitlestbl TEXT NOT NULL, "
-                                              " stockdatatbl TEXT NOT NULL, "
-                                              " PRIMARY KEY ( date ) ");
+        CoreLib::Database::SessionScope sessionScope(Rest::Pool::Database());
+        (void)sessionScope;
+
+        Rest::StockDataImporter::RegisterTables(*Rest::Pool::Database());
         Rest::Pool::Database()->Initialize();
     }
 
@@ -0,0 +1,348 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A tiny HTTP server standing in for the stock data source, so the ingest
+ * and serve paths can be load tested offline. Every GET is answered with
+ * the next fixture workbook, whatever the requested path.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <CoreLib/CoreLib.hpp>
+#include <CoreLib/Exception.hpp>
+#include <CoreLib/Log.hpp>
+
+#define     UNKNOWN_ERROR                   "Unknown error!"
+
+#define     DEFAULT_ADDRESS                 "127.0.0.1"
+#define     DEFAULT_PORT                    8181
+#define     MAX_REQUEST_HEADER_BYTES        8192
+#define     WORKBOOK_FILE_EXTENSION         ".xlsx"
+#define     WORKBOOK_CONTENT_TYPE           "application/vnd.openxmlformats-officedocument.spreadsheetml.sheet"
+
+struct Options
+{
+    std::string Address;
+    unsigned short Port;
+    std::string Fixtures;
+    bool Repeat;
+};
+
+struct Fixture
+{
+    std::string Path;
+    std::string Body;
+};
+
+typedef std::vector<Fixture> Fixtures;
+
+[[ noreturn ]] void Terminate(int signo);
+
+bool ParseOptions(int argc, char **argv, Options &out_options);
+void PrintUsage(const std::string &appId);
+
+bool LoadFixtures(const Options &options, Fixtures &out_fixtures);
+void Serve(boost::asio::ip::tcp::socket &socket, const Fixture &fixture);
+void Respond(boost::asio::ip::tcp::socket &socket, const std::string &status,
+             const std::string &contentType, const std::string &body,
+             const bool withBody);
+
+int main(int argc, char **argv)
+{
+    try {
+        /// Gracefully handling SIGTERM
+        void (*prev_fn)(int);
+        prev_fn = signal(SIGTERM, Terminate);
+        if (prev_fn == SIG_IGN)
+            signal(SIGTERM, SIG_IGN);
+
+
+        /// Extract the executable path and name
+        boost::filesystem::path path(boost::filesystem::initial_path<boost::filesystem::path>());
+        if (argc > 0 && argv[0] != NULL)
+            path = boost::filesystem::system_complete(boost::filesystem::path(argv[0]));
+        std::string appId(path.filename().string());
+        std::string appPath(boost::algorithm::replace_last_copy(path.string(), appId, ""));
+
+
+        /// Options are parsed before changing directory, so relative
+        /// paths given on the command line keep their meaning
+        Options options;
+        if (!ParseOptions(argc, argv, options)) {
+            PrintUsage(appId);
+            return EXIT_FAILURE;
+        }
+
+
+        /// Force changing the current path to executable path
+        boost::filesystem::current_path(appPath);
+
+
+        /// Initializing CoreLib
+        CoreLib::CoreLibInitialize(argc, argv);
+
+
+        /// Initializing log system
+        CoreLib::Log::Initialize(std::cout,
+                                 (boost::filesystem::path(appPath)
+                                  / boost::filesystem::path("..")
+                                  / boost::filesystem::path("log")).string(),
+                                 "FixtureServer");
+
+
+        /// Fixtures are small, so they are read once and served from memory
+        Fixtures fixtures;
+        if (!LoadFixtures(options, fixtures)) {
+            return EXIT_FAILURE;
+        }
+
+
+        boost::asio::io_service service;
+        boost::asio::ip::tcp::acceptor acceptor(
+                    service,
+                    boost::asio::ip::tcp::endpoint(
+                        boost::asio::ip::address::from_string(options.Address), options.Port));
+
+        LOG_INFO("Serving fixtures", options.Address, options.Port, fixtures.size());
+
+        /// The stock update worker fetches once per interval, so one
+        /// connection at a time is plenty
+        std::size_t next = 0;
+        for (;;) {
+            boost::asio::ip::tcp::socket socket(service);
+            acceptor.accept(socket);
+
+            try {
+                const Fixture &fixture = fixtures[next % fixtures.size()];
+                Serve(socket, fixture);
+
+                if (!options.Repeat)
+                    ++next;
+            }
+
+            catch (boost::system::system_error &ex) {
+                LOG_ERROR(ex.what());
+            }
+        }
+    }
+
+    catch (CoreLib::Exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+        return EXIT_FAILURE;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void Terminate(int signo)
+{
+    std::clog << "Terminating...." << std::endl;
+    exit(signo);
+}
+
+bool ParseOptions(int argc, char **argv, Options &out_options)
+{
+    out_options.Address = DEFAULT_ADDRESS;
+    out_options.Port = DEFAULT_PORT;
+    out_options.Fixtures.clear();
+    out_options.Repeat = false;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option(argv[i]);
+
+            if (option == "--help" || option == "-h")
+                return false;
+
+            if (option == "--repeat") {
+                out_options.Repeat = true;
+                continue;
+            }
+
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for '" << option << "'" << std::endl;
+                return false;
+            }
+
+            const std::string value(argv[++i]);
+
+            if (option == "--bind") {
+                out_options.Address = value;
+            } else if (option == "--port") {
+                out_options.Port = boost::lexical_cast<unsigned short>(value);
+            } else if (option == "--fixtures") {
+                out_options.Fixtures = boost::filesystem::absolute(value).string();
+            } else {
+                std::cerr << "Unknown option '" << option << "'" << std::endl;
+                return false;
+            }
+        }
+    } catch (const boost::bad_lexical_cast &) {
+        std::cerr << "Invalid numeric value!" << std::endl;
+        return false;
+    }
+
+    if (out_options.Fixtures.empty()) {
+        std::cerr << "--fixtures is required" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void PrintUsage(const std::string &appId)
+{
+    std::cerr << "Usage: " << appId << " --fixtures PATH [options]" << std::endl
+              << "  --fixtures PATH   a workbook, or a directory of " WORKBOOK_FILE_EXTENSION
+              << " files served in name order" << std::endl
+              << "  --bind ADDR       listen address (default " DEFAULT_ADDRESS ")" << std::endl
+              << "  --port N          listen port (default " << DEFAULT_PORT << ")" << std::endl
+              << "  --repeat          always serve the first fixture instead of rotating" << std::endl
+              << std::endl
+              << "Point STOCK_DATA_SOURCE_URL at http://ADDR:N/ and generate fixtures with"
+              << " 'ingest-benchmark --fixtures DIR'." << std::endl;
+}
+
+bool LoadFixtures(const Options &options, Fixtures &out_fixtures)
+{
+    std::vector<std::string> paths;
+
+    if (boost::filesystem::is_directory(options.Fixtures)) {
+        for (boost::filesystem::directory_iterator it(options.Fixtures), end; it != end; ++it) {
+            if (boost::filesystem::is_regular_file(it->status())
+                    && boost::algorithm::iequals(it->path().extension().string(), WORKBOOK_FILE_EXTENSION)) {
+                paths.push_back(it->path().string());
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+    } else {
+        paths.push_back(options.Fixtures);
+    }
+
+    if (paths.empty()) {
+        LOG_ERROR("No fixtures found!", options.Fixtures);
+        return false;
+    }
+
+    out_fixtures.clear();
+    out_fixtures.reserve(paths.size());
+
+    for (const auto &p : paths) {
+        std::ifstream stream(p, std::ios::in | std::ios::binary);
+        if (!stream.is_open()) {
+            LOG_ERROR("Could not read the fixture!", p);
+            return false;
+        }
+
+        Fixture fixture;
+        fixture.Path = p;
+        fixture.Body.assign(std::istreambuf_iterator<char>(stream),
+                            std::istreambuf_iterator<char>());
+        out_fixtures.push_back(std::move(fixture));
+    }
+
+    return true;
+}
+
+void Serve(boost::asio::ip::tcp::socket &socket, const Fixture &fixture)
+{
+    boost::asio::streambuf request(MAX_REQUEST_HEADER_BYTES);
+    boost::system::error_code ec;
+    boost::asio::read_until(socket, request, "\r\n\r\n", ec);
+    if (ec) {
+        LOG_ERROR("Malformed request!", ec.message());
+        return;
+    }
+
+    std::istream stream(&request);
+    std::string method;
+    std::string target;
+    stream >> method >> target;
+
+    if (method == "GET" || method == "HEAD") {
+        Respond(socket, "200 OK", WORKBOOK_CONTENT_TYPE, fixture.Body, method == "GET");
+        LOG_INFO(method, target, fixture.Path);
+    } else {
+        Respond(socket, "405 Method Not Allowed", "text/plain", "", true);
+        LOG_WARNING(method, target, "not allowed");
+    }
+}
+
+void Respond(boost::asio::ip::tcp::socket &socket, const std::string &status,
+             const std::string &contentType, const std::string &body,
+             const bool withBody)
+{
+    const std::string head((boost::format("HTTP/1.1 %1%\r\n"
+                                          "Content-Type: %2%\r\n"
+                                          "Content-Length: %3%\r\n"
+                                          "Connection: close\r\n"
+                                          "\r\n")
+                            % status % contentType % body.size()).str());
+
+    std::vector<boost::asio::const_buffer> buffers;
+    buffers.push_back(boost::asio::buffer(head));
+    if (withBody)
+        buffers.push_back(boost::asio::buffer(body));
+
+    boost::asio::write(socket, buffers);
+
+    boost::system::error_code ec;
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
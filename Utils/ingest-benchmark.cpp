@@ -0,0 +1,941 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Benchmarks the stock data ingest stage by stage against a synthetic,
+ * MarketWatchPlus-style workbook, on SQLite and optionally PostgreSQL,
+ * and writes the timings as JSON for regression tracking.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <cppdb/frontend.h>
+#include <zip.h>
+#include <CoreLib/Archiver.hpp>
+#include <CoreLib/CoreLib.hpp>
+#include <CoreLib/Database.hpp>
+#include <CoreLib/Exception.hpp>
+#include <CoreLib/FileSystem.hpp>
+#include <CoreLib/Http.hpp>
+#include <CoreLib/Log.hpp>
+#include <CoreLib/Stopwatch.hpp>
+#include <REST/StockDataImporter.hpp>
+
+#define     UNKNOWN_ERROR                   "Unknown error!"
+
+#define     DEFAULT_SYMBOLS                 700
+#define     DEFAULT_COLUMNS                 23
+#define     DEFAULT_ITERATIONS              5
+#define     DEFAULT_SEED                    1395
+#define     WORKBOOK_FILE_NAME              "market-watch-plus.xlsx"
+#define     DOWNLOADED_FILE_NAME            "downloaded.xlsx"
+#define     EXTRACTION_DIR_NAME             "extracted"
+#define     SQLITE3_DATABASE_FILE_NAME      "ingest-benchmark.db"
+#define     ARCHIVE_DIR_NAME                "archive"
+#define     SNAPSHOT_DIR_NAME               "snapshots"
+#define     RESULTS_FORMAT_VERSION          2
+#define     DEFAULT_FIXTURE_COUNT           10
+#define     FIXTURE_FILE_NAME_FORMAT        "market-watch-plus-%1$04d.xlsx"
+#define     MARKET_WATCH_TITLE_FORMAT       "دیده بان بازار - 1395/07/28 %1$02d:%2$02d:%3$02d"
+#define     MARKET_WATCH_FIRST_SECOND       (12 * 3600 + 29 * 60 + 58)
+/// The trading day before the workbook's, so every iteration archives it
+#define     PREVIOUS_TRADING_DATE           "1395/07/27"
+
+#define     SPREADSHEET_NAMESPACE           "http://schemas.openxmlformats.org/spreadsheetml/2006/main"
+#define     RELATIONSHIPS_NAMESPACE         "http://schemas.openxmlformats.org/package/2006/relationships"
+#define     DOCUMENT_RELATIONSHIPS_TYPE     "http://schemas.openxmlformats.org/officeDocument/2006/relationships"
+
+struct Options
+{
+    std::size_t Symbols;
+    std::size_t Columns;
+    std::size_t Iterations;
+    unsigned int Seed;
+    std::string WorkDirectory;
+    std::string Sqlite3File;
+    std::string PgSqlParameters;
+    std::string OutputFile;
+    std::string FixtureDirectory;
+    std::size_t FixtureCount;
+};
+
+struct Workbook
+{
+    std::string Path;
+    std::size_t Bytes;
+    std::size_t SharedStrings;
+    std::size_t Cells;
+};
+
+/// One row per stage and backend; samples are in seconds
+struct Result
+{
+    std::string Backend;
+    std::string Stage;
+    std::vector<double> Samples;
+    std::size_t Errors;
+};
+
+typedef std::vector<Result> Results;
+
+[[ noreturn ]] void Terminate(int signo);
+
+bool ParseOptions(int argc, char **argv, Options &out_options);
+void PrintUsage(const std::string &appId);
+
+bool GenerateWorkbook(const Options &options, const std::string &path,
+                      const std::size_t sequence, Workbook &out_workbook);
+bool GenerateFixtures(const Options &options);
+std::string GetColumnName(std::size_t index);
+std::string EscapeXml(const std::string &text);
+
+void RunBackend(const Options &options, const Workbook &workbook,
+                const std::string &backend, const std::string &connectionString,
+                Results &out_results);
+bool RunIteration(const Options &options, const Workbook &workbook,
+                  CoreLib::Database &database,
+                  std::map<std::string, double> &out_timings, std::size_t &out_errors);
+bool Import(const Options &options, const std::string &extractionDir,
+            CoreLib::Database &database,
+            std::map<std::string, double> &out_timings, std::size_t &out_errors);
+void RewindLastUpdate(CoreLib::Database &database);
+
+void PrintResults(const Results &results);
+bool WriteResults(const Options &options, const Workbook &workbook, const Results &results);
+std::string FormatSeconds(double seconds);
+
+int main(int argc, char **argv)
+{
+    try {
+        /// Gracefully handling SIGTERM
+        void (*prev_fn)(int);
+        prev_fn = signal(SIGTERM, Terminate);
+        if (prev_fn == SIG_IGN)
+            signal(SIGTERM, SIG_IGN);
+
+
+        /// Extract the executable path and name
+        boost::filesystem::path path(boost::filesystem::initial_path<boost::filesystem::path>());
+        if (argc > 0 && argv[0] != NULL)
+            path = boost::filesystem::system_complete(boost::filesystem::path(argv[0]));
+        std::string appId(path.filename().string());
+        std::string appPath(boost::algorithm::replace_last_copy(path.string(), appId, ""));
+
+
+        /// Options are parsed before changing directory, so relative
+        /// paths given on the command line keep their meaning
+        Options options;
+        if (!ParseOptions(argc, argv, options)) {
+            PrintUsage(appId);
+            return EXIT_FAILURE;
+        }
+
+
+        /// Force changing the current path to executable path
+        boost::filesystem::current_path(appPath);
+
+
+        /// Initializing CoreLib
+        CoreLib::CoreLibInitialize(argc, argv);
+
+
+        /// Initializing log system; results go to stdout, so logs do not
+        CoreLib::Log::Initialize(std::cerr,
+                                 (boost::filesystem::path(appPath)
+                                  / boost::filesystem::path("..")
+                                  / boost::filesystem::path("log")).string(),
+                                 "IngestBenchmark");
+
+
+        /// Only write workbooks for the fixture server, no benchmark run
+        if (!options.FixtureDirectory.empty()) {
+            return GenerateFixtures(options) ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+
+        if (CoreLib::FileSystem::DirExists(options.WorkDirectory))
+            CoreLib::FileSystem::Erase(options.WorkDirectory);
+        boost::filesystem::create_directories(options.WorkDirectory);
+
+        Workbook workbook;
+        if (!GenerateWorkbook(options,
+                              (boost::filesystem::path(options.WorkDirectory)
+                               / WORKBOOK_FILE_NAME).string(),
+                              0, workbook)) {
+            return EXIT_FAILURE;
+        }
+
+        std::cout << (boost::format("Workbook: %1% symbols x %2% columns, %3% cells, "
+                                    "%4% shared strings, %5% bytes")
+                      % options.Symbols % options.Columns % workbook.Cells
+                      % workbook.SharedStrings % workbook.Bytes).str()
+                  << std::endl;
+
+        Results results;
+
+#if defined ( CORELIB_STATIC )
+#if defined ( HAS_CPPDB_SQLITE3_DRIVER )
+        if (!CoreLib::Database::IsSqlite3DriverLoaded()) {
+            CoreLib::Database::LoadSqlite3Driver();
+        }
+#endif  // defined ( HAS_CPPDB_SQLITE3_DRIVER )
+#endif  // defined ( CORELIB_STATIC )
+
+        if (CoreLib::FileSystem::FileExists(options.Sqlite3File))
+            CoreLib::FileSystem::Erase(options.Sqlite3File);
+
+        RunBackend(options, workbook, "sqlite3",
+                   (boost::format("sqlite3:db=%1%") % options.Sqlite3File).str(),
+                   results);
+
+        if (!options.PgSqlParameters.empty()) {
+#if defined ( CORELIB_STATIC )
+#if defined ( HAS_CPPDB_PGSQL_DRIVER )
+            if (!CoreLib::Database::IsPgSqlDriverLoaded()) {
+                CoreLib::Database::LoadPgSqlDriver();
+            }
+#endif  // defined ( HAS_CPPDB_PGSQL_DRIVER )
+#endif  // defined ( CORELIB_STATIC )
+
+            RunBackend(options, workbook, "pgsql",
+                       (boost::format("postgresql:%1%") % options.PgSqlParameters).str(),
+                       results);
+        }
+
+        PrintResults(results);
+
+        if (!options.OutputFile.empty()) {
+            if (!WriteResults(options, workbook, results))
+                return EXIT_FAILURE;
+        }
+
+        CoreLib::FileSystem::Erase(options.WorkDirectory);
+    }
+
+    catch (CoreLib::Exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+        return EXIT_FAILURE;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void Terminate(int signo)
+{
+    std::clog << "Terminating...." << std::endl;
+    exit(signo);
+}
+
+bool ParseOptions(int argc, char **argv, Options &out_options)
+{
+    out_options.Symbols = DEFAULT_SYMBOLS;
+    out_options.Columns = DEFAULT_COLUMNS;
+    out_options.Iterations = DEFAULT_ITERATIONS;
+    out_options.Seed = DEFAULT_SEED;
+    out_options.WorkDirectory = (boost::filesystem::temp_directory_path()
+                                 / boost::filesystem::unique_path("ingest-benchmark-%%%%-%%%%")).string();
+    out_options.Sqlite3File.clear();
+    out_options.PgSqlParameters.clear();
+    out_options.OutputFile.clear();
+    out_options.FixtureDirectory.clear();
+    out_options.FixtureCount = DEFAULT_FIXTURE_COUNT;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option(argv[i]);
+
+            if (option == "--help" || option == "-h")
+                return false;
+
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for '" << option << "'" << std::endl;
+                return false;
+            }
+
+            const std::string value(argv[++i]);
+
+            if (option == "--symbols") {
+                out_options.Symbols = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--columns") {
+                out_options.Columns = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--iterations") {
+                out_options.Iterations = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--seed") {
+                out_options.Seed = boost::lexical_cast<unsigned int>(value);
+            } else if (option == "--work-dir") {
+                out_options.WorkDirectory = boost::filesystem::absolute(value).string();
+            } else if (option == "--sqlite3") {
+                out_options.Sqlite3File = boost::filesystem::absolute(value).string();
+            } else if (option == "--pgsql") {
+                out_options.PgSqlParameters = value;
+            } else if (option == "--output") {
+                out_options.OutputFile = boost::filesystem::absolute(value).string();
+            } else if (option == "--fixtures") {
+                out_options.FixtureDirectory = boost::filesystem::absolute(value).string();
+            } else if (option == "--fixture-count") {
+                out_options.FixtureCount = boost::lexical_cast<std::size_t>(value);
+            } else {
+                std::cerr << "Unknown option '" << option << "'" << std::endl;
+                return false;
+            }
+        }
+    } catch (const boost::bad_lexical_cast &) {
+        std::cerr << "Invalid numeric value!" << std::endl;
+        return false;
+    }
+
+    /// The importer needs the symbol and name columns plus at least one value
+    if (out_options.Symbols == 0 || out_options.Columns < 3 || out_options.Iterations == 0) {
+        std::cerr << "--symbols and --iterations must be positive, --columns at least 3" << std::endl;
+        return false;
+    }
+
+    if (out_options.FixtureCount == 0) {
+        std::cerr << "--fixture-count must be positive" << std::endl;
+        return false;
+    }
+
+    if (out_options.Sqlite3File.empty()) {
+        out_options.Sqlite3File = (boost::filesystem::path(out_options.WorkDirectory)
+                                   / SQLITE3_DATABASE_FILE_NAME).string();
+    }
+
+    return true;
+}
+
+void PrintUsage(const std::string &appId)
+{
+    std::cerr << "Usage: " << appId << " [options]" << std::endl
+              << "  --symbols N       rows of the generated workbook (default "
+              << DEFAULT_SYMBOLS << ")" << std::endl
+              << "  --columns M       columns per row (default "
+              << DEFAULT_COLUMNS << ")" << std::endl
+              << "  --iterations R    runs per backend (default "
+              << DEFAULT_ITERATIONS << ")" << std::endl
+              << "  --seed S          seed of the value generator (default "
+              << DEFAULT_SEED << ")" << std::endl
+              << "  --work-dir DIR    scratch directory, erased on exit" << std::endl
+              << "  --sqlite3 FILE    SQLite database file (default inside --work-dir)" << std::endl
+              << "  --pgsql PARAMS    cppdb PostgreSQL parameters, e.g."
+              << " 'host=localhost;dbname=bench;user=bench'" << std::endl
+              << "  --output FILE     write machine-readable results as JSON" << std::endl
+              << "  --fixtures DIR    only write workbooks for fixture-server into DIR" << std::endl
+              << "  --fixture-count K number of fixture workbooks, one minute apart (default "
+              << DEFAULT_FIXTURE_COUNT << ")" << std::endl;
+}
+
+bool GenerateWorkbook(const Options &options, const std::string &path,
+                      const std::size_t sequence, Workbook &out_workbook)
+{
+    /// The header row mirrors the MarketWatchPlus export; wider sheets
+    /// repeat it with a running suffix
+    static const std::vector<std::string> TITLES {
+        "نماد", "نام", "تعداد", "حجم", "ارزش", "دیروز", "اولین",
+        "آخرین معامله - مقدار", "آخرین معامله - تغییر", "آخرین معامله - درصد",
+        "قیمت پایانی - مقدار", "قیمت پایانی - تغییر", "قیمت پایانی - درصد",
+        "کمترین", "بیشترین", "EPS", "P/E",
+        "خرید - تعداد", "خرید - حجم", "خرید - قیمت",
+        "فروش - قیمت", "فروش - حجم", "فروش - تعداد"
+    };
+    static const std::vector<std::string> SYLLABLES {
+        "فو", "لاد", "خو", "درو", "وب", "ملت", "شس", "تا", "پا", "رس",
+        "کا", "سپ", "غد", "یر", "وت", "جا", "مس", "ثا", "نو", "بر"
+    };
+    static const std::vector<std::string> SECTORS {
+        "سیمان", "پتروشیمی", "بانک", "خودرو", "فولاد", "دارویی", "بیمه",
+        "سرمایه گذاری", "معدنی", "قند"
+    };
+
+    std::vector<std::string> sharedStrings;
+    std::map<std::string, std::size_t> sharedStringIndices;
+    const auto share = [&](const std::string &text) {
+        auto it = sharedStringIndices.find(text);
+        if (it != sharedStringIndices.end())
+            return it->second;
+        sharedStrings.push_back(text);
+        sharedStringIndices[text] = sharedStrings.size() - 1;
+        return sharedStrings.size() - 1;
+    };
+
+    /// Each workbook of a sequence carries its own market time and values,
+    /// otherwise the stock update worker skips it as already imported
+    std::mt19937 random(options.Seed + static_cast<unsigned int>(sequence));
+    std::uniform_int_distribution<int> price(1000, 50000);
+    std::uniform_int_distribution<int> volume(1000, 90000000);
+    std::uniform_real_distribution<double> percent(-5.0, 5.0);
+
+    std::ostringstream sheet;
+    sheet << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+          << "<worksheet xmlns=\"" SPREADSHEET_NAMESPACE "\"><sheetData>";
+
+    const std::size_t second = (MARKET_WATCH_FIRST_SECOND + sequence * 60) % (24 * 3600);
+    sheet << "<row r=\"1\"><c r=\"A1\" t=\"s\"><v>"
+          << share((boost::format(MARKET_WATCH_TITLE_FORMAT)
+                    % (second / 3600) % (second / 60 % 60) % (second % 60)).str())
+          << "</v></c></row>";
+
+    sheet << "<row r=\"2\">";
+    for (std::size_t col = 0; col < options.Columns; ++col) {
+        std::string title(TITLES[col % TITLES.size()]);
+        if (col >= TITLES.size())
+            title += (boost::format(" %1%") % (col / TITLES.size() + 1)).str();
+        sheet << "<c r=\"" << GetColumnName(col) << "2\" t=\"s\"><v>" << share(title) << "</v></c>";
+    }
+    sheet << "</row>";
+
+    std::size_t cells = options.Columns;
+
+    for (std::size_t symbol = 0; symbol < options.Symbols; ++symbol) {
+        const std::size_t r = symbol + 3;
+
+        std::string name(SYLLABLES[symbol % SYLLABLES.size()]
+                         + SYLLABLES[(symbol / SYLLABLES.size()) % SYLLABLES.size()]);
+        if (symbol >= SYLLABLES.size() * SYLLABLES.size())
+            name += boost::lexical_cast<std::string>(symbol / (SYLLABLES.size() * SYLLABLES.size()));
+
+        sheet << "<row r=\"" << r << "\">";
+        sheet << "<c r=\"A" << r << "\" t=\"s\"><v>" << share(name) << "</v></c>";
+        sheet << "<c r=\"B" << r << "\" t=\"s\"><v>"
+              << share(SECTORS[symbol % SECTORS.size()] + " " + name) << "</v></c>";
+
+        for (std::size_t col = 2; col < options.Columns; ++col) {
+            sheet << "<c r=\"" << GetColumnName(col) << r << "\"><v>";
+            switch (col % 3) {
+            case 0:
+                sheet << price(random);
+                break;
+            case 1:
+                sheet << volume(random);
+                break;
+            default:
+                sheet << std::round(percent(random) * 100.0) / 100.0;
+                break;
+            }
+            sheet << "</v></c>";
+        }
+
+        sheet << "</row>";
+        cells += options.Columns;
+    }
+
+    sheet << "</sheetData></worksheet>";
+
+    std::ostringstream sst;
+    sst << "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+        << "<sst xmlns=\"" SPREADSHEET_NAMESPACE "\" count=\"" << sharedStrings.size()
+        << "\" uniqueCount=\"" << sharedStrings.size() << "\">";
+    for (const auto &text : sharedStrings) {
+        sst << "<si><t>" << EscapeXml(text) << "</t></si>";
+    }
+    sst << "</sst>";
+
+    /// Parts must outlive zip_close(), which is when libzip reads them
+    const std::vector<std::pair<std::string, std::string>> parts {
+        { "[Content_Types].xml",
+          "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+          "<Types xmlns=\"http://schemas.openxmlformats.org/package/2006/content-types\">"
+          "<Default Extension=\"rels\" ContentType=\"application/vnd.openxmlformats-package.relationships+xml\"/>"
+          "<Default Extension=\"xml\" ContentType=\"application/xml\"/>"
+          "<Override PartName=\"/xl/workbook.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sheet.main+xml\"/>"
+          "<Override PartName=\"/xl/worksheets/sheet1.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.worksheet+xml\"/>"
+          "<Override PartName=\"/xl/sharedStrings.xml\" ContentType=\"application/vnd.openxmlformats-officedocument.spreadsheetml.sharedStrings+xml\"/>"
+          "</Types>" },
+        { "_rels/.rels",
+          "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+          "<Relationships xmlns=\"" RELATIONSHIPS_NAMESPACE "\">"
+          "<Relationship Id=\"rId1\" Type=\"" DOCUMENT_RELATIONSHIPS_TYPE "/officeDocument\" Target=\"xl/workbook.xml\"/>"
+          "</Relationships>" },
+        { "xl/workbook.xml",
+          "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+          "<workbook xmlns=\"" SPREADSHEET_NAMESPACE "\" xmlns:r=\"" DOCUMENT_RELATIONSHIPS_TYPE "\">"
+          "<sheets><sheet name=\"MarketWatchPlus\" sheetId=\"1\" r:id=\"rId1\"/></sheets>"
+          "</workbook>" },
+        { "xl/_rels/workbook.xml.rels",
+          "<?xml version=\"1.0\" encoding=\"UTF-8\" standalone=\"yes\"?>\n"
+          "<Relationships xmlns=\"" RELATIONSHIPS_NAMESPACE "\">"
+          "<Relationship Id=\"rId1\" Type=\"" DOCUMENT_RELATIONSHIPS_TYPE "/worksheet\" Target=\"worksheets/sheet1.xml\"/>"
+          "<Relationship Id=\"rId2\" Type=\"" DOCUMENT_RELATIONSHIPS_TYPE "/sharedStrings\" Target=\"sharedStrings.xml\"/>"
+          "</Relationships>" },
+        { "xl/sharedStrings.xml", sst.str() },
+        { "xl/worksheets/sheet1.xml", sheet.str() }
+    };
+
+    out_workbook.Path = path;
+
+    int err;
+    struct zip *za = zip_open(out_workbook.Path.c_str(), ZIP_CREATE | ZIP_EXCL, &err);
+    if (za == NULL) {
+        char buf[100];
+        zip_error_to_str(buf, sizeof(buf), err, errno);
+        LOG_ERROR("Could not create the workbook!", out_workbook.Path, buf);
+        return false;
+    }
+
+    for (const auto &part : parts) {
+        struct zip_source *source = zip_source_buffer(za, part.second.data(), part.second.size(), 0);
+        if (source == NULL || zip_file_add(za, part.first.c_str(), source, ZIP_FL_OVERWRITE) < 0) {
+            if (source != NULL)
+                zip_source_free(source);
+            LOG_ERROR("Could not add a part to the workbook!", part.first, zip_strerror(za));
+            zip_discard(za);
+            return false;
+        }
+    }
+
+    if (zip_close(za) == -1) {
+        LOG_ERROR("Could not write the workbook!", out_workbook.Path, zip_strerror(za));
+        zip_discard(za);
+        return false;
+    }
+
+    out_workbook.Bytes = static_cast<std::size_t>(boost::filesystem::file_size(out_workbook.Path));
+    out_workbook.SharedStrings = sharedStrings.size();
+    out_workbook.Cells = cells;
+
+    return true;
+}
+
+bool GenerateFixtures(const Options &options)
+{
+    boost::filesystem::create_directories(options.FixtureDirectory);
+
+    for (std::size_t i = 0; i < options.FixtureCount; ++i) {
+        const std::string path((boost::filesystem::path(options.FixtureDirectory)
+                                / (boost::format(FIXTURE_FILE_NAME_FORMAT) % (i + 1)).str()).string());
+
+        if (CoreLib::FileSystem::FileExists(path))
+            CoreLib::FileSystem::Erase(path);
+
+        Workbook workbook;
+        if (!GenerateWorkbook(options, path, i, workbook))
+            return false;
+
+        std::cout << workbook.Path << " (" << workbook.Bytes << " bytes)" << std::endl;
+    }
+
+    return true;
+}
+
+std::string GetColumnName(std::size_t index)
+{
+    std::string name;
+
+    for (++index; index > 0; index = (index - 1) / 26) {
+        name.insert(name.begin(), static_cast<char>('A' + (index - 1) % 26));
+    }
+
+    return name;
+}
+
+std::string EscapeXml(const std::string &text)
+{
+    std::string escaped;
+    escaped.reserve(text.size());
+
+    for (const char c : text) {
+        switch (c) {
+        case '&':
+            escaped += "&amp;";
+            break;
+        case '<':
+            escaped += "&lt;";
+            break;
+        case '>':
+            escaped += "&gt;";
+            break;
+        default:
+            escaped += c;
+            break;
+        }
+    }
+
+    return escaped;
+}
+
+void RunBackend(const Options &options, const Workbook &workbook,
+                const std::string &backend, const std::string &connectionString,
+                Results &out_results)
+{
+    static const std::vector<std::string> STAGES {
+        "download", "unzip", "parse.shared_strings", "parse.sheet", "archive", "import", "commit",
+        "snapshot", "total"
+    };
+
+    std::cout << "Running " << backend << "..." << std::endl;
+
+    std::map<std::string, Result> results;
+    for (const auto &stage : STAGES) {
+        Result &result = results[stage];
+        result.Backend = backend;
+        result.Stage = stage;
+        result.Errors = 0;
+    }
+
+    try {
+        CoreLib::Database database(connectionString);
+
+        /// Same tables and shapes as the REST back-end uses
+        Rest::StockDataImporter::RegisterTables(database, "bench_");
+        /// The importer sets the real columns; this only lets Initialize()
+        /// create a valid table
+        database.SetTableFields("STOCK_DATA", " r INTEGER NOT NULL, PRIMARY KEY ( r ) ");
+
+        CoreLib::Database::SessionScope sessionScope(&database);
+        (void)sessionScope;
+
+        if (!database.Initialize()) {
+            LOG_ERROR("Could not initialize the benchmark database!", backend);
+            return;
+        }
+
+        /// Untimed, so the first iteration has a previous day to archive
+        std::map<std::string, double> warmUpTimings;
+        std::size_t warmUpErrors = 0;
+        RunIteration(options, workbook, database, warmUpTimings, warmUpErrors);
+
+        for (std::size_t i = 0; i < options.Iterations; ++i) {
+            std::map<std::string, double> timings;
+            std::size_t errors = 0;
+
+            RewindLastUpdate(database);
+
+            bool isSucceeded = RunIteration(options, workbook, database, timings, errors);
+
+            for (const auto &timing : timings) {
+                results[timing.first].Samples.push_back(timing.second);
+            }
+
+            results["import"].Errors += errors;
+            if (!isSucceeded)
+                ++results["total"].Errors;
+        }
+
+        database.DropTable("ARCHIVE");
+        database.DropTable("LAST_UPDATE");
+        database.DropTable("STOCK_DATA");
+        database.DropTable("DATA_TITLES");
+    }
+
+    catch (const std::exception &ex) {
+        LOG_ERROR(backend, ex.what());
+    }
+
+    catch (...) {
+        LOG_ERROR(backend, UNKNOWN_ERROR);
+    }
+
+    for (const auto &stage : STAGES) {
+        out_results.push_back(results[stage]);
+    }
+}
+
+/// Follows StockUpdateWorker::Impl::Update() stage by stage: fetch the
+/// workbook (from a file:// URL, to leave the network out), extract it,
+/// then hand it to the same StockDataImporter the worker uses
+bool RunIteration(const Options &options, const Workbook &workbook,
+                  CoreLib::Database &database,
+                  std::map<std::string, double> &out_timings, std::size_t &out_errors)
+{
+    typedef CoreLib::Stopwatch<std::chrono::steady_clock> Stopwatch;
+
+    const std::string downloadedFile((boost::filesystem::path(options.WorkDirectory)
+                                      / DOWNLOADED_FILE_NAME).string());
+    const std::string extractionDir((boost::filesystem::path(options.WorkDirectory)
+                                     / EXTRACTION_DIR_NAME).string());
+
+    if (CoreLib::FileSystem::FileExists(downloadedFile))
+        CoreLib::FileSystem::Erase(downloadedFile);
+    if (CoreLib::FileSystem::DirExists(extractionDir))
+        CoreLib::FileSystem::Erase(extractionDir);
+
+    std::string err;
+    Stopwatch total;
+    Stopwatch stage;
+
+    if (!CoreLib::Http::Download("file://" + workbook.Path, downloadedFile, err)) {
+        LOG_ERROR(err);
+        return false;
+    }
+    out_timings["download"] = stage.Stop() / 1000000.0;
+
+    stage.Start();
+    /// Extracts what the stock update worker extracts
+    CoreLib::Archiver::UnZipOptions unzipOptions;
+    unzipOptions.Threads = 0;
+    unzipOptions.Filter = [](const std::string &entry) {
+        return entry == "xl/sharedStrings.xml" || entry == "xl/worksheets/sheet1.xml";
+    };
+    CoreLib::Archiver::ExtractionStats unzipStats;
+    if (!CoreLib::Archiver::UnZip(downloadedFile, extractionDir, unzipOptions, unzipStats, err)) {
+        LOG_ERROR(err);
+        return false;
+    }
+    out_timings["unzip"] = stage.Stop() / 1000000.0;
+
+    if (!Import(options, extractionDir, database, out_timings, out_errors))
+        return false;
+
+    out_timings["total"] = total.Stop() / 1000000.0;
+
+    return true;
+}
+
+bool Import(const Options &options, const std::string &extractionDir,
+            CoreLib::Database &database,
+            std::map<std::string, double> &out_timings, std::size_t &out_errors)
+{
+    typedef CoreLib::Stopwatch<std::chrono::steady_clock> Stopwatch;
+
+    Rest::StockDataImporter::Options importerOptions;
+    importerOptions.ArchivePath = (boost::filesystem::path(options.WorkDirectory)
+                                   / ARCHIVE_DIR_NAME).string();
+    importerOptions.SnapshotPath = (boost::filesystem::path(options.WorkDirectory)
+                                    / SNAPSHOT_DIR_NAME).string();
+
+    try {
+        Rest::StockDataImporter importer(database, importerOptions);
+        Stopwatch stage;
+
+        importer.ReadSharedStrings((boost::filesystem::path(extractionDir)
+                                    / "xl" / "sharedStrings.xml").string());
+        out_timings["parse.shared_strings"] = stage.Stop() / 1000000.0;
+
+        stage.Start();
+        importer.ReadSheet((boost::filesystem::path(extractionDir)
+                            / "xl" / "worksheets" / "sheet1.xml").string());
+        out_timings["parse.sheet"] = stage.Stop() / 1000000.0;
+
+        /// Covers reading LAST_UPDATE and archiving the previous day
+        stage.Start();
+        if (!importer.Begin()) {
+            LOG_ERROR("The workbook was already imported!", importer.GetDate(), importer.GetTime());
+            return false;
+        }
+        out_timings["archive"] = stage.Stop() / 1000000.0;
+
+        stage.Start();
+        importer.Import();
+        out_timings["import"] = stage.Stop() / 1000000.0;
+
+        stage.Start();
+        importer.Commit();
+        out_timings["commit"] = stage.Stop() / 1000000.0;
+
+        stage.Start();
+        if (!importer.PublishSnapshot())
+            ++out_errors;
+        out_timings["snapshot"] = stage.Stop() / 1000000.0;
+
+        out_errors += importer.GetFailedStatements();
+    }
+
+    catch (const boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+        return false;
+    }
+
+    catch (const std::exception &ex) {
+        LOG_ERROR(ex.what());
+        return false;
+    }
+
+    return true;
+}
+
+/// Makes the data already in the tables look like the previous trading day
+/// and forgets its archive, so the next import archives it again
+void RewindLastUpdate(CoreLib::Database &database)
+{
+    cppdb::transaction guard(database.Sql());
+
+    database.DropTable("ARCHIVE");
+    database.CreateTable("ARCHIVE");
+
+    std::string time;
+    cppdb::result r = database.Sql()
+            << (boost::format("SELECT time FROM %1%;")
+                % database.GetTableName("LAST_UPDATE")).str()
+            << cppdb::row;
+    if (!r.empty())
+        r >> time;
+
+    database.DropTable("LAST_UPDATE");
+    database.CreateTable("LAST_UPDATE");
+    database.Insert("LAST_UPDATE", "date, time", { PREVIOUS_TRADING_DATE, time });
+
+    guard.commit();
+}
+
+void PrintResults(const Results &results)
+{
+    std::cout << std::endl
+              << (boost::format("%-10s %-22s %12s %12s %12s %12s %8s")
+                  % "backend" % "stage" % "min" % "median" % "mean" % "max" % "errors").str()
+              << std::endl;
+
+    for (const auto &result : results) {
+        std::vector<double> samples(result.Samples);
+        std::sort(samples.begin(), samples.end());
+
+        if (samples.empty()) {
+            std::cout << (boost::format("%-10s %-22s %12s %12s %12s %12s %8d")
+                          % result.Backend % result.Stage % "-" % "-" % "-" % "-"
+                          % result.Errors).str()
+                      << std::endl;
+            continue;
+        }
+
+        double sum = 0.0;
+        for (const double sample : samples)
+            sum += sample;
+
+        std::cout << (boost::format("%-10s %-22s %12s %12s %12s %12s %8d")
+                      % result.Backend % result.Stage
+                      % FormatSeconds(samples.front())
+                      % FormatSeconds(samples[samples.size() / 2])
+                      % FormatSeconds(sum / samples.size())
+                      % FormatSeconds(samples.back())
+                      % result.Errors).str()
+                  << std::endl;
+    }
+}
+
+/// Raw samples are kept next to the summary, so a regression check can
+/// apply whatever statistic it prefers
+bool WriteResults(const Options &options, const Workbook &workbook, const Results &results)
+{
+    std::ostringstream json;
+    json.imbue(std::locale::classic());
+    json.precision(9);
+
+    json << "{\n"
+         << "  \"version\": " << RESULTS_FORMAT_VERSION << ",\n"
+         << "  \"timestamp\": \""
+         << boost::posix_time::to_iso_extended_string(boost::posix_time::second_clock::universal_time())
+         << "Z\",\n"
+         << "  \"parameters\": {\n"
+         << "    \"symbols\": " << options.Symbols << ",\n"
+         << "    \"columns\": " << options.Columns << ",\n"
+         << "    \"iterations\": " << options.Iterations << ",\n"
+         << "    \"seed\": " << options.Seed << ",\n"
+         << "    \"workbookBytes\": " << workbook.Bytes << ",\n"
+         << "    \"sharedStrings\": " << workbook.SharedStrings << ",\n"
+         << "    \"cells\": " << workbook.Cells << "\n"
+         << "  },\n"
+         << "  \"unit\": \"seconds\",\n"
+         << "  \"results\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+
+        std::vector<double> sorted(result.Samples);
+        std::sort(sorted.begin(), sorted.end());
+        double sum = 0.0;
+        for (const double sample : sorted)
+            sum += sample;
+
+        json << (i == 0 ? "\n" : ",\n")
+             << "    { \"backend\": \"" << result.Backend << "\""
+             << ", \"stage\": \"" << result.Stage << "\""
+             << ", \"errors\": " << result.Errors;
+
+        if (!sorted.empty()) {
+            json << ", \"min\": " << sorted.front()
+                 << ", \"median\": " << sorted[sorted.size() / 2]
+                 << ", \"mean\": " << sum / sorted.size()
+                 << ", \"max\": " << sorted.back();
+        }
+
+        json << ", \"samples\": [";
+        for (std::size_t j = 0; j < result.Samples.size(); ++j) {
+            json << (j == 0 ? "" : ", ") << result.Samples[j];
+        }
+        json << "] }";
+    }
+
+    json << "\n  ]\n}\n";
+
+    try {
+        std::ofstream file(options.OutputFile, std::ios::out | std::ios::trunc);
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        file << json.str();
+        file.close();
+    } catch (const std::exception &ex) {
+        LOG_ERROR("Could not write the results!", options.OutputFile, ex.what());
+        return false;
+    }
+
+    std::cout << std::endl << "Results written to " << options.OutputFile << std::endl;
+
+    return true;
+}
+
+std::string FormatSeconds(double seconds)
+{
+    if (seconds < 0.001)
+        return (boost::format("%.1fus") % (seconds * 1000000.0)).str();
+    if (seconds < 1.0)
+        return (boost::format("%.2fms") % (seconds * 1000.0)).str();
+    return (boost::format("%.3fs") % seconds).str();
+}
+
@@ -0,0 +1,764 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * Drives the public REST endpoints at a configurable concurrency with
+ * valid client tokens and reports latency percentiles and throughput.
+ */
+
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <locale>
+#include <map>
+#include <random>
+#include <sstream>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#include <boost/algorithm/string.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <curlpp/cURLpp.hpp>
+#include <curlpp/Easy.hpp>
+#include <curlpp/Exception.hpp>
+#include <curlpp/Infos.hpp>
+#include <curlpp/Options.hpp>
+#include <CoreLib/CoreLib.hpp>
+#include <CoreLib/Crypto.hpp>
+#include <CoreLib/Exception.hpp>
+#include <CoreLib/Log.hpp>
+#include <CoreLib/Stopwatch.hpp>
+#include <REST/TokenVerifier.hpp>
+
+#define     UNKNOWN_ERROR                   "Unknown error!"
+
+#define     DEFAULT_URL                     "http://127.0.0.1:8080/StockMarket"
+#define     DEFAULT_CONCURRENCY             8
+#define     DEFAULT_DURATION_SECONDS        30
+#define     DEFAULT_WARMUP_SECONDS          5
+#define     DEFAULT_TIMEOUT_SECONDS         30
+#define     DEFAULT_MIX                     "latest=8,date=1,token=1"
+#define     DEFAULT_FORMAT                  "JSON"
+#define     DEFAULT_DATE                    "1395-07-28"
+#define     DEFAULT_CLIENT_ID               "loadtest"
+#define     DEFAULT_TOKEN_LIFETIME_SECONDS  60
+#define     DEFAULT_SEED                    1395
+#define     RESPONSE_PREFIX_BYTES           256
+#define     INVALID_TOKEN_MARKER            "INVALID_TOKEN"
+#define     RESULTS_FORMAT_VERSION          1
+
+struct Route
+{
+    std::string Name;
+    std::string Path;
+    bool NeedsToken;
+    unsigned int Weight;
+};
+
+typedef std::vector<Route> Routes;
+
+struct Options
+{
+    std::string Url;
+    std::size_t Concurrency;
+    std::size_t DurationSeconds;
+    std::size_t WarmupSeconds;
+    std::size_t TimeoutSeconds;
+    std::string Mix;
+    std::string Format;
+    std::string Date;
+    std::string ClientId;
+    bool LegacyTokens;
+    std::size_t TokenLifetimeSeconds;
+    unsigned int Seed;
+    std::string OutputFile;
+};
+
+/// Per route counters; each worker owns one set, merged after the run
+struct Result
+{
+    std::vector<double> Latencies;
+    std::size_t Requests;
+    std::size_t Failures;
+    std::size_t Rejections;
+    std::size_t Bytes;
+    std::map<long, std::size_t> Statuses;
+
+    Result();
+    void Merge(const Result &other);
+};
+
+typedef std::vector<Result> Results;
+
+/// Counts the response bytes and keeps only the head of the body, which is
+/// enough to spot an error document without buffering whole data sets
+class ResponseSink : public std::streambuf
+{
+private:
+    std::size_t m_bytes;
+    std::string m_prefix;
+
+public:
+    ResponseSink();
+
+public:
+    void Reset();
+    std::size_t Bytes() const;
+    const std::string &Prefix() const;
+
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char *s, std::streamsize n) override;
+};
+
+[[ noreturn ]] void Terminate(int signo);
+
+bool ParseOptions(int argc, char **argv, Options &out_options);
+bool ParseMix(const Options &options, Routes &out_routes);
+void PrintUsage(const std::string &appId);
+
+bool MintToken(const Options &options, CoreLib::Crypto &legacySigner,
+               std::string &out_token);
+
+void RunWorker(const Options &options, const Routes &routes, const std::size_t index,
+               const std::chrono::steady_clock::time_point measureFrom,
+               const std::atomic<bool> &stop, Results &out_results);
+
+double Percentile(const std::vector<double> &sorted, const double p);
+void PrintResults(const Options &options, const Routes &routes, const Results &results);
+bool WriteResults(const Options &options, const Routes &routes, const Results &results);
+std::string FormatSeconds(double seconds);
+
+int main(int argc, char **argv)
+{
+    try {
+        /// Gracefully handling SIGTERM
+        void (*prev_fn)(int);
+        prev_fn = signal(SIGTERM, Terminate);
+        if (prev_fn == SIG_IGN)
+            signal(SIGTERM, SIG_IGN);
+
+
+        /// Extract the executable path and name
+        boost::filesystem::path path(boost::filesystem::initial_path<boost::filesystem::path>());
+        if (argc > 0 && argv[0] != NULL)
+            path = boost::filesystem::system_complete(boost::filesystem::path(argv[0]));
+        std::string appId(path.filename().string());
+        std::string appPath(boost::algorithm::replace_last_copy(path.string(), appId, ""));
+
+
+        /// Options are parsed before changing directory, so relative
+        /// paths given on the command line keep their meaning
+        Options options;
+        Routes routes;
+        if (!ParseOptions(argc, argv, options) || !ParseMix(options, routes)) {
+            PrintUsage(appId);
+            return EXIT_FAILURE;
+        }
+
+
+        /// Force changing the current path to executable path
+        boost::filesystem::current_path(appPath);
+
+
+        /// Initializing CoreLib
+        CoreLib::CoreLibInitialize(argc, argv);
+
+
+        /// Initializing log system; results go to stdout, so logs do not
+        CoreLib::Log::Initialize(std::cerr,
+                                 (boost::filesystem::path(appPath)
+                                  / boost::filesystem::path("..")
+                                  / boost::filesystem::path("log")).string(),
+                                 "RestLoadTest");
+
+
+        curlpp::Cleanup cleanup;
+        (void)cleanup;
+
+        std::cout << (boost::format("Target: %1%, %2% workers, %3%s warm-up, %4%s measured, %5% tokens")
+                      % options.Url % options.Concurrency % options.WarmupSeconds
+                      % options.DurationSeconds % (options.LegacyTokens ? "legacy" : "HMAC")).str()
+                  << std::endl;
+
+        const std::chrono::steady_clock::time_point measureFrom =
+                std::chrono::steady_clock::now() + std::chrono::seconds(options.WarmupSeconds);
+
+        std::atomic<bool> stop(false);
+        std::vector<Results> workerResults(options.Concurrency, Results(routes.size()));
+        std::vector<std::thread> workers;
+
+        for (std::size_t i = 0; i < options.Concurrency; ++i) {
+            workers.emplace_back(&RunWorker, std::cref(options), std::cref(routes), i,
+                                 measureFrom, std::cref(stop), std::ref(workerResults[i]));
+        }
+
+        std::this_thread::sleep_until(measureFrom + std::chrono::seconds(options.DurationSeconds));
+        stop.store(true);
+
+        for (auto &worker : workers) {
+            worker.join();
+        }
+
+        Results results(routes.size());
+        for (const auto &worker : workerResults) {
+            for (std::size_t r = 0; r < routes.size(); ++r) {
+                results[r].Merge(worker[r]);
+            }
+        }
+
+        PrintResults(options, routes, results);
+
+        if (!options.OutputFile.empty()) {
+            if (!WriteResults(options, routes, results))
+                return EXIT_FAILURE;
+        }
+    }
+
+    catch (CoreLib::Exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+        return EXIT_FAILURE;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+Result::Result() :
+    Requests(0),
+    Failures(0),
+    Rejections(0),
+    Bytes(0)
+{
+
+}
+
+void Result::Merge(const Result &other)
+{
+    Latencies.insert(Latencies.end(), other.Latencies.begin(), other.Latencies.end());
+    Requests += other.Requests;
+    Failures += other.Failures;
+    Rejections += other.Rejections;
+    Bytes += other.Bytes;
+
+    for (const auto &status : other.Statuses) {
+        Statuses[status.first] += status.second;
+    }
+}
+
+ResponseSink::ResponseSink() :
+    m_bytes(0)
+{
+
+}
+
+void ResponseSink::Reset()
+{
+    m_bytes = 0;
+    m_prefix.clear();
+}
+
+std::size_t ResponseSink::Bytes() const
+{
+    return m_bytes;
+}
+
+const std::string &ResponseSink::Prefix() const
+{
+    return m_prefix;
+}
+
+ResponseSink::int_type ResponseSink::overflow(int_type c)
+{
+    if (traits_type::eq_int_type(c, traits_type::eof()))
+        return traits_type::not_eof(c);
+
+    const char ch = traits_type::to_char_type(c);
+    xsputn(&ch, 1);
+
+    return c;
+}
+
+std::streamsize ResponseSink::xsputn(const char *s, std::streamsize n)
+{
+    if (m_prefix.size() < RESPONSE_PREFIX_BYTES) {
+        m_prefix.append(s, std::min(static_cast<std::size_t>(n),
+                                    RESPONSE_PREFIX_BYTES - m_prefix.size()));
+    }
+
+    m_bytes += static_cast<std::size_t>(n);
+
+    return n;
+}
+
+void Terminate(int signo)
+{
+    std::clog << "Terminating...." << std::endl;
+    exit(signo);
+}
+
+bool ParseOptions(int argc, char **argv, Options &out_options)
+{
+    out_options.Url = DEFAULT_URL;
+    out_options.Concurrency = DEFAULT_CONCURRENCY;
+    out_options.DurationSeconds = DEFAULT_DURATION_SECONDS;
+    out_options.WarmupSeconds = DEFAULT_WARMUP_SECONDS;
+    out_options.TimeoutSeconds = DEFAULT_TIMEOUT_SECONDS;
+    out_options.Mix = DEFAULT_MIX;
+    out_options.Format = DEFAULT_FORMAT;
+    out_options.Date = DEFAULT_DATE;
+    out_options.ClientId = DEFAULT_CLIENT_ID;
+    out_options.LegacyTokens = false;
+    out_options.TokenLifetimeSeconds = DEFAULT_TOKEN_LIFETIME_SECONDS;
+    out_options.Seed = DEFAULT_SEED;
+    out_options.OutputFile.clear();
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option(argv[i]);
+
+            if (option == "--help" || option == "-h")
+                return false;
+
+            if (option == "--legacy-tokens") {
+                out_options.LegacyTokens = true;
+                continue;
+            }
+
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for '" << option << "'" << std::endl;
+                return false;
+            }
+
+            const std::string value(argv[++i]);
+
+            if (option == "--url") {
+                out_options.Url = boost::algorithm::trim_right_copy_if(value, boost::is_any_of("/"));
+            } else if (option == "--concurrency") {
+                out_options.Concurrency = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--duration") {
+                out_options.DurationSeconds = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--warmup") {
+                out_options.WarmupSeconds = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--timeout") {
+                out_options.TimeoutSeconds = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--mix") {
+                out_options.Mix = value;
+            } else if (option == "--format") {
+                out_options.Format = boost::algorithm::to_upper_copy(value);
+            } else if (option == "--date") {
+                out_options.Date = value;
+            } else if (option == "--client-id") {
+                out_options.ClientId = value;
+            } else if (option == "--token-lifetime") {
+                out_options.TokenLifetimeSeconds = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--seed") {
+                out_options.Seed = boost::lexical_cast<unsigned int>(value);
+            } else if (option == "--output") {
+                out_options.OutputFile = boost::filesystem::absolute(value).string();
+            } else {
+                std::cerr << "Unknown option '" << option << "'" << std::endl;
+                return false;
+            }
+        }
+    } catch (const boost::bad_lexical_cast &) {
+        std::cerr << "Invalid numeric value!" << std::endl;
+        return false;
+    }
+
+    if (out_options.Concurrency == 0 || out_options.DurationSeconds == 0
+            || out_options.TimeoutSeconds == 0) {
+        std::cerr << "--concurrency, --duration and --timeout must be positive" << std::endl;
+        return false;
+    }
+
+    if (out_options.Format != "JSON" && out_options.Format != "XML"
+            && out_options.Format != "CSV" && out_options.Format != "NDJSON") {
+        std::cerr << "--format must be one of JSON, XML, CSV or NDJSON" << std::endl;
+        return false;
+    }
+
+    /// Tokens older than this are refused by the server
+    if (out_options.TokenLifetimeSeconds * 1000 >= MAX_TOKEN_MILLISECONDS_DIFFERENCE) {
+        std::cerr << "--token-lifetime must be below "
+                  << MAX_TOKEN_MILLISECONDS_DIFFERENCE / 1000 << " seconds" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool ParseMix(const Options &options, Routes &out_routes)
+{
+    /// The token route only speaks JSON and XML
+    const std::string tokenFormat(options.Format == "XML" ? "XML" : "JSON");
+
+    out_routes.clear();
+
+    std::vector<std::string> entries;
+    boost::split(entries, options.Mix, boost::is_any_of(","), boost::token_compress_on);
+
+    for (const auto &entry : entries) {
+        std::vector<std::string> pair;
+        boost::split(pair, entry, boost::is_any_of("="));
+
+        Route route;
+        route.Name = boost::algorithm::trim_copy(pair[0]);
+
+        try {
+            route.Weight = pair.size() == 2 ? boost::lexical_cast<unsigned int>(pair[1]) : 1;
+        } catch (const boost::bad_lexical_cast &) {
+            std::cerr << "Invalid weight in --mix: '" << entry << "'" << std::endl;
+            return false;
+        }
+
+        if (route.Name == "latest") {
+            route.Path = "/LatestData/" + options.Format + "/";
+            route.NeedsToken = true;
+        } else if (route.Name == "date") {
+            route.Path = "/DataByDate/" + options.Format + "/" + options.Date + "/";
+            route.NeedsToken = true;
+        } else if (route.Name == "token") {
+            route.Path = "/Token/" + tokenFormat;
+            route.NeedsToken = false;
+        } else {
+            std::cerr << "Unknown route in --mix: '" << route.Name << "'" << std::endl;
+            return false;
+        }
+
+        if (route.Weight > 0)
+            out_routes.push_back(route);
+    }
+
+    if (out_routes.empty()) {
+        std::cerr << "--mix selects no route" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void PrintUsage(const std::string &appId)
+{
+    std::cerr << "Usage: " << appId << " [options]" << std::endl
+              << "  --url URL           base of the public API (default " DEFAULT_URL ")" << std::endl
+              << "  --concurrency N     parallel keep-alive connections (default "
+              << DEFAULT_CONCURRENCY << ")" << std::endl
+              << "  --duration S        measured seconds (default "
+              << DEFAULT_DURATION_SECONDS << ")" << std::endl
+              << "  --warmup S          unmeasured seconds before that (default "
+              << DEFAULT_WARMUP_SECONDS << ")" << std::endl
+              << "  --timeout S         per request timeout (default "
+              << DEFAULT_TIMEOUT_SECONDS << ")" << std::endl
+              << "  --mix SPEC          weighted routes out of latest, date and token"
+              << " (default " DEFAULT_MIX ")" << std::endl
+              << "  --format F          JSON, XML, CSV or NDJSON (default " DEFAULT_FORMAT ")" << std::endl
+              << "  --date D            date of the DataByDate route (default " DEFAULT_DATE ")" << std::endl
+              << "  --client-id ID      client id signed into HMAC tokens (default "
+                 DEFAULT_CLIENT_ID ")" << std::endl
+              << "  --legacy-tokens     mint encrypted-timestamp tokens instead of HMAC ones" << std::endl
+              << "  --token-lifetime S  seconds a worker reuses a token (default "
+              << DEFAULT_TOKEN_LIFETIME_SECONDS << ")" << std::endl
+              << "  --seed S            seed of the route picker (default "
+              << DEFAULT_SEED << ")" << std::endl
+              << "  --output FILE       write machine-readable results as JSON" << std::endl;
+}
+
+/// Tokens are minted with the keys the REST service is built with
+bool MintToken(const Options &options, CoreLib::Crypto &legacySigner,
+               std::string &out_token)
+{
+    if (options.LegacyTokens) {
+        const Rest::TokenVerifier::Timestamp now = Rest::TokenVerifier::Now();
+        return legacySigner.Encrypt(boost::lexical_cast<std::string>(now), out_token);
+    }
+
+    static const std::string KEY = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_HMAC_KEY);
+    static const Rest::TokenVerifier SIGNER(reinterpret_cast<const Rest::TokenVerifier::Byte *>(KEY.c_str()),
+                                            KEY.size(), MAX_TOKEN_MILLISECONDS_DIFFERENCE);
+
+    return SIGNER.Sign(options.ClientId, Rest::TokenVerifier::Now(), out_token);
+}
+
+void RunWorker(const Options &options, const Routes &routes, const std::size_t index,
+               const std::chrono::steady_clock::time_point measureFrom,
+               const std::atomic<bool> &stop, Results &out_results)
+{
+    static const std::string KEY = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_KEY);
+    static const std::string IV = CoreLib::Crypto::HexStringToString(CLIENT_TOKEN_CRYPTO_IV);
+
+    CoreLib::Crypto legacySigner(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
+                                 reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
+
+    std::vector<unsigned int> weights;
+    for (const auto &route : routes) {
+        weights.push_back(route.Weight);
+    }
+
+    std::mt19937 random(options.Seed + static_cast<unsigned int>(index));
+    std::discrete_distribution<std::size_t> pick(weights.begin(), weights.end());
+
+    ResponseSink sink;
+    std::ostream sinkStream(&sink);
+
+    /// One handle per worker, so libcurl keeps its connection alive
+    /// between requests the way a real client would
+    curlpp::Easy request;
+    request.setOpt<curlpp::options::WriteStream>(&sinkStream);
+    request.setOpt<curlpp::options::NoSignal>(true);
+    request.setOpt<curlpp::options::Timeout>(static_cast<long>(options.TimeoutSeconds));
+
+    std::string token;
+    std::chrono::steady_clock::time_point tokenMintedAt;
+
+    while (!stop.load(std::memory_order_relaxed)) {
+        const std::size_t r = pick(random);
+        const Route &route = routes[r];
+
+        std::string url(options.Url + route.Path);
+
+        if (route.NeedsToken) {
+            if (token.empty()
+                    || std::chrono::steady_clock::now() - tokenMintedAt
+                    >= std::chrono::seconds(options.TokenLifetimeSeconds)) {
+                if (!MintToken(options, legacySigner, token)) {
+                    LOG_ERROR("Could not mint a client token!", options.ClientId);
+                    return;
+                }
+                tokenMintedAt = std::chrono::steady_clock::now();
+            }
+            url += token;
+        }
+
+        request.setOpt<curlpp::options::Url>(url);
+        sink.Reset();
+
+        const bool measured = std::chrono::steady_clock::now() >= measureFrom;
+        long status = 0;
+        bool failed = false;
+
+        CoreLib::Stopwatch<std::chrono::steady_clock, std::chrono::nanoseconds> stopwatch;
+
+        try {
+            request.perform();
+            status = curlpp::infos::ResponseCode::get(request);
+        }
+
+        catch (const curlpp::RuntimeError &ex) {
+            failed = true;
+            if (measured)
+                LOG_ERROR(url, ex.what());
+        }
+
+        catch (const curlpp::LogicError &ex) {
+            failed = true;
+            if (measured)
+                LOG_ERROR(url, ex.what());
+        }
+
+        const double seconds = stopwatch.Stop() / 1000000000.0;
+
+        if (!measured || stop.load(std::memory_order_relaxed))
+            continue;
+
+        /// Errors are reported in the body with a 200, so both are checked
+        Result &result = out_results[r];
+        ++result.Requests;
+        ++result.Statuses[status];
+        result.Bytes += sink.Bytes();
+        result.Latencies.push_back(seconds);
+
+        if (sink.Prefix().find(INVALID_TOKEN_MARKER) != std::string::npos) {
+            ++result.Rejections;
+        } else if (failed || status != 200) {
+            ++result.Failures;
+        }
+    }
+}
+
+/// Nearest-rank percentile of an ascending sample
+double Percentile(const std::vector<double> &sorted, const double p)
+{
+    if (sorted.empty())
+        return 0.0;
+
+    std::size_t rank = static_cast<std::size_t>(std::ceil(p / 100.0 * sorted.size()));
+    if (rank > 0)
+        --rank;
+
+    return sorted[std::min(rank, sorted.size() - 1)];
+}
+
+void PrintResults(const Options &options, const Routes &routes, const Results &results)
+{
+    Result total;
+    for (const auto &result : results) {
+        total.Merge(result);
+    }
+
+    std::cout << std::endl
+              << (boost::format("%-8s %9s %10s %11s %10s %10s %10s %10s %10s %8s %8s")
+                  % "route" % "requests" % "req/s" % "MiB/s" % "p50" % "p90" % "p99"
+                  % "p99.9" % "max" % "failed" % "rejected").str()
+              << std::endl;
+
+    for (std::size_t i = 0; i <= results.size(); ++i) {
+        const Result &result = i < results.size() ? results[i] : total;
+        const std::string name(i < results.size() ? routes[i].Name : "all");
+
+        std::vector<double> sorted(result.Latencies);
+        std::sort(sorted.begin(), sorted.end());
+
+        std::cout << (boost::format("%-8s %9d %10.1f %11.2f %10s %10s %10s %10s %10s %8d %8d")
+                      % name % result.Requests
+                      % (static_cast<double>(result.Requests) / options.DurationSeconds)
+                      % (result.Bytes / 1048576.0 / options.DurationSeconds)
+                      % FormatSeconds(Percentile(sorted, 50.0))
+                      % FormatSeconds(Percentile(sorted, 90.0))
+                      % FormatSeconds(Percentile(sorted, 99.0))
+                      % FormatSeconds(Percentile(sorted, 99.9))
+                      % FormatSeconds(sorted.empty() ? 0.0 : sorted.back())
+                      % result.Failures % result.Rejections).str()
+                  << std::endl;
+    }
+
+    std::cout << std::endl << "HTTP statuses:";
+    for (const auto &status : total.Statuses) {
+        std::cout << " " << (status.first == 0 ? std::string("none")
+                             : boost::lexical_cast<std::string>(status.first))
+                  << "=" << status.second;
+    }
+    std::cout << std::endl;
+}
+
+bool WriteResults(const Options &options, const Routes &routes, const Results &results)
+{
+    std::ostringstream json;
+    json.imbue(std::locale::classic());
+    json.precision(9);
+
+    json << "{\n"
+         << "  \"version\": " << RESULTS_FORMAT_VERSION << ",\n"
+         << "  \"timestamp\": \""
+         << boost::posix_time::to_iso_extended_string(boost::posix_time::second_clock::universal_time())
+         << "Z\",\n"
+         << "  \"parameters\": {\n"
+         << "    \"url\": \"" << options.Url << "\",\n"
+         << "    \"concurrency\": " << options.Concurrency << ",\n"
+         << "    \"durationSeconds\": " << options.DurationSeconds << ",\n"
+         << "    \"warmupSeconds\": " << options.WarmupSeconds << ",\n"
+         << "    \"mix\": \"" << options.Mix << "\",\n"
+         << "    \"format\": \"" << options.Format << "\",\n"
+         << "    \"tokens\": \"" << (options.LegacyTokens ? "legacy" : "hmac") << "\"\n"
+         << "  },\n"
+         << "  \"unit\": \"seconds\",\n"
+         << "  \"results\": [";
+
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        const Result &result = results[i];
+
+        std::vector<double> sorted(result.Latencies);
+        std::sort(sorted.begin(), sorted.end());
+
+        json << (i == 0 ? "\n" : ",\n")
+             << "    { \"route\": \"" << routes[i].Name << "\""
+             << ", \"requests\": " << result.Requests
+             << ", \"failures\": " << result.Failures
+             << ", \"rejections\": " << result.Rejections
+             << ", \"bytes\": " << result.Bytes
+             << ", \"throughput\": " << static_cast<double>(result.Requests) / options.DurationSeconds;
+
+        if (!sorted.empty()) {
+            json << ", \"p50\": " << Percentile(sorted, 50.0)
+                 << ", \"p90\": " << Percentile(sorted, 90.0)
+                 << ", \"p99\": " << Percentile(sorted, 99.0)
+                 << ", \"p999\": " << Percentile(sorted, 99.9)
+                 << ", \"max\": " << sorted.back();
+        }
+
+        json << ", \"statuses\": {";
+        bool first = true;
+        for (const auto &status : result.Statuses) {
+            json << (first ? " " : ", ") << "\"" << status.first << "\": " << status.second;
+            first = false;
+        }
+        json << " } }";
+    }
+
+    json << "\n  ]\n}\n";
+
+    try {
+        std::ofstream file(options.OutputFile, std::ios::out | std::ios::trunc);
+        file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+        file << json.str();
+        file.close();
+    } catch (const std::exception &ex) {
+        LOG_ERROR("Could not write the results!", options.OutputFile, ex.what());
+        return false;
+    }
+
+    std::cout << std::endl << "Results written to " << options.OutputFile << std::endl;
+
+    return true;
+}
+
+std::string FormatSeconds(double seconds)
+{
+    if (seconds < 0.001)
+        return (boost::format("%.1fus") % (seconds * 1000000.0)).str();
+    if (seconds < 1.0)
+        return (boost::format("%.2fms") % (seconds * 1000.0)).str();
+    return (boost::format("%.3fs") % seconds).str();
+}
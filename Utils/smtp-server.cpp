@@ -0,0 +1,435 @@
+/**
+ * @file
+ * @author  Mohammad S. Babaei <info@babaei.net>
+ * @version 0.1.0
+ *
+ * @section LICENSE
+ *
+ * (The MIT License)
+ *
+ * Copyright (c) 2016 Mohammad S. Babaei
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ *
+ * @section DESCRIPTION
+ *
+ * A tiny SMTP server standing in for the mail relay, so the Mail sender can
+ * be tried offline. Every message is accepted, optionally saved, and can be
+ * made to fail in the ways a real relay does: idle sessions closed, data
+ * rejected, or the connection lost right after the data.
+ */
+
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <csignal>
+#include <cstdlib>
+#if ! defined ( _WIN32 )
+#include <poll.h>
+#endif  // ! defined ( _WIN32 )
+#include <boost/algorithm/string.hpp>
+#include <boost/asio.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <CoreLib/CoreLib.hpp>
+#include <CoreLib/Exception.hpp>
+#include <CoreLib/Log.hpp>
+
+#define     UNKNOWN_ERROR                   "Unknown error!"
+
+#define     DEFAULT_ADDRESS                 "127.0.0.1"
+#define     DEFAULT_PORT                    2525
+#define     SERVER_NAME                     "localhost"
+#define     MAX_LINE_BYTES                  (64 * 1024)
+#define     READ_CHUNK_BYTES                4096
+#define     MESSAGE_FILE_NAME_FORMAT        "message-%1$06d.eml"
+
+struct Options
+{
+    std::string Address;
+    unsigned short Port;
+    std::string OutputDirectory;
+    std::size_t IdleTimeout;
+    std::size_t RejectEvery;
+    std::size_t DropEvery;
+};
+
+/// What the client has said so far in one session
+struct Session
+{
+    std::string Pending;
+    std::string From;
+    std::vector<std::string> Recipients;
+};
+
+[[ noreturn ]] void Terminate(int signo);
+
+bool ParseOptions(int argc, char **argv, Options &out_options);
+void PrintUsage(const std::string &appId);
+
+void Serve(boost::asio::ip::tcp::socket &socket, const Options &options, std::size_t &messages);
+bool ReadLine(boost::asio::ip::tcp::socket &socket, const Options &options,
+              Session &session, std::string &out_line);
+void Reply(boost::asio::ip::tcp::socket &socket, const std::string &reply);
+bool SaveMessage(const Options &options, const std::size_t sequence, const std::string &data);
+
+int main(int argc, char **argv)
+{
+    try {
+        /// Gracefully handling SIGTERM
+        void (*prev_fn)(int);
+        prev_fn = signal(SIGTERM, Terminate);
+        if (prev_fn == SIG_IGN)
+            signal(SIGTERM, SIG_IGN);
+
+
+        /// Extract the executable path and name
+        boost::filesystem::path path(boost::filesystem::initial_path<boost::filesystem::path>());
+        if (argc > 0 && argv[0] != NULL)
+            path = boost::filesystem::system_complete(boost::filesystem::path(argv[0]));
+        std::string appId(path.filename().string());
+        std::string appPath(boost::algorithm::replace_last_copy(path.string(), appId, ""));
+
+
+        /// Options are parsed before changing directory, so relative
+        /// paths given on the command line keep their meaning
+        Options options;
+        if (!ParseOptions(argc, argv, options)) {
+            PrintUsage(appId);
+            return EXIT_FAILURE;
+        }
+
+
+        /// Force changing the current path to executable path
+        boost::filesystem::current_path(appPath);
+
+
+        /// Initializing CoreLib
+        CoreLib::CoreLibInitialize(argc, argv);
+
+
+        /// Initializing log system
+        CoreLib::Log::Initialize(std::cout,
+                                 (boost::filesystem::path(appPath)
+                                  / boost::filesystem::path("..")
+                                  / boost::filesystem::path("log")).string(),
+                                 "SmtpServer");
+
+
+        if (!options.OutputDirectory.empty())
+            boost::filesystem::create_directories(options.OutputDirectory);
+
+        boost::asio::io_service service;
+        boost::asio::ip::tcp::acceptor acceptor(
+                    service,
+                    boost::asio::ip::tcp::endpoint(
+                        boost::asio::ip::address::from_string(options.Address), options.Port));
+
+        LOG_INFO("Accepting mail", options.Address, options.Port);
+
+        /// Sessions are served one at a time, so with more than one Mail
+        /// sender thread the others wait in the accept backlog
+        std::size_t messages = 0;
+        for (;;) {
+            boost::asio::ip::tcp::socket socket(service);
+            acceptor.accept(socket);
+
+            try {
+                Serve(socket, options, messages);
+            }
+
+            catch (boost::system::system_error &ex) {
+                LOG_ERROR(ex.what());
+            }
+        }
+    }
+
+    catch (CoreLib::Exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+        return EXIT_FAILURE;
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+        return EXIT_FAILURE;
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+void Terminate(int signo)
+{
+    std::clog << "Terminating...." << std::endl;
+    exit(signo);
+}
+
+bool ParseOptions(int argc, char **argv, Options &out_options)
+{
+    out_options.Address = DEFAULT_ADDRESS;
+    out_options.Port = DEFAULT_PORT;
+    out_options.OutputDirectory.clear();
+    out_options.IdleTimeout = 0;
+    out_options.RejectEvery = 0;
+    out_options.DropEvery = 0;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string option(argv[i]);
+
+            if (option == "--help" || option == "-h")
+                return false;
+
+            if (i + 1 >= argc) {
+                std::cerr << "Missing value for '" << option << "'" << std::endl;
+                return false;
+            }
+
+            const std::string value(argv[++i]);
+
+            if (option == "--bind") {
+                out_options.Address = value;
+            } else if (option == "--port") {
+                out_options.Port = boost::lexical_cast<unsigned short>(value);
+            } else if (option == "--output") {
+                out_options.OutputDirectory = boost::filesystem::absolute(value).string();
+            } else if (option == "--idle-timeout") {
+                out_options.IdleTimeout = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--reject-every") {
+                out_options.RejectEvery = boost::lexical_cast<std::size_t>(value);
+            } else if (option == "--drop-every") {
+                out_options.DropEvery = boost::lexical_cast<std::size_t>(value);
+            } else {
+                std::cerr << "Unknown option '" << option << "'" << std::endl;
+                return false;
+            }
+        }
+    } catch (const boost::bad_lexical_cast &) {
+        std::cerr << "Invalid numeric value!" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void PrintUsage(const std::string &appId)
+{
+    std::cerr << "Usage: " << appId << " [options]" << std::endl
+              << "  --bind ADDR         listen address (default " DEFAULT_ADDRESS ")" << std::endl
+              << "  --port N            listen port (default " << DEFAULT_PORT << ")" << std::endl
+              << "  --output DIR        save every accepted message as a .eml file" << std::endl
+              << "  --idle-timeout S    close sessions idle for S seconds, as relays do"
+              << " (default 0, never; not available on Windows)" << std::endl
+              << "  --reject-every N    answer the data of every Nth message with 554" << std::endl
+              << "  --drop-every N      close the connection after the data of every Nth"
+              << " message, without replying" << std::endl
+              << std::endl
+              << "Build with MAIL_SMTP_URL set to smtp://ADDR:N. Any AUTH PLAIN or LOGIN"
+              << " credentials are accepted." << std::endl;
+}
+
+void Serve(boost::asio::ip::tcp::socket &socket, const Options &options, std::size_t &messages)
+{
+    Session session;
+    std::string line;
+
+    Reply(socket, "220 " SERVER_NAME " ESMTP ready");
+
+    while (ReadLine(socket, options, session, line)) {
+        const std::string::size_type space = line.find(' ');
+        const std::string verb(boost::algorithm::to_upper_copy(line.substr(0, space)));
+        const std::string argument(space == std::string::npos ? "" : line.substr(space + 1));
+
+        if (verb == "EHLO") {
+            session.From.clear();
+            session.Recipients.clear();
+            Reply(socket, "250-" SERVER_NAME "\r\n"
+                  "250-8BITMIME\r\n"
+                  "250 AUTH PLAIN LOGIN");
+        } else if (verb == "HELO") {
+            session.From.clear();
+            session.Recipients.clear();
+            Reply(socket, "250 " SERVER_NAME);
+        } else if (verb == "AUTH") {
+            /// PLAIN may carry its credentials on the same line; LOGIN asks
+            /// for the user name and password in turn
+            const std::string mechanism(boost::algorithm::to_upper_copy(
+                                            argument.substr(0, argument.find(' '))));
+            if (mechanism == "PLAIN" && argument.find(' ') == std::string::npos) {
+                Reply(socket, "334 ");
+                if (!ReadLine(socket, options, session, line))
+                    break;
+            } else if (mechanism == "LOGIN") {
+                Reply(socket, "334 VXNlcm5hbWU6");
+                if (!ReadLine(socket, options, session, line))
+                    break;
+                Reply(socket, "334 UGFzc3dvcmQ6");
+                if (!ReadLine(socket, options, session, line))
+                    break;
+            } else if (mechanism != "PLAIN") {
+                Reply(socket, "504 Unrecognized authentication type");
+                continue;
+            }
+            Reply(socket, "235 Authentication succeeded");
+        } else if (verb == "MAIL") {
+            session.From = argument;
+            session.Recipients.clear();
+            Reply(socket, "250 OK");
+        } else if (verb == "RCPT") {
+            if (session.From.empty()) {
+                Reply(socket, "503 Need MAIL first");
+                continue;
+            }
+            session.Recipients.push_back(argument);
+            Reply(socket, "250 OK");
+        } else if (verb == "DATA") {
+            if (session.Recipients.empty()) {
+                Reply(socket, "503 Need RCPT first");
+                continue;
+            }
+            Reply(socket, "354 End data with <CR><LF>.<CR><LF>");
+
+            std::string data;
+            bool isComplete = false;
+            while (ReadLine(socket, options, session, line)) {
+                if (line == ".") {
+                    isComplete = true;
+                    break;
+                }
+                /// Undo the dot-stuffing
+                data += (line.size() > 1 && line[0] == '.' ? line.substr(1) : line) + "\r\n";
+            }
+            if (!isComplete)
+                break;
+
+            const std::size_t sequence = ++messages;
+
+            if (options.DropEvery != 0 && sequence % options.DropEvery == 0) {
+                LOG_WARNING("Dropping the connection after the data", sequence, session.From);
+                break;
+            }
+
+            if (options.RejectEvery != 0 && sequence % options.RejectEvery == 0) {
+                LOG_WARNING("Rejecting message", sequence, session.From);
+                Reply(socket, "554 Transaction failed");
+            } else {
+                LOG_INFO("Accepted message", sequence, session.From,
+                         session.Recipients.size(), data.size());
+                if (!options.OutputDirectory.empty())
+                    SaveMessage(options, sequence, data);
+                Reply(socket, "250 OK queued");
+            }
+
+            session.From.clear();
+            session.Recipients.clear();
+        } else if (verb == "RSET") {
+            session.From.clear();
+            session.Recipients.clear();
+            Reply(socket, "250 OK");
+        } else if (verb == "NOOP") {
+            Reply(socket, "250 OK");
+        } else if (verb == "QUIT") {
+            Reply(socket, "221 Bye");
+            break;
+        } else {
+            Reply(socket, "502 Command not implemented");
+        }
+    }
+
+    boost::system::error_code ec;
+    socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+}
+
+bool ReadLine(boost::asio::ip::tcp::socket &socket, const Options &options,
+              Session &session, std::string &out_line)
+{
+    std::string::size_type end;
+
+    while ((end = session.Pending.find("\r\n")) == std::string::npos) {
+        if (session.Pending.size() > MAX_LINE_BYTES) {
+            LOG_WARNING("Line too long, closing the session");
+            return false;
+        }
+
+#if ! defined ( _WIN32 )
+        if (options.IdleTimeout != 0) {
+            struct pollfd descriptor;
+            descriptor.fd = socket.native_handle();
+            descriptor.events = POLLIN;
+            descriptor.revents = 0;
+
+            if (poll(&descriptor, 1, static_cast<int>(options.IdleTimeout * 1000)) == 0) {
+                LOG_INFO("Closing idle session");
+                Reply(socket, "421 " SERVER_NAME " Idle timeout, closing connection");
+                return false;
+            }
+        }
+#else
+        (void)options;
+#endif  // ! defined ( _WIN32 )
+
+        char chunk[READ_CHUNK_BYTES];
+        boost::system::error_code ec;
+        const std::size_t bytes = socket.read_some(boost::asio::buffer(chunk), ec);
+        if (ec)
+            return false;
+
+        session.Pending.append(chunk, bytes);
+    }
+
+    out_line.assign(session.Pending, 0, end);
+    session.Pending.erase(0, end + 2);
+
+    return true;
+}
+
+void Reply(boost::asio::ip::tcp::socket &socket, const std::string &reply)
+{
+    boost::system::error_code ec;
+    boost::asio::write(socket, boost::asio::buffer(reply + "\r\n"), ec);
+}
+
+bool SaveMessage(const Options &options, const std::size_t sequence, const std::string &data)
+{
+    const std::string file((boost::filesystem::path(options.OutputDirectory)
+                            / (boost::format(MESSAGE_FILE_NAME_FORMAT) % sequence).str()).string());
+
+    std::ofstream stream(file, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        LOG_ERROR("Could not save the message!", file);
+        return false;
+    }
+
+    stream << data;
+
+    return true;
+}
@@ -42,7 +42,6 @@
 #include <ImageMagick-6/Magick++.h>
 #endif // MAGICKPP_BACKEND == MAGICKPP_GM
 #include <CoreLib/make_unique.hpp>
-#include <CoreLib/FileSystem.hpp>
 #include <CoreLib/Random.hpp>
 #include <CoreLib/System.hpp>
 #include "Captcha.hpp"
@@ -98,26 +97,14 @@ Wt::WImage *Captcha::Generate()
     img.draw(drawList);
 
 
-    string captchaPath;
-
-    do {
-        captchaPath = "../tmp/captcha-";
-        captchaPath += Random::Characters(Random::Character::Alphanumeric, 24);
-        captchaPath += ".png";
-    } while (FileSystem::FileExists(captchaPath));
-
-
-    img.write(captchaPath);
+    /// Encoded in memory; no temporary file to write, read back and erase
+    Blob captchaBlob;
+    img.magick("PNG");
+    img.write(&captchaBlob);
 
     WMemoryResource *captchaResource = new WMemoryResource("image/png");
-
-    std::string buffer;
-    FileSystem::Read(captchaPath, buffer);
-
-    captchaResource->setData(reinterpret_cast<const unsigned char*>(buffer.c_str()),
-                             static_cast<int>(buffer.size()));
-
-    FileSystem::Erase(captchaPath);
+    captchaResource->setData(static_cast<const unsigned char*>(captchaBlob.data()),
+                             static_cast<int>(captchaBlob.length()));
 
     WImage *captchaImage = new WImage(captchaResource, "Captcha");
     captchaImage->setStyleClass("captcha");
@@ -40,6 +40,7 @@
 #include <Wt/WContainerWidget>
 #include <Wt/WEnvironment>
 #include <Wt/WText>
+#include <CoreLib/Database.hpp>
 #include <CoreLib/Log.hpp>
 #include <CoreLib/make_unique.hpp>
 #include "CgiRoot.hpp"
@@ -80,6 +81,9 @@ CgiRoot::CgiRoot(const WEnvironment &env) :
     WApplication(env),
     m_pimpl(std::make_unique<CgiRoot::Impl>(this))
 {
+    CoreLib::Database::SessionScope sessionScope(Pool::Database());
+    (void)sessionScope;
+
     try {
         this->setInternalPathDefaultValid(false);
 
@@ -149,6 +153,16 @@ CgiRoot::CgiRoot(const WEnvironment &env) :
     }
 }
 
+void CgiRoot::notify(const Wt::WEvent &event)
+{
+    /// Any database session used while handling the event goes back
+    /// to the pool once the event is done
+    CoreLib::Database::SessionScope sessionScope(Pool::Database());
+    (void)sessionScope;
+
+    WApplication::notify(event);
+}
+
 void CgiRoot::Redirect(const std::string &url)
 {
     redirect(url);
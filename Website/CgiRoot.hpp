@@ -43,6 +43,7 @@
 
 namespace Wt {
 class WEnvironment;
+class WEvent;
 }
 
 namespace Website {
@@ -69,6 +70,9 @@ public:
 public:
     explicit CgiRoot(const Wt::WEnvironment &env);
 
+protected:
+    virtual void notify(const Wt::WEvent &event) override;
+
 public:
     void Redirect(const std::string &url);
     void Exit(const std::string &url);
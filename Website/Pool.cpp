@@ -33,12 +33,12 @@
  */
 
 
-#include <mutex>
 #include <boost/algorithm/string.hpp>
 #include <boost/filesystem/path.hpp>
 #include <boost/format.hpp>
 #include <CoreLib/Crypto.hpp>
 #include <CoreLib/Database.hpp>
+#include <CoreLib/LazyInstance.hpp>
 #include <CoreLib/make_unique.hpp>
 #include <CoreLib/Log.hpp>
 #include "Pool.hpp"
@@ -52,14 +52,13 @@ struct Pool::Impl
     typedef std::unique_ptr<CoreLib::Crypto> Crypto_ptr;
     typedef std::unique_ptr<CoreLib::Database> Database_ptr;
 
-    std::mutex StorageMutex;
-    Storage_ptr StorageInstance;
+    CoreLib::LazyInstance<StorageStruct> StorageInstance;
+    CoreLib::LazyInstance<CoreLib::Crypto> CryptoInstance;
+    CoreLib::LazyInstance<CoreLib::Database> DatabaseInstance;
 
-    std::mutex CryptoMutex;
-    Crypto_ptr CryptoInstance;
-
-    std::mutex DatabaseMutex;
-    Database_ptr DatabaseInstance;
+    static Storage_ptr CreateStorage();
+    static Crypto_ptr CreateCrypto();
+    static Database_ptr CreateDatabase();
 };
 
 std::unique_ptr<Pool::Impl> Pool::s_pimpl = std::make_unique<Pool::Impl>();
@@ -146,142 +145,185 @@ const int &Pool::StorageStruct::MaxPasswordLength() const
 
 Pool::StorageStruct *Pool::Storage()
 {
-    lock_guard<mutex> lock(s_pimpl->StorageMutex);
-    (void)lock;
-
-    if (s_pimpl->StorageInstance == nullptr) {
-        s_pimpl->StorageInstance = std::make_unique<Pool::StorageStruct>();
-    }
-
-    return s_pimpl->StorageInstance.get();
+    return s_pimpl->StorageInstance.Get(&Impl::CreateStorage);
 }
 
 CoreLib::Crypto *Pool::Crypto()
 {
-    lock_guard<mutex> lock(s_pimpl->CryptoMutex);
-    (void)lock;
-
-    if (s_pimpl->CryptoInstance == nullptr) {
-        static const string KEY = CoreLib::Crypto::HexStringToString(CRYPTO_KEY);
-        static const string IV = CoreLib::Crypto::HexStringToString(CRYPTO_IV);
+    return s_pimpl->CryptoInstance.Get(&Impl::CreateCrypto);
+}
 
-        s_pimpl->CryptoInstance =
-                std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
-                                                  reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
-    }
+CoreLib::Database *Pool::Database()
+{
+    return s_pimpl->DatabaseInstance.Get(&Impl::CreateDatabase);
+}
 
-    return s_pimpl->CryptoInstance.get();
+Pool::Impl::Storage_ptr Pool::Impl::CreateStorage()
+{
+    return std::make_unique<Pool::StorageStruct>();
 }
 
-CoreLib::Database *Pool::Database()
+Pool::Impl::Crypto_ptr Pool::Impl::CreateCrypto()
 {
-    lock_guard<mutex> lock(s_pimpl->DatabaseMutex);
-    (void)lock;
+    static const string KEY = CoreLib::Crypto::HexStringToString(CRYPTO_KEY);
+    static const string IV = CoreLib::Crypto::HexStringToString(CRYPTO_IV);
 
-    if (s_pimpl->DatabaseInstance == nullptr) {
+    return std::make_unique<CoreLib::Crypto>(reinterpret_cast<const CoreLib::Crypto::Byte *>(KEY.c_str()), KEY.size(),
+                                             reinterpret_cast<const CoreLib::Crypto::Byte *>(IV.c_str()), IV.size());
+}
+
+Pool::Impl::Database_ptr Pool::Impl::CreateDatabase()
+{
+    CoreLib::Database::PoolOptions poolOptions;
 
 #if DATABASE_BACKEND == PGSQL
 
 #ifdef CORELIB_STATIC
 #if defined ( HAS_CPPDB_PGSQL_DRIVER )
-        if (!Database::IsPgSqlDriverLoaded()) {
-            Database::LoadPgSqlDriver();
-        }
+    if (!Database::IsPgSqlDriverLoaded()) {
+        Database::LoadPgSqlDriver();
+    }
 #endif  // defined ( HAS_CPPDB_PGSQL_DRIVER )
 #endif  // CORELIB_STATIC
 
-        std::string parameters;
-        std::string pgSqlHost(PGSQL_HOST);
-        std::string pgSqlPort(PGSQL_PORT);
-        std::string pgSqlDatabase(PGSQL_DATABASE);
-        std::string pgSqlUser(PGSQL_USER);
-        std::string pgSqlPassword(PGSQL_PASSWORD);
+    std::string parameters;
+    std::string pgSqlHost(PGSQL_HOST);
+    std::string pgSqlPort(PGSQL_PORT);
+    std::string pgSqlDatabase(PGSQL_DATABASE);
+    std::string pgSqlUser(PGSQL_USER);
+    std::string pgSqlPassword(PGSQL_PASSWORD);
 
-        if (boost::trim_copy(pgSqlHost) != "")
-            parameters += (boost::format("host=%1%;") % pgSqlHost).str();
+    if (boost::trim_copy(pgSqlHost) != "")
+        parameters += (boost::format("host=%1%;") % pgSqlHost).str();
 
-        if (boost::trim_copy(pgSqlPort) != "")
-            parameters += (boost::format("port=%1%;") % pgSqlPort).str();
+    if (boost::trim_copy(pgSqlPort) != "")
+        parameters += (boost::format("port=%1%;") % pgSqlPort).str();
 
-        if (boost::trim_copy(pgSqlDatabase) != "")
-            parameters += (boost::format("dbname=%1%;") % pgSqlDatabase).str();
+    if (boost::trim_copy(pgSqlDatabase) != "")
+        parameters += (boost::format("dbname=%1%;") % pgSqlDatabase).str();
 
-        if (boost::trim_copy(pgSqlUser) != "")
-            parameters += (boost::format("user=%1%;") % pgSqlUser).str();
+    if (boost::trim_copy(pgSqlUser) != "")
+        parameters += (boost::format("user=%1%;") % pgSqlUser).str();
 
-        if (boost::trim_copy(pgSqlPassword) != "")
-            parameters += (boost::format("password=%1%;") % pgSqlPassword).str();
+    if (boost::trim_copy(pgSqlPassword) != "")
+        parameters += (boost::format("password=%1%;") % pgSqlPassword).str();
 
-        static const std::string CONNECTION_STRING(
-                    (boost::format("postgresql:%1%")
-                     % parameters).str());
+    static const std::string CONNECTION_STRING(
+                (boost::format("postgresql:%1%")
+                 % parameters).str());
 
 #elif DATABASE_BACKEND == MYSQL
 
 #ifdef CORELIB_STATIC
 #if defined ( HAS_CPPDB_MYSQL_DRIVER )
-        if (!Database::IsMySqlDriverLoaded()) {
-            Database::LoadMySqlDriver();
-        }
+    if (!Database::IsMySqlDriverLoaded()) {
+        Database::LoadMySqlDriver();
+    }
 #endif  // defined ( HAS_CPPDB_MYSQL_DRIVER )
 #endif  // CORELIB_STATIC
 
-        std::string parameters;
-        std::string mySqlHost(MYSQL_HOST);
-        std::string mySqlPort(MYSQL_PORT);
-        std::string mySqlUnixSocket(MYSQL_UNIX_SOCKET);
-        std::string mySqlDatabase(MYSQL_DATABASE);
-        std::string mySqlUser(MYSQL_USER);
-        std::string mySqlPassword(MYSQL_PASSWORD);
+    std::string parameters;
+    std::string mySqlHost(MYSQL_HOST);
+    std::string mySqlPort(MYSQL_PORT);
+    std::string mySqlUnixSocket(MYSQL_UNIX_SOCKET);
+    std::string mySqlDatabase(MYSQL_DATABASE);
+    std::string mySqlUser(MYSQL_USER);
+    std::string mySqlPassword(MYSQL_PASSWORD);
 
-        if (boost::trim_copy(mySqlHost) != "")
-            parameters += (boost::format("host=%1%;") % mySqlHost).str();
+    if (boost::trim_copy(mySqlHost) != "")
+        parameters += (boost::format("host=%1%;") % mySqlHost).str();
 
-        if (boost::trim_copy(mySqlPort) != "")
-            parameters += (boost::format("port=%1%;") % mySqlPort).str();
+    if (boost::trim_copy(mySqlPort) != "")
+        parameters += (boost::format("port=%1%;") % mySqlPort).str();
 
-        if (boost::trim_copy(mySqlUnixSocket) != "")
-            parameters += (boost::format("unix_socket=%1%;") % mySqlUnixSocket).str();
+    if (boost::trim_copy(mySqlUnixSocket) != "")
+        parameters += (boost::format("unix_socket=%1%;") % mySqlUnixSocket).str();
 
-        if (boost::trim_copy(mySqlDatabase) != "")
-            parameters += (boost::format("database=%1%;") % mySqlDatabase).str();
+    if (boost::trim_copy(mySqlDatabase) != "")
+        parameters += (boost::format("database=%1%;") % mySqlDatabase).str();
 
-        if (boost::trim_copy(mySqlUser) != "")
-            parameters += (boost::format("user=%1%;") % mySqlUser).str();
+    if (boost::trim_copy(mySqlUser) != "")
+        parameters += (boost::format("user=%1%;") % mySqlUser).str();
 
-        if (boost::trim_copy(mySqlPassword) != "")
-            parameters += (boost::format("password=%1%;") % mySqlPassword).str();
+    if (boost::trim_copy(mySqlPassword) != "")
+        parameters += (boost::format("password=%1%;") % mySqlPassword).str();
 
-        static const std::string CONNECTION_STRING(
-                    (boost::format("mysql:%1%")
-                     % parameters).str());
+    static const std::string CONNECTION_STRING(
+                (boost::format("mysql:%1%")
+                 % parameters).str());
 
 #else   // SQLITE3
 
 #if defined ( CORELIB_STATIC )
 #if defined ( HAS_CPPDB_SQLITE3_DRIVER )
-        if (!Database::IsSqlite3DriverLoaded()) {
-            Database::LoadSQLite3Driver();
-        }
+    if (!Database::IsSqlite3DriverLoaded()) {
+        Database::LoadSQLite3Driver();
+    }
 #endif  // defined ( HAS_CPPDB_SQLITE3_DRIVER )
 #endif  // defined ( CORELIB_STATIC )
 
-        static const std::string DB_FILE((boost::filesystem::path(Storage()->AppPath)
-                                          / boost::filesystem::path(SQLITE3_DATABASE_FILE_PATH)
-                                          / boost::filesystem::path(SQLITE3_DATABASE_FILE_NAME)).string());
-        static const std::string CONNECTION_STRING(
-                    (boost::format("sqlite3:db=%1%")
-                     % DB_FILE).str());
-
-#if defined ( HAS_SQLITE3 )
-        CoreLib::Database::Sqlite3Vacuum(DB_FILE);
-#endif  // defined ( HAS_SQLITE3 )
+    static const std::string DB_FILE((boost::filesystem::path(Storage()->AppPath)
+                                      / boost::filesystem::path(SQLITE3_DATABASE_FILE_PATH)
+                                      / boost::filesystem::path(SQLITE3_DATABASE_FILE_NAME)).string());
+    static const std::string CONNECTION_STRING(
+                (boost::format("sqlite3:db=%1%")
+                 % DB_FILE).str());
+
+    CoreLib::Database::Sqlite3Profile sqlite3Profile;
+#if defined ( SQLITE3_JOURNAL_MODE )
+    sqlite3Profile.JournalMode = SQLITE3_JOURNAL_MODE;
+#endif  // defined ( SQLITE3_JOURNAL_MODE )
+#if defined ( SQLITE3_SYNCHRONOUS )
+    sqlite3Profile.Synchronous = SQLITE3_SYNCHRONOUS;
+#endif  // defined ( SQLITE3_SYNCHRONOUS )
+#if defined ( SQLITE3_CACHE_SIZE_KIB )
+    sqlite3Profile.CacheSizeKiB = SQLITE3_CACHE_SIZE_KIB;
+#endif  // defined ( SQLITE3_CACHE_SIZE_KIB )
+#if defined ( SQLITE3_MMAP_SIZE_BYTES )
+    sqlite3Profile.MmapSizeBytes = SQLITE3_MMAP_SIZE_BYTES;
+#endif  // defined ( SQLITE3_MMAP_SIZE_BYTES )
+#if defined ( SQLITE3_BUSY_TIMEOUT_MILLISECONDS )
+    sqlite3Profile.BusyTimeout = std::chrono::milliseconds(SQLITE3_BUSY_TIMEOUT_MILLISECONDS);
+#endif  // defined ( SQLITE3_BUSY_TIMEOUT_MILLISECONDS )
+#if defined ( SQLITE3_INCREMENTAL_VACUUM_PAGES )
+    sqlite3Profile.IncrementalVacuumPages = SQLITE3_INCREMENTAL_VACUUM_PAGES;
+#endif  // defined ( SQLITE3_INCREMENTAL_VACUUM_PAGES )
+#if defined ( SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS )
+    sqlite3Profile.IncrementalVacuumInterval = std::chrono::seconds(SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS);
+#endif  // defined ( SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS )
+
+    poolOptions.SessionInitStatements = sqlite3Profile.GetSessionStatements();
 
 #endif // DATABASE_BACKEND == PGSQL
 
-        s_pimpl->DatabaseInstance = std::make_unique<CoreLib::Database>(CONNECTION_STRING);
-    }
-
-    return s_pimpl->DatabaseInstance.get();
+#if defined ( DATABASE_POOL_MAX_SIZE )
+    poolOptions.MaxSize = DATABASE_POOL_MAX_SIZE;
+#endif  // defined ( DATABASE_POOL_MAX_SIZE )
+#if defined ( DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS )
+    poolOptions.CheckoutTimeout = std::chrono::milliseconds(DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS);
+#endif  // defined ( DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS )
+#if defined ( DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS )
+    poolOptions.HealthCheckIdleInterval = std::chrono::seconds(DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS);
+#endif  // defined ( DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS )
+
+    CoreLib::Database::WriteQueueOptions writeQueueOptions;
+#if defined ( DATABASE_WRITE_QUEUE_MAX_SIZE )
+    writeQueueOptions.MaxSize = DATABASE_WRITE_QUEUE_MAX_SIZE;
+#endif  // defined ( DATABASE_WRITE_QUEUE_MAX_SIZE )
+#if defined ( DATABASE_WRITE_BATCH_MAX_SIZE )
+    writeQueueOptions.MaxBatchSize = DATABASE_WRITE_BATCH_MAX_SIZE;
+#endif  // defined ( DATABASE_WRITE_BATCH_MAX_SIZE )
+#if defined ( DATABASE_WRITE_BATCH_DELAY_MILLISECONDS )
+    writeQueueOptions.MaxBatchDelay = std::chrono::milliseconds(DATABASE_WRITE_BATCH_DELAY_MILLISECONDS);
+#endif  // defined ( DATABASE_WRITE_BATCH_DELAY_MILLISECONDS )
+
+    Database_ptr database(std::make_unique<CoreLib::Database>(CONNECTION_STRING, poolOptions,
+                                                              writeQueueOptions));
+
+#if DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+    database->Sqlite3StartBackgroundVacuum(DB_FILE, sqlite3Profile);
+#endif  // DATABASE_BACKEND != PGSQL && DATABASE_BACKEND != MYSQL && defined ( HAS_SQLITE3 )
+
+    return database;
 }
 
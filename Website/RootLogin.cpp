@@ -111,6 +111,7 @@ public:
     void GenerateCaptcha();
     void PasswordRecoveryForm();
     void PreserveSessionData(const CDate::Now &n, const std::string &username, const bool saveLocally);
+    void SaveLastLogin(const CDate::Now &n, const std::string &username);
 
     void SendLoginAlertEmail(const std::string &email, const std::string &username, CDate::Now &n);
     void SendPasswordRecoveryEmail(const std::string &email,
@@ -183,6 +184,9 @@ RootLogin::RootLogin(CgiRoot *cgi) :
                         }
 
                         guard.commit();
+
+                        if (hasValidSession)
+                            m_pimpl->SaveLastLogin(n, m_cgiEnv->SignedInUser.Username);
                     }
 
                     catch (boost::exception &ex) {
@@ -430,6 +434,8 @@ void RootLogin::Impl::TryLogin()
 
         guard.commit();
 
+        SaveLastLogin(n, m_parent->m_cgiEnv->SignedInUser.Username);
+
         /// It's absolutely safe since we attach it to Wt's WObject hierarchy in it's constructor.
         new Cms(m_parent->m_cgiRoot);
 
@@ -608,25 +614,6 @@ void RootLogin::Impl::PasswordRecoveryForm()
 void RootLogin::Impl::PreserveSessionData(const CDate::Now &n, const std::string &username, const bool saveLocally)
 {
     try {
-        Pool::Database()->Update("ROOT",
-                                 "username", username,
-                                 "last_login_ip=?, last_login_location=?,"
-                                 " last_login_rawtime=?,"
-                                 " last_login_gdate=?, last_login_jdate=?,"
-                                 " last_login_time=?,"
-                                 " last_login_user_agent=?,"
-                                 " last_login_referer=?",
-                                 {
-                                     m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::IP),
-                                     m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Location),
-                                     boost::lexical_cast<std::string>(n.RawTime),
-                                     DateConv::ToGregorian(n),
-                                     DateConv::DateConv::ToJalali(n),
-                                     DateConv::Time(n),
-                                     m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Browser),
-                                     m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Referer)
-                                 });
-
         std::string user;
         std::string token;
 
@@ -658,6 +645,49 @@ void RootLogin::Impl::PreserveSessionData(const CDate::Now &n, const std::string
     }
 }
 
+void RootLogin::Impl::SaveLastLogin(const CDate::Now &n, const std::string &username)
+{
+    try {
+        /// Bookkeeping only, nothing depends on it being on disk yet. Queued
+        /// after the login transaction has committed, so it neither commits
+        /// on its own when that one rolls back nor waits on its locks.
+        Pool::Database()->UpdateAsync("ROOT",
+                                      "username", username,
+                                      "last_login_ip=?, last_login_location=?,"
+                                      " last_login_rawtime=?,"
+                                      " last_login_gdate=?, last_login_jdate=?,"
+                                      " last_login_time=?,"
+                                      " last_login_user_agent=?,"
+                                      " last_login_referer=?",
+                                      {
+                                          m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::IP),
+                                          m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Location),
+                                          boost::lexical_cast<std::string>(n.RawTime),
+                                          DateConv::ToGregorian(n),
+                                          DateConv::DateConv::ToJalali(n),
+                                          DateConv::Time(n),
+                                          m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Browser),
+                                          m_parent->m_cgiEnv->GetClientInfo(CgiEnv::ClientInfo::Referer)
+                                      },
+                                      [username](bool succeeded) {
+            if (!succeeded)
+                LOG_ERROR("Failed to save last login info!", username);
+        });
+    }
+
+    catch (boost::exception &ex) {
+        LOG_ERROR(boost::diagnostic_information(ex));
+    }
+
+    catch (std::exception &ex) {
+        LOG_ERROR(ex.what());
+    }
+
+    catch (...) {
+        LOG_ERROR(UNKNOWN_ERROR);
+    }
+}
+
 void RootLogin::Impl::SendLoginAlertEmail(const std::string &email, const std::string &username, CDate::Now &n)
 {
     std::string htmlData;
@@ -59,6 +59,7 @@
 #include <CoreLib/Log.hpp>
 #include <CoreLib/make_unique.hpp>
 #include <CoreLib/System.hpp>
+#include <CoreLib/Trace.hpp>
 #include "CgiRoot.hpp"
 #include "Exception.hpp"
 #include "Pool.hpp"
@@ -99,11 +100,11 @@ int main(int argc, char **argv)
 
 
         /// Initializing log system
-        CoreLib::Log::Initialize(std::cout,
-                                 (boost::filesystem::path(appPath)
-                                  / boost::filesystem::path("..")
-                                  / boost::filesystem::path("log")).string(),
-                                 "JobApplicationSystemServer");
+        const std::string logPath((boost::filesystem::path(appPath)
+                                   / boost::filesystem::path("..")
+                                   / boost::filesystem::path("log")).string());
+        CoreLib::Log::InitializeFromDefinitions(std::cout, logPath, "JobApplicationSystemServer");
+        CoreLib::Trace::EnableFromDefinitions(logPath, "JobApplicationSystemServer-trace");
 
 
         /// Acquiring process lock
@@ -212,6 +213,9 @@ void Terminate(int signo)
 void InitializeDatabase()
 {
     try {
+        CoreLib::Database::SessionScope sessionScope(Website::Pool::Database());
+        (void)sessionScope;
+
         Website::Pool::Database()->RegisterTable("ROOT", "root",
                                                  " username TEXT NOT NULL PRIMARY KEY, "
                                                  " email TEXT NOT NULL UNIQUE, "
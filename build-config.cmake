@@ -52,11 +52,27 @@ SET_PROPERTY( CACHE BUILD_UTILS_SPAWN_FASTCGI PROPERTY STRINGS "YES" "NO" )
 SET ( BUILD_UTILS_SPAWN_WTHTTPD "YES" CACHE STRING "" )
 SET_PROPERTY( CACHE BUILD_UTILS_SPAWN_WTHTTPD PROPERTY STRINGS "YES" "NO" )
 
+SET ( BUILD_UTILS_INGEST_BENCHMARK "NO" CACHE STRING "" )
+SET_PROPERTY( CACHE BUILD_UTILS_INGEST_BENCHMARK PROPERTY STRINGS "YES" "NO" )
+
+SET ( BUILD_UTILS_FIXTURE_SERVER "NO" CACHE STRING "" )
+SET_PROPERTY( CACHE BUILD_UTILS_FIXTURE_SERVER PROPERTY STRINGS "YES" "NO" )
+
+SET ( BUILD_UTILS_SMTP_SERVER "NO" CACHE STRING "" )
+SET_PROPERTY( CACHE BUILD_UTILS_SMTP_SERVER PROPERTY STRINGS "YES" "NO" )
+
+SET ( BUILD_UTILS_REST_LOADTEST "NO" CACHE STRING "" )
+SET_PROPERTY( CACHE BUILD_UTILS_REST_LOADTEST PROPERTY STRINGS "YES" "NO" )
+
 SET ( CORELIB_BIN_NAME "core" CACHE STRING "" )
 SET ( REST_BIN_NAME "tse-rtsq-backend.app" CACHE STRING "" )
 SET ( WEBSITE_BIN_NAME "tse-rtsq-frontend.app" CACHE STRING "" )
 SET ( UTILS_GEOIP_UPDATER_BIN_NAME "geoip-updater" CACHE STRING "" )
 SET ( UTILS_SPAWN_FASTCGI_BIN_NAME "spawn-fastcgi" CACHE STRING "" )
 SET ( UTILS_SPAWN_WTHTTPD_BIN_NAME "spawn-wthttpd" CACHE STRING "" )
+SET ( UTILS_INGEST_BENCHMARK_BIN_NAME "ingest-benchmark" CACHE STRING "" )
+SET ( UTILS_FIXTURE_SERVER_BIN_NAME "fixture-server" CACHE STRING "" )
+SET ( UTILS_SMTP_SERVER_BIN_NAME "smtp-server" CACHE STRING "" )
+SET ( UTILS_REST_LOADTEST_BIN_NAME "rest-loadtest" CACHE STRING "" )
 
 
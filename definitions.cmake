@@ -28,6 +28,7 @@
 # REST_CLIENT_TOKEN_CRYPTO_IV: exactly 16, 24 or 32 chars
 # REST_SERVER_TOKEN_CRYPTO_KEY: exactly 16, 24 or 32 chars
 # REST_SERVER_TOKEN_CRYPTO_IV: exactly 16, 24 or 32 chars
+# REST_CLIENT_TOKEN_HMAC_KEY: at least 32 chars
 # WEBSITE_ROOT_USERNAME: 4 to 16 chars
 # WEBSITE_ROOT_INITIAL_EMAIL: ANY_VALID_EMAIL
 # WEBSITE_ROOT_INITIAL_PASSWORD: 8 to 24 chars
@@ -38,20 +39,112 @@ SET ( REST_CLIENT_TOKEN_CRYPTO_KEY  "2b:4c:3b:2f:32:5f:77:2c:7b:4f:54:40:33:3c:3
 SET ( REST_CLIENT_TOKEN_CRYPTO_IV   "6f:41:41:30:31:73:56:31:77:35:33:53:5b:71:6a:6a" CACHE STRING "" ) # oAA01sV1w53S[qjj
 SET ( REST_SERVER_TOKEN_CRYPTO_KEY  "32:2b:3b:3c:5c:48:77:57:7b:20:5d:3c:5b:5b:4a" CACHE STRING "" ) # 2+;<\HwW{ ]<[[J
 SET ( REST_SERVER_TOKEN_CRYPTO_IV   "3c:7a:34:5f:2a:44:36:21:5b:48:3d:30:32:42:5d:62" CACHE STRING "" ) # <z4_*D6![H=02B]b
+SET ( REST_CLIENT_TOKEN_HMAC_KEY    "39:4a:4b:7a:6a:69:47:29:51:47:56:5a:78:46:45:21:6a:3f:3d:6b:3b:32:31:67:34:53:62:39:47:72:3b:52" CACHE STRING "" ) # 9JKzjiG)QGVZxFE!j?=k;21g4Sb9Gr;R
 SET ( WEBSITE_ROOT_USERNAME         "72:6f:6f:74" CACHE STRING "" ) # root
 SET ( WEBSITE_ROOT_INITIAL_EMAIL    "6e:6f:2d:72:65:70:6c:79:40:62:61:62:61:65:69:2e:6e:65:74" CACHE STRING "" ) # no-reply@babaei.net
 SET ( WEBSITE_ROOT_INITIAL_PASSWORD "60:21:64:33:46:61:75:6c:74:2d:2f:2e:3f" CACHE STRING "" ) # `!d3Fault-/.?
 SET ( WEBSITE_CRYPTO_KEY            "4d:52:35:37:33:4a:32:39:78:41:37:36:2b:45:77:46" CACHE STRING "" ) # MR573J29xA76+EwF
 SET ( WEBSITE_CRYPTO_IV             "36:39:48:64:41:68:35:32:34:7a:75:55:3d:35:6b:74" CACHE STRING "" ) # 69HdAh524zuU=5kt
 
+# /metrics answers loopback clients only; with REST_METRICS_TOKEN set, other
+# scrapers are let in when they send 'Authorization: Bearer <token>'
+SET ( REST_METRICS_TOKEN "" CACHE STRING "" )
+
 SET ( STOCK_DATA_UPDATE_INTERVAL_SECONDS "120" CACHE STRING "" )
 SET ( STOCK_DATA_SOURCE_URL "http://members.tsetmc.com/tsev2/excel/MarketWatchPlus.aspx?d=0" CACHE STRING "" )
 
+# Closed trading days go to one column archive file per day under
+# STOCK_DATA_ARCHIVE_PATH (relative to the executable) instead of a pair of
+# archive__* tables; ZSTD and LZ4 fall back to GZIP when the library is not
+# found
+SET ( STOCK_DATA_ARCHIVE_PATH "../db/archive/" CACHE STRING "" )
+SET ( STOCK_DATA_ARCHIVE_COMPRESSION "ZSTD" CACHE STRING "" )
+SET_PROPERTY( CACHE STOCK_DATA_ARCHIVE_COMPRESSION PROPERTY STRINGS "NONE" "GZIP" "BZIP2" "ZSTD" "LZ4" )
+
+# Every published update is also written to an immutable, memory-mapped
+# snapshot under STOCK_DATA_SNAPSHOT_PATH (relative to the executable) that
+# REST servers answer LatestData from; only the newest
+# STOCK_DATA_SNAPSHOT_KEEP files are kept
+SET ( STOCK_DATA_SNAPSHOT_PATH "../db/snapshot/" CACHE STRING "" )
+SET ( STOCK_DATA_SNAPSHOT_KEEP "3" CACHE STRING "" )
+
+# LOG_* calls below LOG_MIN_LEVEL are compiled out, arguments included
+SET ( LOG_MIN_LEVEL "TRACE" CACHE STRING "" )
+SET_PROPERTY( CACHE LOG_MIN_LEVEL PROPERTY STRINGS "TRACE" "DEBUG" "INFO" "WARNING" "ERROR" "FATAL" )
+
+# The servers start filtering at LOG_LEVEL at run time and SIGUSR1 switches
+# a running server between it and TRACE; nothing below LOG_MIN_LEVEL shows
+SET ( LOG_LEVEL "TRACE" CACHE STRING "" )
+SET_PROPERTY( CACHE LOG_LEVEL PROPERTY STRINGS "TRACE" "DEBUG" "INFO" "WARNING" "ERROR" "FATAL" )
+
+# JSON writes one object per line: time, level, file, function, line,
+# message, args and the LOG_FIELD key / values
+SET ( LOG_FORMAT "TEXT" CACHE STRING "" )
+SET_PROPERTY( CACHE LOG_FORMAT PROPERTY STRINGS "TEXT" "JSON" )
+
+# With DROP, records that do not fit in the log buffer are counted and
+# skipped instead of stalling the logging thread
+SET ( LOG_BUFFER_CAPACITY "8192" CACHE STRING "" )
+SET ( LOG_OVERFLOW_POLICY "BLOCK" CACHE STRING "" )
+SET_PROPERTY( CACHE LOG_OVERFLOW_POLICY PROPERTY STRINGS "BLOCK" "DROP" )
+
+# Set LOG_ROTATION_MAX_FILE_SIZE_BYTES or LOG_ROTATION_RETENTION_COUNT to 0
+# to disable the respective limit; ZSTD and LZ4 fall back to GZIP when the
+# library is not found
+SET ( LOG_ROTATION_MAX_FILE_SIZE_BYTES "67108864" CACHE STRING "" )
+SET ( LOG_ROTATION_DAILY "ON" CACHE BOOL "" )
+SET ( LOG_ROTATION_COMPRESSION "GZIP" CACHE STRING "" )
+SET_PROPERTY( CACHE LOG_ROTATION_COMPRESSION PROPERTY STRINGS "NONE" "GZIP" "BZIP2" "ZSTD" "LZ4" )
+SET ( LOG_ROTATION_RETENTION_COUNT "30" CACHE STRING "" )
+
+# With TRACE_SPANS on, spans are recorded from start-up and SIGUSR2 dumps
+# them next to the logs as Chrome trace_event JSON; TRACE_BUFFER_CAPACITY
+# bounds the events each thread keeps between two dumps
+SET ( TRACE_SPANS "OFF" CACHE BOOL "" )
+SET ( TRACE_BUFFER_CAPACITY "65536" CACHE STRING "" )
+
+# The options above, as compile definitions for CoreLib's
+# Log::InitializeFromDefinitions() and Trace::EnableFromDefinitions()
+SET ( CORELIB_LOG_DEFINES "CORELIB_LOG_LEVEL=CORELIB_LOG_LEVEL_${LOG_LEVEL}" )
+IF ( "${LOG_FORMAT}" STREQUAL "JSON" )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_FORMAT_JSON_LINES" )
+ENDIF (  )
+LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_BUFFER_CAPACITY=${LOG_BUFFER_CAPACITY}" )
+IF ( "${LOG_OVERFLOW_POLICY}" STREQUAL "DROP" )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_OVERFLOW_POLICY_DROP" )
+ENDIF (  )
+LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_MAX_FILE_SIZE_BYTES=${LOG_ROTATION_MAX_FILE_SIZE_BYTES}" )
+IF ( NOT LOG_ROTATION_DAILY )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_NOT_DAILY" )
+ENDIF (  )
+IF ( "${LOG_ROTATION_COMPRESSION}" STREQUAL "NONE" )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_COMPRESSION_NONE" )
+ELSEIF ( "${LOG_ROTATION_COMPRESSION}" STREQUAL "BZIP2" )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_COMPRESSION_BZIP2" )
+ELSEIF ( "${LOG_ROTATION_COMPRESSION}" STREQUAL "ZSTD" AND DEFINED ZSTD_FOUND )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_COMPRESSION_ZSTD" )
+ELSEIF ( "${LOG_ROTATION_COMPRESSION}" STREQUAL "LZ4" AND DEFINED LZ4_FOUND )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_COMPRESSION_LZ4" )
+ENDIF (  )
+LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_LOG_ROTATION_RETENTION_COUNT=${LOG_ROTATION_RETENTION_COUNT}" )
+IF ( TRACE_SPANS )
+    LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_TRACE_SPANS_ENABLED" )
+ENDIF (  )
+LIST ( APPEND CORELIB_LOG_DEFINES "CORELIB_TRACE_BUFFER_CAPACITY=${TRACE_BUFFER_CAPACITY}" )
+
 SET ( DATABASE_BACKEND "PGSQL" CACHE STRING "" )
 SET_PROPERTY( CACHE DATABASE_BACKEND PROPERTY STRINGS "SQLITE3" "PGSQL" "MYSQL" )
 
 SET ( SQLITE3_DATABASE_FILE_PATH "../db/" CACHE STRING "" )
 SET ( SQLITE3_DATABASE_FILE_NAME "tse-rtsq.db" CACHE STRING "" )
+SET ( SQLITE3_JOURNAL_MODE "WAL" CACHE STRING "" )
+SET ( SQLITE3_SYNCHRONOUS "NORMAL" CACHE STRING "" )
+SET ( SQLITE3_CACHE_SIZE_KIB "16384" CACHE STRING "" )
+SET ( SQLITE3_MMAP_SIZE_BYTES "268435456" CACHE STRING "" )
+SET ( SQLITE3_BUSY_TIMEOUT_MILLISECONDS "5000" CACHE STRING "" )
+# Set SQLITE3_INCREMENTAL_VACUUM_PAGES to 0 to keep auto_vacuum off
+SET ( SQLITE3_INCREMENTAL_VACUUM_PAGES "1024" CACHE STRING "" )
+SET ( SQLITE3_INCREMENTAL_VACUUM_INTERVAL_SECONDS "600" CACHE STRING "" )
 
 SET ( PGSQL_HOST "localhost" CACHE STRING "" )
 SET ( PGSQL_PORT "5432" CACHE STRING "" )
@@ -66,8 +159,30 @@ SET ( MYSQL_DATABASE "tse_rtsq_db" CACHE STRING "" )
 SET ( MYSQL_USER "tse_rtsq_user" CACHE STRING "" )
 SET ( MYSQL_PASSWORD "BE_SURE_TO_USE_A_STRONG_SECRET_PASSPHRASE_HERE" CACHE STRING "" )
 
+# Keep DATABASE_POOL_MAX_SIZE at or above the number of Wt worker threads
+# configured in wt_config.xml, otherwise requests queue up for a session
+SET ( DATABASE_POOL_MAX_SIZE "16" CACHE STRING "" )
+SET ( DATABASE_POOL_CHECKOUT_TIMEOUT_MILLISECONDS "10000" CACHE STRING "" )
+SET ( DATABASE_POOL_HEALTH_CHECK_IDLE_SECONDS "60" CACHE STRING "" )
+
+SET ( DATABASE_WRITE_QUEUE_MAX_SIZE "4096" CACHE STRING "" )
+SET ( DATABASE_WRITE_BATCH_MAX_SIZE "256" CACHE STRING "" )
+SET ( DATABASE_WRITE_BATCH_DELAY_MILLISECONDS "5" CACHE STRING "" )
+
 SET ( LIBB64_BUFFERSIZE "16777216" CACHE STRING "" )
 
+# Upper bound on threads delivering CoreLib::Mail::SendAsync() mails; they
+# are started on demand and exit after ten idle seconds
+SET ( MAIL_SENDER_THREADS "2" CACHE STRING "" )
+
+# Every sender thread keeps one SMTP session open while it has mail to
+# deliver; point MAIL_SMTP_URL at a local stand-in (e.g. smtp://localhost:1025)
+# to try it out. Authentication is only used when a username is set; the
+# password is read from the MAIL_SMTP_PASSWORD environment variable at run
+# time, so it never ends up in the binary.
+SET ( MAIL_SMTP_URL "smtp://localhost" CACHE STRING "" )
+SET ( MAIL_SMTP_USERNAME "" CACHE STRING "" )
+
 SET ( GEO_LITE_COUNTRY_DB_URL "http://geolite.maxmind.com/download/geoip/database/GeoLiteCountry/GeoIP.dat.gz" CACHE STRING "" )
 SET ( GEO_LITE_CITY_DB_URL "http://geolite.maxmind.com/download/geoip/database/GeoLiteCity.dat.gz" CACHE STRING "" )
 
@@ -54,6 +54,7 @@ SET ( LIBB64_FIND_REQUIRED TRUE )
 SET ( LIBCURL_FIND_REQUIRED TRUE )
 SET ( LIBSTATGRAB_FIND_REQUIRED TRUE )
 SET ( LIBZIP_FIND_REQUIRED TRUE )
+SET ( LZ4_FIND_REQUIRED FALSE )
 SET ( MAGICKPP_FIND_REQUIRED TRUE )
 SET ( MYSQL_FIND_REQUIRED FALSE )
 SET ( NPM_FIND_REQUIRED TRUE )
@@ -62,6 +63,8 @@ SET ( SQLITE3_FIND_REQUIRED TRUE )
 SET ( Threads_FIND_REQUIRED TRUE )
 SET ( VMIME_FIND_REQUIRED TRUE )
 SET ( WT_FIND_REQUIRED TRUE )
+SET ( ZLIB_FIND_REQUIRED TRUE )
+SET ( ZSTD_FIND_REQUIRED FALSE )
 IF ( "${WT_APPLICATION_TYPE}" STREQUAL "FASTCGI" )
     SET ( WT_FCGI_FIND_REQUIRED TRUE )
     SET ( WT_HTTPD_FIND_REQUIRED FALSE )
@@ -145,6 +148,13 @@ FIND_PACKAGE ( libzip )
 INCLUDE_DIRECTORIES ( SYSTEM ${LIBZIP_INCLUDE_DIR} )
 
 
+### lz4 ###
+FIND_PACKAGE ( lz4 )
+IF ( LZ4_FOUND )
+    INCLUDE_DIRECTORIES ( SYSTEM ${LZ4_INCLUDE_DIR} )
+ENDIF (  )
+
+
 ### Magick ###
 FIND_PACKAGE ( Magick )
 INCLUDE_DIRECTORIES ( SYSTEM ${MAGICKPP_INCLUDE_DIR} )
@@ -191,6 +201,23 @@ FIND_PACKAGE ( Wt )
 INCLUDE_DIRECTORIES ( SYSTEM ${WT_INCLUDE_DIR} )
 
 
+### zlib ###
+FIND_PACKAGE ( ZLIB )
+IF ( NOT ZLIB_FOUND )
+    IF ( ZLIB_FIND_REQUIRED )
+        MESSAGE ( FATAL_ERROR "Could not find zlib" )
+    ENDIF (  )
+ENDIF (  )
+INCLUDE_DIRECTORIES ( SYSTEM ${ZLIB_INCLUDE_DIRS} )
+
+
+### zstd ###
+FIND_PACKAGE ( zstd )
+IF ( ZSTD_FOUND )
+    INCLUDE_DIRECTORIES ( SYSTEM ${ZSTD_INCLUDE_DIR} )
+ENDIF (  )
+
+
 ### SQL Drivers Check ###
 IF ( NOT DEFINED MYSQL_FOUND
         AND NOT DEFINED PGSQL_FOUND